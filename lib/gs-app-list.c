@@ -30,14 +30,58 @@ struct _GsAppList
 {
 	GObject			 parent_instance;
 	GPtrArray		*array;
+	GHashTable		*entries;	/* (owned) (element-type GsApp GsAppListEntry) */
+	GHashTable		*index;		/* (owned) (element-type utf8 GPtrArray<GsApp>) */
+	GPtrArray		*unindexed;	/* (owned) (element-type GsApp) */
 	GMutex			 mutex;
 	guint			 size_peak;
 	GsAppListFlags		 flags;
 	GsAppState		 state;
 	guint			 progress;  /* 0–100 inclusive, or %GS_APP_PROGRESS_UNKNOWN */
 	guint			 custom_progress; /* overrides the 'progress', if not %GS_APP_PROGRESS_UNKNOWN */
+
+	/* running totals over the watched apps, so the state and progress
+	 * can be updated in O(1) when one of them changes */
+	GHashTable		*watches;	/* (owned) (element-type GsApp GsAppListWatches) */
+	GHashTable		*watched;	/* (owned) (element-type GsApp GsAppListWatched) */
+	guint			 n_watched;
+	guint			 n_progress_unknown;
+	guint64			 progress_sum;	/* of the watched apps with known progress */
+	guint			 n_installing;
+	guint			 n_removing;
 };
 
+/* The apps watched because of an app in the list, as they were when it was
+ * added, so exactly the same apps are unwatched when it is removed even if its
+ * addons or related apps have changed since. */
+typedef struct {
+	guint			 count;
+	GPtrArray		*apps;	/* (owned) (element-type GsApp) */
+} GsAppListWatches;
+
+/* Every watched app has one of these, holding the progress and state it
+ * currently contributes to the totals, @count times. */
+typedef struct {
+	guint			 count;
+	guint			 progress;
+	GsAppState		 state;
+} GsAppListWatched;
+
+/* Every app in the list has an entry, which counts how many times it is in
+ * the list and remembers the component ID it was indexed under.
+ *
+ * Apps are indexed by the component ID part of their unique ID, as that is the
+ * only part which can’t be a wildcard. Each bucket in the index holds the apps
+ * in the same order as the list, so the first match in a bucket is the first
+ * match in the list. Apps whose unique ID has no usable component ID (yet) are
+ * kept in the unindexed array, which every lookup has to check.
+ *
+ * The component ID of an app is not expected to change once it is in a list. */
+typedef struct {
+	guint			 count;
+	gchar			*cid;	/* (owned) (nullable) */
+} GsAppListEntry;
+
 G_DEFINE_TYPE (GsAppList, gs_app_list, G_TYPE_OBJECT)
 
 enum {
@@ -135,135 +179,211 @@ static void
 gs_app_list_add_watched_for_app (GsAppList *list, GPtrArray *apps, GsApp *app)
 {
 	if (list->flags & GS_APP_LIST_FLAG_WATCH_APPS)
-		g_ptr_array_add (apps, app);
+		g_ptr_array_add (apps, g_object_ref (app));
 	if (list->flags & GS_APP_LIST_FLAG_WATCH_APPS_ADDONS) {
 		g_autoptr(GsAppList) list2 = gs_app_dup_addons (app);
 
 		for (guint i = 0; list2 != NULL && i < gs_app_list_length (list2); i++) {
 			GsApp *app2 = gs_app_list_index (list2, i);
-			g_ptr_array_add (apps, app2);
+			g_ptr_array_add (apps, g_object_ref (app2));
 		}
 	}
 	if (list->flags & GS_APP_LIST_FLAG_WATCH_APPS_RELATED) {
 		GsAppList *list2 = gs_app_get_related (app);
 		for (guint i = 0; i < gs_app_list_length (list2); i++) {
 			GsApp *app2 = gs_app_list_index (list2, i);
-			g_ptr_array_add (apps, app2);
+			g_ptr_array_add (apps, g_object_ref (app2));
 		}
 	}
 }
 
-static GPtrArray *
-gs_app_list_get_watched_for_app (GsAppList *list, GsApp *app)
+static void
+gs_app_list_watches_free (GsAppListWatches *watches)
 {
-	GPtrArray *apps = g_ptr_array_new ();
-	gs_app_list_add_watched_for_app (list, apps, app);
-	return apps;
+	g_ptr_array_unref (watches->apps);
+	g_free (watches);
 }
 
-static GPtrArray *
-gs_app_list_get_watched (GsAppList *list)
+/* Adds @n times (or removes, if @n is negative) the contribution of @watched
+ * to the totals */
+static void
+gs_app_list_account_watched (GsAppList *self, const GsAppListWatched *watched, gint n)
 {
-	GPtrArray *apps = g_ptr_array_new ();
-	for (guint i = 0; i < list->array->len; i++) {
-		GsApp *app_tmp = g_ptr_array_index (list->array, i);
-		gs_app_list_add_watched_for_app (list, apps, app_tmp);
-	}
-	return apps;
+	self->n_watched += n;
+	if (watched->progress == GS_APP_PROGRESS_UNKNOWN)
+		self->n_progress_unknown += n;
+	else
+		self->progress_sum += (gint64) n * watched->progress;
+	if (watched->state == GS_APP_STATE_INSTALLING)
+		self->n_installing += n;
+	else if (watched->state == GS_APP_STATE_REMOVING)
+		self->n_removing += n;
 }
 
-static void
-gs_app_list_invalidate_progress (GsAppList *self)
+/* Returns %TRUE if the progress changed */
+static gboolean
+gs_app_list_update_progress (GsAppList *self)
 {
-	guint progress = 0;
-	g_autoptr(GPtrArray) apps = gs_app_list_get_watched (self);
+	guint progress;
 
 	/* find the average percentage complete of the list */
-	if (apps->len > 0) {
-		guint64 pc_cnt = 0;
-		gboolean unknown_seen = FALSE;
+	if (self->n_watched > 0 && self->n_progress_unknown == 0)
+		progress = self->progress_sum / self->n_watched;
+	else
+		progress = GS_APP_PROGRESS_UNKNOWN;
 
-		for (guint i = 0; i < apps->len; i++) {
-			GsApp *app_tmp = g_ptr_array_index (apps, i);
-			guint app_progress = gs_app_get_progress (app_tmp);
+	if (self->progress == progress)
+		return FALSE;
+	self->progress = progress;
+	return TRUE;
+}
 
-			if (app_progress == GS_APP_PROGRESS_UNKNOWN) {
-				unknown_seen = TRUE;
-				break;
-			}
-			pc_cnt += gs_app_get_progress (app_tmp);
-		}
+/* Returns %TRUE if the state changed */
+static gboolean
+gs_app_list_update_state (GsAppList *self)
+{
+	GsAppState state = GS_APP_STATE_UNKNOWN;
 
-		progress = (!unknown_seen) ? pc_cnt / apps->len : GS_APP_PROGRESS_UNKNOWN;
-	} else {
-		progress = GS_APP_PROGRESS_UNKNOWN;
-	}
+	/* find any action state of the list */
+	if (self->n_installing > 0)
+		state = GS_APP_STATE_INSTALLING;
+	else if (self->n_removing > 0)
+		state = GS_APP_STATE_REMOVING;
+
+	if (self->state == state)
+		return FALSE;
+	self->state = state;
+	return TRUE;
+}
 
-	if (self->progress != progress) {
-		self->progress = progress;
+static void
+gs_app_list_invalidate_progress (GsAppList *self)
+{
+	if (gs_app_list_update_progress (self))
 		g_object_notify (G_OBJECT (self), "progress");
-	}
 }
 
 static void
 gs_app_list_invalidate_state (GsAppList *self)
 {
-	GsAppState state = GS_APP_STATE_UNKNOWN;
-	g_autoptr(GPtrArray) apps = gs_app_list_get_watched (self);
-
-	/* find any action state of the list */
-	for (guint i = 0; i < apps->len; i++) {
-		GsApp *app_tmp = g_ptr_array_index (apps, i);
-		GsAppState state_tmp = gs_app_get_state (app_tmp);
-		if (state_tmp == GS_APP_STATE_INSTALLING ||
-		    state_tmp == GS_APP_STATE_REMOVING) {
-			state = state_tmp;
-			break;
-		}
-	}
-	if (self->state != state) {
-		self->state = state;
+	if (gs_app_list_update_state (self))
 		g_object_notify (G_OBJECT (self), "state");
-	}
 }
 
 static void
 gs_app_list_progress_notify_cb (GsApp *app, GParamSpec *pspec, GsAppList *self)
 {
-	gs_app_list_invalidate_progress (self);
+	GsAppListWatched *watched;
+	gboolean changed = FALSE;
+
+	g_mutex_lock (&self->mutex);
+	watched = g_hash_table_lookup (self->watched, app);
+	if (watched != NULL) {
+		gs_app_list_account_watched (self, watched, -(gint) watched->count);
+		watched->progress = gs_app_get_progress (app);
+		gs_app_list_account_watched (self, watched, watched->count);
+		changed = gs_app_list_update_progress (self);
+	}
+	g_mutex_unlock (&self->mutex);
+
+	if (changed)
+		g_object_notify (G_OBJECT (self), "progress");
 }
 
 static void
 gs_app_list_state_notify_cb (GsApp *app, GParamSpec *pspec, GsAppList *self)
 {
-	gs_app_list_invalidate_state (self);
+	GsAppListWatched *watched;
+	gboolean changed = FALSE;
+
+	g_mutex_lock (&self->mutex);
+	watched = g_hash_table_lookup (self->watched, app);
+	if (watched != NULL) {
+		gs_app_list_account_watched (self, watched, -(gint) watched->count);
+		watched->state = gs_app_get_state (app);
+		gs_app_list_account_watched (self, watched, watched->count);
+		changed = gs_app_list_update_state (self);
+	}
+	g_mutex_unlock (&self->mutex);
+
+	if (changed)
+		g_object_notify (G_OBJECT (self), "state");
 
 	g_signal_emit (self, signals[SIGNAL_APP_STATE_CHANGED], 0, app);
 }
 
 static void
-gs_app_list_maybe_watch_app (GsAppList *list, GsApp *app)
+gs_app_list_watch_app (GsAppList *list, GsApp *app)
 {
-	g_autoptr(GPtrArray) apps = gs_app_list_get_watched_for_app (list, app);
-	for (guint i = 0; i < apps->len; i++) {
-		GsApp *app_tmp = g_ptr_array_index (apps, i);
-		g_signal_connect_object (app_tmp, "notify::progress",
+	GsAppListWatched *watched = g_hash_table_lookup (list->watched, app);
+
+	if (watched == NULL) {
+		watched = g_new0 (GsAppListWatched, 1);
+		watched->progress = gs_app_get_progress (app);
+		watched->state = gs_app_get_state (app);
+		g_hash_table_insert (list->watched, g_object_ref (app), watched);
+		g_signal_connect_object (app, "notify::progress",
 					 G_CALLBACK (gs_app_list_progress_notify_cb),
 					 list, 0);
-		g_signal_connect_object (app_tmp, "notify::state",
+		g_signal_connect_object (app, "notify::state",
 					 G_CALLBACK (gs_app_list_state_notify_cb),
 					 list, 0);
 	}
+	watched->count++;
+	gs_app_list_account_watched (list, watched, 1);
 }
 
 static void
-gs_app_list_maybe_unwatch_app (GsAppList *list, GsApp *app)
+gs_app_list_unwatch_app (GsAppList *list, GsApp *app)
 {
-	g_autoptr(GPtrArray) apps = gs_app_list_get_watched_for_app (list, app);
-	for (guint i = 0; i < apps->len; i++) {
-		GsApp *app_tmp = g_ptr_array_index (apps, i);
-		g_signal_handlers_disconnect_by_data (app_tmp, list);
+	GsAppListWatched *watched = g_hash_table_lookup (list->watched, app);
+
+	if (watched == NULL)
+		return;
+	gs_app_list_account_watched (list, watched, -1);
+	if (--watched->count == 0) {
+		g_signal_handlers_disconnect_by_data (app, list);
+		g_hash_table_remove (list->watched, app);
+	}
+}
+
+static void
+gs_app_list_maybe_watch_app (GsAppList *list, GsApp *app)
+{
+	GsAppListWatches *watches;
+
+	/* nothing to do, and avoids making every add slower */
+	if ((list->flags & (GS_APP_LIST_FLAG_WATCH_APPS |
+			    GS_APP_LIST_FLAG_WATCH_APPS_ADDONS |
+			    GS_APP_LIST_FLAG_WATCH_APPS_RELATED)) == 0)
+		return;
+
+	watches = g_hash_table_lookup (list->watches, app);
+	if (watches == NULL) {
+		watches = g_new0 (GsAppListWatches, 1);
+		watches->apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+		gs_app_list_add_watched_for_app (list, watches->apps, app);
+		g_hash_table_insert (list->watches, g_object_ref (app), watches);
 	}
+	watches->count++;
+
+	for (guint i = 0; i < watches->apps->len; i++)
+		gs_app_list_watch_app (list, g_ptr_array_index (watches->apps, i));
+}
+
+static void
+gs_app_list_maybe_unwatch_app (GsAppList *list, GsApp *app)
+{
+	GsAppListWatches *watches = g_hash_table_lookup (list->watches, app);
+
+	if (watches == NULL)
+		return;
+
+	for (guint i = 0; i < watches->apps->len; i++)
+		gs_app_list_unwatch_app (list, g_ptr_array_index (watches->apps, i));
+
+	if (--watches->count == 0)
+		g_hash_table_remove (list->watches, app);
 }
 
 /**
@@ -299,11 +419,126 @@ gs_app_list_set_size_peak (GsAppList *list,
 	list->size_peak = size_peak;
 }
 
+static void
+gs_app_list_entry_free (GsAppListEntry *entry)
+{
+	g_free (entry->cid);
+	g_free (entry);
+}
+
+/* Returns the component ID part of @unique_id, or %NULL if it is a wildcard
+ * or @unique_id does not have the usual five parts */
+static gchar *
+gs_app_list_unique_id_get_cid (const gchar *unique_id)
+{
+	const gchar *start = NULL;
+	const gchar *end = NULL;
+	guint n_separators = 0;
+
+	if (unique_id == NULL)
+		return NULL;
+	for (const gchar *p = unique_id; *p != '\0'; p++) {
+		if (*p != '/')
+			continue;
+		n_separators++;
+		if (n_separators == 3)
+			start = p + 1;
+		else if (n_separators == 4)
+			end = p;
+	}
+	if (n_separators != 4)
+		return NULL;
+	if (end - start == 1 && *start == '*')
+		return NULL;
+	return g_strndup (start, (gsize) (end - start));
+}
+
+static void
+gs_app_list_index_add (GsAppList *list, GsApp *app)
+{
+	GsAppListEntry *entry = g_hash_table_lookup (list->entries, app);
+	GPtrArray *bucket;
+
+	if (entry == NULL) {
+		entry = g_new0 (GsAppListEntry, 1);
+		entry->cid = gs_app_list_unique_id_get_cid (gs_app_get_unique_id (app));
+		g_hash_table_insert (list->entries, app, entry);
+	}
+	entry->count++;
+
+	if (entry->cid == NULL) {
+		g_ptr_array_add (list->unindexed, app);
+		return;
+	}
+	bucket = g_hash_table_lookup (list->index, entry->cid);
+	if (bucket == NULL) {
+		bucket = g_ptr_array_new ();
+		g_hash_table_insert (list->index, g_strdup (entry->cid), bucket);
+	}
+	g_ptr_array_add (bucket, app);
+}
+
+static void
+gs_app_list_index_remove (GsAppList *list, GsApp *app)
+{
+	GsAppListEntry *entry = g_hash_table_lookup (list->entries, app);
+
+	if (entry == NULL)
+		return;
+	if (entry->cid == NULL) {
+		g_ptr_array_remove (list->unindexed, app);
+	} else {
+		GPtrArray *bucket = g_hash_table_lookup (list->index, entry->cid);
+		g_ptr_array_remove (bucket, app);
+		if (bucket->len == 0)
+			g_hash_table_remove (list->index, entry->cid);
+	}
+	if (--entry->count == 0)
+		g_hash_table_remove (list->entries, app);
+}
+
+static void
+gs_app_list_index_remove_all (GsAppList *list)
+{
+	g_hash_table_remove_all (list->entries);
+	g_hash_table_remove_all (list->index);
+	g_ptr_array_set_size (list->unindexed, 0);
+}
+
+/* needed after anything that reorders or drops apps in bulk, as each bucket
+ * has to stay in list order */
+static void
+gs_app_list_index_rebuild (GsAppList *list)
+{
+	gs_app_list_index_remove_all (list);
+	for (guint i = 0; i < list->array->len; i++)
+		gs_app_list_index_add (list, g_ptr_array_index (list->array, i));
+}
+
 static GsApp *
 gs_app_list_lookup_safe (GsAppList *list, const gchar *unique_id)
 {
-	for (guint i = 0; i < list->array->len; i++) {
-		GsApp *app = g_ptr_array_index (list->array, i);
+	g_autofree gchar *cid = gs_app_list_unique_id_get_cid (unique_id);
+	GPtrArray *bucket;
+
+	/* a wildcard component ID can match anything */
+	if (cid == NULL) {
+		for (guint i = 0; i < list->array->len; i++) {
+			GsApp *app = g_ptr_array_index (list->array, i);
+			if (as_utils_data_id_equal (gs_app_get_unique_id (app), unique_id))
+				return app;
+		}
+		return NULL;
+	}
+
+	bucket = g_hash_table_lookup (list->index, cid);
+	for (guint i = 0; bucket != NULL && i < bucket->len; i++) {
+		GsApp *app = g_ptr_array_index (bucket, i);
+		if (as_utils_data_id_equal (gs_app_get_unique_id (app), unique_id))
+			return app;
+	}
+	for (guint i = 0; i < list->unindexed->len; i++) {
+		GsApp *app = g_ptr_array_index (list->unindexed, i);
 		if (as_utils_data_id_equal (gs_app_get_unique_id (app), unique_id))
 			return app;
 	}
@@ -362,15 +597,33 @@ gs_app_list_add_flag (GsAppList *list, GsAppListFlags flag)
 {
 	if (list->flags & flag)
 		return;
-	list->flags |= flag;
 
-	/* turn this on for existing apps */
+	/* watch the existing apps again, with the new set of flags */
+	for (guint i = 0; i < list->array->len; i++) {
+		GsApp *app = g_ptr_array_index (list->array, i);
+		gs_app_list_maybe_unwatch_app (list, app);
+	}
+	list->flags |= flag;
 	for (guint i = 0; i < list->array->len; i++) {
 		GsApp *app = g_ptr_array_index (list->array, i);
 		gs_app_list_maybe_watch_app (list, app);
 	}
 }
 
+static gboolean
+gs_app_list_has_same_wildcard (GPtrArray *apps, GsApp *app)
+{
+	for (guint i = 0; apps != NULL && i < apps->len; i++) {
+		GsApp *app_tmp = g_ptr_array_index (apps, i);
+		if (!gs_app_has_quirk (app_tmp, GS_APP_QUIRK_IS_WILDCARD))
+			continue;
+		if (g_strcmp0 (gs_app_get_unique_id (app_tmp),
+			       gs_app_get_unique_id (app)) == 0)
+			return TRUE;
+	}
+	return FALSE;
+}
+
 static gboolean
 gs_app_list_check_for_duplicate (GsAppList *list, GsApp *app)
 {
@@ -379,24 +632,21 @@ gs_app_list_check_for_duplicate (GsAppList *list, GsApp *app)
 
 	/* adding a wildcard */
 	if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD)) {
-		for (guint i = 0; i < list->array->len; i++) {
-			GsApp *app_tmp = g_ptr_array_index (list->array, i);
-			if (!gs_app_has_quirk (app_tmp, GS_APP_QUIRK_IS_WILDCARD))
-				continue;
-			/* not adding exactly the same wildcard */
-			if (g_strcmp0 (gs_app_get_unique_id (app_tmp),
-				       gs_app_get_unique_id (app)) == 0)
-				return FALSE;
-		}
-		return TRUE;
-	}
+		g_autofree gchar *cid = gs_app_list_unique_id_get_cid (gs_app_get_unique_id (app));
 
-	for (guint i = 0; i < list->array->len; i++) {
-		GsApp *app_tmp = g_ptr_array_index (list->array, i);
-		if (app_tmp == app)
+		/* not adding exactly the same wildcard, which can only be in
+		 * the same bucket */
+		if (cid != NULL &&
+		    gs_app_list_has_same_wildcard (g_hash_table_lookup (list->index, cid), app))
 			return FALSE;
+		if (gs_app_list_has_same_wildcard (list->unindexed, app))
+			return FALSE;
+		return TRUE;
 	}
 
+	if (g_hash_table_contains (list->entries, app))
+		return FALSE;
+
 	/* does not exist */
 	id = gs_app_get_unique_id (app);
 	if (id == NULL) {
@@ -432,6 +682,7 @@ gs_app_list_add_safe (GsAppList *list, GsApp *app, GsAppListAddFlag flag)
 	/* just use the ref */
 	gs_app_list_maybe_watch_app (list, app);
 	g_ptr_array_add (list->array, g_object_ref (app));
+	gs_app_list_index_add (list, app);
 
 	/* update the historical max */
 	if (list->array->len > list->size_peak)
@@ -488,6 +739,7 @@ gs_app_list_remove (GsAppList *list, GsApp *app)
 	g_return_val_if_fail (GS_IS_APP (app), FALSE);
 
 	locker = g_mutex_locker_new (&list->mutex);
+	gs_app_list_index_remove (list, app);
 	removed = g_ptr_array_remove (list->array, app);
 	if (removed) {
 		gs_app_list_maybe_unwatch_app (list, app);
@@ -574,6 +826,7 @@ gs_app_list_remove_all_safe (GsAppList *list)
 		gs_app_list_maybe_unwatch_app (list, app);
 	}
 	g_ptr_array_set_size (list->array, 0);
+	gs_app_list_index_remove_all (list);
 	gs_app_list_invalidate_state (list);
 	gs_app_list_invalidate_progress (list);
 }
@@ -628,6 +881,9 @@ gs_app_list_filter (GsAppList *list, GsAppListFilterFunc func, gpointer user_dat
 		if (func (app, user_data))
 			gs_app_list_add_safe (list, app, GS_APP_LIST_ADD_FLAG_NONE);
 	}
+
+	gs_app_list_invalidate_state (list);
+	gs_app_list_invalidate_progress (list);
 }
 
 typedef struct {
@@ -664,6 +920,7 @@ gs_app_list_sort (GsAppList *list, GsAppListSortFunc func, gpointer user_data)
 	helper.func = func;
 	helper.user_data = user_data;
 	g_ptr_array_sort_with_data (list->array, gs_app_list_sort_cb, &helper);
+	gs_app_list_index_rebuild (list);
 }
 
 /**
@@ -695,7 +952,12 @@ gs_app_list_truncate (GsAppList *list, guint length)
 
 	/* remove the apps in the positions larger than the length */
 	locker = g_mutex_locker_new (&list->mutex);
+	for (guint i = length; i < list->array->len; i++)
+		gs_app_list_maybe_unwatch_app (list, g_ptr_array_index (list->array, i));
 	g_ptr_array_set_size (list->array, length);
+	gs_app_list_index_rebuild (list);
+	gs_app_list_invalidate_state (list);
+	gs_app_list_invalidate_progress (list);
 }
 
 /**
@@ -735,6 +997,7 @@ gs_app_list_randomize (GsAppList *list)
 		list->array->pdata[i] = list->array->pdata[j];
 		list->array->pdata[j] = tmp;
 	}
+	gs_app_list_index_rebuild (list);
 
 	g_rand_free (rand);
 }
@@ -885,6 +1148,9 @@ gs_app_list_filter_duplicates (GsAppList *list, GsAppListFilterFlags flags)
 			g_hash_table_remove (kept_apps, app);
 		}
 	}
+
+	gs_app_list_invalidate_state (list);
+	gs_app_list_invalidate_progress (list);
 }
 
 /**
@@ -944,7 +1210,18 @@ static void
 gs_app_list_finalize (GObject *object)
 {
 	GsAppList *list = GS_APP_LIST (object);
+	GHashTableIter iter;
+	gpointer app;
+
+	g_hash_table_iter_init (&iter, list->watched);
+	while (g_hash_table_iter_next (&iter, &app, NULL))
+		g_signal_handlers_disconnect_by_data (app, list);
+	g_hash_table_unref (list->watched);
+	g_hash_table_unref (list->watches);
 	g_ptr_array_unref (list->array);
+	g_hash_table_unref (list->entries);
+	g_hash_table_unref (list->index);
+	g_ptr_array_unref (list->unindexed);
 	g_mutex_clear (&list->mutex);
 	G_OBJECT_CLASS (gs_app_list_parent_class)->finalize (object);
 }
@@ -1000,6 +1277,15 @@ gs_app_list_init (GsAppList *list)
 {
 	g_mutex_init (&list->mutex);
 	list->array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	list->entries = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					       NULL, (GDestroyNotify) gs_app_list_entry_free);
+	list->index = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     g_free, (GDestroyNotify) g_ptr_array_unref);
+	list->unindexed = g_ptr_array_new ();
+	list->watches = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					       g_object_unref, (GDestroyNotify) gs_app_list_watches_free);
+	list->watched = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					       g_object_unref, g_free);
 	list->custom_progress = GS_APP_PROGRESS_UNKNOWN;
 }
 
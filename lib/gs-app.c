@@ -58,15 +58,15 @@ typedef struct
 	gchar			*id;
 	gchar			*unique_id;
 	gboolean		 unique_id_valid;
-	gchar			*branch;
+	gchar			*branch;  /* (owned) (nullable) (interned) */
 	gchar			*name;
 	gchar			*renamed_from;
 	GsAppQuality		 name_quality;
 	GPtrArray		*icons;  /* (nullable) (owned) (element-type AsIcon), sorted by pixel size, smallest first */
 	GPtrArray		*sources;
 	GPtrArray		*source_ids;
-	gchar			*project_group;
-	gchar			*developer_name;
+	gchar			*project_group;  /* (owned) (nullable) (interned) */
+	gchar			*developer_name;  /* (owned) (nullable) (interned) */
 	gchar			*agreement;
 	gchar			*version;
 	gchar			*version_ui;
@@ -76,19 +76,19 @@ typedef struct
 	gchar			*description;
 	GsAppQuality		 description_quality;
 	GPtrArray		*screenshots;
-	GPtrArray		*categories;
+	GPtrArray		*categories;  /* (owned) (element-type utf8) (interned) */
 	GArray			*key_colors;  /* (nullable) (element-type GdkRGBA) */
 	gboolean		 user_key_colors;
 	GHashTable		*urls;  /* (element-type AsUrlKind utf8) (owned) (nullable) */
 	GHashTable		*launchables;
 	gchar			*url_missing;
-	gchar			*license;
+	gchar			*license;  /* (owned) (nullable) (interned) */
 	GsAppQuality		 license_quality;
 	gchar			**menu_path;
-	gchar			*origin;
-	gchar			*origin_ui;
-	gchar			*origin_appstream;
-	gchar			*origin_hostname;
+	gchar			*origin;  /* (owned) (nullable) (interned) */
+	gchar			*origin_ui;  /* (owned) (nullable) (interned) */
+	gchar			*origin_appstream;  /* (owned) (nullable) (interned) */
+	gchar			*origin_hostname;  /* (owned) (nullable) (interned) */
 	gchar			*update_version;
 	gchar			*update_version_ui;
 	gchar			*update_details_markup;
@@ -198,6 +198,20 @@ _g_set_str (gchar **str_ptr, const gchar *new_str)
 	return TRUE;
 }
 
+/* Like _g_set_str(), but for the fields marked (interned) in #GsAppPrivate.
+ * These have few distinct values across all the apps, so each value is stored
+ * once as a #GRefString and shared; free them with g_ref_string_release(). */
+static gboolean
+_g_set_interned_str (gchar **str_ptr, const gchar *new_str)
+{
+	if (*str_ptr == new_str || g_strcmp0 (*str_ptr, new_str) == 0)
+		return FALSE;
+	g_clear_pointer (str_ptr, g_ref_string_release);
+	if (new_str != NULL)
+		*str_ptr = g_ref_string_new_intern (new_str);
+	return TRUE;
+}
+
 static gboolean
 _g_set_strv (gchar ***strv_ptr, gchar **new_strv)
 {
@@ -1606,7 +1620,7 @@ gs_app_set_branch (GsApp *app, const gchar *branch)
 	g_autoptr(GMutexLocker) locker = NULL;
 	g_return_if_fail (GS_IS_APP (app));
 	locker = g_mutex_locker_new (&priv->mutex);
-	if (_g_set_str (&priv->branch, branch))
+	if (_g_set_interned_str (&priv->branch, branch))
 		priv->unique_id_valid = FALSE;
 }
 
@@ -1858,7 +1872,7 @@ gs_app_set_project_group (GsApp *app, const gchar *project_group)
 	g_autoptr(GMutexLocker) locker = NULL;
 	g_return_if_fail (GS_IS_APP (app));
 	locker = g_mutex_locker_new (&priv->mutex);
-	_g_set_str (&priv->project_group, project_group);
+	_g_set_interned_str (&priv->project_group, project_group);
 }
 
 /**
@@ -1877,7 +1891,7 @@ gs_app_set_developer_name (GsApp *app, const gchar *developer_name)
 	g_autoptr(GMutexLocker) locker = NULL;
 	g_return_if_fail (GS_IS_APP (app));
 	locker = g_mutex_locker_new (&priv->mutex);
-	_g_set_str (&priv->developer_name, developer_name);
+	_g_set_interned_str (&priv->developer_name, developer_name);
 }
 
 static GtkIconTheme *
@@ -2790,7 +2804,7 @@ gs_app_set_license (GsApp *app, GsAppQuality quality, const gchar *license)
 
 	priv->license_is_free = as_license_is_free_license (license);
 
-	if (_g_set_str (&priv->license, license))
+	if (_g_set_interned_str (&priv->license, license))
 		gs_app_queue_notify (app, obj_props[PROP_LICENSE]);
 }
 
@@ -2969,8 +2983,7 @@ gs_app_set_origin (GsApp *app, const gchar *origin)
 		return;
 	}
 
-	g_free (priv->origin);
-	priv->origin = g_strdup (origin);
+	_g_set_interned_str (&priv->origin, origin);
 
 	/* no longer valid */
 	priv->unique_id_valid = FALSE;
@@ -3016,8 +3029,7 @@ gs_app_set_origin_appstream (GsApp *app, const gchar *origin_appstream)
 	if (g_strcmp0 (origin_appstream, priv->origin_appstream) == 0)
 		return;
 
-	g_free (priv->origin_appstream);
-	priv->origin_appstream = g_strdup (origin_appstream);
+	_g_set_interned_str (&priv->origin_appstream, origin_appstream);
 }
 
 /**
@@ -3069,7 +3081,6 @@ gs_app_set_origin_hostname (GsApp *app, const gchar *origin_hostname)
 	/* same */
 	if (g_strcmp0 (origin_hostname, priv->origin_hostname) == 0)
 		return;
-	g_free (priv->origin_hostname);
 
 	/* convert a URL */
 	uri = g_uri_parse (origin_hostname, SOUP_HTTP_URI_FLAGS, NULL);
@@ -3087,7 +3098,7 @@ gs_app_set_origin_hostname (GsApp *app, const gchar *origin_hostname)
 		origin_hostname = "localhost";
 
 	/* success */
-	priv->origin_hostname = g_strdup (origin_hostname);
+	_g_set_interned_str (&priv->origin_hostname, origin_hostname);
 }
 
 /**
@@ -4532,7 +4543,8 @@ gs_app_has_category (GsApp *app, const gchar *category)
  * @app: a #GsApp
  * @categories: a set of categories
  *
- * Set the list of categories for an application.
+ * Set the list of categories for an application. The category IDs are copied
+ * from @categories.
  *
  * Since: 3.22
  **/
@@ -4544,7 +4556,11 @@ gs_app_set_categories (GsApp *app, GPtrArray *categories)
 	g_return_if_fail (GS_IS_APP (app));
 	g_return_if_fail (categories != NULL);
 	locker = g_mutex_locker_new (&priv->mutex);
-	_g_set_ptr_array (&priv->categories, categories);
+	if (priv->categories == categories)
+		return;
+	g_ptr_array_set_size (priv->categories, 0);
+	for (guint i = 0; i < categories->len; i++)
+		g_ptr_array_add (priv->categories, g_ref_string_new_intern (g_ptr_array_index (categories, i)));
 }
 
 /**
@@ -4566,7 +4582,7 @@ gs_app_add_category (GsApp *app, const gchar *category)
 	locker = g_mutex_locker_new (&priv->mutex);
 	if (gs_app_has_category (app, category))
 		return;
-	g_ptr_array_add (priv->categories, g_strdup (category));
+	g_ptr_array_add (priv->categories, g_ref_string_new_intern (category));
 }
 
 /**
@@ -4762,7 +4778,7 @@ calculate_key_colors (GsApp *app)
 
 	/* get a list of key colors */
 	g_clear_pointer (&priv->key_colors, g_array_unref);
-	priv->key_colors = gs_calculate_key_colors (pb_small);
+	priv->key_colors = gs_calculate_key_colors_cached (pb_small);
 }
 
 /**
@@ -5552,22 +5568,22 @@ gs_app_finalize (GObject *object)
 	g_mutex_clear (&priv->mutex);
 	g_free (priv->id);
 	g_free (priv->unique_id);
-	g_free (priv->branch);
+	g_clear_pointer (&priv->branch, g_ref_string_release);
 	g_free (priv->name);
 	g_free (priv->renamed_from);
 	g_free (priv->url_missing);
 	g_clear_pointer (&priv->urls, g_hash_table_unref);
 	g_hash_table_unref (priv->launchables);
-	g_free (priv->license);
+	g_clear_pointer (&priv->license, g_ref_string_release);
 	g_strfreev (priv->menu_path);
-	g_free (priv->origin);
-	g_free (priv->origin_ui);
-	g_free (priv->origin_appstream);
-	g_free (priv->origin_hostname);
+	g_clear_pointer (&priv->origin, g_ref_string_release);
+	g_clear_pointer (&priv->origin_ui, g_ref_string_release);
+	g_clear_pointer (&priv->origin_appstream, g_ref_string_release);
+	g_clear_pointer (&priv->origin_hostname, g_ref_string_release);
 	g_ptr_array_unref (priv->sources);
 	g_ptr_array_unref (priv->source_ids);
-	g_free (priv->project_group);
-	g_free (priv->developer_name);
+	g_clear_pointer (&priv->project_group, g_ref_string_release);
+	g_clear_pointer (&priv->developer_name, g_ref_string_release);
 	g_free (priv->agreement);
 	g_free (priv->version);
 	g_free (priv->version_ui);
@@ -6062,7 +6078,7 @@ gs_app_init (GsApp *app)
 	priv->rating = -1;
 	priv->sources = g_ptr_array_new_with_free_func (g_free);
 	priv->source_ids = g_ptr_array_new_with_free_func (g_free);
-	priv->categories = g_ptr_array_new_with_free_func (g_free);
+	priv->categories = g_ptr_array_new_with_free_func ((GDestroyNotify) g_ref_string_release);
 	priv->related = gs_app_list_new ();
 	priv->history = gs_app_list_new ();
 	priv->screenshots = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
@@ -6271,8 +6287,7 @@ gs_app_set_origin_ui (GsApp *app,
 	if (g_strcmp0 (priv->origin_ui, origin_ui) == 0)
 		return;
 
-	g_free (priv->origin_ui);
-	priv->origin_ui = g_strdup (origin_ui);
+	_g_set_interned_str (&priv->origin_ui, origin_ui);
 	gs_app_queue_notify (app, obj_props[PROP_ORIGIN_UI]);
 }
 
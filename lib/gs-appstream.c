@@ -352,15 +352,17 @@ traverse_component_icons (GsApp *app,
 
 static void
 traverse_components_xpath_for_icons (GsApp *app,
-				     XbSilo *silo,
+				     GPtrArray *silos,
 				     const gchar *xpath,
 				     gboolean try_with_launchable)
 {
-	g_autoptr(GPtrArray) components = NULL;
-	g_autoptr(GError) local_error = NULL;
+	for (guint j = 0; j < silos->len; j++) {
+		g_autoptr(GPtrArray) components = NULL;
+		g_autoptr(GError) local_error = NULL;
 
-	components = xb_silo_query (silo, xpath, 0, &local_error);
-	if (components) {
+		components = xb_silo_query (g_ptr_array_index (silos, j), xpath, 0, &local_error);
+		if (components == NULL)
+			continue;
 		for (guint i = 0; i < components->len; i++) {
 			g_autoptr(GPtrArray) icons = NULL;  /* (element-type XbNode) */
 			XbNode *component = g_ptr_array_index (components, i);
@@ -376,7 +378,7 @@ traverse_components_xpath_for_icons (GsApp *app,
 					/* Inherit the icon from the .desktop file */
 					xpath2 = g_strdup_printf ("/component[@type='desktop-application']/launchable[@type='desktop-id'][text()='%s']/..",
 								  launchable_id);
-					traverse_components_xpath_for_icons (app, silo, xpath2, FALSE);
+					traverse_components_xpath_for_icons (app, silos, xpath2, FALSE);
 				}
 			}
 		}
@@ -385,7 +387,7 @@ traverse_components_xpath_for_icons (GsApp *app,
 
 static void
 gs_appstream_refine_icon (GsApp *app,
-			  XbSilo *silo,
+			  GPtrArray *silos,
 			  XbNode *component)
 {
 	g_autoptr(GError) local_error = NULL;
@@ -402,51 +404,58 @@ gs_appstream_refine_icon (GsApp *app,
 		if (launchable_id != NULL) {
 			xpath = g_strdup_printf ("/component[@type='desktop-application']/launchable[@type='desktop-id'][text()='%s']/..",
 						 launchable_id);
-			traverse_components_xpath_for_icons (app, silo, xpath, FALSE);
+			traverse_components_xpath_for_icons (app, silos, xpath, FALSE);
 			g_clear_pointer (&xpath, g_free);
 		}
 
 		xpath = g_strdup_printf ("/component[@type='desktop-application']/launchable[@type='desktop-id'][text()='%s']/..",
 					 gs_app_get_id (app));
-		traverse_components_xpath_for_icons (app, silo, xpath, FALSE);
+		traverse_components_xpath_for_icons (app, silos, xpath, FALSE);
 	}
 }
 
 static gboolean
 gs_appstream_refine_add_addons (GsPlugin *plugin,
 				GsApp *app,
-				XbSilo *silo,
+				GPtrArray *silos,
 				GError **error)
 {
 	g_autofree gchar *xpath = NULL;
-	g_autoptr(GError) error_local = NULL;
-	g_autoptr(GPtrArray) addons = NULL;
 	g_autoptr(GsAppList) addons_list = NULL;
 
 	/* get all components */
 	xpath = g_strdup_printf ("components/component/extends[text()='%s']/..",
 				 gs_app_get_id (app));
-	addons = xb_silo_query (silo, xpath, 0, &error_local);
-	if (addons == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return TRUE;
-		g_propagate_error (error, g_steal_pointer (&error_local));
-		return FALSE;
-	}
-
 	addons_list = gs_app_list_new ();
 
-	for (guint i = 0; i < addons->len; i++) {
-		XbNode *addon = g_ptr_array_index (addons, i);
-		g_autoptr(GsApp) addon_app = NULL;
+	for (guint j = 0; j < silos->len; j++) {
+		XbSilo *silo = g_ptr_array_index (silos, j);
+		g_autoptr(GError) error_local = NULL;
+		g_autoptr(GPtrArray) addons = NULL;
 
-		addon_app = gs_appstream_create_app (plugin, silo, addon, error);
-		if (addon_app == NULL)
+		addons = xb_silo_query (silo, xpath, 0, &error_local);
+		if (addons == NULL) {
+			if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+				continue;
+			g_propagate_error (error, g_steal_pointer (&error_local));
 			return FALSE;
+		}
+
+		for (guint i = 0; i < addons->len; i++) {
+			XbNode *addon = g_ptr_array_index (addons, i);
+			g_autoptr(GsApp) addon_app = NULL;
 
-		gs_app_list_add (addons_list, addon_app);
+			addon_app = gs_appstream_create_app (plugin, silo, addon, error);
+			if (addon_app == NULL)
+				return FALSE;
+
+			gs_app_list_add (addons_list, addon_app);
+		}
 	}
 
+	if (gs_app_list_length (addons_list) == 0)
+		return TRUE;
+
 	gs_app_add_addons (app, addons_list);
 
 	return TRUE;
@@ -683,7 +692,7 @@ gs_appstream_copy_metadata (GsApp *app, XbNode *component, GError **error)
 
 static gboolean
 gs_appstream_refine_app_updates (GsApp *app,
-				 XbSilo *silo,
+				 GPtrArray *silos,
 				 XbNode *component,
 				 GError **error)
 {
@@ -691,7 +700,7 @@ gs_appstream_refine_app_updates (GsApp *app,
 	g_autofree gchar *xpath = NULL;
 	g_autoptr(GError) error_local = NULL;
 	g_autoptr(GHashTable) installed = g_hash_table_new (g_str_hash, g_str_equal);
-	g_autoptr(GPtrArray) releases_inst = NULL;
+	g_autoptr(GPtrArray) releases_inst = g_ptr_array_new_with_free_func (g_object_unref);
 	g_autoptr(GPtrArray) releases = NULL;
 	g_autoptr(GPtrArray) updates_list = g_ptr_array_new ();
 
@@ -702,21 +711,26 @@ gs_appstream_refine_app_updates (GsApp *app,
 	/* find out which releases are already installed */
 	xpath = g_strdup_printf ("component/id[text()='%s']/../releases/*[@version]",
 				 gs_app_get_id (app));
-	releases_inst = xb_silo_query (silo, xpath, 0, &error_local);
-	if (releases_inst == NULL) {
-		if (!g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
-			g_propagate_error (error, g_steal_pointer (&error_local));
-			return FALSE;
+	for (guint j = 0; j < silos->len; j++) {
+		g_autoptr(GPtrArray) releases_tmp = NULL;
+
+		releases_tmp = xb_silo_query (g_ptr_array_index (silos, j), xpath, 0, &error_local);
+		if (releases_tmp == NULL) {
+			if (!g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+				g_propagate_error (error, g_steal_pointer (&error_local));
+				return FALSE;
+			}
+			g_clear_error (&error_local);
+			continue;
 		}
-	} else {
-		for (guint i = 0; i < releases_inst->len; i++) {
-			XbNode *release = g_ptr_array_index (releases_inst, i);
+		for (guint i = 0; i < releases_tmp->len; i++) {
+			XbNode *release = g_ptr_array_index (releases_tmp, i);
+			g_ptr_array_add (releases_inst, g_object_ref (release));
 			g_hash_table_insert (installed,
 					     (gpointer) xb_node_get_attr (release, "version"),
 					     (gpointer) release);
 		}
 	}
-	g_clear_error (&error_local);
 
 	/* get all components */
 	releases = xb_node_query (component, "releases/*", 0, &error_local);
@@ -1086,6 +1100,27 @@ gs_appstream_refine_app (GsPlugin *plugin,
 			 XbNode *component,
 			 GsPluginRefineFlags refine_flags,
 			 GError **error)
+{
+	g_autoptr(GPtrArray) silos = g_ptr_array_new ();
+
+	g_return_val_if_fail (XB_IS_SILO (silo), FALSE);
+
+	g_ptr_array_add (silos, silo);
+	return gs_appstream_refine_app_in_silos (plugin, app, silos, component,
+						 refine_flags, error);
+}
+
+/* Like gs_appstream_refine_app(), but for AppStream data which is split across
+ * several silos. @component can be in any of @silos; other components it
+ * refers to, such as the .desktop file it inherits its icon from, its addons
+ * or its installed metainfo, are looked up in all of them. */
+gboolean
+gs_appstream_refine_app_in_silos (GsPlugin *plugin,
+				  GsApp *app,
+				  GPtrArray *silos,
+				  XbNode *component,
+				  GsPluginRefineFlags refine_flags,
+				  GError **error)
 {
 	const gchar *tmp;
 	guint64 timestamp;
@@ -1095,7 +1130,7 @@ gs_appstream_refine_app (GsPlugin *plugin,
 
 	/* The 'plugin' can be NULL, when creating app for --show-metainfo */
 	g_return_val_if_fail (GS_IS_APP (app), FALSE);
-	g_return_val_if_fail (XB_IS_SILO (silo), FALSE);
+	g_return_val_if_fail (silos != NULL, FALSE);
 	g_return_val_if_fail (XB_IS_NODE (component), FALSE);
 
 	/* is compatible */
@@ -1268,7 +1303,7 @@ gs_appstream_refine_app (GsPlugin *plugin,
 	/* set icon */
 	if ((refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON) > 0 &&
 	    gs_app_get_icons (app) == NULL)
-		gs_appstream_refine_icon (app, silo, component);
+		gs_appstream_refine_icon (app, silos, component);
 
 	/* set categories */
 	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_CATEGORIES) {
@@ -1382,8 +1417,8 @@ gs_appstream_refine_app (GsPlugin *plugin,
 
 	/* set addons */
 	if ((refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ADDONS) != 0 &&
-	    plugin != NULL && silo != NULL) {
-		if (!gs_appstream_refine_add_addons (plugin, app, silo, error))
+	    plugin != NULL) {
+		if (!gs_appstream_refine_add_addons (plugin, app, silos, error))
 			return FALSE;
 	}
 
@@ -1453,10 +1488,9 @@ gs_appstream_refine_app (GsPlugin *plugin,
 	}
 
 	/* is there any update information */
-	if ((refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_DETAILS) != 0 &&
-	    silo != NULL) {
+	if ((refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_DETAILS) != 0) {
 		if (!gs_appstream_refine_app_updates (app,
-						      silo,
+						      silos,
 						      component,
 						      error))
 			return FALSE;
@@ -1468,6 +1502,7 @@ gs_appstream_refine_app (GsPlugin *plugin,
 typedef struct {
 	AsSearchTokenMatch	 match_value;
 	XbQuery			*query;
+	const gchar		*index_attr;
 } GsAppstreamSearchHelper;
 
 static void
@@ -1478,7 +1513,7 @@ gs_appstream_search_helper_free (GsAppstreamSearchHelper *helper)
 }
 
 static guint16
-gs_appstream_silo_search_component2 (GPtrArray *array, XbNode *component, const gchar *search)
+gs_appstream_silo_search_component2 (GPtrArray *array, XbNode *component, const gchar *search, guint16 match_mask)
 {
 	guint16 match_value = 0;
 
@@ -1488,6 +1523,12 @@ gs_appstream_silo_search_component2 (GPtrArray *array, XbNode *component, const
 		GsAppstreamSearchHelper *helper = g_ptr_array_index (array, i);
 #if LIBXMLB_CHECK_VERSION(0, 3, 0)
 		g_auto(XbQueryContext) context = XB_QUERY_CONTEXT_INIT ();
+#endif
+
+		/* the search index already knows this can’t match */
+		if ((helper->match_value & match_mask) == 0)
+			continue;
+#if LIBXMLB_CHECK_VERSION(0, 3, 0)
 		xb_value_bindings_bind_str (xb_query_context_get_bindings (&context), 0, search, NULL);
 		n = xb_node_query_with_context (component, helper->query, &context, NULL);
 #else
@@ -1501,13 +1542,13 @@ gs_appstream_silo_search_component2 (GPtrArray *array, XbNode *component, const
 }
 
 static guint16
-gs_appstream_silo_search_component (GPtrArray *array, XbNode *component, const gchar * const *search)
+gs_appstream_silo_search_component (GPtrArray *array, XbNode *component, const gchar * const *search, const guint16 *match_masks)
 {
 	guint16 matches_sum = 0;
 
 	/* do *all* search keywords match */
 	for (guint i = 0; search[i] != NULL; i++) {
-		guint tmp = gs_appstream_silo_search_component2 (array, component, search[i]);
+		guint tmp = gs_appstream_silo_search_component2 (array, component, search[i], match_masks[i]);
 		if (tmp == 0)
 			return 0;
 		matches_sum |= tmp;
@@ -1518,20 +1559,364 @@ gs_appstream_silo_search_component (GPtrArray *array, XbNode *component, const g
 typedef struct {
 	AsSearchTokenMatch	match_value;
 	const gchar		*xpath;
+	const gchar		*index_xpath;	/* nodes providing the text to index */
+	const gchar		*index_attr;	/* (nullable): index this attribute rather than the text */
 } Query;
 
+/* The search index maps a short token prefix to a posting list of the
+ * components which contain a token starting with it, together with the
+ * #AsSearchTokenMatch fields it was found in.
+ *
+ * The `~=stem(?)` queries match when the stemmed search term is a prefix of
+ * any token in the node. Stemming only rewrites the end of a word, so keying
+ * on the first couple of characters gives a superset of the components which
+ * can match; the surviving candidates are then checked with the real queries,
+ * but only for the fields the posting says can match.
+ *
+ * The only words whose stem differs from them within the first couple of
+ * characters are the English stemmer’s exceptions ‘dying’, ‘lying’ and
+ * ‘tying’ (stemmed to ‘die’, ‘lie’ and ‘tie’), so the keys ‘dy’, ‘ly’ and
+ * ‘ty’ are folded into ‘di’, ‘li’ and ‘ti’. Without that, searching for
+ * ‘tie’ would not find ‘tying’, or the other way round. The cost is that
+ * searches starting with any of those six keys check the candidates of both.
+ *
+ * The index is built once per silo and attached to it, together with the
+ * array of components its postings refer to by ordinal, so searches don’t
+ * have to query the silo for every component each time. #XbNodes don’t hold
+ * a reference to their silo, so this doesn’t keep the silo alive. Plugins
+ * build it with gs_appstream_build_search_indexes() before publishing a new
+ * silo, so that no search has to wait for it; a search on a silo without
+ * one builds it under the silo’s own lock, so that doesn’t hold up searches
+ * in other silos. */
+#define GS_APPSTREAM_SEARCH_INDEX_KEY_CHARS	2
+
+static const Query gs_appstream_search_queries[] = {
+	{ AS_SEARCH_TOKEN_MATCH_MIMETYPE,	"mimetypes/mimetype[text()~=stem(?)]",	"mimetypes/mimetype",	NULL },
+	{ AS_SEARCH_TOKEN_MATCH_PKGNAME,	"pkgname[text()~=stem(?)]",		"pkgname",		NULL },
+	{ AS_SEARCH_TOKEN_MATCH_SUMMARY,	"summary[text()~=stem(?)]",		"summary",		NULL },
+	{ AS_SEARCH_TOKEN_MATCH_NAME,	"name[text()~=stem(?)]",		"name",			NULL },
+	{ AS_SEARCH_TOKEN_MATCH_KEYWORD,	"keywords/keyword[text()~=stem(?)]",	"keywords/keyword",	NULL },
+	{ AS_SEARCH_TOKEN_MATCH_ID,	"id[text()~=stem(?)]",			"id",			NULL },
+	{ AS_SEARCH_TOKEN_MATCH_ID,	"launchable[text()~=stem(?)]",		"launchable",		NULL },
+	{ AS_SEARCH_TOKEN_MATCH_ORIGIN,	"../components[@origin~=stem(?)]",	"../components",	"origin" },
+	{ AS_SEARCH_TOKEN_MATCH_NONE,	NULL,					NULL,			NULL }
+};
+
+static const Query gs_appstream_search_developer_queries[] = {
+	{ AS_SEARCH_TOKEN_MATCH_PKGNAME,	"developer_name[text()~=stem(?)]",	"developer_name",	NULL },
+	{ AS_SEARCH_TOKEN_MATCH_SUMMARY,	"project_group[text()~=stem(?)]",	"project_group",	NULL },
+	{ AS_SEARCH_TOKEN_MATCH_NONE,		NULL,					NULL,			NULL }
+};
+
+typedef struct {
+	guint32			 component_idx;
+	guint16			 match_value;
+} GsAppstreamSearchPosting;
+
+typedef struct {
+	GMutex			 mutex;
+	GPtrArray		*components;	/* (owned) (nullable) (element-type XbNode) (mutex mutex); %NULL until built */
+	GHashTable		*postings;	/* (owned) (nullable) (element-type utf8 GArray<GsAppstreamSearchPosting>) (mutex mutex) */
+} GsAppstreamSearchIndex;
+
+static void
+gs_appstream_search_index_free (GsAppstreamSearchIndex *search_index)
+{
+	g_clear_pointer (&search_index->components, g_ptr_array_unref);
+	g_clear_pointer (&search_index->postings, g_hash_table_unref);
+	g_mutex_clear (&search_index->mutex);
+	g_free (search_index);
+}
+
+/* Returns %NULL if @token is too short to be used as a key */
+static gchar *
+gs_appstream_search_index_key (const gchar *token)
+{
+	const gchar *end = token;
+	gchar *key;
+
+	for (guint i = 0; i < GS_APPSTREAM_SEARCH_INDEX_KEY_CHARS; i++) {
+		if (*end == '\0')
+			return NULL;
+		end = g_utf8_next_char (end);
+	}
+	key = g_strndup (token, (gsize) (end - token));
+
+	/* see the comment above */
+	if (g_str_equal (key, "dy") || g_str_equal (key, "ly") || g_str_equal (key, "ty"))
+		key[1] = 'i';
+
+	return key;
+}
+
+static void
+gs_appstream_search_index_add_token (GsAppstreamSearchIndex *search_index,
+				     const gchar *token,
+				     guint32 component_idx,
+				     guint16 match_value)
+{
+	GArray *postings;
+	GsAppstreamSearchPosting posting;
+	g_autofree gchar *key = gs_appstream_search_index_key (token);
+
+	/* shorter tokens can only be matched by an unindexed search */
+	if (key == NULL)
+		return;
+
+	postings = g_hash_table_lookup (search_index->postings, key);
+	if (postings == NULL) {
+		postings = g_array_new (FALSE, FALSE, sizeof (GsAppstreamSearchPosting));
+		g_hash_table_insert (search_index->postings, g_steal_pointer (&key), postings);
+	}
+
+	/* components are added in order, so each posting list is sorted and
+	 * only the last posting can be for the current component */
+	if (postings->len > 0) {
+		GsAppstreamSearchPosting *last;
+		last = &g_array_index (postings, GsAppstreamSearchPosting, postings->len - 1);
+		if (last->component_idx == component_idx) {
+			last->match_value |= match_value;
+			return;
+		}
+	}
+	posting.component_idx = component_idx;
+	posting.match_value = match_value;
+	g_array_append_val (postings, posting);
+}
+
+static void
+gs_appstream_search_index_add_text (GsAppstreamSearchIndex *search_index,
+				    const gchar *text,
+				    guint32 component_idx,
+				    guint16 match_value)
+{
+	g_auto(GStrv) tokens = NULL;
+	g_auto(GStrv) ascii_tokens = NULL;
+
+	if (text == NULL)
+		return;
+	tokens = g_str_tokenize_and_fold (text, NULL, &ascii_tokens);
+	for (guint i = 0; tokens[i] != NULL; i++)
+		gs_appstream_search_index_add_token (search_index, tokens[i], component_idx, match_value);
+	for (guint i = 0; ascii_tokens[i] != NULL; i++)
+		gs_appstream_search_index_add_token (search_index, ascii_tokens[i], component_idx, match_value);
+}
+
+/* Queries all the components in @silo, and indexes them into @search_index */
+static gboolean
+gs_appstream_search_index_build (GsAppstreamSearchIndex *search_index,
+				 XbSilo *silo,
+				 const Query queries[],
+				 GError **error)
+{
+	g_autoptr(GPtrArray) components = NULL;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GPtrArray) array = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_appstream_search_helper_free);
+	g_autoptr(GTimer) timer = g_timer_new ();
+
+	for (guint i = 0; queries[i].xpath != NULL; i++) {
+		g_autoptr(GError) error_query = NULL;
+		g_autoptr(XbQuery) query = xb_query_new (silo, queries[i].index_xpath, &error_query);
+		if (query != NULL) {
+			GsAppstreamSearchHelper *helper = g_new0 (GsAppstreamSearchHelper, 1);
+			helper->match_value = queries[i].match_value;
+			helper->query = g_steal_pointer (&query);
+			helper->index_attr = queries[i].index_attr;
+			g_ptr_array_add (array, helper);
+		} else {
+			g_debug ("ignoring: %s", error_query->message);
+		}
+	}
+
+	components = xb_silo_query (silo, "components/component", 0, &error_local);
+	if (components == NULL) {
+		if (!g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+			g_propagate_error (error, g_steal_pointer (&error_local));
+			return FALSE;
+		}
+		components = g_ptr_array_new_with_free_func (g_object_unref);
+	}
+
+	search_index->postings = g_hash_table_new_full (g_str_hash, g_str_equal,
+							g_free, (GDestroyNotify) g_array_unref);
+
+	for (guint i = 0; i < components->len; i++) {
+		XbNode *component = g_ptr_array_index (components, i);
+
+		for (guint j = 0; j < array->len; j++) {
+			GsAppstreamSearchHelper *helper = g_ptr_array_index (array, j);
+			g_autoptr(GPtrArray) nodes = xb_node_query_full (component, helper->query, NULL);
+
+			for (guint k = 0; nodes != NULL && k < nodes->len; k++) {
+				XbNode *n = g_ptr_array_index (nodes, k);
+				const gchar *text = helper->index_attr != NULL ?
+						    xb_node_get_attr (n, helper->index_attr) :
+						    xb_node_get_text (n);
+				gs_appstream_search_index_add_text (search_index, text, i, helper->match_value);
+			}
+		}
+	}
+
+	g_debug ("search index of %u components with %u keys took %fms",
+		 components->len, g_hash_table_size (search_index->postings),
+		 g_timer_elapsed (timer, NULL) * 1000);
+	search_index->components = g_steal_pointer (&components);
+	return TRUE;
+}
+
+/* Returns (transfer none): the index for @silo, which is valid for as long as
+ * the caller holds a reference to @silo. Once this has returned it, its
+ * components and postings never change, so they can be read without its lock. */
+static GsAppstreamSearchIndex *
+gs_appstream_search_index_ensure (XbSilo *silo,
+				  const gchar *index_name,
+				  const Query queries[],
+				  GError **error)
+{
+	GsAppstreamSearchIndex *search_index;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	/* attach an empty index to the silo, unless another thread got there
+	 * first, then build it under its own lock */
+	search_index = g_object_get_data (G_OBJECT (silo), index_name);
+	if (search_index == NULL) {
+		GsAppstreamSearchIndex *search_index_new = g_new0 (GsAppstreamSearchIndex, 1);
+
+		g_mutex_init (&search_index_new->mutex);
+		if (g_object_replace_data (G_OBJECT (silo), index_name, NULL, search_index_new,
+					   (GDestroyNotify) gs_appstream_search_index_free, NULL)) {
+			search_index = search_index_new;
+		} else {
+			gs_appstream_search_index_free (search_index_new);
+			search_index = g_object_get_data (G_OBJECT (silo), index_name);
+		}
+	}
+
+	locker = g_mutex_locker_new (&search_index->mutex);
+	if (search_index->components == NULL &&
+	    !gs_appstream_search_index_build (search_index, silo, queries, error))
+		return NULL;
+
+	return search_index;
+}
+
+/* Returns (transfer full) (nullable): a map of component ordinal to the
+ * #AsSearchTokenMatch fields @value may match in, or %NULL if @value cannot be
+ * narrowed down using the index */
+static GHashTable *
+gs_appstream_search_index_lookup (GsAppstreamSearchIndex *search_index,
+				  const gchar *value)
+{
+	g_autoptr(GHashTable) candidates = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_auto(GStrv) tokens = NULL;
+	g_auto(GStrv) ascii_tokens = NULL;
+	g_autoptr(GPtrArray) keys = g_ptr_array_new_with_free_func (g_free);
+
+	tokens = g_str_tokenize_and_fold (value, NULL, &ascii_tokens);
+	for (guint i = 0; tokens[i] != NULL; i++)
+		g_ptr_array_add (keys, gs_appstream_search_index_key (tokens[i]));
+	for (guint i = 0; ascii_tokens[i] != NULL; i++)
+		g_ptr_array_add (keys, gs_appstream_search_index_key (ascii_tokens[i]));
+	if (keys->len == 0)
+		return NULL;
+
+	/* a component matches if any of the tokens matches */
+	for (guint i = 0; i < keys->len; i++) {
+		const gchar *key = g_ptr_array_index (keys, i);
+		GArray *postings;
+
+		if (key == NULL)
+			return NULL;
+		postings = g_hash_table_lookup (search_index->postings, key);
+		for (guint j = 0; postings != NULL && j < postings->len; j++) {
+			GsAppstreamSearchPosting *posting = &g_array_index (postings, GsAppstreamSearchPosting, j);
+			gpointer component_idx = GUINT_TO_POINTER (posting->component_idx);
+			guint match_value = GPOINTER_TO_UINT (g_hash_table_lookup (candidates, component_idx));
+			g_hash_table_insert (candidates, component_idx,
+					     GUINT_TO_POINTER (match_value | posting->match_value));
+		}
+	}
+
+	return g_steal_pointer (&candidates);
+}
+
+static gint
+gs_appstream_search_ordinal_cmp (gconstpointer a, gconstpointer b)
+{
+	guint ordinal_a = *((const guint *) a);
+	guint ordinal_b = *((const guint *) b);
+	if (ordinal_a < ordinal_b)
+		return -1;
+	if (ordinal_a > ordinal_b)
+		return 1;
+	return 0;
+}
+
+static gboolean
+gs_appstream_search_add_component (GsPlugin *plugin,
+				   XbSilo *silo,
+				   XbNode *component,
+				   guint16 match_value,
+				   GsAppList *list,
+				   GError **error)
+{
+	g_autoptr(GsApp) app = gs_appstream_create_app (plugin, silo, component, error);
+	if (app == NULL)
+		return FALSE;
+	if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD)) {
+		g_debug ("not returning wildcard %s",
+			 gs_app_get_unique_id (app));
+		return TRUE;
+	}
+	g_debug ("add %s", gs_app_get_unique_id (app));
+
+	/* The match value is used for prioritising results.
+	 * Drop the ID token from it as it’s the highest
+	 * numeric value but isn’t visible to the user in the
+	 * UI, which leads to confusing results ordering. */
+	gs_app_set_match_value (app, match_value & (~AS_SEARCH_TOKEN_MATCH_ID));
+	gs_app_list_add (list, app);
+
+	if (gs_app_get_kind (app) == AS_COMPONENT_KIND_ADDON) {
+		g_autoptr(GPtrArray) extends = NULL;
+
+		/* add the parent app as a wildcard, to be refined later */
+		extends = xb_node_query (component, "extends", 0, NULL);
+		for (guint jj = 0; extends && jj < extends->len; jj++) {
+			XbNode *extend = g_ptr_array_index (extends, jj);
+			g_autoptr(GsApp) app2 = NULL;
+			const gchar *tmp;
+			app2 = gs_app_new (xb_node_get_text (extend));
+			gs_app_add_quirk (app2, GS_APP_QUIRK_IS_WILDCARD);
+			tmp = xb_node_query_attr (extend, "../..", "origin", NULL);
+			if (gs_appstream_origin_valid (tmp))
+				gs_app_set_origin_appstream (app2, tmp);
+			gs_app_list_add (list, app2);
+		}
+	}
+
+	return TRUE;
+}
+
 static gboolean
 gs_appstream_do_search (GsPlugin *plugin,
 			XbSilo *silo,
 			const gchar * const *values,
+			const gchar *index_name,
 			const Query queries[],
 			GsAppList *list,
 			GCancellable *cancellable,
 			GError **error)
 {
-	g_autoptr(GError) error_local = NULL;
+	GsAppstreamSearchIndex *search_index;
 	g_autoptr(GPtrArray) array = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_appstream_search_helper_free);
-	g_autoptr(GPtrArray) components = NULL;
+	GPtrArray *components;
+	g_autoptr(GPtrArray) value_candidates = g_ptr_array_new_with_free_func ((GDestroyNotify) g_hash_table_unref);
+	g_autoptr(GArray) ordinals = g_array_new (FALSE, FALSE, sizeof (guint));
+	g_autofree GHashTable **candidates_for_value = NULL;
+	g_autofree guint16 *match_masks = NULL;
+	GHashTable *smallest = NULL;
+	guint n_values;
 	g_autoptr(GTimer) timer = g_timer_new ();
 
 	g_return_val_if_fail (GS_IS_PLUGIN (plugin), FALSE);
@@ -1553,58 +1938,73 @@ gs_appstream_do_search (GsPlugin *plugin,
 		}
 	}
 
-	/* get all components */
-	components = xb_silo_query (silo, "components/component", 0, &error_local);
-	if (components == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return TRUE;
-		g_propagate_error (error, g_steal_pointer (&error_local));
+	/* get all components, which are only queried once per silo */
+	search_index = gs_appstream_search_index_ensure (silo, index_name, queries, error);
+	if (search_index == NULL)
 		return FALSE;
-	}
-	for (guint i = 0; i < components->len; i++) {
-		XbNode *component = g_ptr_array_index (components, i);
-		guint16 match_value = gs_appstream_silo_search_component (array, component, values);
-		if (match_value != 0) {
-			g_autoptr(GsApp) app = gs_appstream_create_app (plugin, silo, component, error);
-			if (app == NULL)
-				return FALSE;
-			if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD)) {
-				g_debug ("not returning wildcard %s",
-					 gs_app_get_unique_id (app));
-				continue;
+	components = search_index->components;
+
+	/* narrow down the candidates for each search value; the values which
+	 * can’t be narrowed may match anything */
+	n_values = g_strv_length ((gchar **) values);
+	candidates_for_value = g_new0 (GHashTable *, n_values);
+	match_masks = g_new0 (guint16, n_values);
+	for (guint i = 0; i < n_values; i++) {
+		GHashTable *candidates = gs_appstream_search_index_lookup (search_index, values[i]);
+		if (candidates == NULL)
+			continue;
+		if (smallest == NULL || g_hash_table_size (candidates) < g_hash_table_size (smallest))
+			smallest = candidates;
+		candidates_for_value[i] = candidates;
+		g_ptr_array_add (value_candidates, candidates);
+	}
+
+	/* *all* search values have to match, so intersect the candidates */
+	if (smallest != NULL) {
+		GHashTableIter iter;
+		gpointer key;
+
+		g_hash_table_iter_init (&iter, smallest);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			gboolean found = TRUE;
+			for (guint i = 0; i < value_candidates->len && found; i++) {
+				GHashTable *candidates = g_ptr_array_index (value_candidates, i);
+				found = g_hash_table_contains (candidates, key);
 			}
-			g_debug ("add %s", gs_app_get_unique_id (app));
+			if (found) {
+				guint ordinal = GPOINTER_TO_UINT (key);
+				g_array_append_val (ordinals, ordinal);
+			}
+		}
 
-			/* The match value is used for prioritising results.
-			 * Drop the ID token from it as it’s the highest
-			 * numeric value but isn’t visible to the user in the
-			 * UI, which leads to confusing results ordering. */
-			gs_app_set_match_value (app, match_value & (~AS_SEARCH_TOKEN_MATCH_ID));
-			gs_app_list_add (list, app);
+		/* return results in silo order, as the unindexed search did */
+		g_array_sort (ordinals, gs_appstream_search_ordinal_cmp);
+	} else {
+		for (guint i = 0; i < components->len; i++)
+			g_array_append_val (ordinals, i);
+	}
 
-			if (gs_app_get_kind (app) == AS_COMPONENT_KIND_ADDON) {
-				g_autoptr(GPtrArray) extends = NULL;
-
-				/* add the parent app as a wildcard, to be refined later */
-				extends = xb_node_query (component, "extends", 0, NULL);
-				for (guint jj = 0; extends && jj < extends->len; jj++) {
-					XbNode *extend = g_ptr_array_index (extends, jj);
-					g_autoptr(GsApp) app2 = NULL;
-					const gchar *tmp;
-					app2 = gs_app_new (xb_node_get_text (extend));
-					gs_app_add_quirk (app2, GS_APP_QUIRK_IS_WILDCARD);
-					tmp = xb_node_query_attr (extend, "../..", "origin", NULL);
-					if (gs_appstream_origin_valid (tmp))
-						gs_app_set_origin_appstream (app2, tmp);
-					gs_app_list_add (list, app2);
-				}
-			}
+	for (guint i = 0; i < ordinals->len; i++) {
+		guint ordinal = g_array_index (ordinals, guint, i);
+		XbNode *component = g_ptr_array_index (components, ordinal);
+		guint16 match_value;
+
+		for (guint j = 0; j < n_values; j++) {
+			GHashTable *candidates = candidates_for_value[j];
+			match_masks[j] = candidates != NULL ?
+					 GPOINTER_TO_UINT (g_hash_table_lookup (candidates, GUINT_TO_POINTER (ordinal))) :
+					 G_MAXUINT16;
 		}
 
+		match_value = gs_appstream_silo_search_component (array, component, values, match_masks);
+		if (match_value != 0 &&
+		    !gs_appstream_search_add_component (plugin, silo, component, match_value, list, error))
+			return FALSE;
+
 		if (g_cancellable_set_error_if_cancelled (cancellable, error))
 			return FALSE;
 	}
-	g_debug ("search took %fms", g_timer_elapsed (timer, NULL) * 1000);
+	g_debug ("search of %u candidates took %fms", ordinals->len, g_timer_elapsed (timer, NULL) * 1000);
 	return TRUE;
 }
 
@@ -1618,19 +2018,8 @@ gs_appstream_search (GsPlugin *plugin,
 		     GCancellable *cancellable,
 		     GError **error)
 {
-	const Query queries[] = {
-		{ AS_SEARCH_TOKEN_MATCH_MIMETYPE,	"mimetypes/mimetype[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_PKGNAME,	"pkgname[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_SUMMARY,	"summary[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_NAME,	"name[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_KEYWORD,	"keywords/keyword[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_ID,	"id[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_ID,	"launchable[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_ORIGIN,	"../components[@origin~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_NONE,	NULL }
-	};
-
-	return gs_appstream_do_search (plugin, silo, values, queries, list, cancellable, error);
+	return gs_appstream_do_search (plugin, silo, values, "GnomeSoftware::search-index",
+				       gs_appstream_search_queries, list, cancellable, error);
 }
 
 gboolean
@@ -1641,13 +2030,27 @@ gs_appstream_search_developer_apps (GsPlugin *plugin,
 				    GCancellable *cancellable,
 				    GError **error)
 {
-	const Query queries[] = {
-		{ AS_SEARCH_TOKEN_MATCH_PKGNAME,	"developer_name[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_SUMMARY,	"project_group[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_NONE,		NULL }
-	};
+	return gs_appstream_do_search (plugin, silo, values, "GnomeSoftware::search-index-developer",
+				       gs_appstream_search_developer_queries, list, cancellable, error);
+}
+
+/* Builds the indexes used by gs_appstream_search() and
+ * gs_appstream_search_developer_apps() for @silo, if it doesn’t have them
+ * yet. Call this before publishing a newly built silo, so the first search
+ * on it doesn’t have to build them. */
+gboolean
+gs_appstream_build_search_indexes (XbSilo *silo,
+				   GError **error)
+{
+	g_return_val_if_fail (XB_IS_SILO (silo), FALSE);
 
-	return gs_appstream_do_search (plugin, silo, values, queries, list, cancellable, error);
+	if (gs_appstream_search_index_ensure (silo, "GnomeSoftware::search-index",
+					      gs_appstream_search_queries, error) == NULL)
+		return FALSE;
+	if (gs_appstream_search_index_ensure (silo, "GnomeSoftware::search-index-developer",
+					      gs_appstream_search_developer_queries, error) == NULL)
+		return FALSE;
+	return TRUE;
 }
 
 gboolean
@@ -23,6 +23,12 @@ gboolean	 gs_appstream_refine_app		(GsPlugin	*plugin,
 							 XbNode		*component,
 							 GsPluginRefineFlags flags,
 							 GError		**error);
+gboolean	 gs_appstream_refine_app_in_silos	(GsPlugin	*plugin,
+							 GsApp		*app,
+							 GPtrArray	*silos,
+							 XbNode		*component,
+							 GsPluginRefineFlags flags,
+							 GError		**error);
 gboolean	 gs_appstream_search			(GsPlugin	*plugin,
 							 XbSilo		*silo,
 							 const gchar * const *values,
@@ -35,6 +41,8 @@ gboolean	 gs_appstream_search_developer_apps	(GsPlugin	*plugin,
 							 GsAppList	*list,
 							 GCancellable	*cancellable,
 							 GError		**error);
+gboolean	 gs_appstream_build_search_indexes	(XbSilo		*silo,
+							 GError		**error);
 gboolean	 gs_appstream_refine_category_sizes	(XbSilo		*silo,
 							 GPtrArray	*list,
 							 GCancellable	*cancellable,
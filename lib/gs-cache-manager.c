@@ -0,0 +1,819 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 GNOME Software contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/**
+ * SECTION:gs-cache-manager
+ * @short_description: Size-limited cache of downloaded icons and screenshots
+ *
+ * #GsCacheManager keeps the remote icons and screenshots which are downloaded
+ * into the user cache directory within a maximum total size.
+ *
+ * Files are placed in subdirectories sharded by the first two characters of
+ * their (checksum-prefixed) basename by gs_cache_manager_get_filename(), so
+ * no single directory grows too large. Callers report newly written files
+ * using gs_cache_manager_add_file(), and cache hits and misses using
+ * gs_cache_manager_note_hit() and gs_cache_manager_note_miss(). The size and
+ * last access time of each file are kept in a small index file in the cache
+ * directory.
+ *
+ * When the cache grows beyond gs_cache_manager_get_max_size(), the least
+ * recently used files are deleted in a worker thread until the cache is back
+ * under 90% of that size. The index is loaded in that worker thread too, so
+ * the callers never block on it; files reported before it is loaded take
+ * precedence over their entries in it. On the first use without an index,
+ * any existing icons and screenshots are added to the index, using their
+ * modification time as access time. Those from before the cache was sharded
+ * are moved into their shard first.
+ *
+ * All methods are thread safe.
+ *
+ * Since: 44
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "gs-cache-manager.h"
+
+#define GS_CACHE_MANAGER_INDEX_FILENAME	"cache-index.gvariant"
+#define GS_CACHE_MANAGER_INDEX_VERSION	4
+#define GS_CACHE_MANAGER_INDEX_FORMAT	"(ua{s(xt)})"
+
+/* how often to write the access times back to the index at most */
+#define GS_CACHE_MANAGER_SAVE_INTERVAL	(5 * 60 * G_USEC_PER_SEC)
+
+/* the kinds which are managed and scanned for files; bump the index version
+ * when adding one, or when changing where files are placed, so the existing
+ * files are found or moved */
+static const gchar * const managed_kinds[] = { "icons", "screenshots", NULL };
+
+typedef struct {
+	gint64		 atime;  /* real time, in microseconds */
+	guint64		 size;
+} GsCacheEntry;
+
+struct _GsCacheManager
+{
+	GObject		 parent_instance;
+
+	gchar		*cache_dir;  /* (owned) (not nullable) */
+
+	GMutex		 evict_mutex;  /* serialises gs_cache_manager_evict() */
+
+	GMutex		 mutex;
+	GHashTable	*entries;  /* (owned) (lock mutex) (element-type filename GsCacheEntry), keyed by path relative to @cache_dir */
+	gboolean	 loaded;  /* (lock mutex), whether the index has been merged into @entries */
+	gboolean	 needs_scan;  /* (lock mutex) */
+	gboolean	 dirty;  /* (lock mutex) */
+	gboolean	 maintenance_queued;  /* (lock mutex) */
+	gint64		 last_save_time;  /* (lock mutex), monotonic time */
+	guint64		 size;  /* (lock mutex) */
+	guint64		 max_size;  /* (lock mutex), 0 for no limit */
+	guint64		 n_hits;  /* (lock mutex) */
+	guint64		 n_misses;  /* (lock mutex) */
+	guint64		 n_evicted;  /* (lock mutex) */
+};
+
+G_DEFINE_TYPE (GsCacheManager, gs_cache_manager, G_TYPE_OBJECT)
+
+static void
+gs_cache_manager_finalize (GObject *object)
+{
+	GsCacheManager *self = GS_CACHE_MANAGER (object);
+
+	g_free (self->cache_dir);
+	g_hash_table_unref (self->entries);
+	g_mutex_clear (&self->mutex);
+	g_mutex_clear (&self->evict_mutex);
+
+	G_OBJECT_CLASS (gs_cache_manager_parent_class)->finalize (object);
+}
+
+static void
+gs_cache_manager_class_init (GsCacheManagerClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = gs_cache_manager_finalize;
+}
+
+static void
+gs_cache_manager_init (GsCacheManager *self)
+{
+	g_mutex_init (&self->mutex);
+	g_mutex_init (&self->evict_mutex);
+	self->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	self->max_size = GS_CACHE_MANAGER_DEFAULT_MAX_SIZE;
+	self->last_save_time = g_get_monotonic_time ();
+}
+
+/**
+ * gs_cache_manager_new:
+ * @cache_dir: the cache directory to manage
+ *
+ * Creates a new cache manager for the icons and screenshots in @cache_dir.
+ * Most callers want gs_cache_manager_get_default() instead.
+ *
+ * Returns: (transfer full): a new #GsCacheManager
+ *
+ * Since: 44
+ **/
+GsCacheManager *
+gs_cache_manager_new (const gchar *cache_dir)
+{
+	GsCacheManager *self;
+
+	g_return_val_if_fail (cache_dir != NULL, NULL);
+
+	self = g_object_new (GS_TYPE_CACHE_MANAGER, NULL);
+	self->cache_dir = g_strdup (cache_dir);
+	return self;
+}
+
+/**
+ * gs_cache_manager_get_default:
+ *
+ * Gets the cache manager for the writable gnome-software cache directory, as
+ * used by gs_utils_get_cache_filename().
+ *
+ * Returns: (transfer none): the default #GsCacheManager
+ *
+ * Since: 44
+ **/
+GsCacheManager *
+gs_cache_manager_get_default (void)
+{
+	static gsize initialised = 0;
+	static GsCacheManager *manager = NULL;
+
+	if (g_once_init_enter (&initialised)) {
+		const gchar *tmp = g_getenv ("GS_SELF_TEST_CACHEDIR");
+		g_autofree gchar *cache_dir = NULL;
+
+		if (tmp != NULL)
+			cache_dir = g_strdup (tmp);
+		else
+			cache_dir = g_build_filename (g_get_user_cache_dir (), "gnome-software", NULL);
+		manager = gs_cache_manager_new (cache_dir);
+		g_once_init_leave (&initialised, 1);
+	}
+
+	return manager;
+}
+
+/* returns a pointer into @filename, or %NULL if it is not in the cache */
+static const gchar *
+gs_cache_manager_get_relative_path (GsCacheManager *self,
+				    const gchar *filename)
+{
+	gsize len = strlen (self->cache_dir);
+
+	if (strncmp (filename, self->cache_dir, len) != 0 ||
+	    filename[len] != G_DIR_SEPARATOR)
+		return NULL;
+	return filename + len + 1;
+}
+
+static gchar *
+gs_cache_manager_get_index_filename (GsCacheManager *self)
+{
+	return g_build_filename (self->cache_dir, GS_CACHE_MANAGER_INDEX_FILENAME, NULL);
+}
+
+static void
+gs_cache_manager_insert_unlocked (GsCacheManager *self,
+				  const gchar *relative_path,
+				  gint64 atime,
+				  guint64 size)
+{
+	GsCacheEntry *entry;
+
+	entry = g_hash_table_lookup (self->entries, relative_path);
+	if (entry == NULL) {
+		entry = g_new0 (GsCacheEntry, 1);
+		g_hash_table_insert (self->entries, g_strdup (relative_path), entry);
+	} else {
+		self->size -= entry->size;
+	}
+	entry->atime = atime;
+	entry->size = size;
+	self->size += size;
+}
+
+/* Returns (transfer full) (nullable): the entries of a valid index, or %NULL
+ * if there is none; this does blocking I/O, so is only called in the worker */
+static GVariantIter *
+gs_cache_manager_read_index (GsCacheManager *self)
+{
+	g_autofree gchar *filename = NULL;
+	g_autoptr(GMappedFile) mapped = NULL;
+	g_autoptr(GBytes) bytes = NULL;
+	g_autoptr(GVariant) index = NULL;
+	g_autoptr(GError) error_local = NULL;
+	GVariantIter *iter = NULL;
+	guint32 version;
+
+	filename = gs_cache_manager_get_index_filename (self);
+	mapped = g_mapped_file_new (filename, FALSE, &error_local);
+	if (mapped == NULL) {
+		if (!g_error_matches (error_local, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_debug ("failed to load cache index: %s", error_local->message);
+		return NULL;
+	}
+	bytes = g_mapped_file_get_bytes (mapped);
+	index = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (GS_CACHE_MANAGER_INDEX_FORMAT),
+							      bytes, FALSE));
+	if (!g_variant_is_normal_form (index)) {
+		g_debug ("ignoring corrupt cache index %s", filename);
+		return NULL;
+	}
+	g_variant_get (index, "(ua{s(xt)})", &version, &iter);
+	if (version != GS_CACHE_MANAGER_INDEX_VERSION) {
+		g_debug ("ignoring cache index version %u", version);
+		g_variant_iter_free (iter);
+		return NULL;
+	}
+	return iter;
+}
+
+/* Must be called with @self->evict_mutex held, so the index is only loaded
+ * once */
+static void
+gs_cache_manager_ensure_loaded (GsCacheManager *self)
+{
+	g_autoptr(GVariantIter) iter = NULL;
+	const gchar *relative_path;
+	gint64 atime;
+	guint64 size;
+
+	g_mutex_lock (&self->mutex);
+	if (self->loaded) {
+		g_mutex_unlock (&self->mutex);
+		return;
+	}
+	g_mutex_unlock (&self->mutex);
+
+	/* read it without holding the lock, so callers aren’t blocked */
+	iter = gs_cache_manager_read_index (self);
+
+	g_mutex_lock (&self->mutex);
+	while (iter != NULL &&
+	       g_variant_iter_next (iter, "{&s(xt)}", &relative_path, &atime, &size)) {
+		/* files added or used in the meantime are more up to date */
+		if (g_hash_table_contains (self->entries, relative_path))
+			continue;
+		gs_cache_manager_insert_unlocked (self, relative_path, atime, size);
+	}
+
+	/* anything not in a valid index needs to be found on disk */
+	self->needs_scan = (iter == NULL);
+	self->loaded = TRUE;
+	g_mutex_unlock (&self->mutex);
+}
+
+static gboolean
+gs_cache_manager_save_index (GsCacheManager *self,
+			     GError **error)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	g_autofree gchar *filename = NULL;
+	g_autoptr(GVariant) index = NULL;
+	g_autoptr(GVariantBuilder) builder = NULL;
+
+	g_mutex_lock (&self->mutex);
+	if (!self->dirty) {
+		g_mutex_unlock (&self->mutex);
+		return TRUE;
+	}
+	builder = g_variant_builder_new (G_VARIANT_TYPE ("a{s(xt)}"));
+	g_hash_table_iter_init (&iter, self->entries);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		GsCacheEntry *entry = value;
+		g_variant_builder_add (builder, "{s(xt)}", (const gchar *) key,
+				       entry->atime, entry->size);
+	}
+	self->dirty = FALSE;
+	self->last_save_time = g_get_monotonic_time ();
+	g_mutex_unlock (&self->mutex);
+
+	index = g_variant_ref_sink (g_variant_new ("(ua{s(xt)})",
+						   (guint32) GS_CACHE_MANAGER_INDEX_VERSION,
+						   builder));
+	if (g_mkdir_with_parents (self->cache_dir, 0755) != 0) {
+		gint errsv = errno;
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+			     "Failed to create %s: %s", self->cache_dir, g_strerror (errsv));
+		return FALSE;
+	}
+	filename = gs_cache_manager_get_index_filename (self);
+	return g_file_set_contents (filename,
+				    g_variant_get_data (index),
+				    (gssize) g_variant_get_size (index),
+				    error);
+}
+
+static gchar *gs_cache_manager_get_shard (const gchar *basename);
+
+/* Moves @filename, which is called @name and is in @path, into the shard
+ * subdirectory of @path which gs_cache_manager_get_filename() would put it in,
+ * unless it’s already there. If the file is already in the shard, the copy
+ * being moved is deleted.
+ *
+ * Returns (transfer full): the new filename, or %NULL if @filename was
+ * deleted or couldn’t be moved */
+static gchar *
+gs_cache_manager_move_to_shard (const gchar *path,
+				const gchar *name,
+				const gchar *filename)
+{
+	g_autofree gchar *shard = gs_cache_manager_get_shard (name);
+	g_autofree gchar *dirname = NULL;
+	g_autofree gchar *filename_new = NULL;
+	g_autofree gchar *parent = g_path_get_basename (path);
+
+	if (g_strcmp0 (parent, shard) == 0)
+		return g_strdup (filename);
+
+	dirname = g_build_filename (path, shard, NULL);
+	filename_new = g_build_filename (dirname, name, NULL);
+	if (g_file_test (filename_new, G_FILE_TEST_EXISTS)) {
+		if (g_unlink (filename) != 0)
+			g_debug ("failed to delete %s: %s", filename, g_strerror (errno));
+		return NULL;
+	}
+	if (g_mkdir_with_parents (dirname, 0755) != 0 ||
+	    g_rename (filename, filename_new) != 0) {
+		g_debug ("failed to move %s to %s: %s", filename, filename_new, g_strerror (errno));
+		return NULL;
+	}
+	return g_steal_pointer (&filename_new);
+}
+
+/* adds the files under @path which are not yet in @found, moving any which
+ * are not in their shard */
+static void
+gs_cache_manager_scan_dir (GsCacheManager *self,
+			   const gchar *path,
+			   GHashTable *found,
+			   GCancellable *cancellable)
+{
+	const gchar *name;
+	g_autoptr(GDir) dir = NULL;
+
+	dir = g_dir_open (path, 0, NULL);
+	if (dir == NULL)
+		return;
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *child = g_build_filename (path, name, NULL);
+		GStatBuf st;
+
+		if (g_cancellable_is_cancelled (cancellable))
+			return;
+		if (g_lstat (child, &st) != 0)
+			continue;
+		if (S_ISDIR (st.st_mode)) {
+			gs_cache_manager_scan_dir (self, child, found, cancellable);
+		} else if (S_ISREG (st.st_mode)) {
+			GsCacheEntry *entry;
+			g_autofree gchar *child_sharded = gs_cache_manager_move_to_shard (path, name, child);
+
+			if (child_sharded == NULL)
+				continue;
+			g_free (child);
+			child = g_steal_pointer (&child_sharded);
+
+			entry = g_new0 (GsCacheEntry, 1);
+			entry->atime = (gint64) st.st_mtime * G_USEC_PER_SEC;
+			entry->size = (guint64) st.st_size;
+			g_hash_table_insert (found,
+					     g_strdup (gs_cache_manager_get_relative_path (self, child)),
+					     entry);
+		}
+	}
+}
+
+static void
+gs_cache_manager_scan (GsCacheManager *self,
+		       GCancellable *cancellable)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	g_autoptr(GHashTable) found = NULL;
+
+	found = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	for (guint i = 0; managed_kinds[i] != NULL; i++) {
+		g_autofree gchar *path = g_build_filename (self->cache_dir, managed_kinds[i], NULL);
+		gs_cache_manager_scan_dir (self, path, found, cancellable);
+	}
+
+	g_mutex_lock (&self->mutex);
+	g_hash_table_iter_init (&iter, found);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		GsCacheEntry *entry = value;
+
+		/* files added in the meantime are more up to date */
+		if (g_hash_table_contains (self->entries, key))
+			continue;
+		gs_cache_manager_insert_unlocked (self, key, entry->atime, entry->size);
+	}
+	self->dirty = TRUE;
+	g_mutex_unlock (&self->mutex);
+
+	g_debug ("found %u files in %s", g_hash_table_size (found), self->cache_dir);
+}
+
+typedef struct {
+	const gchar	*relative_path;  /* (unowned) */
+	gint64		 atime;
+} GsCacheVictim;
+
+static gint
+gs_cache_manager_victim_cmp (gconstpointer a,
+			     gconstpointer b)
+{
+	const GsCacheVictim *victim_a = a;
+	const GsCacheVictim *victim_b = b;
+
+	if (victim_a->atime < victim_b->atime)
+		return -1;
+	if (victim_a->atime > victim_b->atime)
+		return 1;
+	return g_strcmp0 (victim_a->relative_path, victim_b->relative_path);
+}
+
+/* removes the least recently used entries until the cache is below 90% of
+ * the maximum size, and returns their paths */
+static GPtrArray *
+gs_cache_manager_take_victims_unlocked (GsCacheManager *self)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	guint64 target_size;
+	g_autoptr(GArray) candidates = NULL;
+	GPtrArray *victims = g_ptr_array_new_with_free_func (g_free);
+
+	if (self->max_size == 0 || self->size <= self->max_size)
+		return victims;
+
+	candidates = g_array_sized_new (FALSE, FALSE, sizeof (GsCacheVictim),
+					g_hash_table_size (self->entries));
+	g_hash_table_iter_init (&iter, self->entries);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		GsCacheEntry *entry = value;
+		GsCacheVictim victim;
+
+		victim.relative_path = key;
+		victim.atime = entry->atime;
+		g_array_append_val (candidates, victim);
+	}
+	g_array_sort (candidates, gs_cache_manager_victim_cmp);
+
+	target_size = self->max_size / 10 * 9;
+	for (guint i = 0; i < candidates->len && self->size > target_size; i++) {
+		GsCacheVictim *victim = &g_array_index (candidates, GsCacheVictim, i);
+		GsCacheEntry *entry = g_hash_table_lookup (self->entries, victim->relative_path);
+
+		self->size -= entry->size;
+		g_ptr_array_add (victims, g_strdup (victim->relative_path));
+		g_hash_table_remove (self->entries, victim->relative_path);
+	}
+	self->n_evicted += victims->len;
+	if (victims->len > 0)
+		self->dirty = TRUE;
+
+	return victims;
+}
+
+/**
+ * gs_cache_manager_evict:
+ * @self: a #GsCacheManager
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Deletes the least recently used files until the cache is within its
+ * maximum size, and saves the index.
+ *
+ * This is normally done automatically in a worker thread, and does
+ * blocking I/O.
+ *
+ * Returns: %TRUE on success
+ *
+ * Since: 44
+ **/
+gboolean
+gs_cache_manager_evict (GsCacheManager *self,
+			GCancellable *cancellable,
+			GError **error)
+{
+	gboolean needs_scan;
+	g_autoptr(GMutexLocker) evict_locker = NULL;
+	g_autoptr(GPtrArray) victims = NULL;
+
+	g_return_val_if_fail (GS_IS_CACHE_MANAGER (self), FALSE);
+
+	evict_locker = g_mutex_locker_new (&self->evict_mutex);
+
+	gs_cache_manager_ensure_loaded (self);
+
+	g_mutex_lock (&self->mutex);
+	needs_scan = self->needs_scan;
+	self->needs_scan = FALSE;
+	g_mutex_unlock (&self->mutex);
+
+	if (needs_scan)
+		gs_cache_manager_scan (self, cancellable);
+
+	g_mutex_lock (&self->mutex);
+	victims = gs_cache_manager_take_victims_unlocked (self);
+	g_mutex_unlock (&self->mutex);
+
+	for (guint i = 0; i < victims->len; i++) {
+		g_autofree gchar *filename = NULL;
+
+		filename = g_build_filename (self->cache_dir,
+					     g_ptr_array_index (victims, i),
+					     NULL);
+		if (g_unlink (filename) != 0 && errno != ENOENT)
+			g_debug ("failed to evict %s: %s", filename, g_strerror (errno));
+	}
+	if (victims->len > 0)
+		g_debug ("evicted %u files from %s", victims->len, self->cache_dir);
+
+	if (g_cancellable_set_error_if_cancelled (cancellable, error))
+		return FALSE;
+
+	return gs_cache_manager_save_index (self, error);
+}
+
+static void
+gs_cache_manager_maintenance_thread_cb (GTask *task,
+					gpointer source_object,
+					gpointer task_data,
+					GCancellable *cancellable)
+{
+	GsCacheManager *self = GS_CACHE_MANAGER (source_object);
+	g_autoptr(GError) error_local = NULL;
+
+	/* changes from now on need another run */
+	g_mutex_lock (&self->mutex);
+	self->maintenance_queued = FALSE;
+	g_mutex_unlock (&self->mutex);
+
+	if (!gs_cache_manager_evict (self, cancellable, &error_local))
+		g_warning ("Failed to maintain cache %s: %s", self->cache_dir, error_local->message);
+	g_task_return_boolean (task, TRUE);
+}
+
+static void
+gs_cache_manager_maybe_queue_maintenance_unlocked (GsCacheManager *self)
+{
+	g_autoptr(GTask) task = NULL;
+
+	if (self->maintenance_queued)
+		return;
+	if (self->loaded &&
+	    !self->needs_scan &&
+	    (self->max_size == 0 || self->size <= self->max_size) &&
+	    !(self->dirty && g_get_monotonic_time () - self->last_save_time >= GS_CACHE_MANAGER_SAVE_INTERVAL))
+		return;
+
+	self->maintenance_queued = TRUE;
+	task = g_task_new (self, NULL, NULL, NULL);
+	g_task_set_source_tag (task, gs_cache_manager_maybe_queue_maintenance_unlocked);
+	g_task_run_in_thread (task, gs_cache_manager_maintenance_thread_cb);
+}
+
+static gchar *
+gs_cache_manager_get_shard (const gchar *basename)
+{
+	g_autofree gchar *checksum = NULL;
+
+	/* the basenames are usually prefixed with a checksum already */
+	if (g_ascii_isxdigit (basename[0]) && g_ascii_isxdigit (basename[1]))
+		return g_ascii_strdown (basename, 2);
+
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, basename, -1);
+	return g_strndup (checksum, 2);
+}
+
+/**
+ * gs_cache_manager_get_filename:
+ * @self: a #GsCacheManager
+ * @kind: a cache kind, e.g. "icons" or "screenshots/624x351"
+ * @basename: the basename of the file, ideally prefixed with a checksum
+ * @flags: some #GsUtilsCacheFlags, e.g. %GS_UTILS_CACHE_FLAG_WRITEABLE
+ * @error: a #GError, or %NULL
+ *
+ * Returns the filename to use for @basename in the cache, as
+ * gs_utils_get_cache_filename() does, but in a subdirectory of @kind named
+ * after the first two characters of @basename.
+ *
+ * This can only fail if %GS_UTILS_CACHE_FLAG_ENSURE_EMPTY or
+ * %GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY are passed in @flags.
+ *
+ * Returns: the full path and filename, which may or may not exist, or %NULL
+ *
+ * Since: 44
+ **/
+gchar *
+gs_cache_manager_get_filename (GsCacheManager *self,
+			       const gchar *kind,
+			       const gchar *basename,
+			       GsUtilsCacheFlags flags,
+			       GError **error)
+{
+	g_autofree gchar *shard = NULL;
+	g_autofree gchar *sharded_kind = NULL;
+
+	g_return_val_if_fail (GS_IS_CACHE_MANAGER (self), NULL);
+	g_return_val_if_fail (kind != NULL, NULL);
+	g_return_val_if_fail (basename != NULL && basename[0] != '\0', NULL);
+
+	shard = gs_cache_manager_get_shard (basename);
+	sharded_kind = g_build_filename (kind, shard, NULL);
+	return gs_utils_get_cache_filename (sharded_kind, basename, flags, error);
+}
+
+/**
+ * gs_cache_manager_note_hit:
+ * @self: a #GsCacheManager
+ * @filename: the cached file which was found
+ *
+ * Records that @filename was found in the cache and is about to be used,
+ * so it is not evicted before less recently used files.
+ *
+ * Since: 44
+ **/
+void
+gs_cache_manager_note_hit (GsCacheManager *self,
+			   const gchar *filename)
+{
+	const gchar *relative_path;
+	GsCacheEntry *entry;
+
+	g_return_if_fail (GS_IS_CACHE_MANAGER (self));
+	g_return_if_fail (filename != NULL);
+
+	relative_path = gs_cache_manager_get_relative_path (self, filename);
+
+	g_mutex_lock (&self->mutex);
+	self->n_hits++;
+	if (relative_path == NULL) {
+		g_mutex_unlock (&self->mutex);
+		return;
+	}
+	entry = g_hash_table_lookup (self->entries, relative_path);
+	if (entry != NULL) {
+		entry->atime = g_get_real_time ();
+		self->dirty = TRUE;
+		gs_cache_manager_maybe_queue_maintenance_unlocked (self);
+	}
+	g_mutex_unlock (&self->mutex);
+
+	/* not known yet, e.g. before the index is loaded */
+	if (entry == NULL)
+		gs_cache_manager_add_file (self, filename);
+}
+
+/**
+ * gs_cache_manager_note_miss:
+ * @self: a #GsCacheManager
+ *
+ * Records that a file was not found in the cache and has to be downloaded.
+ *
+ * Since: 44
+ **/
+void
+gs_cache_manager_note_miss (GsCacheManager *self)
+{
+	g_return_if_fail (GS_IS_CACHE_MANAGER (self));
+
+	g_mutex_lock (&self->mutex);
+	self->n_misses++;
+	g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * gs_cache_manager_add_file:
+ * @self: a #GsCacheManager
+ * @filename: a file which has just been written to the cache
+ *
+ * Adds @filename to the index, or updates its size if it is already known.
+ * Least recently used files are evicted in the background if this takes the
+ * cache over its maximum size.
+ *
+ * Files outside the cache directory of @self are ignored.
+ *
+ * Since: 44
+ **/
+void
+gs_cache_manager_add_file (GsCacheManager *self,
+			   const gchar *filename)
+{
+	const gchar *relative_path;
+	GStatBuf st;
+
+	g_return_if_fail (GS_IS_CACHE_MANAGER (self));
+	g_return_if_fail (filename != NULL);
+
+	relative_path = gs_cache_manager_get_relative_path (self, filename);
+	if (relative_path == NULL)
+		return;
+	if (g_stat (filename, &st) != 0 || !S_ISREG (st.st_mode))
+		return;
+
+	g_mutex_lock (&self->mutex);
+	gs_cache_manager_insert_unlocked (self, relative_path,
+					  g_get_real_time (),
+					  (guint64) st.st_size);
+	self->dirty = TRUE;
+	gs_cache_manager_maybe_queue_maintenance_unlocked (self);
+	g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * gs_cache_manager_get_max_size:
+ * @self: a #GsCacheManager
+ *
+ * Gets the maximum total size of the cached files.
+ *
+ * Returns: size in bytes, or 0 for no limit
+ *
+ * Since: 44
+ **/
+guint64
+gs_cache_manager_get_max_size (GsCacheManager *self)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_CACHE_MANAGER (self), 0);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	return self->max_size;
+}
+
+/**
+ * gs_cache_manager_set_max_size:
+ * @self: a #GsCacheManager
+ * @max_size: size in bytes, or 0 for no limit
+ *
+ * Sets the maximum total size of the cached files. If the cache is larger
+ * than this, files are evicted in the background.
+ *
+ * Since: 44
+ **/
+void
+gs_cache_manager_set_max_size (GsCacheManager *self,
+			       guint64 max_size)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_CACHE_MANAGER (self));
+
+	locker = g_mutex_locker_new (&self->mutex);
+	self->max_size = max_size;
+	gs_cache_manager_maybe_queue_maintenance_unlocked (self);
+}
+
+/**
+ * gs_cache_manager_get_stats:
+ * @self: a #GsCacheManager
+ * @out_n_hits: (out) (optional): return location for the number of cache hits
+ * @out_n_misses: (out) (optional): return location for the number of cache misses
+ * @out_n_evicted: (out) (optional): return location for the number of evicted files
+ * @out_size: (out) (optional): return location for the total size in bytes
+ *
+ * Gets statistics about the use of the cache since @self was created.
+ *
+ * Since: 44
+ **/
+void
+gs_cache_manager_get_stats (GsCacheManager *self,
+			    guint64 *out_n_hits,
+			    guint64 *out_n_misses,
+			    guint64 *out_n_evicted,
+			    guint64 *out_size)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_CACHE_MANAGER (self));
+
+	locker = g_mutex_locker_new (&self->mutex);
+	if (out_n_hits != NULL)
+		*out_n_hits = self->n_hits;
+	if (out_n_misses != NULL)
+		*out_n_misses = self->n_misses;
+	if (out_n_evicted != NULL)
+		*out_n_evicted = self->n_evicted;
+	if (out_size != NULL)
+		*out_size = self->size;
+}
@@ -0,0 +1,60 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2023 GNOME Software contributors
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gio/gio.h>
+
+#include "gs-utils.h"
+
+G_BEGIN_DECLS
+
+/**
+ * GS_CACHE_MANAGER_DEFAULT_MAX_SIZE:
+ *
+ * The default maximum size of the managed cache files, in bytes.
+ *
+ * Since: 44
+ */
+#define GS_CACHE_MANAGER_DEFAULT_MAX_SIZE (512 * 1024 * 1024)
+
+#define GS_TYPE_CACHE_MANAGER (gs_cache_manager_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsCacheManager, gs_cache_manager, GS, CACHE_MANAGER, GObject)
+
+GsCacheManager	*gs_cache_manager_new		(const gchar		*cache_dir);
+GsCacheManager	*gs_cache_manager_get_default	(void);
+
+gchar		*gs_cache_manager_get_filename	(GsCacheManager		*self,
+						 const gchar		*kind,
+						 const gchar		*basename,
+						 GsUtilsCacheFlags	 flags,
+						 GError			**error);
+void		 gs_cache_manager_note_hit	(GsCacheManager		*self,
+						 const gchar		*filename);
+void		 gs_cache_manager_note_miss	(GsCacheManager		*self);
+void		 gs_cache_manager_add_file	(GsCacheManager		*self,
+						 const gchar		*filename);
+
+guint64		 gs_cache_manager_get_max_size	(GsCacheManager		*self);
+void		 gs_cache_manager_set_max_size	(GsCacheManager		*self,
+						 guint64		 max_size);
+
+gboolean	 gs_cache_manager_evict		(GsCacheManager		*self,
+						 GCancellable		*cancellable,
+						 GError			**error);
+
+void		 gs_cache_manager_get_stats	(GsCacheManager		*self,
+						 guint64		*out_n_hits,
+						 guint64		*out_n_misses,
+						 guint64		*out_n_evicted,
+						 guint64		*out_size);
+
+G_END_DECLS
@@ -112,20 +112,26 @@ typedef struct {
 	int io_priority;
 	GsDownloadProgressCallback progress_callback;  /* (nullable) */
 	gpointer progress_user_data;
+	gboolean resumable;
+	goffset resume_offset;  /* bytes already in the output stream */
+	gchar *resume_validator;  /* (nullable) (owned) */
 
 	/* In-progress state. */
 	SoupMessage *message;  /* (nullable) (owned) */
+	gboolean response_received;
 	gboolean close_input_stream;
 	gboolean close_output_stream;
 	gboolean discard_output_stream;
 	gsize total_read_bytes;
 	gsize total_written_bytes;
 	gsize expected_stream_size_bytes;
+	gsize expected_end_bytes;  /* 0 if unknown */
 	GBytes *currently_unwritten_chunk;  /* (nullable) (owned) */
 
 	/* Output data. */
 	gchar *new_etag;  /* (nullable) (owned) */
 	GDateTime *new_last_modified_date;  /* (nullable) (owned) */
+	gchar *range_validator;  /* (nullable) (owned) */
 	GError *error;  /* (nullable) (owned) */
 } DownloadData;
 
@@ -142,10 +148,12 @@ download_data_free (DownloadData *data)
 
 	g_clear_pointer (&data->last_etag, g_free);
 	g_clear_pointer (&data->last_modified_date, g_date_time_unref);
+	g_clear_pointer (&data->resume_validator, g_free);
 	g_clear_object (&data->message);
 	g_clear_pointer (&data->uri, g_free);
 	g_clear_pointer (&data->new_etag, g_free);
 	g_clear_pointer (&data->new_last_modified_date, g_date_time_unref);
+	g_clear_pointer (&data->range_validator, g_free);
 	g_clear_pointer (&data->currently_unwritten_chunk, g_bytes_unref);
 	g_clear_error (&data->error);
 
@@ -169,6 +177,20 @@ static void close_stream_cb (GObject      *source_object,
                              GAsyncResult *result,
                              gpointer      user_data);
 static void download_progress (GTask *task);
+static void download_stream_internal_async (SoupSession                *soup_session,
+                                            const gchar                *uri,
+                                            GOutputStream              *output_stream,
+                                            const gchar                *last_etag,
+                                            GDateTime                  *last_modified_date,
+                                            gboolean                    resumable,
+                                            goffset                     resume_offset,
+                                            const gchar                *resume_validator,
+                                            int                         io_priority,
+                                            GsDownloadProgressCallback  progress_callback,
+                                            gpointer                    progress_user_data,
+                                            GCancellable               *cancellable,
+                                            GAsyncReadyCallback         callback,
+                                            gpointer                    user_data);
 
 /**
  * gs_download_stream_async:
@@ -214,10 +236,43 @@ gs_download_stream_async (SoupSession                *soup_session,
                           GCancellable               *cancellable,
                           GAsyncReadyCallback         callback,
                           gpointer                    user_data)
+{
+	download_stream_internal_async (soup_session, uri, output_stream,
+					last_etag, last_modified_date,
+					FALSE, 0, NULL,
+					io_priority, progress_callback, progress_user_data,
+					cancellable, callback, user_data);
+}
+
+/* As gs_download_stream_async(), but if @resumable is set, the download is
+ * done so that it can be continued later by appending to the same output.
+ *
+ * @output_stream must already contain @resume_offset bytes of an earlier
+ * download of @uri. If @resume_validator (the ETag or Last-Modified value the
+ * server sent with those bytes) is set, only the rest of the file is requested.
+ * If the server sends the whole file instead, @output_stream is truncated and
+ * the download starts from the beginning, so it must be seekable if
+ * @resume_offset is non-zero. */
+static void
+download_stream_internal_async (SoupSession                *soup_session,
+                                const gchar                *uri,
+                                GOutputStream              *output_stream,
+                                const gchar                *last_etag,
+                                GDateTime                  *last_modified_date,
+                                gboolean                    resumable,
+                                goffset                     resume_offset,
+                                const gchar                *resume_validator,
+                                int                         io_priority,
+                                GsDownloadProgressCallback  progress_callback,
+                                gpointer                    progress_user_data,
+                                GCancellable               *cancellable,
+                                GAsyncReadyCallback         callback,
+                                gpointer                    user_data)
 {
 	g_autoptr(GTask) task = NULL;
 	g_autoptr(GError) local_error = NULL;
 	g_autoptr(SoupMessage) msg = NULL;
+	SoupMessageHeaders *request_headers;
 	DownloadData *data;
 	g_autoptr(DownloadData) data_owned = NULL;
 
@@ -237,6 +292,9 @@ gs_download_stream_async (SoupSession                *soup_session,
 	data->io_priority = io_priority;
 	data->progress_callback = progress_callback;
 	data->progress_user_data = progress_user_data;
+	data->resumable = resumable;
+	data->resume_offset = resume_offset;
+	data->resume_validator = g_strdup (resume_validator);
 
 	g_task_set_task_data (task, g_steal_pointer (&data_owned), (GDestroyNotify) download_data_free);
 
@@ -260,6 +318,12 @@ gs_download_stream_async (SoupSession                *soup_session,
 
 	data->message = g_object_ref (msg);
 
+#if SOUP_CHECK_VERSION(3, 0, 0)
+	request_headers = soup_message_get_request_headers (msg);
+#else
+	request_headers = msg->request_headers;
+#endif
+
 	/* Caching support. Prefer ETags to modification dates, as the latter
 	 * have problems with rapid updates and clock drift. */
 	if (last_etag != NULL && *last_etag == '\0')
@@ -270,18 +334,25 @@ gs_download_stream_async (SoupSession                *soup_session,
 		data->last_modified_date = g_date_time_ref (last_modified_date);
 
 	if (last_etag != NULL) {
-#if SOUP_CHECK_VERSION(3, 0, 0)
-		soup_message_headers_append (soup_message_get_request_headers (msg), "If-None-Match", last_etag);
-#else
-		soup_message_headers_append (msg->request_headers, "If-None-Match", last_etag);
-#endif
+		soup_message_headers_append (request_headers, "If-None-Match", last_etag);
 	} else if (last_modified_date != NULL) {
 		g_autofree gchar *last_modified_date_str = date_time_to_rfc7231 (last_modified_date);
-#if SOUP_CHECK_VERSION(3, 0, 0)
-		soup_message_headers_append (soup_message_get_request_headers (msg), "If-Modified-Since", last_modified_date_str);
-#else
-		soup_message_headers_append (msg->request_headers, "If-Modified-Since", last_modified_date_str);
-#endif
+		soup_message_headers_append (request_headers, "If-Modified-Since", last_modified_date_str);
+	}
+
+	/* Resuming support. Byte ranges have to refer to the bytes which end
+	 * up in @output_stream, so don’t let the server apply a content coding
+	 * which #SoupSession would then decode. If-Range makes the server send
+	 * the whole file if it has changed since the earlier bytes were sent. */
+	if (resumable) {
+		soup_message_headers_replace (request_headers, "Accept-Encoding", "identity");
+
+		if (resume_offset > 0 && resume_validator != NULL) {
+			g_debug ("Resuming download of %s from byte %" G_GOFFSET_FORMAT,
+				 uri, resume_offset);
+			soup_message_headers_set_range (request_headers, resume_offset, -1);
+			soup_message_headers_append (request_headers, "If-Range", resume_validator);
+		}
 	}
 
 #if SOUP_CHECK_VERSION(3, 0, 0)
@@ -291,6 +362,56 @@ gs_download_stream_async (SoupSession                *soup_session,
 #endif
 }
 
+/* The server didn’t send the part of the file which was asked for, so throw
+ * away what was downloaded before and start again from the beginning. */
+static gboolean
+restart_output_stream (DownloadData  *data,
+                       GCancellable  *cancellable,
+                       GError       **error)
+{
+	if (data->resume_offset == 0)
+		return TRUE;
+
+	if (!G_IS_SEEKABLE (data->output_stream) ||
+	    !g_seekable_can_truncate (G_SEEKABLE (data->output_stream))) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+			     "Failed to restart download of ‘%s’: output can’t be truncated",
+			     data->uri);
+		return FALSE;
+	}
+
+	g_debug ("Restarting download of %s from the beginning", data->uri);
+
+	if (!g_seekable_truncate (G_SEEKABLE (data->output_stream), 0, cancellable, error))
+		return FALSE;
+
+	data->resume_offset = 0;
+
+	return TRUE;
+}
+
+/* Whether the body of a response is stored byte-for-byte as it was sent. */
+static gboolean
+is_identity_encoded (SoupMessageHeaders *response_headers)
+{
+	const gchar *content_encoding = soup_message_headers_get_one (response_headers, "Content-Encoding");
+
+	return (content_encoding == NULL ||
+		*content_encoding == '\0' ||
+		g_ascii_strcasecmp (content_encoding, "identity") == 0);
+}
+
+/* Get a validator to send in If-Range when resuming the download later.
+ * Only strong validators may be used, so weak ETags are ignored. */
+static gchar *
+get_range_validator (const gchar *etag,
+                     const gchar *last_modified_str)
+{
+	if (etag != NULL && !g_str_has_prefix (etag, "W/"))
+		return g_strdup (etag);
+	return g_strdup (last_modified_str);
+}
+
 static void
 open_input_stream_cb (GObject      *source_object,
                       GAsyncResult *result,
@@ -320,8 +441,15 @@ open_input_stream_cb (GObject      *source_object,
 		g_assert (data->input_stream == NULL);
 		data->input_stream = g_object_ref (input_stream);
 		data->close_input_stream = TRUE;
+		data->response_received = TRUE;
+
+		if (!restart_output_stream (data, cancellable, &local_error)) {
+			finish_download (task, g_steal_pointer (&local_error));
+			return;
+		}
 	} else if (SOUP_IS_SESSION (source_object)) {
 		SoupSession *soup_session = SOUP_SESSION (source_object);
+		SoupMessageHeaders *response_headers;
 		guint status_code;
 		const gchar *new_etag, *new_last_modified_str;
 
@@ -329,11 +457,17 @@ open_input_stream_cb (GObject      *source_object,
 #if SOUP_CHECK_VERSION(3, 0, 0)
 		input_stream = soup_session_send_finish (soup_session, result, &local_error);
 		status_code = soup_message_get_status (data->message);
+		response_headers = soup_message_get_response_headers (data->message);
 #else
 		input_stream = soup_session_send_finish (soup_session, result, &local_error);
 		status_code = data->message->status_code;
+		response_headers = data->message->response_headers;
 #endif
 
+		/* Lower status codes are transport errors, where the server
+		 * never got to respond. */
+		data->response_received = (status_code >= 100);
+
 		if (input_stream != NULL) {
 			g_assert (data->input_stream == NULL);
 			data->input_stream = g_object_ref (input_stream);
@@ -356,7 +490,8 @@ open_input_stream_cb (GObject      *source_object,
 						      "Skipped downloading ‘%s’: %s",
 						      data->uri, soup_status_get_phrase (status_code)));
 			return;
-		} else if (status_code != SOUP_STATUS_OK) {
+		} else if (status_code != SOUP_STATUS_OK &&
+			   !(status_code == SOUP_STATUS_PARTIAL_CONTENT && data->resume_offset > 0)) {
 			g_autoptr(GString) str = g_string_new (NULL);
 			g_string_append (str, soup_status_get_phrase (status_code));
 
@@ -376,32 +511,56 @@ open_input_stream_cb (GObject      *source_object,
 		g_assert (input_stream != NULL);
 
 		/* Get the expected download size. */
-#if SOUP_CHECK_VERSION(3, 0, 0)
-		data->expected_stream_size_bytes = soup_message_headers_get_content_length (soup_message_get_response_headers (data->message));
-#else
-		data->expected_stream_size_bytes = soup_message_headers_get_content_length (data->message->response_headers);
-#endif
+		data->expected_stream_size_bytes = soup_message_headers_get_content_length (response_headers);
 
 		/* Store the new ETag for later use. */
-#if SOUP_CHECK_VERSION(3, 0, 0)
-		new_etag = soup_message_headers_get_one (soup_message_get_response_headers (data->message), "ETag");
-#else
-		new_etag = soup_message_headers_get_one (data->message->response_headers, "ETag");
-#endif
+		new_etag = soup_message_headers_get_one (response_headers, "ETag");
 		if (new_etag != NULL && *new_etag == '\0')
 			new_etag = NULL;
 		data->new_etag = g_strdup (new_etag);
 
 		/* Store the Last-Modified date for later use. */
-#if SOUP_CHECK_VERSION(3, 0, 0)
-		new_last_modified_str = soup_message_headers_get_one (soup_message_get_response_headers (data->message), "Last-Modified");
-#else
-		new_last_modified_str = soup_message_headers_get_one (data->message->response_headers, "Last-Modified");
-#endif
+		new_last_modified_str = soup_message_headers_get_one (response_headers, "Last-Modified");
 		if (new_last_modified_str != NULL && *new_last_modified_str == '\0')
 			new_last_modified_str = NULL;
 		if (new_last_modified_str != NULL)
 			data->new_last_modified_date = date_time_from_rfc7231 (new_last_modified_str);
+
+		if (status_code == SOUP_STATUS_PARTIAL_CONTENT) {
+			goffset range_start, range_end, range_total;
+
+			/* Only append the range if it continues exactly where
+			 * the earlier bytes stopped, and runs to the end of the
+			 * file. */
+			if (!soup_message_headers_get_content_range (response_headers, &range_start, &range_end, &range_total) ||
+			    range_start != data->resume_offset ||
+			    range_total <= 0 ||
+			    range_end + 1 != range_total ||
+			    !is_identity_encoded (response_headers)) {
+				finish_download (task,
+						 g_error_new (G_IO_ERROR,
+							      G_IO_ERROR_INVALID_DATA,
+							      "Failed to resume download of ‘%s’: unexpected range returned",
+							      data->uri));
+				return;
+			}
+
+			data->total_read_bytes = data->resume_offset;
+			data->total_written_bytes = data->resume_offset;
+			data->expected_stream_size_bytes = range_total;
+		} else if (!restart_output_stream (data, cancellable, &local_error)) {
+			finish_download (task, g_steal_pointer (&local_error));
+			return;
+		}
+
+		/* Remember how to resume the download if it is interrupted,
+		 * and how long it should be once complete. */
+		if (data->resumable && is_identity_encoded (response_headers)) {
+			data->range_validator = get_range_validator (new_etag, new_last_modified_str);
+
+			if (soup_message_headers_get_encoding (response_headers) == SOUP_ENCODING_CONTENT_LENGTH)
+				data->expected_end_bytes = data->total_read_bytes + soup_message_headers_get_content_length (response_headers);
+		}
 	} else {
 		g_assert_not_reached ();
 	}
@@ -444,6 +603,13 @@ read_bytes_cb (GObject      *source_object,
 
 		g_output_stream_write_bytes_async (data->output_stream, bytes, data->io_priority,
 						   cancellable, write_bytes_cb, g_steal_pointer (&task));
+	} else if (data->expected_end_bytes > 0 && data->total_read_bytes != data->expected_end_bytes) {
+		/* Don’t treat a truncated response as a complete file. */
+		finish_download (task,
+				 g_error_new (G_IO_ERROR,
+					      G_IO_ERROR_PARTIAL_INPUT,
+					      "Download of ‘%s’ ended after %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " bytes",
+					      data->uri, data->total_read_bytes, data->expected_end_bytes));
 	} else {
 		finish_download (task, NULL);
 	}
@@ -657,6 +823,25 @@ gs_download_stream_finish (SoupSession   *soup_session,
 	return g_task_propagate_boolean (G_TASK (result), error);
 }
 
+/* Get the validator to resume an interrupted download with. If the server
+ * responded, this is only set if the download was started as resumable and
+ * the response was suitable for resuming. If the server never responded (for
+ * example, if the connection failed or the download was cancelled first),
+ * the output stream hasn’t been touched, so the validator it was resumed
+ * with still applies. */
+static const gchar *
+download_stream_get_range_validator (GAsyncResult *result)
+{
+	DownloadData *data = g_task_get_task_data (G_TASK (result));
+
+	if (!data->response_received)
+		return data->resume_validator;
+
+	return data->range_validator;
+}
+
+#define RANGE_VALIDATOR_ATTRIBUTE "xattr::gnome-software::range-validator"
+
 typedef struct {
 	/* Input data. */
 	gchar *uri;  /* (not nullable) (owned) */
@@ -668,23 +853,74 @@ typedef struct {
 	/* In-progress data. */
 	gchar *last_etag;  /* (nullable) (owned) */
 	GDateTime *last_modified_date;  /* (nullable) (owned) */
+	GFile *partial_file;  /* (not nullable) (owned) */
+	gboolean holds_partial_file;
+	goffset resume_offset;
+	gchar *resume_validator;  /* (nullable) (owned) */
 } DownloadFileData;
 
+/* The partial files which downloads in this process are currently writing
+ * to. A second download of the same output file would append to the same
+ * partial file and corrupt it, so it’s failed instead. */
+static GMutex partial_files_lock;
+static GHashTable *partial_files = NULL;  /* (owned) (element-type GFile) (nullable) (locked-by partial_files_lock) */
+
+static gboolean
+download_file_acquire_partial_file (DownloadFileData  *data,
+                                    GError           **error)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&partial_files_lock);
+
+	if (partial_files == NULL)
+		partial_files = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+						       g_object_unref, NULL);
+
+	if (g_hash_table_contains (partial_files, data->partial_file)) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_BUSY,
+			     "‘%s’ is already being downloaded",
+			     g_file_peek_path (data->output_file));
+		return FALSE;
+	}
+
+	g_hash_table_add (partial_files, g_object_ref (data->partial_file));
+	data->holds_partial_file = TRUE;
+
+	return TRUE;
+}
+
+/* This must be called before the task returns, so the caller can start
+ * another download of the same file from its callback. */
+static void
+download_file_release_partial_file (DownloadFileData *data)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	if (!data->holds_partial_file)
+		return;
+
+	locker = g_mutex_locker_new (&partial_files_lock);
+	g_hash_table_remove (partial_files, data->partial_file);
+	data->holds_partial_file = FALSE;
+}
+
 static void
 download_file_data_free (DownloadFileData *data)
 {
+	download_file_release_partial_file (data);
 	g_free (data->uri);
 	g_clear_object (&data->output_file);
 	g_free (data->last_etag);
 	g_clear_pointer (&data->last_modified_date, g_date_time_unref);
+	g_clear_object (&data->partial_file);
+	g_free (data->resume_validator);
 	g_free (data);
 }
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (DownloadFileData, download_file_data_free)
 
-static void download_replace_file_cb (GObject      *source_object,
-                                      GAsyncResult *result,
-                                      gpointer      user_data);
+static void download_append_file_cb (GObject      *source_object,
+                                     GAsyncResult *result,
+                                     gpointer      user_data);
 static void download_file_cb (GObject      *source_object,
                               GAsyncResult *result,
                               gpointer      user_data);
@@ -708,6 +944,15 @@ static void download_file_cb (GObject      *source_object,
  * The ETag and modification time of @output_file will be queried and, if known,
  * used to skip the download if @output_file is already up to date.
  *
+ * The download is written to a `.partial` file next to @output_file, which
+ * is moved over @output_file once complete. If the download is interrupted,
+ * the partial file is kept, and the next download of @output_file asks the
+ * server only for the rest of it (using `Range` and `If-Range`). If the file
+ * has changed on the server in the meantime, the download starts again.
+ *
+ * Only one download of @output_file can be in progress at once in this
+ * process; starting another fails with %G_IO_ERROR_BUSY.
+ *
  * If specified, @progress_callback will be called zero or more times until
  * @callback is called, providing progress updates on the download.
  *
@@ -728,6 +973,9 @@ gs_download_file_async (SoupSession                *soup_session,
 	DownloadFileData *data;
 	g_autoptr(DownloadFileData) data_owned = NULL;
 	g_autoptr(GFile) output_file_parent = NULL;
+	g_autofree gchar *output_basename = NULL;
+	g_autofree gchar *partial_basename = NULL;
+	g_autoptr(GFileInfo) partial_info = NULL;
 	g_autoptr(GError) local_error = NULL;
 
 	g_return_if_fail (SOUP_IS_SESSION (soup_session));
@@ -763,34 +1011,45 @@ gs_download_file_async (SoupSession                *soup_session,
 	/* Query the old ETag and modification date if the file already exists. */
 	data->last_etag = gs_utils_get_file_etag (output_file, &data->last_modified_date, cancellable);
 
-	/* Create the output file.
-	 *
-	 * Note that `data->last_etag` is *not* passed in here, as the ETag from
-	 * the server and the file modification ETag that GLib uses are
-	 * different things. For g_file_replace_async(), GLib always uses an
-	 * ETag it generates internally based on the file mtime (see
-	 * _g_local_file_info_create_etag()), which will never match what the
-	 * server returns in its ETag header.
-	 *
-	 * This is fine, as we are using the ETag to avoid an unnecessary HTTP
-	 * download if possible. We don’t care about tracking changes to the
-	 * file on disk. */
-	g_file_replace_async (output_file,
-			      NULL,  /* ETag */
-			      FALSE,  /* make_backup */
-			      G_FILE_CREATE_PRIVATE | G_FILE_CREATE_REPLACE_DESTINATION,
-			      io_priority,
-			      cancellable,
-			      download_replace_file_cb,
-			      g_steal_pointer (&task));
+	/* Look for what’s left of an earlier, interrupted download. Any
+	 * content in it which can’t be resumed is truncated once the server
+	 * responds. */
+	output_basename = g_file_get_basename (output_file);
+	partial_basename = g_strconcat (output_basename, ".partial", NULL);
+	data->partial_file = g_file_get_child (output_file_parent, partial_basename);
+
+	if (!download_file_acquire_partial_file (data, &local_error)) {
+		g_task_return_error (task, g_steal_pointer (&local_error));
+		return;
+	}
+
+	partial_info = g_file_query_info (data->partial_file,
+					  G_FILE_ATTRIBUTE_STANDARD_SIZE "," RANGE_VALIDATOR_ATTRIBUTE,
+					  G_FILE_QUERY_INFO_NONE,
+					  cancellable,
+					  NULL);
+	if (partial_info != NULL) {
+		data->resume_offset = g_file_info_get_size (partial_info);
+		data->resume_validator = g_strdup (g_file_info_get_attribute_string (partial_info, RANGE_VALIDATOR_ATTRIBUTE));
+	}
+
+	/* Open the partial file for writing. It’s written to directly, rather
+	 * than through a temporary file as g_file_replace_async() would, so
+	 * that the downloaded bytes are kept if the download is interrupted. */
+	g_file_append_to_async (data->partial_file,
+				G_FILE_CREATE_PRIVATE,
+				io_priority,
+				cancellable,
+				download_append_file_cb,
+				g_steal_pointer (&task));
 }
 
 static void
-download_replace_file_cb (GObject      *source_object,
-                          GAsyncResult *result,
-                          gpointer      user_data)
+download_append_file_cb (GObject      *source_object,
+                         GAsyncResult *result,
+                         gpointer      user_data)
 {
-	GFile *output_file = G_FILE (source_object);
+	GFile *partial_file = G_FILE (source_object);
 	g_autoptr(GTask) task = g_steal_pointer (&user_data);
 	SoupSession *soup_session = g_task_get_source_object (task);
 	GCancellable *cancellable = g_task_get_cancellable (task);
@@ -798,18 +1057,27 @@ download_replace_file_cb (GObject      *source_object,
 	g_autoptr(GFileOutputStream) output_stream = NULL;
 	g_autoptr(GError) local_error = NULL;
 
-	output_stream = g_file_replace_finish (output_file, result, &local_error);
+	output_stream = g_file_append_to_finish (partial_file, result, &local_error);
 
 	if (output_stream == NULL) {
+		download_file_release_partial_file (data);
 		g_task_return_error (task, g_steal_pointer (&local_error));
 		return;
 	}
 
-	/* Do the download. */
-	gs_download_stream_async (soup_session, data->uri, G_OUTPUT_STREAM (output_stream),
-				  data->last_etag, data->last_modified_date, data->io_priority,
-				  data->progress_callback, data->progress_user_data,
-				  cancellable, download_file_cb, g_steal_pointer (&task));
+	/* Do the download.
+	 *
+	 * Note that `data->last_etag` is the ETag from the server, stored
+	 * by gs_utils_set_file_etag(), rather than the file modification ETag
+	 * that GLib generates internally based on the file mtime (see
+	 * _g_local_file_info_create_etag()), which will never match what the
+	 * server returns in its ETag header. */
+	download_stream_internal_async (soup_session, data->uri, G_OUTPUT_STREAM (output_stream),
+					data->last_etag, data->last_modified_date,
+					TRUE, data->resume_offset, data->resume_validator,
+					data->io_priority,
+					data->progress_callback, data->progress_user_data,
+					cancellable, download_file_cb, g_steal_pointer (&task));
 }
 
 static void
@@ -821,10 +1089,37 @@ download_file_cb (GObject      *source_object,
 	g_autoptr(GTask) task = g_steal_pointer (&user_data);
 	GCancellable *cancellable = g_task_get_cancellable (task);
 	DownloadFileData *data = g_task_get_task_data (task);
+	const gchar *range_validator = download_stream_get_range_validator (result);
 	g_autofree gchar *new_etag = NULL;
 	g_autoptr(GError) local_error = NULL;
 
 	if (!gs_download_stream_finish (soup_session, result, &new_etag, NULL, &local_error)) {
+		/* Keep the partial file if the download can be resumed from
+		 * it, along with the validator to resume it with. It’s only
+		 * deleted if the server’s response means it can’t be resumed.
+		 * The task’s cancellable may have been cancelled, so isn’t
+		 * used here. */
+		if (range_validator == NULL ||
+		    g_error_matches (local_error, GS_DOWNLOAD_ERROR, GS_DOWNLOAD_ERROR_NOT_MODIFIED) ||
+		    !g_file_set_attribute_string (data->partial_file, RANGE_VALIDATOR_ATTRIBUTE, range_validator,
+						  G_FILE_QUERY_INFO_NONE, NULL, NULL))
+			g_file_delete (data->partial_file, NULL, NULL);
+
+		download_file_release_partial_file (data);
+		g_task_return_error (task, g_steal_pointer (&local_error));
+		return;
+	}
+
+	/* Move the complete download into place. The move is a rename, so it’s
+	 * fast enough to not need to be async. */
+	g_file_set_attribute (data->partial_file, RANGE_VALIDATOR_ATTRIBUTE, G_FILE_ATTRIBUTE_TYPE_INVALID,
+			      NULL, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+
+	if (!g_file_move (data->partial_file, data->output_file, G_FILE_COPY_OVERWRITE,
+			  cancellable, NULL, NULL, &local_error)) {
+		g_prefix_error (&local_error, "Failed to move ‘%s’ into place: ",
+				g_file_peek_path (data->partial_file));
+		download_file_release_partial_file (data);
 		g_task_return_error (task, g_steal_pointer (&local_error));
 		return;
 	}
@@ -842,6 +1137,7 @@ download_file_cb (GObject      *source_object,
 	 * the file. */
 	gs_utils_set_file_etag (data->output_file, new_etag, cancellable);
 
+	download_file_release_partial_file (data);
 	g_task_return_boolean (task, TRUE);
 }
 
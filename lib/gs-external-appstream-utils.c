@@ -16,10 +16,16 @@
  * them locally.
  *
  * According to the `external-appstream-system-wide` GSetting, the files will
- * either be downloaded to a per-user cache, or to a system-wide cache. In the
- * case of a system-wide cache, they are downloaded to a temporary file writable
- * by the user, and then the suexec binary `gnome-software-install-appstream` is
- * run to copy them to the system location.
+ * either be downloaded to a per-user cache, or to a system-wide cache. They are
+ * downloaded with gs_download_file_async() to a file in the user’s cache,
+ * which is kept so later downloads can be conditional or resumed. In the case
+ * of a system-wide cache, the suexec binary `gnome-software-install-appstream`
+ * is then run to copy them to the system location; otherwise they are copied
+ * into the per-user cache.
+ *
+ * A checksum of the (decompressed) content is computed once downloaded. If
+ * it matches the checksum of the previous download, the cached file is left
+ * untouched, so the appstream plugin doesn’t have to parse it again.
  *
  * All the downloads are done in the default #GMainContext for the thread which
  * calls gs_external_appstream_refresh_async(). They are done in parallel and
@@ -53,6 +59,7 @@
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
 #include <libsoup/soup.h>
+#include <string.h>
 
 #include "gs-external-appstream-utils.h"
 
@@ -83,14 +90,50 @@ gs_external_appstream_utils_get_system_dir (void)
 	return APPSTREAM_SYSTEM_DIR;
 }
 
+#define CONTENT_CHECKSUM_ATTRIBUTE "xattr::gnome-software::content-checksum"
+#define CHECKED_AT_ATTRIBUTE "xattr::gnome-software::checked-at"
+
+/* Whether @appstream_file is older than @cache_age_secs, counting from when it
+ * was last found to be up to date, as recorded on @annotated_file. An
+ * unchanged file isn’t touched, so its modification time alone would make
+ * it look out of date forever. */
 static gboolean
 gs_external_appstream_check (GFile   *appstream_file,
+                             GFile   *annotated_file,
                              guint64  cache_age_secs)
 {
 	guint64 appstream_file_age = gs_utils_get_file_age (appstream_file);
+	g_autoptr(GFileInfo) info = NULL;
+	const gchar *checked_at_str;
+	guint64 checked_at, now;
+
+	if (appstream_file_age == G_MAXUINT64)
+		return TRUE;
+
+	info = g_file_query_info (annotated_file, CHECKED_AT_ATTRIBUTE, G_FILE_QUERY_INFO_NONE,
+				  NULL, NULL);
+	checked_at_str = (info != NULL) ? g_file_info_get_attribute_string (info, CHECKED_AT_ATTRIBUTE) : NULL;
+	now = (guint64) g_get_real_time () / G_USEC_PER_SEC;
+	if (checked_at_str != NULL &&
+	    g_ascii_string_to_unsigned (checked_at_str, 10, 0, now, &checked_at, NULL))
+		appstream_file_age = MIN (appstream_file_age, now - checked_at);
+
 	return appstream_file_age >= cache_age_secs;
 }
 
+/* Record that @annotated_file’s AppStream file has just been found to be up
+ * to date, without changing its modification time. */
+static void
+gs_external_appstream_set_checked (GFile        *annotated_file,
+                                   GCancellable *cancellable)
+{
+	g_autofree gchar *now_str = NULL;
+
+	now_str = g_strdup_printf ("%" G_GINT64_FORMAT, g_get_real_time () / G_USEC_PER_SEC);
+	g_file_set_attribute_string (annotated_file, CHECKED_AT_ATTRIBUTE, now_str,
+				     G_FILE_QUERY_INFO_NONE, cancellable, NULL);
+}
+
 static gboolean
 gs_external_appstream_install (const gchar   *appstream_file,
                                GCancellable  *cancellable,
@@ -110,12 +153,68 @@ gs_external_appstream_install (const gchar   *appstream_file,
 	return g_subprocess_wait_check (subprocess, cancellable, error);
 }
 
-static void download_replace_file_cb (GObject      *source_object,
-				      GAsyncResult *result,
-				      gpointer      user_data);
-static void download_stream_cb (GObject      *source_object,
-                                GAsyncResult *result,
-                                gpointer      user_data);
+/* Compute a checksum of the AppStream content in @file. Compressed files are
+ * checksummed after decompression, as recompressing an unchanged file (with a
+ * new timestamp in its gzip header, for example) doesn’t change what the
+ * appstream plugin would build from it. */
+static gchar *
+gs_external_appstream_compute_content_checksum (GFile         *file,
+                                                GCancellable  *cancellable,
+                                                GError       **error)
+{
+	g_autoptr(GFileInputStream) file_stream = NULL;
+	g_autoptr(GInputStream) stream = NULL;
+	g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+	guint8 buf[8192];
+	gssize n_read;
+
+	file_stream = g_file_read (file, cancellable, error);
+	if (file_stream == NULL)
+		return NULL;
+
+	/* Only gzip is supported, as that’s the only compression the
+	 * appstream plugin loads external files with. */
+	n_read = g_input_stream_read (G_INPUT_STREAM (file_stream), buf, 2, cancellable, error);
+	if (n_read < 0 ||
+	    !g_seekable_seek (G_SEEKABLE (file_stream), 0, G_SEEK_SET, cancellable, error))
+		return NULL;
+
+	if (n_read == 2 && buf[0] == 0x1f && buf[1] == 0x8b) {
+		g_autoptr(GZlibDecompressor) decompressor = g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+		stream = g_converter_input_stream_new (G_INPUT_STREAM (file_stream), G_CONVERTER (decompressor));
+	} else {
+		stream = G_INPUT_STREAM (g_object_ref (file_stream));
+	}
+
+	while ((n_read = g_input_stream_read (stream, buf, sizeof (buf), cancellable, error)) > 0)
+		g_checksum_update (checksum, buf, n_read);
+	if (n_read < 0)
+		return NULL;
+
+	return g_strdup (g_checksum_get_string (checksum));
+}
+
+static gchar *
+gs_external_appstream_get_content_checksum (GFile        *file,
+                                            GCancellable *cancellable)
+{
+	g_autoptr(GFileInfo) info = NULL;
+
+	info = g_file_query_info (file, CONTENT_CHECKSUM_ATTRIBUTE, G_FILE_QUERY_INFO_NONE,
+				  cancellable, NULL);
+	if (info == NULL)
+		return NULL;
+
+	return g_strdup (g_file_info_get_attribute_string (info, CONTENT_CHECKSUM_ATTRIBUTE));
+}
+
+static void download_file_cb (GObject      *source_object,
+                              GAsyncResult *result,
+                              gpointer      user_data);
+static void install_file_thread_cb (GTask        *task,
+                                    gpointer      source_object,
+                                    gpointer      task_data,
+                                    GCancellable *cancellable);
 
 /* A tuple to store the last-received progress data for a single download.
  * Each download (refresh_url_async()) has a pointer to the relevant
@@ -132,13 +231,13 @@ typedef struct {
 	gchar *url;  /* (not nullable) (owned) */
 	GTask *task;  /* (not nullable) (owned) */
 	GFile *output_file;  /* (not nullable) (owned) */
+	GFile *target_file;  /* (not nullable) (owned) */
 	ProgressTuple *progress_tuple;  /* (not nullable) */
 	SoupSession *soup_session;  /* (not nullable) (owned) */
 	gboolean system_wide;
 
 	/* In-progress data. */
-	gchar *last_etag;  /* (nullable) (owned) */
-	GDateTime *last_modified_date;  /* (nullable) (owned) */
+	gchar *last_checksum;  /* (nullable) (owned) */
 } DownloadAppStreamData;
 
 static void
@@ -147,9 +246,9 @@ download_appstream_data_free (DownloadAppStreamData *data)
 	g_free (data->url);
 	g_clear_object (&data->task);
 	g_clear_object (&data->output_file);
+	g_clear_object (&data->target_file);
 	g_clear_object (&data->soup_session);
-	g_free (data->last_etag);
-	g_clear_pointer (&data->last_modified_date, g_date_time_unref);
+	g_free (data->last_checksum);
 	g_free (data);
 }
 
@@ -186,8 +285,9 @@ refresh_url_async (GSettings           *settings,
 	g_autofree gchar *hash = NULL;
 	g_autofree gchar *target_file_path = NULL;
 	g_autoptr(GFile) target_file = NULL;
-	g_autoptr(GFile) tmp_file_parent = NULL;
+	g_autoptr(GFile) target_file_parent = NULL;
 	g_autoptr(GFile) tmp_file = NULL;
+	g_autofree gchar *tmp_file_path = NULL;
 	g_autoptr(GsApp) app_dl = gs_app_new ("external-appstream");
 	g_autoptr(GError) local_error = NULL;
 	DownloadAppStreamData *data;
@@ -239,7 +339,28 @@ refresh_url_async (GSettings           *settings,
 
 	target_file = g_file_new_for_path (target_file_path);
 
-	if (!gs_external_appstream_check (target_file, cache_age_secs)) {
+	/* Download into a file in the user’s cache, which is kept between
+	 * refreshes: its ETag makes the next request conditional, and an
+	 * interrupted download is resumed from it. If downloading system wide,
+	 * it will be installed into the system location later; otherwise it
+	 * will be copied over the target file. Either way, the target file is
+	 * left alone if its content turns out to be unchanged, so the
+	 * appstream plugin doesn’t parse it again. */
+	tmp_file_path = gs_utils_get_cache_filename ("external-appstream",
+						     basename,
+						     GS_UTILS_CACHE_FLAG_WRITEABLE |
+						     GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+						     &local_error);
+	if (tmp_file_path == NULL) {
+		g_task_return_error (task, g_steal_pointer (&local_error));
+		return;
+	}
+
+	tmp_file = g_file_new_for_path (tmp_file_path);
+
+	/* The download is annotated, rather than the target file, as the
+	 * system-wide file can’t be annotated by the user. */
+	if (!gs_external_appstream_check (target_file, tmp_file, cache_age_secs)) {
 		g_debug ("skipping updating external appstream file %s: "
 			 "cache age is older than file",
 			 target_file_path);
@@ -247,26 +368,6 @@ refresh_url_async (GSettings           *settings,
 		return;
 	}
 
-	/* If downloading system wide, write the download contents into a
-	 * temporary file that will be copied into the system location later. */
-	if (system_wide) {
-		g_autofree gchar *tmp_file_path = NULL;
-
-		tmp_file_path = gs_utils_get_cache_filename ("external-appstream",
-							     basename,
-							     GS_UTILS_CACHE_FLAG_WRITEABLE |
-							     GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
-							     &local_error);
-		if (tmp_file_path == NULL) {
-			g_task_return_error (task, g_steal_pointer (&local_error));
-			return;
-		}
-
-		tmp_file = g_file_new_for_path (tmp_file_path);
-	} else {
-		tmp_file = g_object_ref (target_file);
-	}
-
 	gs_app_set_summary_missing (app_dl,
 				    /* TRANSLATORS: status text when downloading */
 				    _("Downloading extra metadata files…"));
@@ -275,6 +376,7 @@ refresh_url_async (GSettings           *settings,
 	data->url = g_strdup (url);
 	data->task = g_object_ref (task);
 	data->output_file = g_object_ref (tmp_file);
+	data->target_file = g_object_ref (target_file);
 	data->progress_tuple = progress_tuple;
 	data->soup_session = g_object_ref (soup_session);
 	data->system_wide = system_wide;
@@ -283,10 +385,11 @@ refresh_url_async (GSettings           *settings,
 	/* Create the destination file’s directory.
 	 * FIXME: This should be made async; it hasn’t done for now as it’s
 	 * likely to be fast. */
-	tmp_file_parent = g_file_get_parent (tmp_file);
+	target_file_parent = g_file_get_parent (target_file);
 
-	if (tmp_file_parent != NULL &&
-	    !g_file_make_directory_with_parents (tmp_file_parent, cancellable, &local_error) &&
+	if (!system_wide &&
+	    target_file_parent != NULL &&
+	    !g_file_make_directory_with_parents (target_file_parent, cancellable, &local_error) &&
 	    !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
 		g_task_return_error (task, g_steal_pointer (&local_error));
 		return;
@@ -294,76 +397,43 @@ refresh_url_async (GSettings           *settings,
 
 	g_clear_error (&local_error);
 
-	/* Query the ETag and modification date of the target file, if the file already exists. For
-	 * system-wide installations, this is the ETag of the AppStream file installed system-wide.
-	 * For local installations, this is just the local output file. */
-	data->last_etag = gs_utils_get_file_etag (target_file, &data->last_modified_date, cancellable);
-	g_debug ("Queried ETag of file %s: %s", g_file_peek_path (target_file), data->last_etag);
-
-	/* Create the output file */
-	g_file_replace_async (tmp_file,
-			      NULL,  /* ETag */
-			      FALSE,  /* make_backup */
-			      G_FILE_CREATE_PRIVATE | G_FILE_CREATE_REPLACE_DESTINATION,
-			      G_PRIORITY_LOW,
-			      cancellable,
-			      download_replace_file_cb,
-			      g_steal_pointer (&task));
-}
-
-static void
-download_replace_file_cb (GObject      *source_object,
-                          GAsyncResult *result,
-                          gpointer      user_data)
-{
-	GFile *output_file = G_FILE (source_object);
-	g_autoptr(GTask) task = g_steal_pointer (&user_data);
-	GCancellable *cancellable = g_task_get_cancellable (task);
-	DownloadAppStreamData *data = g_task_get_task_data (task);
-	g_autoptr(GFileOutputStream) output_stream = NULL;
-	g_autoptr(GError) local_error = NULL;
-
-	output_stream = g_file_replace_finish (output_file, result, &local_error);
+	/* If the target file has gone, the ETag of the download can’t be used
+	 * to skip downloading it again. */
+	if (!g_file_query_exists (target_file, cancellable))
+		g_file_delete (tmp_file, NULL, NULL);
 
-	if (output_stream == NULL) {
-		g_task_return_error (task, g_steal_pointer (&local_error));
-		return;
-	}
+	/* Query the checksum of the content last downloaded. */
+	data->last_checksum = gs_external_appstream_get_content_checksum (tmp_file, cancellable);
 
 	/* Do the download. */
-	gs_download_stream_async (data->soup_session,
-				  data->url,
-				  G_OUTPUT_STREAM (output_stream),
-				  data->last_etag,
-				  data->last_modified_date,
-				  G_PRIORITY_LOW,
-				  refresh_url_progress_cb,
-				  data->progress_tuple,
-				  cancellable,
-				  download_stream_cb,
-				  g_steal_pointer (&task));
+	gs_download_file_async (soup_session,
+				url,
+				tmp_file,
+				G_PRIORITY_LOW,
+				refresh_url_progress_cb,
+				progress_tuple,
+				cancellable,
+				download_file_cb,
+				g_steal_pointer (&task));
 }
 
 static void
-download_stream_cb (GObject      *source_object,
-                    GAsyncResult *result,
-                    gpointer      user_data)
+download_file_cb (GObject      *source_object,
+                  GAsyncResult *result,
+                  gpointer      user_data)
 {
 	SoupSession *soup_session = SOUP_SESSION (source_object);
 	g_autoptr(GTask) task = g_steal_pointer (&user_data);
 	GCancellable *cancellable = g_task_get_cancellable (task);
 	DownloadAppStreamData *data = g_task_get_task_data (task);
 	g_autoptr(GError) local_error = NULL;
-	g_autofree gchar *new_etag = NULL;
 
-	if (!gs_download_stream_finish (soup_session, result, &new_etag, NULL, &local_error)) {
-		if (data->system_wide && g_error_matches (local_error, GS_DOWNLOAD_ERROR, GS_DOWNLOAD_ERROR_NOT_MODIFIED)) {
-			g_debug ("External AppStream file not modified, removing temporary download file %s",
-				 g_file_peek_path (data->output_file));
+	if (!gs_download_file_finish (soup_session, result, &local_error)) {
+		if (g_error_matches (local_error, GS_DOWNLOAD_ERROR, GS_DOWNLOAD_ERROR_NOT_MODIFIED)) {
+			g_debug ("External AppStream file %s not modified",
+				 g_file_peek_path (data->target_file));
 
-			/* System-wide installs should delete the empty file created when preparing to
-			 * download the external AppStream file. */
-			g_file_delete_async (data->output_file, G_PRIORITY_LOW, NULL, NULL, NULL);
+			gs_external_appstream_set_checked (data->output_file, cancellable);
 			g_task_return_boolean (task, TRUE);
 		} else if (!g_network_monitor_get_network_available (g_network_monitor_get_default ())) {
 			g_task_return_new_error (task,
@@ -382,7 +452,46 @@ download_stream_cb (GObject      *source_object,
 
 	g_debug ("Downloaded appstream file %s", g_file_peek_path (data->output_file));
 
-	gs_utils_set_file_etag (data->output_file, new_etag, cancellable);
+	/* Checksumming the file and installing it both block, so do them in
+	 * a worker thread. */
+	g_task_run_in_thread (task, install_file_thread_cb);
+}
+
+static void
+install_file_thread_cb (GTask        *task,
+                        gpointer      source_object,
+                        gpointer      task_data,
+                        GCancellable *cancellable)
+{
+	DownloadAppStreamData *data = task_data;
+	g_autofree gchar *checksum = NULL;
+	g_autoptr(GError) local_error = NULL;
+
+	/* The checksum is computed over the finished file, as a resumed
+	 * download only sees the end of its content. */
+	checksum = gs_external_appstream_compute_content_checksum (data->output_file, cancellable, &local_error);
+	if (checksum == NULL) {
+		g_task_return_new_error (task,
+					 GS_EXTERNAL_APPSTREAM_ERROR,
+					 GS_EXTERNAL_APPSTREAM_ERROR_DOWNLOADING,
+					 "Error reading downloaded external AppStream file: %s",
+					 local_error->message);
+		return;
+	}
+
+	g_file_set_attribute_string (data->output_file, CONTENT_CHECKSUM_ATTRIBUTE, checksum,
+				     G_FILE_QUERY_INFO_NONE, cancellable, NULL);
+
+	/* The server sent the whole file again, but its content hasn’t
+	 * changed, so keep the existing target file (and the silo built from
+	 * it). */
+	if (g_strcmp0 (checksum, data->last_checksum) == 0) {
+		g_debug ("External AppStream file %s is unchanged, not replacing it",
+			 g_file_peek_path (data->target_file));
+		gs_external_appstream_set_checked (data->output_file, cancellable);
+		g_task_return_boolean (task, TRUE);
+		return;
+	}
 
 	if (data->system_wide) {
 		/* install file systemwide */
@@ -396,6 +505,20 @@ download_stream_cb (GObject      *source_object,
 			return;
 		}
 		g_debug ("Installed appstream file %s", g_file_peek_path (data->output_file));
+	} else {
+		/* The download is copied rather than moved, so it’s kept for
+		 * the next refresh. */
+		if (!g_file_copy (data->output_file, data->target_file,
+				  G_FILE_COPY_OVERWRITE,
+				  cancellable, NULL, NULL, &local_error)) {
+			g_task_return_new_error (task,
+						 GS_EXTERNAL_APPSTREAM_ERROR,
+						 GS_EXTERNAL_APPSTREAM_ERROR_DOWNLOADING,
+						 "Error copying external AppStream file into place: %s",
+						 local_error->message);
+			return;
+		}
+		g_debug ("Copied appstream file to %s", g_file_peek_path (data->target_file));
 	}
 
 	g_task_return_boolean (task, TRUE);
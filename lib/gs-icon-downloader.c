@@ -21,6 +21,10 @@
  * download using gs_icon_downloader_queue_app(). The actual download may
  * happen at any arbitrary time in the future.
  *
+ * A bounded number of icons are downloaded concurrently, with icons for
+ * interactive requests served before background ones. Several apps using an
+ * icon with the same URI share a single download of it.
+ *
  * Since: 44
  */
 
@@ -28,7 +32,9 @@
 
 #include "gs-app-private.h"
 #include "gs-remote-icon.h"
-#include "gs-worker-thread.h"
+
+/* The #SoupSession may limit the number of connections per host further. */
+#define MAX_CONCURRENT_DOWNLOADS 4
 
 struct _GsIconDownloader
 {
@@ -37,10 +43,51 @@ struct _GsIconDownloader
 	guint		 maximum_size_px;
 	SoupSession	*soup_session; /* (owned) */
 
-	GsWorkerThread	*worker; /* (owned) */
+	GMutex		 mutex;
+	GThreadPool	*download_pool; /* (owned) (nullable) (lock mutex); %NULL after shutdown */
+	GHashTable	*downloads; /* (owned) (element-type utf8 IconDownload) (lock mutex) */
+	guint64		 next_sequence; /* (lock mutex) */
 	GCancellable	*cancellable; /* (owned) */
 };
 
+/* The icons still to download for one app, shared by all of its
+ * #IconDownloads. */
+typedef struct {
+	GTask		*task; /* (owned) */
+	guint		 n_pending; /* (lock GsIconDownloader.mutex) */
+	gboolean	 cancelled; /* (lock GsIconDownloader.mutex) */
+} AppDownload;
+
+typedef struct {
+	AppDownload	*app_download; /* (unowned) */
+	GsRemoteIcon	*icon; /* (owned) */
+} IconWaiter;
+
+/* A download of one icon URI, which may be waited on by several apps. */
+typedef struct {
+	GsIconDownloader *downloader; /* (unowned) */
+	GsRemoteIcon	*icon; /* (owned) */
+	gint		 priority; /* (lock GsIconDownloader.mutex) */
+	guint64		 sequence;
+	gboolean	 started; /* (lock GsIconDownloader.mutex) */
+	GPtrArray	*waiters; /* (owned) (element-type IconWaiter) (lock GsIconDownloader.mutex) */
+} IconDownload;
+
+static void
+icon_waiter_free (IconWaiter *waiter)
+{
+	g_clear_object (&waiter->icon);
+	g_free (waiter);
+}
+
+static void
+icon_download_free (IconDownload *download)
+{
+	g_clear_object (&download->icon);
+	g_clear_pointer (&download->waiters, g_ptr_array_unref);
+	g_free (download);
+}
+
 G_DEFINE_FINAL_TYPE (GsIconDownloader, gs_icon_downloader, G_TYPE_OBJECT)
 
 typedef enum {
@@ -56,9 +103,12 @@ gs_icon_downloader_finalize (GObject *object)
 	GsIconDownloader *self = (GsIconDownloader *)object;
 
 	g_cancellable_cancel (self->cancellable);
+	if (self->download_pool != NULL)
+		g_thread_pool_free (g_steal_pointer (&self->download_pool), TRUE, TRUE);
 	g_clear_object (&self->cancellable);
-	g_clear_object (&self->worker);
+	g_clear_pointer (&self->downloads, g_hash_table_unref);
 	g_clear_object (&self->soup_session);
+	g_mutex_clear (&self->mutex);
 
 	G_OBJECT_CLASS (gs_icon_downloader_parent_class)->finalize (object);
 }
@@ -143,10 +193,26 @@ gs_icon_downloader_class_init (GsIconDownloaderClass *klass)
 	g_object_class_install_properties (object_class, G_N_ELEMENTS (properties), properties);
 }
 
+static void download_icon_cb (gpointer data,
+                              gpointer user_data);
+static void icon_download_cancel (gpointer data);
+static gint icon_download_compare (gconstpointer a,
+                                   gconstpointer b,
+                                   gpointer      user_data);
+
 static void
 gs_icon_downloader_init (GsIconDownloader *self)
 {
-	self->worker = gs_worker_thread_new ("gs-icon-downloader");
+	g_mutex_init (&self->mutex);
+	self->cancellable = g_cancellable_new ();
+	self->downloads = g_hash_table_new (g_str_hash, g_str_equal);
+	self->download_pool = g_thread_pool_new_full (download_icon_cb,
+						      self,
+						      icon_download_cancel,
+						      MAX_CONCURRENT_DOWNLOADS,
+						      FALSE,
+						      NULL);
+	g_thread_pool_set_sort_function (self->download_pool, icon_download_compare, NULL);
 }
 
 /**
@@ -169,11 +235,6 @@ gs_icon_downloader_new (SoupSession *soup_session,
 }
 
 
-static void download_remote_icons_of_the_app_cb (GTask        *task,
-                                                 gpointer      source_object,
-                                                 gpointer      task_data,
-                                                 GCancellable *cancellable);
-
 static void app_remote_icons_download_finished (GObject      *source_object,
                                                 GAsyncResult *result,
                                                 gpointer      user_data);
@@ -194,89 +255,205 @@ gs_icon_downloader_queue_app (GsIconDownloader *self,
 			      gboolean          interactive)
 {
 	g_autoptr(GTask) task = NULL;
+	g_autoptr(GPtrArray) remote_icons = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+	AppDownload *app_download;
 	GPtrArray *icons;
-	gboolean has_remote_icon = FALSE;
+	gint priority = interactive ? G_PRIORITY_DEFAULT : G_PRIORITY_LOW;
 
 	g_return_if_fail (GS_IS_ICON_DOWNLOADER (self));
 	g_return_if_fail (GS_IS_APP (app));
 
 	icons = gs_app_get_icons (app);
+	remote_icons = g_ptr_array_new_full (icons ? icons->len : 0, g_object_unref);
 
 	for (guint j = 0; icons && j < icons->len; j++) {
-		has_remote_icon |= GS_IS_REMOTE_ICON (g_ptr_array_index (icons, j));
-		if (has_remote_icon)
-			break;
+		GObject *icon = g_ptr_array_index (icons, j);
+
+		if (GS_IS_REMOTE_ICON (icon))
+			g_ptr_array_add (remote_icons, g_object_ref (icon));
 	}
 
 	/* Nothing to download */
-	if (!has_remote_icon) {
+	if (remote_icons->len == 0) {
 		gs_app_set_icons_state (app, GS_APP_ICONS_STATE_AVAILABLE);
 		return;
 	}
 
+	locker = g_mutex_locker_new (&self->mutex);
+
+	/* It is an error to queue apps after shutdown */
+	g_return_if_fail (self->download_pool != NULL);
+
 	gs_app_set_icons_state (app, GS_APP_ICONS_STATE_PENDING_DOWNLOAD);
 
 	task = g_task_new (self, self->cancellable, app_remote_icons_download_finished, NULL);
 	g_task_set_task_data (task, g_object_ref (app), g_object_unref);
 	g_task_set_source_tag (task, gs_icon_downloader_queue_app);
 
-	gs_worker_thread_queue (self->worker, interactive ? G_PRIORITY_DEFAULT : G_PRIORITY_LOW,
-				download_remote_icons_of_the_app_cb, g_steal_pointer (&task));
+	g_debug ("Downloading %u icons for app %s", remote_icons->len, gs_app_get_id (app));
+
+	app_download = g_new0 (AppDownload, 1);
+	app_download->task = g_steal_pointer (&task);
+	app_download->n_pending = remote_icons->len;
+
+	for (guint j = 0; j < remote_icons->len; j++) {
+		GsRemoteIcon *icon = g_ptr_array_index (remote_icons, j);
+		IconDownload *download;
+		IconWaiter *waiter;
+
+		waiter = g_new0 (IconWaiter, 1);
+		waiter->app_download = app_download;
+		waiter->icon = g_object_ref (icon);
+
+		/* Share the download with any other app using the same URI */
+		download = g_hash_table_lookup (self->downloads, gs_remote_icon_get_uri (icon));
+		if (download != NULL) {
+			g_ptr_array_add (download->waiters, waiter);
+
+			if (download->started) {
+				gs_app_set_icons_state (app, GS_APP_ICONS_STATE_DOWNLOADING);
+			} else if (priority < download->priority) {
+				/* An interactive request overtakes the
+				 * background downloads queued before it */
+				download->priority = priority;
+				g_thread_pool_move_to_front (self->download_pool, download);
+			}
+			continue;
+		}
+
+		download = g_new0 (IconDownload, 1);
+		download->downloader = self;
+		download->icon = g_object_ref (icon);
+		download->priority = priority;
+		download->sequence = self->next_sequence++;
+		download->waiters = g_ptr_array_new_with_free_func ((GDestroyNotify) icon_waiter_free);
+		g_ptr_array_add (download->waiters, waiter);
+
+		g_hash_table_insert (self->downloads,
+				     (gpointer) gs_remote_icon_get_uri (download->icon),
+				     download);
+		g_thread_pool_push (self->download_pool, download, NULL);
+	}
 }
 
-/* Run in @worker. */
+/* Sort the queue by priority, then in the order the icons were queued. */
+static gint
+icon_download_compare (gconstpointer a,
+                       gconstpointer b,
+                       gpointer      user_data)
+{
+	const IconDownload *download_a = a;
+	const IconDownload *download_b = b;
+
+	if (download_a->priority != download_b->priority)
+		return (download_a->priority < download_b->priority) ? -1 : 1;
+	if (download_a->sequence != download_b->sequence)
+		return (download_a->sequence < download_b->sequence) ? -1 : 1;
+	return 0;
+}
+
+/* Called once the icon of @download is cached, or failed or was cancelled.
+ * Completes the apps which have no more icons to wait for, and frees
+ * @download. */
 static void
-download_remote_icons_of_the_app_cb (GTask        *task,
-                                     gpointer      source_object,
-                                     gpointer      task_data,
-                                     GCancellable *cancellable)
+icon_download_finish (IconDownload *download,
+                      gboolean      cancelled)
 {
-	GsIconDownloader *self = GS_ICON_DOWNLOADER (source_object);
-	g_autoptr(GPtrArray) remote_icons = NULL;
-	GPtrArray *icons;
-	GsApp *app;
+	GsIconDownloader *self = download->downloader;
+	g_autoptr(GPtrArray) completed = g_ptr_array_new ();
+	gpointer width, height;
 
-	g_assert (gs_worker_thread_is_in_worker_context (self->worker));
+	width = g_object_get_data (G_OBJECT (download->icon), "width");
+	height = g_object_get_data (G_OBJECT (download->icon), "height");
 
-	app = GS_APP (task_data);
-	icons = gs_app_get_icons (app);
-	remote_icons = g_ptr_array_new_full (icons ? icons->len : 0, g_object_unref);
+	g_mutex_lock (&self->mutex);
 
-	for (guint j = 0; icons && j < icons->len; j++) {
-		GObject *icon = g_ptr_array_index (icons, j);
+	g_hash_table_remove (self->downloads, gs_remote_icon_get_uri (download->icon));
 
-		if (GS_IS_REMOTE_ICON (icon))
-			g_ptr_array_add (remote_icons, g_object_ref (icon));
+	for (guint i = 0; i < download->waiters->len; i++) {
+		IconWaiter *waiter = g_ptr_array_index (download->waiters, i);
+		AppDownload *app_download = waiter->app_download;
+
+		/* Other apps have their own #GsRemoteIcon for the same URI, so
+		 * give them the dimensions of the downloaded one */
+		if (waiter->icon != download->icon && width != NULL) {
+			g_object_set_data (G_OBJECT (waiter->icon), "width", width);
+			g_object_set_data (G_OBJECT (waiter->icon), "height", height);
+		}
+
+		app_download->cancelled |= cancelled;
+		app_download->n_pending--;
+		if (app_download->n_pending == 0)
+			g_ptr_array_add (completed, app_download);
 	}
 
-	g_assert (remote_icons->len > 0);
+	g_mutex_unlock (&self->mutex);
 
-	g_debug ("Downloading %u icons for app %s", remote_icons->len, gs_app_get_id (app));
+	for (guint i = 0; i < completed->len; i++) {
+		AppDownload *app_download = g_ptr_array_index (completed, i);
+		GsApp *app = g_task_get_task_data (app_download->task);
 
-	gs_app_set_icons_state (app, GS_APP_ICONS_STATE_DOWNLOADING);
+		gs_app_set_icons_state (app, GS_APP_ICONS_STATE_AVAILABLE);
 
-	for (guint j = 0; j < remote_icons->len; j++) {
-		GObject *icon = g_ptr_array_index (remote_icons, j);
-		g_autoptr(GError) local_error = NULL;
+		if (app_download->cancelled)
+			g_task_return_new_error (app_download->task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+						 "Icon download was cancelled");
+		else
+			g_task_return_boolean (app_download->task, TRUE);
 
-		gs_remote_icon_ensure_cached (GS_REMOTE_ICON (icon),
-					      self->soup_session,
-					      self->maximum_size_px,
-					      cancellable,
-					      &local_error);
+		g_object_unref (app_download->task);
+		g_free (app_download);
+	}
 
-		if (local_error)
-			g_debug ("Error downloading remote icon: %s", local_error->message);
+	icon_download_free (download);
+}
 
-		if (g_task_return_error_if_cancelled (task)) {
-			gs_app_set_icons_state (app, GS_APP_ICONS_STATE_AVAILABLE);
-			return;
-		}
+/* Run in @download_pool. */
+static void
+download_icon_cb (gpointer data,
+                  gpointer user_data)
+{
+	GsIconDownloader *self = GS_ICON_DOWNLOADER (user_data);
+	IconDownload *download = data;
+	g_autoptr(GError) local_error = NULL;
+
+	g_mutex_lock (&self->mutex);
+
+	/* Shut down since this was queued, but before the pool was freed */
+	if (self->download_pool == NULL) {
+		g_mutex_unlock (&self->mutex);
+		icon_download_finish (download, TRUE);
+		return;
 	}
 
-	gs_app_set_icons_state (app, GS_APP_ICONS_STATE_AVAILABLE);
+	download->started = TRUE;
+	for (guint i = 0; i < download->waiters->len; i++) {
+		IconWaiter *waiter = g_ptr_array_index (download->waiters, i);
+		GsApp *app = g_task_get_task_data (waiter->app_download->task);
 
-	g_task_return_boolean (task, TRUE);
+		gs_app_set_icons_state (app, GS_APP_ICONS_STATE_DOWNLOADING);
+	}
+	g_mutex_unlock (&self->mutex);
+
+	gs_remote_icon_ensure_cached (download->icon,
+				      self->soup_session,
+				      self->maximum_size_px,
+				      self->cancellable,
+				      &local_error);
+
+	if (local_error)
+		g_debug ("Error downloading remote icon: %s", local_error->message);
+
+	icon_download_finish (download,
+			      g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED));
+}
+
+/* Called for the downloads still queued when @download_pool is freed. */
+static void
+icon_download_cancel (gpointer data)
+{
+	icon_download_finish (data, TRUE);
 }
 
 static void
@@ -293,9 +470,10 @@ app_remote_icons_download_finished (GObject      *source_object,
 		g_warning ("Failed to download icons of one app: %s", error->message);
 }
 
-static void shutdown_cb (GObject      *source_object,
-                         GAsyncResult *result,
-                         gpointer      user_data);
+static void shutdown_thread_cb (GTask        *task,
+                                gpointer      source_object,
+                                gpointer      task_data,
+                                GCancellable *cancellable);
 
 /**
  * gs_icon_downloader_shutdown_async:
@@ -306,8 +484,9 @@ static void shutdown_cb (GObject      *source_object,
  *
  * Shut down the icon downloader.
  *
- * This will shut down the internal worker thread that @self uses to
- * queue app downloads.
+ * Icon downloads which are in progress will be finished, and the apps
+ * waiting only on downloads which have not started yet will have their
+ * downloads cancelled.
  *
  * This is a no-op if called subsequently.
  *
@@ -320,6 +499,7 @@ gs_icon_downloader_shutdown_async (GsIconDownloader    *self,
                                    gpointer             user_data)
 {
 	g_autoptr(GTask) task = NULL;
+	GThreadPool *download_pool;
 
 	g_return_if_fail (GS_IS_ICON_DOWNLOADER (self));
 	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
@@ -327,26 +507,32 @@ gs_icon_downloader_shutdown_async (GsIconDownloader    *self,
 	task = g_task_new (self, cancellable, callback, user_data);
 	g_task_set_source_tag (task, gs_icon_downloader_shutdown_async);
 
-	gs_worker_thread_shutdown_async (self->worker, cancellable, shutdown_cb,
-					 g_steal_pointer (&task));
+	g_mutex_lock (&self->mutex);
+	download_pool = g_steal_pointer (&self->download_pool);
+	g_mutex_unlock (&self->mutex);
+
+	/* Already called? */
+	if (download_pool == NULL) {
+		g_task_return_boolean (task, TRUE);
+		return;
+	}
+
+	/* Freeing the pool blocks until the running downloads finish. */
+	g_task_set_task_data (task, download_pool, NULL);
+	g_task_run_in_thread (task, shutdown_thread_cb);
 }
 
 static void
-shutdown_cb (GObject      *source_object,
-             GAsyncResult *result,
-             gpointer      user_data)
+shutdown_thread_cb (GTask        *task,
+                    gpointer      source_object,
+                    gpointer      task_data,
+                    GCancellable *cancellable)
 {
-	g_autoptr(GTask) task = G_TASK (user_data);
-	GsIconDownloader *self = g_task_get_source_object (user_data);
-	g_autoptr(GError) local_error = NULL;
-	gboolean success;
+	GThreadPool *download_pool = task_data;
 
-	success = gs_worker_thread_shutdown_finish (self->worker, result, &local_error);
+	g_thread_pool_free (download_pool, TRUE, TRUE);
 
-	if (local_error)
-		g_task_return_error (task, g_steal_pointer (&local_error));
-	else
-		g_task_return_boolean (task, success);
+	g_task_return_boolean (task, TRUE);
 }
 
 /**
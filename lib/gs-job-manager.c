@@ -18,6 +18,14 @@
  * This makes it possible to track all the jobs ongoing in gnome-software, or
  * in a particular backend, or for a particular app at any time.
  *
+ * It also coalesces #GsPluginJobRefines for a single app: a refine which
+ * arrives while another refine of the same app is pending, and which asks for
+ * no more than the pending one, is attached to the pending one rather than run
+ * again. Refines asking for more are merged into a single follow-up refine
+ * which is run once the pending one has completed. A coalesced refine is only
+ * cancelled once all the callers waiting for it have cancelled it. See
+ * gs_job_manager_coalesce_refine().
+ *
  * See also: #GsPluginJob
  * Since: 44
  */
@@ -30,15 +38,148 @@
 
 #include "gs-enums.h"
 #include "gs-plugin-job.h"
+#include "gs-plugin-job-refine.h"
 #include "gs-plugin-job-update-apps.h"
 #include "gs-plugin-types.h"
 #include "gs-utils.h"
 
+/* Refine flags which change the results of a refine, rather than what is
+ * refined, so have to match for refines to be coalesced */
+#define COALESCE_REFINE_MODIFIER_FLAGS (GS_PLUGIN_REFINE_FLAGS_ALLOW_PACKAGES | \
+					GS_PLUGIN_REFINE_FLAGS_DISABLE_FILTERING)
+
+/* A #GTask waiting for the results of a coalesced refine */
+typedef struct {
+	GTask			*task;			/* (owned) (not nullable) */
+	GCancellable		*cancellable;		/* (owned) (nullable): the cancellable of @task */
+	gulong			 cancelled_id;
+} CoalescedTask;
+
+/* The tasks waiting for the same refine. The refine is run with @cancellable,
+ * which is cancelled once all the tasks have been cancelled, so that one
+ * caller cancelling doesn’t cancel the refine for the others. */
+typedef struct {
+	GsPluginRefineFlags	 flags;
+	gboolean		 interactive;
+	GCancellable		*cancellable;		/* (owned) (not nullable) */
+	gint			 n_uncancelled;		/* (atomic) */
+	GPtrArray		*tasks;			/* (owned) (element-type CoalescedTask) */
+} RefineGroup;
+
+typedef struct {
+	GsPluginJob		*job;			/* (owned) (not nullable) */
+	RefineGroup		*group;			/* (owned) (not nullable): tasks waiting for @job */
+	RefineGroup		*follow_up;		/* (owned) (nullable): tasks waiting for the follow-up refine */
+} PendingRefine;
+
+static void
+refine_group_task_cancelled_cb (GCancellable *cancellable,
+                                gpointer      user_data)
+{
+	RefineGroup *group = user_data;
+
+	if (g_atomic_int_dec_and_test (&group->n_uncancelled))
+		g_cancellable_cancel (group->cancellable);
+}
+
+static void
+coalesced_task_free (CoalescedTask *coalesced_task)
+{
+	if (coalesced_task->cancellable != NULL)
+		g_cancellable_disconnect (coalesced_task->cancellable, coalesced_task->cancelled_id);
+	g_clear_object (&coalesced_task->cancellable);
+	g_object_unref (coalesced_task->task);
+	g_free (coalesced_task);
+}
+
+static RefineGroup *
+refine_group_new (GsPluginRefineFlags flags,
+                  gboolean            interactive)
+{
+	RefineGroup *group = g_new0 (RefineGroup, 1);
+
+	group->flags = flags;
+	group->interactive = interactive;
+	group->cancellable = g_cancellable_new ();
+	group->tasks = g_ptr_array_new_with_free_func ((GDestroyNotify) coalesced_task_free);
+
+	return group;
+}
+
+static void
+refine_group_free (RefineGroup *group)
+{
+	/* disconnect from the tasks’ cancellables before freeing the group */
+	g_ptr_array_unref (group->tasks);
+	g_object_unref (group->cancellable);
+	g_free (group);
+}
+
+/* Attach @task to @group, so it’s returned when @group’s refine completes.
+ * This fails if all the tasks in @group have already been cancelled, as the
+ * refine for @group is then cancelled too. */
+static gboolean
+refine_group_add_task (RefineGroup *group,
+                       GTask       *task)
+{
+	CoalescedTask *coalesced_task;
+
+	g_atomic_int_inc (&group->n_uncancelled);
+	if (g_cancellable_is_cancelled (group->cancellable)) {
+		g_atomic_int_add (&group->n_uncancelled, -1);
+		return FALSE;
+	}
+
+	coalesced_task = g_new0 (CoalescedTask, 1);
+	coalesced_task->task = g_object_ref (task);
+	coalesced_task->cancellable = g_task_get_cancellable (task);
+	if (coalesced_task->cancellable != NULL) {
+		g_object_ref (coalesced_task->cancellable);
+
+		/* this calls the callback straight away if it’s already cancelled */
+		coalesced_task->cancelled_id = g_cancellable_connect (coalesced_task->cancellable,
+								      G_CALLBACK (refine_group_task_cancelled_cb),
+								      group, NULL);
+	}
+	g_ptr_array_add (group->tasks, coalesced_task);
+
+	return TRUE;
+}
+
+/* Returns (transfer container) (element-type GTask): the tasks in @group,
+ * which is left empty */
+static GPtrArray *
+refine_group_steal_tasks (RefineGroup *group)
+{
+	GPtrArray *tasks = g_ptr_array_new_with_free_func (g_object_unref);
+
+	for (guint i = 0; i < group->tasks->len; i++) {
+		CoalescedTask *coalesced_task = g_ptr_array_index (group->tasks, i);
+		g_ptr_array_add (tasks, g_object_ref (coalesced_task->task));
+	}
+	g_ptr_array_set_size (group->tasks, 0);
+
+	return tasks;
+}
+
+static void
+pending_refine_free (PendingRefine *pending)
+{
+	g_object_unref (pending->job);
+	refine_group_free (pending->group);
+	g_clear_pointer (&pending->follow_up, refine_group_free);
+	g_free (pending);
+}
+
 struct _GsJobManager
 {
 	GObject parent;
 
-	GPtrArray *jobs;  /* (owned) (element-type GsPluginJob) (not nullable) */
+	GMutex mutex;
+	GPtrArray *jobs;  /* (owned) (element-type GsPluginJob) (not nullable) (mutex mutex) */
+	GHashTable *pending_refines;  /* (owned) (element-type GsApp PendingRefine) (mutex mutex) */
+	guint n_refines_coalesced;  /* (mutex mutex) */
+	guint n_refines_merged;  /* (mutex mutex) */
 };
 
 G_DEFINE_TYPE (GsJobManager, gs_job_manager, G_TYPE_OBJECT)
@@ -60,6 +201,8 @@ gs_job_manager_finalize (GObject *object)
 	GsJobManager *self = GS_JOB_MANAGER (object);
 
 	g_clear_pointer (&self->jobs, g_ptr_array_unref);
+	g_clear_pointer (&self->pending_refines, g_hash_table_unref);
+	g_mutex_clear (&self->mutex);
 
 	G_OBJECT_CLASS (gs_job_manager_parent_class)->finalize (object);
 }
@@ -76,7 +219,10 @@ gs_job_manager_class_init (GsJobManagerClass *klass)
 static void
 gs_job_manager_init (GsJobManager *self)
 {
+	g_mutex_init (&self->mutex);
 	self->jobs = g_ptr_array_new_with_free_func (g_object_unref);
+	self->pending_refines = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+						       g_object_unref, (GDestroyNotify) pending_refine_free);
 }
 
 /**
@@ -119,9 +265,13 @@ gboolean
 gs_job_manager_add_job (GsJobManager *self,
                         GsPluginJob  *job)
 {
+	g_autoptr(GMutexLocker) locker = NULL;
+
 	g_return_val_if_fail (GS_IS_JOB_MANAGER (self), FALSE);
 	g_return_val_if_fail (GS_IS_PLUGIN_JOB (job), FALSE);
 
+	locker = g_mutex_locker_new (&self->mutex);
+
 	if (g_ptr_array_find (self->jobs, job, NULL))
 		return FALSE;
 
@@ -148,9 +298,13 @@ gboolean
 gs_job_manager_remove_job (GsJobManager *self,
                            GsPluginJob  *job)
 {
+	g_autoptr(GMutexLocker) locker = NULL;
+
 	g_return_val_if_fail (GS_IS_JOB_MANAGER (self), FALSE);
 	g_return_val_if_fail (GS_IS_PLUGIN_JOB (job), FALSE);
 
+	locker = g_mutex_locker_new (&self->mutex);
+
 	if (g_ptr_array_remove_fast (self->jobs, job)) {
 		g_signal_handlers_disconnect_by_func (job, job_completed_cb, self);
 		return TRUE;
@@ -192,10 +346,12 @@ gs_job_manager_get_pending_jobs_for_app (GsJobManager *self,
                                          GsApp        *app)
 {
 	g_autoptr(GPtrArray) jobs_for_app = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
 
 	g_return_val_if_fail (GS_IS_JOB_MANAGER (self), NULL);
 	g_return_val_if_fail (GS_IS_APP (app), NULL);
 
+	locker = g_mutex_locker_new (&self->mutex);
 	jobs_for_app = g_ptr_array_new_with_free_func (g_object_unref);
 
 	for (gsize i = 0; i < self->jobs->len; i++) {
@@ -226,10 +382,14 @@ gs_job_manager_app_has_pending_job_type (GsJobManager *self,
                                          GsApp        *app,
                                          GType         pending_job_type)
 {
+	g_autoptr(GMutexLocker) locker = NULL;
+
 	g_return_val_if_fail (GS_IS_JOB_MANAGER (self), FALSE);
 	g_return_val_if_fail (GS_IS_APP (app), FALSE);
 	g_return_val_if_fail (g_type_is_a (pending_job_type, GS_TYPE_PLUGIN_JOB), FALSE);
 
+	locker = g_mutex_locker_new (&self->mutex);
+
 	for (gsize i = 0; i < self->jobs->len; i++) {
 		GsPluginJob *job = g_ptr_array_index (self->jobs, i);
 
@@ -240,3 +400,243 @@ gs_job_manager_app_has_pending_job_type (GsJobManager *self,
 
 	return FALSE;
 }
+
+/* Returns the app refined by @job, if it refines exactly one app. */
+static GsApp *
+refine_job_get_app (GsPluginJob *job)
+{
+	GsAppList *list;
+
+	if (!GS_IS_PLUGIN_JOB_REFINE (job))
+		return NULL;
+
+	list = gs_plugin_job_refine_get_app_list (GS_PLUGIN_JOB_REFINE (job));
+	if (gs_app_list_length (list) != 1)
+		return NULL;
+
+	return gs_app_list_index (list, 0);
+}
+
+/**
+ * gs_job_manager_coalesce_refine:
+ * @self: a #GsJobManager
+ * @job: a #GsPluginJobRefine which is about to be run
+ * @task: the #GTask which will return the results of @job
+ * @cancellable_out: (out) (transfer full) (optional) (nullable): return
+ *   location for the #GCancellable to run @job with
+ *
+ * Try to attach @task to a pending refine of the same app, so @job doesn’t
+ * have to be run itself.
+ *
+ * If no refine of the app is pending, @job becomes the pending refine for it,
+ * @task is attached to it, and a #GCancellable to run @job with is returned in
+ * @cancellable_out. The caller must then run @job with that cancellable, and
+ * return its results to the tasks from gs_job_manager_complete_refine() once
+ * it completes. The cancellable is only cancelled once every task attached to
+ * the refine has been cancelled, so one caller cancelling doesn’t cancel the
+ * refine for the others.
+ *
+ * If a refine of the same app is pending and its flags are a superset of the
+ * flags of @job, @task is attached to it. If its flags don’t cover those of
+ * @job, @task is attached to a follow-up refine which will be returned from
+ * gs_job_manager_complete_refine() when the pending refine has completed. The
+ * follow-up refine asks for all the flags of the refines attached to it, and
+ * is interactive if any of them is. In both cases %TRUE is returned and
+ * @cancellable_out is set to %NULL.
+ *
+ * An interactive @job isn’t attached to a pending refine which isn’t
+ * interactive, as that would make the user wait for background work.
+ *
+ * If @job can’t be coalesced, %FALSE is returned and @job should be run as
+ * normal with the cancellable of @task.
+ *
+ * This function is thread-safe.
+ *
+ * Returns: %TRUE if @task was attached to a refine, %FALSE otherwise
+ * Since: 44
+ */
+gboolean
+gs_job_manager_coalesce_refine (GsJobManager  *self,
+                                GsPluginJob   *job,
+                                GTask         *task,
+                                GCancellable **cancellable_out)
+{
+	GsApp *app;
+	GsPluginRefineFlags flags;
+	gboolean interactive;
+	PendingRefine *pending;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_JOB_MANAGER (self), FALSE);
+	g_return_val_if_fail (GS_IS_PLUGIN_JOB (job), FALSE);
+	g_return_val_if_fail (G_IS_TASK (task), FALSE);
+
+	if (cancellable_out != NULL)
+		*cancellable_out = NULL;
+
+	app = refine_job_get_app (job);
+	if (app == NULL)
+		return FALSE;
+	flags = gs_plugin_job_refine_get_flags (GS_PLUGIN_JOB_REFINE (job));
+	interactive = gs_plugin_job_get_interactive (job);
+
+	locker = g_mutex_locker_new (&self->mutex);
+
+	pending = g_hash_table_lookup (self->pending_refines, app);
+	if (pending == NULL) {
+		/* this can’t fail, as nothing else can have cancelled the
+		 * group yet */
+		pending = g_new0 (PendingRefine, 1);
+		pending->job = g_object_ref (job);
+		pending->group = refine_group_new (flags, interactive);
+		refine_group_add_task (pending->group, task);
+		g_hash_table_insert (self->pending_refines, g_object_ref (app), pending);
+
+		if (cancellable_out != NULL)
+			*cancellable_out = g_object_ref (pending->group->cancellable);
+		return TRUE;
+	}
+
+	/* this is the pending refine being started */
+	if (pending->job == job)
+		return FALSE;
+
+	if ((pending->group->flags & COALESCE_REFINE_MODIFIER_FLAGS) != (flags & COALESCE_REFINE_MODIFIER_FLAGS))
+		return FALSE;
+
+	if ((flags & ~pending->group->flags) == 0) {
+		if (interactive && !pending->group->interactive)
+			return FALSE;
+		if (!refine_group_add_task (pending->group, task))
+			return FALSE;
+		self->n_refines_coalesced++;
+	} else {
+		if (pending->follow_up == NULL)
+			pending->follow_up = refine_group_new (GS_PLUGIN_REFINE_FLAGS_NONE, FALSE);
+		if (!refine_group_add_task (pending->follow_up, task))
+			return FALSE;
+		pending->follow_up->flags |= flags;
+		pending->follow_up->interactive |= interactive;
+		self->n_refines_merged++;
+	}
+
+	return TRUE;
+}
+
+/**
+ * gs_job_manager_complete_refine:
+ * @self: a #GsJobManager
+ * @job: a #GsPluginJobRefine which has completed, successfully or not
+ * @follow_up_job_out: (out) (transfer full) (optional) (nullable): return
+ *   location for a follow-up refine to run
+ * @follow_up_cancellable_out: (out) (transfer full) (optional) (nullable):
+ *   return location for the #GCancellable to run the follow-up refine with
+ *
+ * Detach the tasks which were attached to @job by
+ * gs_job_manager_coalesce_refine(), so they can be returned with the results
+ * of @job.
+ *
+ * If other refines were merged into a follow-up for @job, the follow-up refine
+ * is returned in @follow_up_job_out and becomes the pending refine for the app.
+ * The caller must run it with the cancellable returned in
+ * @follow_up_cancellable_out.
+ *
+ * This function is thread-safe.
+ *
+ * Returns: (transfer container) (element-type GTask): the tasks attached to
+ *   @job, which may be empty
+ * Since: 44
+ */
+GPtrArray *
+gs_job_manager_complete_refine (GsJobManager  *self,
+                                GsPluginJob   *job,
+                                GsPluginJob  **follow_up_job_out,
+                                GCancellable **follow_up_cancellable_out)
+{
+	GsApp *app;
+	PendingRefine *pending;
+	g_autoptr(GPtrArray) tasks = NULL;
+	g_autoptr(GsPluginJob) follow_up_job = NULL;
+	g_autoptr(GCancellable) follow_up_cancellable = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_JOB_MANAGER (self), NULL);
+	g_return_val_if_fail (GS_IS_PLUGIN_JOB (job), NULL);
+
+	app = refine_job_get_app (job);
+
+	locker = g_mutex_locker_new (&self->mutex);
+
+	pending = (app != NULL) ? g_hash_table_lookup (self->pending_refines, app) : NULL;
+	if (pending == NULL || pending->job != job) {
+		if (follow_up_job_out != NULL)
+			*follow_up_job_out = NULL;
+		if (follow_up_cancellable_out != NULL)
+			*follow_up_cancellable_out = NULL;
+		return g_ptr_array_new_with_free_func (g_object_unref);
+	}
+
+	tasks = refine_group_steal_tasks (pending->group);
+
+	if (pending->follow_up != NULL) {
+		/* the app already has everything from the completed refine */
+		follow_up_job = gs_plugin_job_refine_new_for_app (app, pending->follow_up->flags);
+		gs_plugin_job_set_interactive (follow_up_job, pending->follow_up->interactive);
+		follow_up_cancellable = g_object_ref (pending->follow_up->cancellable);
+		g_set_object (&pending->job, follow_up_job);
+		pending->follow_up->flags |= pending->group->flags;
+		refine_group_free (pending->group);
+		pending->group = g_steal_pointer (&pending->follow_up);
+	} else {
+		g_hash_table_remove (self->pending_refines, app);
+	}
+
+	if (follow_up_job_out != NULL)
+		*follow_up_job_out = g_steal_pointer (&follow_up_job);
+	if (follow_up_cancellable_out != NULL)
+		*follow_up_cancellable_out = g_steal_pointer (&follow_up_cancellable);
+
+	return g_steal_pointer (&tasks);
+}
+
+/**
+ * gs_job_manager_get_n_refines_coalesced:
+ * @self: a #GsJobManager
+ *
+ * Get the number of refines which have been attached to a pending refine
+ * covering all their flags, rather than being run.
+ *
+ * Returns: number of coalesced refines
+ * Since: 44
+ */
+guint
+gs_job_manager_get_n_refines_coalesced (GsJobManager *self)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_JOB_MANAGER (self), 0);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	return self->n_refines_coalesced;
+}
+
+/**
+ * gs_job_manager_get_n_refines_merged:
+ * @self: a #GsJobManager
+ *
+ * Get the number of refines which have been merged into a follow-up refine of
+ * the same app, rather than being run.
+ *
+ * Returns: number of merged refines
+ * Since: 44
+ */
+guint
+gs_job_manager_get_n_refines_merged (GsJobManager *self)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_JOB_MANAGER (self), 0);
+
+	locker = g_mutex_locker_new (&self->mutex);
+	return self->n_refines_merged;
+}
@@ -36,4 +36,15 @@ gboolean	 gs_job_manager_app_has_pending_job_type	(GsJobManager	*self,
 								 GsApp		*app,
 								 GType		 pending_job_type);
 
+gboolean	 gs_job_manager_coalesce_refine			(GsJobManager	*self,
+								 GsPluginJob	*job,
+								 GTask		*task,
+								 GCancellable	**cancellable_out);
+GPtrArray	*gs_job_manager_complete_refine			(GsJobManager	*self,
+								 GsPluginJob	*job,
+								 GsPluginJob	**follow_up_job_out,
+								 GCancellable	**follow_up_cancellable_out);
+guint		 gs_job_manager_get_n_refines_coalesced		(GsJobManager	*self);
+guint		 gs_job_manager_get_n_refines_merged		(GsJobManager	*self);
+
 G_END_DECLS
@@ -0,0 +1,30 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2021 Endless OS Foundation LLC
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include "gs-key-colors.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+	GS_KEY_COLORS_KERNEL_SCALAR,
+	GS_KEY_COLORS_KERNEL_SSE2,
+	GS_KEY_COLORS_KERNEL_AVX2,
+} GsKeyColorsKernel;
+
+gboolean	 gs_key_colors_assign_clusters_for_test	(GsKeyColorsKernel	 kernel,
+							 guint8			*pixels,
+							 gsize			 n_pixels,
+							 const guint8		*cluster_centres,
+							 gsize			 n_cluster_centres,
+							 guint			*out_n_changed);
+void		 gs_key_colors_cache_reload_for_test	(void);
+GArray		*gs_key_colors_cache_lookup_for_test	(GdkPixbuf		*pixbuf);
+
+G_END_DECLS
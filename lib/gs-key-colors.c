@@ -32,7 +32,17 @@
 #include <gdk/gdk.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
-#include "gs-key-colors.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define HAVE_SSE2_KERNEL 1
+#ifdef __GNUC__
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#endif
+#endif
+
+#include "gs-key-colors-private.h"
+#include "gs-utils.h"
 
 /* Hard-code the number of clusters to split the icon color space into. This
  * gives the maximum number of key colors returned for an icon. This number has
@@ -119,6 +129,194 @@ nearest_cluster (const Pixel8 *pixel,
 	return nearest_cluster;
 }
 
+/* Stores the nearest cluster for each of the @n_pixels in @clusters to
+ * @pixels, skipping transparent ones, and returns how many changed. */
+static inline guint
+update_assignments (ClusterPixel8  *pixels,
+                    const guint32  *clusters,
+                    gsize           n_pixels)
+{
+	guint n_assignments_changed = 0;
+
+	for (gsize i = 0; i < n_pixels; i++) {
+		if (pixels[i].cluster >= n_clusters)
+			continue;
+		if (pixels[i].cluster != clusters[i])
+			n_assignments_changed++;
+		pixels[i].cluster = clusters[i];
+	}
+
+	return n_assignments_changed;
+}
+
+static guint
+assign_clusters_scalar (ClusterPixel8 *pixels,
+                        gsize          n_pixels,
+                        const Pixel8  *cluster_centres,
+                        gsize          n_cluster_centres)
+{
+	guint n_assignments_changed = 0;
+
+	for (ClusterPixel8 *p = pixels; p < pixels + n_pixels; p++) {
+		gsize new_cluster;
+
+		if (p->cluster >= n_cluster_centres)
+			continue;
+
+		new_cluster = nearest_cluster (&p->color, cluster_centres, n_cluster_centres);
+		if (new_cluster != p->cluster)
+			n_assignments_changed++;
+		p->cluster = new_cluster;
+	}
+
+	return n_assignments_changed;
+}
+
+#if defined(HAVE_SSE2_KERNEL) || defined(HAVE_AVX2_KERNEL)
+/* The R, G and B of @centre as 16-bit lanes, with a zero alpha lane, so it can
+ * be broadcast against two pixels widened to 16 bits per channel. */
+static inline gint64
+centre_to_epi16 (const Pixel8 *centre)
+{
+	return (gint64) centre->red | ((gint64) centre->green << 16) | ((gint64) centre->blue << 32);
+}
+#endif
+
+#ifdef HAVE_SSE2_KERNEL
+/* Same as color_distance() for four pixels at once. @pixels_lo and @pixels_hi
+ * are pixels 0–1 and 2–3 widened to 16 bits per channel, with alpha zeroed.
+ * _mm_madd_epi16() gives r²+g² and b²+0 for each pixel, and the pairs are
+ * shuffled together and added so the distances come out in pixel order. */
+static inline __m128i
+color_distance_sse2 (__m128i pixels_lo,
+                     __m128i pixels_hi,
+                     gint64  centre)
+{
+	__m128i centre_16 = _mm_set1_epi64x (centre);
+	__m128i d_lo = _mm_sub_epi16 (pixels_lo, centre_16);
+	__m128i d_hi = _mm_sub_epi16 (pixels_hi, centre_16);
+	__m128i sq_lo = _mm_shuffle_epi32 (_mm_madd_epi16 (d_lo, d_lo), _MM_SHUFFLE (3, 1, 2, 0));
+	__m128i sq_hi = _mm_shuffle_epi32 (_mm_madd_epi16 (d_hi, d_hi), _MM_SHUFFLE (3, 1, 2, 0));
+
+	return _mm_add_epi32 (_mm_unpacklo_epi64 (sq_lo, sq_hi),
+			      _mm_unpackhi_epi64 (sq_lo, sq_hi));
+}
+
+static guint
+assign_clusters_sse2 (ClusterPixel8 *pixels,
+                      gsize          n_pixels,
+                      const Pixel8  *cluster_centres,
+                      gsize          n_cluster_centres)
+{
+	const __m128i rgb_mask = _mm_set1_epi32 (0x00ffffff);
+	const __m128i zero = _mm_setzero_si128 ();
+	guint n_assignments_changed = 0;
+	gsize i;
+
+	for (i = 0; i + 4 <= n_pixels; i += 4) {
+		__m128i p = _mm_and_si128 (_mm_loadu_si128 ((const __m128i *) &pixels[i]), rgb_mask);
+		__m128i p_lo = _mm_unpacklo_epi8 (p, zero);
+		__m128i p_hi = _mm_unpackhi_epi8 (p, zero);
+		__m128i best_distance = color_distance_sse2 (p_lo, p_hi, centre_to_epi16 (&cluster_centres[0]));
+		__m128i best_cluster = zero;
+		guint32 clusters[4];
+
+		for (gsize c = 1; c < n_cluster_centres; c++) {
+			__m128i distance = color_distance_sse2 (p_lo, p_hi, centre_to_epi16 (&cluster_centres[c]));
+
+			/* strictly closer, so ties are resolved as in nearest_cluster() */
+			__m128i closer = _mm_cmplt_epi32 (distance, best_distance);
+			best_distance = _mm_or_si128 (_mm_and_si128 (closer, distance),
+						      _mm_andnot_si128 (closer, best_distance));
+			best_cluster = _mm_or_si128 (_mm_and_si128 (closer, _mm_set1_epi32 (c)),
+						     _mm_andnot_si128 (closer, best_cluster));
+		}
+
+		_mm_storeu_si128 ((__m128i *) clusters, best_cluster);
+		n_assignments_changed += update_assignments (&pixels[i], clusters, 4);
+	}
+
+	return n_assignments_changed +
+	       assign_clusters_scalar (pixels + i, n_pixels - i, cluster_centres, n_cluster_centres);
+}
+#endif  /* HAVE_SSE2_KERNEL */
+
+#ifdef HAVE_AVX2_KERNEL
+/* As color_distance_sse2(), for pixels 0–1, 4–5 in @pixels_lo and 2–3, 6–7 in
+ * @pixels_hi, as the AVX2 unpack instructions work within each 128-bit lane. */
+__attribute__ ((target ("avx2")))
+static inline __m256i
+color_distance_avx2 (__m256i pixels_lo,
+                     __m256i pixels_hi,
+                     gint64  centre)
+{
+	__m256i centre_16 = _mm256_set1_epi64x (centre);
+	__m256i d_lo = _mm256_sub_epi16 (pixels_lo, centre_16);
+	__m256i d_hi = _mm256_sub_epi16 (pixels_hi, centre_16);
+	__m256i sq_lo = _mm256_shuffle_epi32 (_mm256_madd_epi16 (d_lo, d_lo), _MM_SHUFFLE (3, 1, 2, 0));
+	__m256i sq_hi = _mm256_shuffle_epi32 (_mm256_madd_epi16 (d_hi, d_hi), _MM_SHUFFLE (3, 1, 2, 0));
+
+	return _mm256_add_epi32 (_mm256_unpacklo_epi64 (sq_lo, sq_hi),
+				 _mm256_unpackhi_epi64 (sq_lo, sq_hi));
+}
+
+__attribute__ ((target ("avx2")))
+static guint
+assign_clusters_avx2 (ClusterPixel8 *pixels,
+                      gsize          n_pixels,
+                      const Pixel8  *cluster_centres,
+                      gsize          n_cluster_centres)
+{
+	const __m256i rgb_mask = _mm256_set1_epi32 (0x00ffffff);
+	const __m256i zero = _mm256_setzero_si256 ();
+	guint n_assignments_changed = 0;
+	gsize i;
+
+	for (i = 0; i + 8 <= n_pixels; i += 8) {
+		__m256i p = _mm256_and_si256 (_mm256_loadu_si256 ((const __m256i *) &pixels[i]), rgb_mask);
+		__m256i p_lo = _mm256_unpacklo_epi8 (p, zero);
+		__m256i p_hi = _mm256_unpackhi_epi8 (p, zero);
+		__m256i best_distance = color_distance_avx2 (p_lo, p_hi, centre_to_epi16 (&cluster_centres[0]));
+		__m256i best_cluster = zero;
+		guint32 clusters[8];
+
+		for (gsize c = 1; c < n_cluster_centres; c++) {
+			__m256i distance = color_distance_avx2 (p_lo, p_hi, centre_to_epi16 (&cluster_centres[c]));
+			__m256i closer = _mm256_cmpgt_epi32 (best_distance, distance);
+
+			best_distance = _mm256_blendv_epi8 (best_distance, distance, closer);
+			best_cluster = _mm256_blendv_epi8 (best_cluster, _mm256_set1_epi32 (c), closer);
+		}
+
+		_mm256_storeu_si256 ((__m256i *) clusters, best_cluster);
+		n_assignments_changed += update_assignments (&pixels[i], clusters, 8);
+	}
+
+	return n_assignments_changed +
+	       assign_clusters_scalar (pixels + i, n_pixels - i, cluster_centres, n_cluster_centres);
+}
+#endif  /* HAVE_AVX2_KERNEL */
+
+/* Assigns each non-transparent pixel to its nearest cluster, returning the
+ * number of pixels whose assignment changed. The vectorised kernels give
+ * exactly the same results as the scalar one. */
+static guint
+assign_clusters (ClusterPixel8 *pixels,
+                 gsize          n_pixels,
+                 const Pixel8  *cluster_centres,
+                 gsize          n_cluster_centres)
+{
+#ifdef HAVE_AVX2_KERNEL
+	if (__builtin_cpu_supports ("avx2"))
+		return assign_clusters_avx2 (pixels, n_pixels, cluster_centres, n_cluster_centres);
+#endif
+#ifdef HAVE_SSE2_KERNEL
+	return assign_clusters_sse2 (pixels, n_pixels, cluster_centres, n_cluster_centres);
+#else
+	return assign_clusters_scalar (pixels, n_pixels, cluster_centres, n_cluster_centres);
+#endif
+}
+
 /* A variant of g_random_int_range() which chooses without replacement,
  * tracking the used integers in @used_ints and @n_used_ints.
  * Once all integers in 0..max_ints have been used once, it will choose
@@ -262,18 +460,8 @@ k_means (GArray    *colors,
 		}
 
 		/* Update assignments of colors to clusters. */
-		n_assignments_changed = 0;
-		for (ClusterPixel8 *p = pixels; p < pixels_end; p++) {
-			gsize new_cluster;
-
-			if (p->cluster >= G_N_ELEMENTS (cluster_centres))
-				continue;
-
-			new_cluster = nearest_cluster (&p->color, cluster_centres, G_N_ELEMENTS (cluster_centres));
-			if (new_cluster != p->cluster)
-				n_assignments_changed++;
-			p->cluster = new_cluster;
-		}
+		n_assignments_changed = assign_clusters (pixels, pixels_end - pixels,
+							 cluster_centres, G_N_ELEMENTS (cluster_centres));
 
 		n_iterations++;
 	} while (n_assignments_changed > assignments_termination_limit && n_iterations < 50);
@@ -293,6 +481,29 @@ k_means (GArray    *colors,
 	}
 }
 
+/* Scales @pixbuf down to the size k_means() works on, with an alpha channel
+ * for it to store the cluster assignments in. */
+static GdkPixbuf *
+scale_for_key_colors (GdkPixbuf *pixbuf)
+{
+	g_autoptr(GdkPixbuf) pb_small = NULL;
+
+	/* people almost always use BILINEAR scaling with pixbufs, but we can
+	 * use NEAREST here since we only care about the rough colour data, not
+	 * whether the edges in the image are smooth and visually appealing;
+	 * NEAREST is twice as fast as BILINEAR */
+	pb_small = gdk_pixbuf_scale_simple (pixbuf, 32, 32, GDK_INTERP_NEAREST);
+
+	/* require an alpha channel for storing temporary values; most images
+	 * have one already, about 2% don’t */
+	if (gdk_pixbuf_get_n_channels (pixbuf) != 4) {
+		g_autoptr(GdkPixbuf) temp = g_steal_pointer (&pb_small);
+		pb_small = gdk_pixbuf_add_alpha (temp, FALSE, 0, 0, 0);
+	}
+
+	return g_steal_pointer (&pb_small);
+}
+
 /**
  * gs_calculate_key_colors:
  * @pixbuf: an app icon to calculate key colors from
@@ -314,21 +525,499 @@ gs_calculate_key_colors (GdkPixbuf *pixbuf)
 	g_autoptr(GdkPixbuf) pb_small = NULL;
 	g_autoptr(GArray) colors = g_array_new (FALSE, FALSE, sizeof (GdkRGBA));
 
-	/* people almost always use BILINEAR scaling with pixbufs, but we can
-	 * use NEAREST here since we only care about the rough colour data, not
-	 * whether the edges in the image are smooth and visually appealing;
-	 * NEAREST is twice as fast as BILINEAR */
-	pb_small = gdk_pixbuf_scale_simple (pixbuf, 32, 32, GDK_INTERP_NEAREST);
+	pb_small = scale_for_key_colors (pixbuf);
 
-	/* require an alpha channel for storing temporary values; most images
-	 * have one already, about 2% don’t */
-	if (gdk_pixbuf_get_n_channels (pixbuf) != 4) {
-		g_autoptr(GdkPixbuf) temp = g_steal_pointer (&pb_small);
-		pb_small = gdk_pixbuf_add_alpha (temp, FALSE, 0, 0, 0);
+	/* get a list of key colors */
+	k_means (colors, pb_small);
+
+	return g_steal_pointer (&colors);
+}
+
+/* Bump this if the output of k_means() or the index format changes, to
+ * ignore old cache entries. */
+#define KEY_COLORS_CACHE_KIND "key-colors-2"
+
+/* An earlier version of the cache, with one file per entry, which is deleted
+ * when the cache is loaded. */
+#define KEY_COLORS_OLD_CACHE_KIND "key-colors-1"
+
+/* The most key colors kept in memory, and in the index file once it’s been
+ * compacted. Each entry is only a few bytes. */
+#define KEY_COLORS_MEMORY_CACHE_MAX 4096
+
+/* The most colors stored for each icon; this has to be at least @n_clusters. */
+#define KEY_COLORS_RECORD_MAX_COLORS 3
+
+/* A record in the index file. Records are appended as key colors are
+ * calculated, so a later record for the same checksum supersedes an earlier
+ * one, and the least recently used entries come first once the index has been
+ * compacted. */
+typedef struct {
+	gchar		checksum[64];  /* hex SHA-256, not nul-terminated */
+	guint8		n_colors;
+	guint8		rgb[3 * KEY_COLORS_RECORD_MAX_COLORS];
+} KeyColorsRecord;
+
+G_STATIC_ASSERT (sizeof (KeyColorsRecord) == 64 + 1 + 3 * KEY_COLORS_RECORD_MAX_COLORS);
+
+typedef struct {
+	gchar		*checksum;  /* (owned) */
+	GArray		*colors;  /* (owned) (element-type GdkRGBA) */
+	GList		 link;  /* in @key_colors_lru */
+} KeyColorsEntry;
+
+typedef enum {
+	KEY_COLORS_OP_LOAD,
+	KEY_COLORS_OP_SAVE,
+} KeyColorsOpKind;
+
+/* An I/O operation on the key colors cache, done in @key_colors_pool */
+typedef struct {
+	KeyColorsOpKind	 kind;
+	gchar		*checksum;  /* (owned) (nullable); %NULL for KEY_COLORS_OP_LOAD */
+	GArray		*colors;  /* (owned) (nullable) (element-type GdkRGBA); only for KEY_COLORS_OP_SAVE */
+} KeyColorsOp;
+
+static GMutex key_colors_mutex;
+static GHashTable *key_colors_cache = NULL;  /* (owned) (nullable) (lock key_colors_mutex) (element-type utf8 KeyColorsEntry) */
+static GQueue key_colors_lru = G_QUEUE_INIT;  /* (lock key_colors_mutex) (element-type KeyColorsEntry); most recently used first */
+static GThreadPool *key_colors_pool = NULL;  /* (owned) (nullable) (lock key_colors_mutex) */
+
+/* The number of records in the index file, including superseded ones. Only
+ * accessed by the thread doing the cache I/O, one operation at a time. */
+static guint key_colors_n_records = 0;
+
+static void
+key_colors_entry_free (KeyColorsEntry *entry)
+{
+	g_free (entry->checksum);
+	g_array_unref (entry->colors);
+	g_free (entry);
+}
+
+static void
+key_colors_op_free (KeyColorsOp *op)
+{
+	g_free (op->checksum);
+	g_clear_pointer (&op->colors, g_array_unref);
+	g_free (op);
+}
+
+/* Must be called with @key_colors_mutex held. */
+static void
+key_colors_cache_ensure_unlocked (void)
+{
+	if (key_colors_cache == NULL)
+		key_colors_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+							  NULL, (GDestroyNotify) key_colors_entry_free);
+}
+
+/* Looks up @checksum, and marks it as the most recently used entry.
+ *
+ * Must be called with @key_colors_mutex held. */
+static KeyColorsEntry *
+key_colors_cache_lookup_unlocked (const gchar *checksum)
+{
+	KeyColorsEntry *entry = g_hash_table_lookup (key_colors_cache, checksum);
+
+	if (entry != NULL) {
+		g_queue_unlink (&key_colors_lru, &entry->link);
+		g_queue_push_head_link (&key_colors_lru, &entry->link);
 	}
 
-	/* get a list of key colors */
+	return entry;
+}
+
+/* Adds a copy of @colors to the cache, as the caller may modify them, as its
+ * most recently used entry, or as its least recently used one if
+ * @least_recent is set. If the cache is full, the least recently used entry
+ * is evicted to make space. An existing entry is kept as it is.
+ *
+ * Must be called with @key_colors_mutex held. */
+static void
+key_colors_cache_insert_unlocked (const gchar *checksum,
+				  GArray *colors,
+				  gboolean least_recent)
+{
+	KeyColorsEntry *entry;
+
+	if (g_hash_table_contains (key_colors_cache, checksum))
+		return;
+
+	if (g_hash_table_size (key_colors_cache) >= KEY_COLORS_MEMORY_CACHE_MAX) {
+		KeyColorsEntry *lru_entry = g_queue_peek_tail (&key_colors_lru);
+
+		g_queue_unlink (&key_colors_lru, &lru_entry->link);
+		g_hash_table_remove (key_colors_cache, lru_entry->checksum);
+	}
+
+	entry = g_new0 (KeyColorsEntry, 1);
+	entry->checksum = g_strdup (checksum);
+	entry->colors = g_array_copy (colors);
+	entry->link.data = entry;
+	if (least_recent)
+		g_queue_push_tail_link (&key_colors_lru, &entry->link);
+	else
+		g_queue_push_head_link (&key_colors_lru, &entry->link);
+	g_hash_table_insert (key_colors_cache, entry->checksum, entry);
+}
+
+static gchar *
+key_colors_get_index_filename (GError **error)
+{
+	return gs_utils_get_cache_filename (KEY_COLORS_CACHE_KIND, "index",
+					    GS_UTILS_CACHE_FLAG_WRITEABLE |
+					    GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+					    error);
+}
+
+static void
+key_colors_record_init (KeyColorsRecord *record,
+			const gchar *checksum,
+			GArray *colors)
+{
+	g_assert (strlen (checksum) == sizeof (record->checksum));
+	g_assert (colors->len <= KEY_COLORS_RECORD_MAX_COLORS);
+
+	memset (record, 0, sizeof (*record));
+	memcpy (record->checksum, checksum, sizeof (record->checksum));
+	record->n_colors = colors->len;
+
+	/* k_means() outputs 8-bit colors, so this round-trips exactly */
+	for (guint i = 0; i < colors->len; i++) {
+		const GdkRGBA *color = &g_array_index (colors, GdkRGBA, i);
+
+		record->rgb[i * 3] = (guint8) (color->red * 255.0 + 0.5);
+		record->rgb[i * 3 + 1] = (guint8) (color->green * 255.0 + 0.5);
+		record->rgb[i * 3 + 2] = (guint8) (color->blue * 255.0 + 0.5);
+	}
+}
+
+/* Rewrites the index file with just the entries in memory, least recently used
+ * first, dropping superseded and evicted records. */
+static void
+key_colors_compact (const gchar *index_fn)
+{
+	g_autoptr(GByteArray) records = NULL;
+	g_autoptr(GError) local_error = NULL;
+	guint n_records = 0;
+
+	g_mutex_lock (&key_colors_mutex);
+	records = g_byte_array_sized_new (g_queue_get_length (&key_colors_lru) * sizeof (KeyColorsRecord));
+	for (GList *l = key_colors_lru.tail; l != NULL; l = l->prev) {
+		KeyColorsEntry *entry = l->data;
+		KeyColorsRecord record;
+
+		key_colors_record_init (&record, entry->checksum, entry->colors);
+		g_byte_array_append (records, (const guint8 *) &record, sizeof (record));
+		n_records++;
+	}
+	g_mutex_unlock (&key_colors_mutex);
+
+	if (!g_file_set_contents (index_fn, (const gchar *) records->data, records->len, &local_error)) {
+		g_debug ("failed to compact key colors index %s: %s", index_fn, local_error->message);
+		return;
+	}
+
+	key_colors_n_records = n_records;
+}
+
+/* Adds the entries in the index file to @key_colors_cache, deleting the old
+ * per-entry files from an earlier version of the cache. */
+static void
+key_colors_load (void)
+{
+	g_autofree gchar *index_fn = NULL;
+	g_autofree gchar *kind_dir = NULL;
+	g_autofree gchar *cache_dir = NULL;
+	g_autofree gchar *old_kind_dir = NULL;
+	g_autofree gchar *data = NULL;
+	gsize data_len = 0;
+	gsize n_records;
+	g_autoptr(GError) local_error = NULL;
+
+	index_fn = key_colors_get_index_filename (&local_error);
+	if (index_fn == NULL) {
+		g_debug ("failed to get key colors index filename: %s", local_error->message);
+		return;
+	}
+
+	kind_dir = g_path_get_dirname (index_fn);
+	cache_dir = g_path_get_dirname (kind_dir);
+	old_kind_dir = g_build_filename (cache_dir, KEY_COLORS_OLD_CACHE_KIND, NULL);
+	if (g_file_test (old_kind_dir, G_FILE_TEST_IS_DIR))
+		gs_utils_rmtree (old_kind_dir, NULL);
+
+	g_mutex_lock (&key_colors_mutex);
+	key_colors_cache_ensure_unlocked ();
+	g_mutex_unlock (&key_colors_mutex);
+
+	if (!g_file_get_contents (index_fn, &data, &data_len, NULL))
+		return;
+
+	/* a later record for a checksum supersedes an earlier one, so load
+	 * them newest first and keep the first one seen */
+	n_records = data_len / sizeof (KeyColorsRecord);
+	g_mutex_lock (&key_colors_mutex);
+	for (gsize i = n_records; i > 0; i--) {
+		const KeyColorsRecord *record = (const KeyColorsRecord *) (data + (i - 1) * sizeof (KeyColorsRecord));
+		g_autofree gchar *checksum = g_strndup (record->checksum, sizeof (record->checksum));
+		g_autoptr(GArray) colors = NULL;
+
+		if (record->n_colors > KEY_COLORS_RECORD_MAX_COLORS ||
+		    g_hash_table_contains (key_colors_cache, checksum))
+			continue;
+		if (g_hash_table_size (key_colors_cache) >= KEY_COLORS_MEMORY_CACHE_MAX)
+			break;
+
+		colors = g_array_sized_new (FALSE, FALSE, sizeof (GdkRGBA), record->n_colors);
+		for (guint j = 0; j < record->n_colors; j++) {
+			GdkRGBA color;
+
+			color.red = (gdouble) record->rgb[j * 3] / 255.0;
+			color.green = (gdouble) record->rgb[j * 3 + 1] / 255.0;
+			color.blue = (gdouble) record->rgb[j * 3 + 2] / 255.0;
+			color.alpha = 1.0;
+			g_array_append_val (colors, color);
+		}
+
+		/* older than anything already in memory */
+		key_colors_cache_insert_unlocked (checksum, colors, TRUE);
+	}
+	g_mutex_unlock (&key_colors_mutex);
+
+	key_colors_n_records = n_records;
+
+	/* drop superseded records, and any partly written one at the end
+	 * which would misalign the records appended after it */
+	if (data_len % sizeof (KeyColorsRecord) != 0 ||
+	    n_records > KEY_COLORS_MEMORY_CACHE_MAX)
+		key_colors_compact (index_fn);
+}
+
+/* Appends a record for @checksum to the index file, compacting it once it
+ * holds a lot of superseded or evicted records. */
+static void
+key_colors_save (const gchar *checksum,
+		 GArray *colors)
+{
+	g_autofree gchar *index_fn = NULL;
+	g_autoptr(GFile) index_file = NULL;
+	g_autoptr(GFileOutputStream) stream = NULL;
+	KeyColorsRecord record;
+	g_autoptr(GError) local_error = NULL;
+
+	index_fn = key_colors_get_index_filename (&local_error);
+	if (index_fn == NULL) {
+		g_debug ("failed to get key colors index filename: %s", local_error->message);
+		return;
+	}
+
+	if (key_colors_n_records >= 2 * KEY_COLORS_MEMORY_CACHE_MAX) {
+		key_colors_compact (index_fn);
+		return;
+	}
+
+	key_colors_record_init (&record, checksum, colors);
+	index_file = g_file_new_for_path (index_fn);
+	stream = g_file_append_to (index_file, G_FILE_CREATE_PRIVATE, NULL, &local_error);
+	if (stream == NULL ||
+	    !g_output_stream_write_all (G_OUTPUT_STREAM (stream), &record, sizeof (record), NULL, NULL, &local_error) ||
+	    !g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, &local_error)) {
+		g_debug ("failed to save key colors to %s: %s", index_fn, local_error->message);
+		return;
+	}
+
+	key_colors_n_records++;
+}
+
+static void
+key_colors_io_cb (gpointer data,
+		  gpointer user_data)
+{
+	KeyColorsOp *op = data;
+
+	switch (op->kind) {
+	case KEY_COLORS_OP_LOAD:
+		key_colors_load ();
+		break;
+	case KEY_COLORS_OP_SAVE:
+		key_colors_save (op->checksum, op->colors);
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	key_colors_op_free (op);
+}
+
+/* Queues @op to be done in a worker thread. The first operation to be queued
+ * also loads the cache from disk.
+ *
+ * Must be called with @key_colors_mutex held. */
+static void
+key_colors_push_op_unlocked (KeyColorsOpKind kind,
+			     const gchar *checksum,
+			     GArray *colors)
+{
+	KeyColorsOp *op;
+
+	/* the operations are done one at a time, in order */
+	if (key_colors_pool == NULL) {
+		KeyColorsOp *load_op = g_new0 (KeyColorsOp, 1);
+
+		key_colors_pool = g_thread_pool_new_full (key_colors_io_cb, NULL,
+							  (GDestroyNotify) key_colors_op_free,
+							  1, FALSE, NULL);
+		load_op->kind = KEY_COLORS_OP_LOAD;
+		g_thread_pool_push (key_colors_pool, load_op, NULL);
+	}
+
+	if (checksum == NULL)
+		return;
+
+	op = g_new0 (KeyColorsOp, 1);
+	op->kind = kind;
+	op->checksum = g_strdup (checksum);
+	op->colors = (colors != NULL) ? g_array_copy (colors) : NULL;
+	g_thread_pool_push (key_colors_pool, op, NULL);
+}
+
+static gchar *
+key_colors_compute_checksum (GdkPixbuf *pb_small)
+{
+	return g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+					    gdk_pixbuf_read_pixels (pb_small),
+					    gdk_pixbuf_get_byte_length (pb_small));
+}
+
+/**
+ * gs_calculate_key_colors_cached:
+ * @pixbuf: an app icon to calculate key colors from
+ *
+ * Like gs_calculate_key_colors(), but the results are cached, keyed by a
+ * checksum of the scaled-down icon, and reused for any identical icon rather
+ * than being calculated again.
+ *
+ * The most recently used entries are kept in memory, and in an index file in
+ * the user’s cache directory. It is loaded and saved in a worker thread, so
+ * this never blocks on I/O; until it has been loaded, the key colors may be
+ * calculated again.
+ *
+ * Returns: (transfer full) (element-type GdkRGBA): key colors for @pixbuf
+ * Since: 44
+ */
+GArray *
+gs_calculate_key_colors_cached (GdkPixbuf *pixbuf)
+{
+	KeyColorsEntry *entry;
+	g_autoptr(GdkPixbuf) pb_small = NULL;
+	g_autoptr(GArray) colors = g_array_new (FALSE, FALSE, sizeof (GdkRGBA));
+	g_autofree gchar *checksum = NULL;
+
+	pb_small = scale_for_key_colors (pixbuf);
+	checksum = key_colors_compute_checksum (pb_small);
+
+	g_mutex_lock (&key_colors_mutex);
+	key_colors_cache_ensure_unlocked ();
+	key_colors_push_op_unlocked (KEY_COLORS_OP_LOAD, NULL, NULL);
+
+	entry = key_colors_cache_lookup_unlocked (checksum);
+	if (entry != NULL) {
+		g_array_append_vals (colors, entry->colors->data, entry->colors->len);
+		g_mutex_unlock (&key_colors_mutex);
+
+		return g_steal_pointer (&colors);
+	}
+	g_mutex_unlock (&key_colors_mutex);
+
 	k_means (colors, pb_small);
 
+	g_mutex_lock (&key_colors_mutex);
+	key_colors_cache_insert_unlocked (checksum, colors, FALSE);
+	key_colors_push_op_unlocked (KEY_COLORS_OP_SAVE, checksum, colors);
+	g_mutex_unlock (&key_colors_mutex);
+
 	return g_steal_pointer (&colors);
 }
+
+/* Runs @kernel on @n_pixels RGBA @pixels, whose alpha bytes hold their
+ * current cluster, against @n_cluster_centres RGB @cluster_centres.
+ * Returns %FALSE if @kernel isn’t available on this machine. */
+gboolean
+gs_key_colors_assign_clusters_for_test (GsKeyColorsKernel  kernel,
+					guint8            *pixels,
+					gsize              n_pixels,
+					const guint8      *cluster_centres,
+					gsize              n_cluster_centres,
+					guint             *out_n_changed)
+{
+	ClusterPixel8 *cluster_pixels = (ClusterPixel8 *) pixels;
+	const Pixel8 *centres = (const Pixel8 *) cluster_centres;
+
+	G_STATIC_ASSERT (sizeof (ClusterPixel8) == 4);
+	G_STATIC_ASSERT (sizeof (Pixel8) == 3);
+
+	switch (kernel) {
+	case GS_KEY_COLORS_KERNEL_SCALAR:
+		*out_n_changed = assign_clusters_scalar (cluster_pixels, n_pixels, centres, n_cluster_centres);
+		return TRUE;
+	case GS_KEY_COLORS_KERNEL_SSE2:
+#ifdef HAVE_SSE2_KERNEL
+		*out_n_changed = assign_clusters_sse2 (cluster_pixels, n_pixels, centres, n_cluster_centres);
+		return TRUE;
+#else
+		return FALSE;
+#endif
+	case GS_KEY_COLORS_KERNEL_AVX2:
+#ifdef HAVE_AVX2_KERNEL
+		if (!__builtin_cpu_supports ("avx2"))
+			return FALSE;
+		*out_n_changed = assign_clusters_avx2 (cluster_pixels, n_pixels, centres, n_cluster_centres);
+		return TRUE;
+#else
+		return FALSE;
+#endif
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+/* Waits for the queued cache I/O to finish, then drops the in-memory cache and
+ * loads it again from disk, as a new process would. */
+void
+gs_key_colors_cache_reload_for_test (void)
+{
+	GThreadPool *pool;
+
+	g_mutex_lock (&key_colors_mutex);
+	pool = g_steal_pointer (&key_colors_pool);
+	g_mutex_unlock (&key_colors_mutex);
+
+	if (pool != NULL)
+		g_thread_pool_free (pool, FALSE, TRUE);
+
+	g_mutex_lock (&key_colors_mutex);
+	g_queue_init (&key_colors_lru);
+	g_clear_pointer (&key_colors_cache, g_hash_table_unref);
+	g_mutex_unlock (&key_colors_mutex);
+
+	key_colors_load ();
+}
+
+/* Returns the cached key colors for @pixbuf, without calculating them on a
+ * miss. */
+GArray *
+gs_key_colors_cache_lookup_for_test (GdkPixbuf *pixbuf)
+{
+	KeyColorsEntry *entry;
+	g_autoptr(GdkPixbuf) pb_small = scale_for_key_colors (pixbuf);
+	g_autofree gchar *checksum = key_colors_compute_checksum (pb_small);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&key_colors_mutex);
+
+	if (key_colors_cache == NULL)
+		return NULL;
+
+	entry = key_colors_cache_lookup_unlocked (checksum);
+	return (entry != NULL) ? g_array_copy (entry->colors) : NULL;
+}
@@ -23,5 +23,6 @@
 G_BEGIN_DECLS
 
 GArray	*gs_calculate_key_colors	(GdkPixbuf	*pixbuf);
+GArray	*gs_calculate_key_colors_cached	(GdkPixbuf	*pixbuf);
 
 G_END_DECLS
@@ -40,26 +40,51 @@
 #include <locale.h>
 #include <math.h>
 #include <string.h>
+#include <glib/gstdio.h>
 
 G_DEFINE_QUARK (gs-odrs-provider-error-quark, gs_odrs_provider_error)
 
-/* Element in self->ratings, all allocated in one big block and sorted
- * alphabetically to reduce the number of allocations and fragmentation. */
+/* The ratings downloaded as JSON are converted once into a binary cache file,
+ * which is then mapped and searched in place, so loading them needs no
+ * parsing and almost no heap.
+ *
+ * The file is a #GsOdrsRatingsHeader, followed by the #GsOdrsRating entries
+ * sorted by app ID, followed by a string table of the nul-terminated app IDs.
+ * All integers are little-endian.
+ *
+ * The header records the modification time and size of the JSON the file was
+ * converted from, so the file is converted again whenever the JSON changes,
+ * even if that happens within a second of the last conversion. */
+#define GS_ODRS_RATINGS_MAGIC "GSODRSR"
+#define GS_ODRS_RATINGS_VERSION 2
+
 typedef struct {
-	gchar *app_id;  /* (owned) */
+	gchar magic[8];
+	guint32 version;
+	guint32 n_ratings;
+	gint64 source_mtime_ns;  /* of the JSON, in nanoseconds since the epoch */
+	guint64 source_size;  /* of the JSON */
+} GsOdrsRatingsHeader;
+
+typedef struct {
+	guint32 app_id_offset;  /* from the start of the file */
 	guint32 n_star_ratings[6];
+	gint32 wilson_rating;  /* from gs_utils_get_wilson_rating() */
 } GsOdrsRating;
 
-static int
-rating_compare (const GsOdrsRating *a, const GsOdrsRating *b)
-{
-	return g_strcmp0 (a->app_id, b->app_id);
-}
+G_STATIC_ASSERT (sizeof (GsOdrsRatingsHeader) == 32);
+G_STATIC_ASSERT (sizeof (GsOdrsRating) == 32);
 
-static void
-rating_clear (GsOdrsRating *rating)
+/* Used while converting the JSON; @app_id is owned by the #JsonParser */
+typedef struct {
+	const gchar *app_id;
+	guint32 n_star_ratings[6];
+} GsOdrsParsedRating;
+
+static int
+parsed_rating_compare (const GsOdrsParsedRating *a, const GsOdrsParsedRating *b)
 {
-	g_free (rating->app_id);
+	return strcmp (a->app_id, b->app_id);
 }
 
 struct _GsOdrsProvider
@@ -69,7 +94,7 @@ struct _GsOdrsProvider
 	gchar		*distro;  /* (not nullable) (owned) */
 	gchar		*user_hash;  /* (not nullable) (owned) */
 	gchar		*review_server;  /* (not nullable) (owned) */
-	GArray		*ratings;  /* (element-type GsOdrsRating) (mutex ratings_mutex) (owned) (nullable) */
+	GBytes		*ratings;  /* (mutex ratings_mutex) (owned) (nullable), in the binary cache format */
 	GMutex		 ratings_mutex;
 	guint64		 max_cache_age_secs;
 	guint		 n_results_max;
@@ -90,9 +115,9 @@ typedef enum {
 static GParamSpec *obj_props[PROP_SESSION + 1] = { NULL, };
 
 static gboolean
-gs_odrs_provider_load_ratings_for_app (JsonObject   *json_app,
-                                       const gchar  *app_id,
-                                       GsOdrsRating *rating_out)
+gs_odrs_provider_load_ratings_for_app (JsonObject         *json_app,
+                                       const gchar        *app_id,
+                                       GsOdrsParsedRating *rating_out)
 {
 	guint i;
 	const gchar *names[] = { "star0", "star1", "star2", "star3",
@@ -104,15 +129,23 @@ gs_odrs_provider_load_ratings_for_app (JsonObject   *json_app,
 		rating_out->n_star_ratings[i] = (guint64) json_object_get_int_member (json_app, names[i]);
 	}
 
-	rating_out->app_id = g_strdup (app_id);
+	rating_out->app_id = app_id;
 
 	return TRUE;
 }
 
-static gboolean
-gs_odrs_provider_load_ratings (GsOdrsProvider  *self,
-                               const gchar     *filename,
-                               GError         **error)
+static gint64
+gs_odrs_provider_get_mtime_ns (const GStatBuf *stat_buf)
+{
+	return (gint64) stat_buf->st_mtim.tv_sec * G_GINT64_CONSTANT (1000000000) + stat_buf->st_mtim.tv_nsec;
+}
+
+/* Parses the ratings JSON in @filename, which was stat-ed as @json_stat before
+ * being read, and returns it in the binary format */
+static GBytes *
+gs_odrs_provider_convert_ratings (const gchar     *filename,
+                                  const GStatBuf  *json_stat,
+                                  GError         **error)
 {
 	JsonNode *json_root;
 	JsonObject *json_item;
@@ -120,8 +153,10 @@ gs_odrs_provider_load_ratings (GsOdrsProvider  *self,
 	const gchar *app_id;
 	JsonNode *json_app_node;
 	JsonObjectIter iter;
-	g_autoptr(GArray) new_ratings = NULL;
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(GArray) parsed = NULL;
+	g_autoptr(GByteArray) buf = NULL;
+	GsOdrsRatingsHeader header = { GS_ODRS_RATINGS_MAGIC, 0, 0, 0, 0 };
+	gsize strings_offset;
 	g_autoptr(GError) local_error = NULL;
 
 	/* parse the data and find the success */
@@ -131,7 +166,7 @@ gs_odrs_provider_load_ratings (GsOdrsProvider  *self,
 			     GS_ODRS_PROVIDER_ERROR,
 			     GS_ODRS_PROVIDER_ERROR_PARSING_DATA,
 			     "Error parsing ODRS data: %s", local_error->message);
-		return FALSE;
+		return NULL;
 	}
 	json_root = json_parser_get_root (json_parser);
 	if (json_root == NULL) {
@@ -139,28 +174,27 @@ gs_odrs_provider_load_ratings (GsOdrsProvider  *self,
 				     GS_ODRS_PROVIDER_ERROR,
 				     GS_ODRS_PROVIDER_ERROR_PARSING_DATA,
 				     "no ratings root");
-		return FALSE;
+		return NULL;
 	}
 	if (json_node_get_node_type (json_root) != JSON_NODE_OBJECT) {
 		g_set_error_literal (error,
 				     GS_ODRS_PROVIDER_ERROR,
 				     GS_ODRS_PROVIDER_ERROR_PARSING_DATA,
 				     "no ratings array");
-		return FALSE;
+		return NULL;
 	}
 
 	json_item = json_node_get_object (json_root);
 
-	new_ratings = g_array_sized_new (FALSE,  /* don’t zero-terminate */
-					 FALSE,  /* don’t clear */
-					 sizeof (GsOdrsRating),
-					 json_object_get_size (json_item));
-	g_array_set_clear_func (new_ratings, (GDestroyNotify) rating_clear);
+	parsed = g_array_sized_new (FALSE,  /* don’t zero-terminate */
+				    FALSE,  /* don’t clear */
+				    sizeof (GsOdrsParsedRating),
+				    json_object_get_size (json_item));
 
 	/* parse each app */
 	json_object_iter_init (&iter, json_item);
 	while (json_object_iter_next (&iter, &app_id, &json_app_node)) {
-		GsOdrsRating rating;
+		GsOdrsParsedRating rating;
 		JsonObject *json_app;
 
 		if (!JSON_NODE_HOLDS_OBJECT (json_app_node))
@@ -168,15 +202,195 @@ gs_odrs_provider_load_ratings (GsOdrsProvider  *self,
 		json_app = json_node_get_object (json_app_node);
 
 		if (gs_odrs_provider_load_ratings_for_app (json_app, app_id, &rating))
-			g_array_append_val (new_ratings, rating);
+			g_array_append_val (parsed, rating);
 	}
 
 	/* Allow for binary searches later. */
-	g_array_sort (new_ratings, (GCompareFunc) rating_compare);
+	g_array_sort (parsed, (GCompareFunc) parsed_rating_compare);
+
+	/* write the header and the fixed-width entries, then the strings */
+	header.version = GUINT32_TO_LE (GS_ODRS_RATINGS_VERSION);
+	header.n_ratings = GUINT32_TO_LE (parsed->len);
+	header.source_mtime_ns = GINT64_TO_LE (gs_odrs_provider_get_mtime_ns (json_stat));
+	header.source_size = GUINT64_TO_LE ((guint64) json_stat->st_size);
+	strings_offset = sizeof (GsOdrsRatingsHeader) + parsed->len * sizeof (GsOdrsRating);
+
+	buf = g_byte_array_sized_new (strings_offset + parsed->len * 32);
+	g_byte_array_append (buf, (const guint8 *) &header, sizeof (header));
+	g_byte_array_set_size (buf, strings_offset);
+
+	for (guint i = 0; i < parsed->len; i++) {
+		const GsOdrsParsedRating *rating = &g_array_index (parsed, GsOdrsParsedRating, i);
+		GsOdrsRating entry;
+
+		entry.app_id_offset = GUINT32_TO_LE (buf->len);
+		for (guint j = 0; j < 6; j++)
+			entry.n_star_ratings[j] = GUINT32_TO_LE (rating->n_star_ratings[j]);
+		entry.wilson_rating = GINT32_TO_LE (gs_utils_get_wilson_rating (rating->n_star_ratings[1],
+										 rating->n_star_ratings[2],
+										 rating->n_star_ratings[3],
+										 rating->n_star_ratings[4],
+										 rating->n_star_ratings[5]));
+		memcpy (buf->data + sizeof (GsOdrsRatingsHeader) + i * sizeof (GsOdrsRating),
+			&entry, sizeof (entry));
+
+		g_byte_array_append (buf, (const guint8 *) rating->app_id, strlen (rating->app_id) + 1);
+	}
+
+	return g_byte_array_free_to_bytes (g_steal_pointer (&buf));
+}
+
+/* Checks @ratings is in the binary format, so lookups can trust it */
+static gboolean
+gs_odrs_provider_validate_ratings (GBytes  *ratings,
+                                   GError **error)
+{
+	gsize size;
+	const guint8 *data = g_bytes_get_data (ratings, &size);
+	const GsOdrsRatingsHeader *header = (const GsOdrsRatingsHeader *) data;
+	const GsOdrsRating *entries = (const GsOdrsRating *) (data + sizeof (GsOdrsRatingsHeader));
+	guint32 n_ratings;
+	gsize strings_offset;
+
+	if (size < sizeof (GsOdrsRatingsHeader) ||
+	    memcmp (header->magic, GS_ODRS_RATINGS_MAGIC, sizeof (header->magic)) != 0 ||
+	    GUINT32_FROM_LE (header->version) != GS_ODRS_RATINGS_VERSION) {
+		g_set_error_literal (error,
+				     GS_ODRS_PROVIDER_ERROR,
+				     GS_ODRS_PROVIDER_ERROR_PARSING_DATA,
+				     "unknown ratings cache format");
+		return FALSE;
+	}
+
+	n_ratings = GUINT32_FROM_LE (header->n_ratings);
+	strings_offset = sizeof (GsOdrsRatingsHeader) + (gsize) n_ratings * sizeof (GsOdrsRating);
+	if (strings_offset > size ||
+	    (n_ratings > 0 && data[size - 1] != '\0')) {
+		g_set_error_literal (error,
+				     GS_ODRS_PROVIDER_ERROR,
+				     GS_ODRS_PROVIDER_ERROR_PARSING_DATA,
+				     "truncated ratings cache");
+		return FALSE;
+	}
+
+	for (guint32 i = 0; i < n_ratings; i++) {
+		guint32 offset = GUINT32_FROM_LE (entries[i].app_id_offset);
+
+		if (offset < strings_offset || offset >= size) {
+			g_set_error_literal (error,
+					     GS_ODRS_PROVIDER_ERROR,
+					     GS_ODRS_PROVIDER_ERROR_PARSING_DATA,
+					     "invalid ratings cache string offset");
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* Checks @ratings, which must be valid, were converted from the JSON which
+ * was stat-ed as @json_stat */
+static gboolean
+gs_odrs_provider_ratings_match_source (GBytes          *ratings,
+                                       const GStatBuf  *json_stat,
+                                       GError         **error)
+{
+	const GsOdrsRatingsHeader *header = g_bytes_get_data (ratings, NULL);
+
+	if (GINT64_FROM_LE (header->source_mtime_ns) != gs_odrs_provider_get_mtime_ns (json_stat) ||
+	    GUINT64_FROM_LE (header->source_size) != (guint64) json_stat->st_size) {
+		g_set_error_literal (error,
+				     GS_ODRS_PROVIDER_ERROR,
+				     GS_ODRS_PROVIDER_ERROR_PARSING_DATA,
+				     "ratings cache is out of date");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static const GsOdrsRating *
+gs_odrs_provider_lookup_rating (GBytes      *ratings,
+                                const gchar *app_id)
+{
+	const guint8 *data = g_bytes_get_data (ratings, NULL);
+	const GsOdrsRatingsHeader *header = (const GsOdrsRatingsHeader *) data;
+	const GsOdrsRating *entries = (const GsOdrsRating *) (data + sizeof (GsOdrsRatingsHeader));
+	guint32 lower = 0;
+	guint32 upper = GUINT32_FROM_LE (header->n_ratings);
+
+	while (lower < upper) {
+		guint32 mid = lower + (upper - lower) / 2;
+		const gchar *mid_app_id = (const gchar *) data + GUINT32_FROM_LE (entries[mid].app_id_offset);
+		gint cmp = strcmp (app_id, mid_app_id);
+
+		if (cmp == 0)
+			return &entries[mid];
+		else if (cmp < 0)
+			upper = mid;
+		else
+			lower = mid + 1;
+	}
+
+	return NULL;
+}
+
+/* Loads the ratings from @filename, the downloaded JSON, using the binary
+ * cache file next to it if it was converted from the current JSON, or
+ * converting the JSON into it otherwise. If the JSON is missing, the binary
+ * cache file is used as it is. */
+static gboolean
+gs_odrs_provider_load_ratings (GsOdrsProvider  *self,
+                               const gchar     *filename,
+                               GError         **error)
+{
+	g_autofree gchar *cache_dir = g_path_get_dirname (filename);
+	g_autofree gchar *binary_filename = g_build_filename (cache_dir, "ratings.bin", NULL);
+	g_autoptr(GBytes) new_ratings = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(GError) local_error = NULL;
+	g_autoptr(GMappedFile) mapped_file = NULL;
+	GStatBuf json_stat;
+	gboolean have_json = (g_stat (filename, &json_stat) == 0);
+
+	mapped_file = g_mapped_file_new (binary_filename, FALSE, &local_error);
+	if (mapped_file != NULL) {
+		new_ratings = g_mapped_file_get_bytes (mapped_file);
+		if (!gs_odrs_provider_validate_ratings (new_ratings, &local_error) ||
+		    (have_json && !gs_odrs_provider_ratings_match_source (new_ratings, &json_stat, &local_error)))
+			g_clear_pointer (&new_ratings, g_bytes_unref);
+	}
+	if (new_ratings == NULL) {
+		if (!g_error_matches (local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_debug ("Failed to load ‘%s’, converting ‘%s’ again: %s",
+				 binary_filename, filename, local_error->message);
+		g_clear_error (&local_error);
+	}
+
+	if (new_ratings == NULL) {
+		if (!have_json) {
+			g_set_error (error,
+				     GS_ODRS_PROVIDER_ERROR,
+				     GS_ODRS_PROVIDER_ERROR_PARSING_DATA,
+				     "Error parsing ODRS data: ‘%s’ not found", filename);
+			return FALSE;
+		}
+
+		new_ratings = gs_odrs_provider_convert_ratings (filename, &json_stat, error);
+		if (new_ratings == NULL)
+			return FALSE;
+
+		/* if it can’t be cached, still use the converted data */
+		if (!g_file_set_contents (binary_filename,
+					  g_bytes_get_data (new_ratings, NULL),
+					  g_bytes_get_size (new_ratings),
+					  &local_error))
+			g_debug ("Failed to save ‘%s’: %s", binary_filename, local_error->message);
+	}
 
 	/* Update the shared state */
 	locker = g_mutex_locker_new (&self->ratings_mutex);
-	g_clear_pointer (&self->ratings, g_array_unref);
+	g_clear_pointer (&self->ratings, g_bytes_unref);
 	self->ratings = g_steal_pointer (&new_ratings);
 
 	return TRUE;
@@ -598,19 +812,16 @@ gs_odrs_provider_refine_ratings (GsOdrsProvider  *self,
 
 	for (guint i = 0; i < reviewable_ids->len; i++) {
 		const gchar *id = g_ptr_array_index (reviewable_ids, i);
-		const GsOdrsRating search_rating = { (gchar *) id, { 0, }};
-		guint found_index;
 		const GsOdrsRating *found_rating;
 
-		if (!g_array_binary_search (self->ratings, &search_rating,
-					    (GCompareFunc) rating_compare, &found_index))
+		found_rating = gs_odrs_provider_lookup_rating (self->ratings, id);
+		if (found_rating == NULL)
 			continue;
 
-		found_rating = &g_array_index (self->ratings, GsOdrsRating, found_index);
-
 		/* copy into accumulator array */
 		for (guint j = 0; j < 6; j++)
-			ratings_raw[j] += found_rating->n_star_ratings[j];
+			ratings_raw[j] += GUINT32_FROM_LE (found_rating->n_star_ratings[j]);
+		rating = GINT32_FROM_LE (found_rating->wilson_rating);
 		cnt++;
 	}
 	if (cnt == 0)
@@ -625,12 +836,13 @@ gs_odrs_provider_refine_ratings (GsOdrsProvider  *self,
 		g_array_append_val (review_ratings, ratings_raw[i]);
 	gs_app_set_review_ratings (app, review_ratings);
 
-	/* find the wilson rating */
-	rating = gs_utils_get_wilson_rating (g_array_index (review_ratings, guint32, 1),
-					     g_array_index (review_ratings, guint32, 2),
-					     g_array_index (review_ratings, guint32, 3),
-					     g_array_index (review_ratings, guint32, 4),
-					     g_array_index (review_ratings, guint32, 5));
+	/* find the wilson rating; it’s precomputed if only one ID matched */
+	if (cnt > 1)
+		rating = gs_utils_get_wilson_rating (g_array_index (review_ratings, guint32, 1),
+						     g_array_index (review_ratings, guint32, 2),
+						     g_array_index (review_ratings, guint32, 3),
+						     g_array_index (review_ratings, guint32, 4),
+						     g_array_index (review_ratings, guint32, 5));
 	if (rating > 0)
 		gs_app_set_rating (app, rating);
 	return TRUE;
@@ -1194,7 +1406,7 @@ gs_odrs_provider_finalize (GObject *object)
 	g_free (self->user_hash);
 	g_free (self->distro);
 	g_free (self->review_server);
-	g_clear_pointer (&self->ratings, g_array_unref);
+	g_clear_pointer (&self->ratings, g_bytes_unref);
 	g_mutex_clear (&self->ratings_mutex);
 
 	G_OBJECT_CLASS (gs_odrs_provider_parent_class)->finalize (object);
@@ -27,6 +27,12 @@
  * Retrieve the resulting #GsAppList using
  * gs_plugin_job_list_apps_get_result_list().
  *
+ * The refined results of queries which only depend on app metadata (such as
+ * #GsAppQuery:is-featured or #GsAppQuery:category) are cached in the
+ * #GsPluginLoader, so repeating such a query only has to filter and sort them
+ * again. The cache is invalidated whenever a plugin signals that its data has
+ * changed.
+ *
  * See also: #GsPluginClass.list_apps_async
  * Since: 43
  */
@@ -61,6 +67,8 @@ struct _GsPluginJobListApps
 	GsAppList *merged_list;  /* (owned) (nullable) */
 	GError *saved_error;  /* (owned) (nullable) */
 	guint n_pending_ops;
+	gchar *cache_key;  /* (owned) (nullable) */
+	guint cache_generation;
 
 	/* Results. */
 	GsAppList *result_list;  /* (owned) (nullable) */
@@ -90,6 +98,7 @@ gs_plugin_job_list_apps_dispose (GObject *object)
 
 	g_clear_object (&self->result_list);
 	g_clear_object (&self->query);
+	g_clear_pointer (&self->cache_key, g_free);
 
 	G_OBJECT_CLASS (gs_plugin_job_list_apps_parent_class)->dispose (object);
 }
@@ -205,6 +214,93 @@ app_filter_qt_for_gtk_and_compatible (GsApp    *app,
 	return gs_plugin_loader_app_is_compatible (plugin_loader, app);
 }
 
+static GsPluginRefineFlags
+get_refine_flags (GsPluginJobListApps *self)
+{
+	GsPluginRefineFlags refine_flags = GS_PLUGIN_REFINE_FLAGS_NONE;
+	GsAppQueryLicenseType license_type = GS_APP_QUERY_LICENSE_ANY;
+
+	if (self->query != NULL) {
+		refine_flags = gs_app_query_get_refine_flags (self->query);
+		license_type = gs_app_query_get_license_type (self->query);
+	}
+
+	if (!(refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE) &&
+	    license_type != GS_APP_QUERY_LICENSE_ANY) {
+		/* Needs the license information when filtering with it */
+		refine_flags |= GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE;
+	}
+
+	return refine_flags;
+}
+
+static void
+append_strv (GString             *key,
+             const gchar         *name,
+             const gchar * const *strv)
+{
+	if (strv == NULL)
+		return;
+
+	g_string_append_printf (key, "%s=", name);
+	for (gsize i = 0; strv[i] != NULL; i++)
+		g_string_append_printf (key, "%s%s", (i > 0) ? "," : "", strv[i]);
+	g_string_append_c (key, ';');
+}
+
+/* Build a canonical key for the query, from all the properties which affect
+ * what the plugins return and how it’s refined. The filtering, sorting and
+ * deduplication are redone on each run, so don’t need to be in the key.
+ *
+ * Queries which depend on the state of installed apps, or on anything other
+ * than the app metadata, are not cached and %NULL is returned. */
+static gchar *
+query_to_cache_key (GsAppQuery          *query,
+                    GsPluginRefineFlags  refine_flags)
+{
+	GsCategory *category;
+	GDateTime *released_since;
+	g_autoptr(GString) key = NULL;
+
+	if (query == NULL ||
+	    gs_app_query_get_n_properties_set (query) == 0 ||
+	    gs_app_query_get_is_installed (query) != GS_APP_QUERY_TRISTATE_UNSET ||
+	    gs_app_query_get_keywords (query) != NULL ||
+	    gs_app_query_get_alternate_of (query) != NULL ||
+	    gs_app_query_get_provides_files (query) != NULL ||
+	    gs_app_query_get_provides (query, NULL) != GS_APP_QUERY_PROVIDES_UNKNOWN)
+		return NULL;
+
+	key = g_string_new (NULL);
+	g_string_append_printf (key, "refine-flags=%" G_GUINT64_FORMAT ";max-results=%u;",
+				(guint64) refine_flags,
+				gs_app_query_get_max_results (query));
+	g_string_append_printf (key, "is-curated=%d;is-featured=%d;",
+				gs_app_query_get_is_curated (query),
+				gs_app_query_get_is_featured (query));
+
+	/* key on the exact time, as the plugins filter on it; rounding it
+	 * would return apps released before it from a slightly earlier query */
+	released_since = gs_app_query_get_released_since (query);
+	if (released_since != NULL)
+		g_string_append_printf (key, "released-since=%" G_GINT64_FORMAT ".%06d;",
+					g_date_time_to_unix (released_since),
+					g_date_time_get_microsecond (released_since));
+
+	category = gs_app_query_get_category (query);
+	if (category != NULL) {
+		GsCategory *parent = gs_category_get_parent (category);
+		g_string_append_printf (key, "category=%s/%s;",
+					(parent != NULL) ? gs_category_get_id (parent) : "",
+					gs_category_get_id (category));
+	}
+
+	append_strv (key, "deployment-featured", gs_app_query_get_deployment_featured (query));
+	append_strv (key, "developers", gs_app_query_get_developers (query));
+
+	return g_string_free (g_steal_pointer (&key), FALSE);
+}
+
 static void plugin_list_apps_cb (GObject      *source_object,
                                  GAsyncResult *result,
                                  gpointer      user_data);
@@ -213,6 +309,8 @@ static void finish_op (GTask  *task,
 static void refine_cb (GObject      *source_object,
                        GAsyncResult *result,
                        gpointer      user_data);
+static void add_to_cache (GTask     *task,
+                          GsAppList *refined_list);
 static void finish_task (GTask     *task,
                          GsAppList *merged_list);
 
@@ -233,16 +331,32 @@ gs_plugin_job_list_apps_run_async (GsPluginJob         *job,
 	g_task_set_source_tag (task, gs_plugin_job_list_apps_run_async);
 	g_task_set_task_data (task, g_object_ref (plugin_loader), (GDestroyNotify) g_object_unref);
 
+#ifdef HAVE_SYSPROF
+	self->begin_time_nsec = SYSPROF_CAPTURE_CURRENT_TIME;
+#endif
+
+	/* use the results of an identical earlier query if nothing has
+	 * changed since */
+	self->cache_key = query_to_cache_key (self->query, get_refine_flags (self));
+	if (self->cache_key != NULL) {
+		g_autoptr(GsAppList) cached_list = NULL;
+
+		cached_list = gs_plugin_loader_lookup_list_apps_cache (plugin_loader,
+								       self->cache_key,
+								       &self->cache_generation);
+		if (cached_list != NULL) {
+			g_debug ("Using cached results for %s", self->cache_key);
+			finish_task (task, cached_list);
+			return;
+		}
+	}
+
 	/* run each plugin, keeping a counter of pending operations which is
 	 * initialised to 1 until all the operations are started */
 	self->n_pending_ops = 1;
 	self->merged_list = gs_app_list_new ();
 	plugins = gs_plugin_loader_get_plugins (plugin_loader);
 
-#ifdef HAVE_SYSPROF
-	self->begin_time_nsec = SYSPROF_CAPTURE_CURRENT_TIME;
-#endif
-
 	for (guint i = 0; i < plugins->len; i++) {
 		GsPlugin *plugin = g_ptr_array_index (plugins, i);
 		GsPluginClass *plugin_class = GS_PLUGIN_GET_CLASS (plugin);
@@ -313,8 +427,7 @@ finish_op (GTask  *task,
 	GCancellable *cancellable = g_task_get_cancellable (task);
 	GsPluginLoader *plugin_loader = g_task_get_task_data (task);
 	g_autoptr(GsAppList) merged_list = NULL;
-	GsPluginRefineFlags refine_flags = GS_PLUGIN_REFINE_FLAGS_NONE;
-	GsAppQueryLicenseType license_type = GS_APP_QUERY_LICENSE_ANY;
+	GsPluginRefineFlags refine_flags;
 	g_autoptr(GError) error_owned = g_steal_pointer (&error);
 
 	if (error_owned != NULL && self->saved_error == NULL)
@@ -338,16 +451,7 @@ finish_op (GTask  *task,
 	}
 
 	/* run refine() on each one if required */
-	if (self->query != NULL) {
-		refine_flags = gs_app_query_get_refine_flags (self->query);
-		license_type = gs_app_query_get_license_type (self->query);
-	}
-
-	if (!(refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE) &&
-	    license_type != GS_APP_QUERY_LICENSE_ANY) {
-		/* Needs the license information when filtering with it */
-		refine_flags |= GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE;
-	}
+	refine_flags = get_refine_flags (self);
 
 	if (merged_list != NULL &&
 	    gs_app_list_length (merged_list) > 0 &&
@@ -363,6 +467,7 @@ finish_op (GTask  *task,
 						    g_object_ref (task));
 	} else {
 		g_debug ("No apps to refine");
+		add_to_cache (task, merged_list);
 		finish_task (task, merged_list);
 	}
 }
@@ -386,9 +491,22 @@ refine_cb (GObject      *source_object,
 		return;
 	}
 
+	add_to_cache (task, new_list);
 	finish_task (task, new_list);
 }
 
+static void
+add_to_cache (GTask     *task,
+              GsAppList *refined_list)
+{
+	GsPluginJobListApps *self = g_task_get_source_object (task);
+	GsPluginLoader *plugin_loader = g_task_get_task_data (task);
+
+	if (self->cache_key != NULL)
+		gs_plugin_loader_add_list_apps_cache (plugin_loader, self->cache_key,
+						      self->cache_generation, refined_list);
+}
+
 static void
 finish_task (GTask     *task,
              GsAppList *merged_list)
@@ -929,3 +929,37 @@ gs_plugin_job_refine_get_result_list (GsPluginJobRefine *self)
 
 	return self->result_list;
 }
+
+/**
+ * gs_plugin_job_refine_get_app_list:
+ * @self: a #GsPluginJobRefine
+ *
+ * Get the list of apps which the job was created to refine.
+ *
+ * Returns: (transfer none) (not nullable): the apps to refine
+ * Since: 44
+ */
+GsAppList *
+gs_plugin_job_refine_get_app_list (GsPluginJobRefine *self)
+{
+	g_return_val_if_fail (GS_IS_PLUGIN_JOB_REFINE (self), NULL);
+
+	return self->app_list;
+}
+
+/**
+ * gs_plugin_job_refine_get_flags:
+ * @self: a #GsPluginJobRefine
+ *
+ * Get the flags which affect what is refined.
+ *
+ * Returns: the refine flags
+ * Since: 44
+ */
+GsPluginRefineFlags
+gs_plugin_job_refine_get_flags (GsPluginJobRefine *self)
+{
+	g_return_val_if_fail (GS_IS_PLUGIN_JOB_REFINE (self), GS_PLUGIN_REFINE_FLAGS_NONE);
+
+	return self->flags;
+}
@@ -27,5 +27,7 @@ GsPluginJob	*gs_plugin_job_refine_new		(GsAppList           *app_list,
 							 GsPluginRefineFlags  flags);
 
 GsAppList	*gs_plugin_job_refine_get_result_list	(GsPluginJobRefine   *self);
+GsAppList	*gs_plugin_job_refine_get_app_list	(GsPluginJobRefine   *self);
+GsPluginRefineFlags gs_plugin_job_refine_get_flags	(GsPluginJobRefine   *self);
 
 G_END_DECLS
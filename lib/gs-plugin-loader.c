@@ -22,6 +22,7 @@
 #include "gs-app-collation.h"
 #include "gs-app-private.h"
 #include "gs-app-list-private.h"
+#include "gs-cache-manager.h"
 #include "gs-category-manager.h"
 #include "gs-category-private.h"
 #include "gs-external-appstream-utils.h"
@@ -37,6 +38,27 @@
 #define GS_PLUGIN_LOADER_UPDATES_CHANGED_DELAY	3	/* s */
 #define GS_PLUGIN_LOADER_RELOAD_DELAY		5	/* s */
 
+/* Operations scheduled with gs_plugin_loader_schedule_task() or
+ * gs_plugin_loader_schedule_job() are queued in one of these lanes, so that
+ * queued background work can never delay an operation the user is waiting
+ * for. */
+typedef enum {
+	GS_PLUGIN_LOADER_LANE_INTERACTIVE,
+	GS_PLUGIN_LOADER_LANE_BACKGROUND,
+	GS_PLUGIN_LOADER_N_LANES
+} GsPluginLoaderLane;
+
+static const gchar *lane_names[GS_PLUGIN_LOADER_N_LANES] = { "interactive", "background" };
+
+typedef struct {
+	GThreadPool		*pool;  /* (owned) */
+	guint			 n_queued;  /* (mutex queue_mutex) */
+	guint			 n_running;  /* (mutex queue_mutex); including async jobs, which don’t hold a thread */
+	guint			 n_started;  /* (mutex queue_mutex) */
+	gint64			 total_wait_usec;  /* (mutex queue_mutex) */
+	gint64			 max_wait_usec;  /* (mutex queue_mutex) */
+} GsPluginLoaderQueue;
+
 struct _GsPluginLoader
 {
 	GObject			 parent;
@@ -55,7 +77,10 @@ struct _GsPluginLoader
 	GsAppList		*pending_apps;		/* (nullable) (owned) */
 	GCancellable		*pending_apps_cancellable;  /* (nullable) (owned) */
 
-	GThreadPool		*queued_ops_pool;
+	GMutex			 queue_mutex;
+	GCond			 queue_cond;
+	GsPluginLoaderQueue	 queues[GS_PLUGIN_LOADER_N_LANES];
+	gboolean		 preempt_background_ops;  /* (mutex queue_mutex) */
 	gint			 active_jobs;
 
 	GSettings		*settings;
@@ -76,25 +101,46 @@ struct _GsPluginLoader
 	gulong			 network_available_notify_handler;
 	gulong			 network_metered_notify_handler;
 
+	GThreadPool		*run_pool;  /* (owned) (nullable); runs plugins in parallel for all jobs */
+
 	GsJobManager		*job_manager;  /* (owned) (not nullable) */
 	GsCategoryManager	*category_manager;
 	GsOdrsProvider		*odrs_provider;  /* (owned) (nullable) */
 
 	GDBusConnection		*session_bus_connection;  /* (owned); (not nullable) after setup */
 	GDBusConnection		*system_bus_connection;  /* (owned); (not nullable) after setup */
+
+	GMutex			 list_apps_cache_mutex;
+	GHashTable		*list_apps_cache;  /* (owned) (element-type utf8 GsAppList) (mutex list_apps_cache_mutex) */
+	GQueue			 list_apps_cache_lru;  /* (element-type utf8) (mutex list_apps_cache_mutex); keys, most recently used first */
+	guint			 list_apps_cache_generation;  /* (mutex list_apps_cache_mutex) */
 };
 
 static void gs_plugin_loader_monitor_network (GsPluginLoader *plugin_loader);
 static void add_app_to_install_queue (GsPluginLoader *plugin_loader, GsApp *app);
 static gboolean remove_app_from_install_queue (GsPluginLoader *plugin_loader, GsApp *app);
 static void gs_plugin_loader_process_in_thread_pool_cb (gpointer data, gpointer user_data);
+
+typedef struct {
+	GTask			*run_task;  /* (owned) (nullable); set for legacy jobs */
+	GTask			*task;  /* (owned) (nullable); set for jobs with a run_async() */
+	GsPluginJob		*plugin_job;  /* (owned) */
+	GsPluginLoaderLane	 lane;
+	gint64			 queued_time_usec;
+} GsPluginLoaderQueuedOp;
+
+static void
+gs_plugin_loader_queued_op_free (GsPluginLoaderQueuedOp *op)
+{
+	g_clear_object (&op->run_task);
+	g_clear_object (&op->task);
+	g_object_unref (op->plugin_job);
+	g_free (op);
+}
 static void gs_plugin_loader_status_changed_cb (GsPlugin       *plugin,
                                                 GsApp          *app,
                                                 GsPluginStatus  status,
                                                 GsPluginLoader *plugin_loader);
-static void async_result_cb (GObject      *source_object,
-                             GAsyncResult *result,
-                             gpointer      user_data);
 
 G_DEFINE_TYPE (GsPluginLoader, gs_plugin_loader, G_TYPE_OBJECT)
 
@@ -191,8 +237,9 @@ typedef struct {
 	const gchar			*function_name_parent;
 	GPtrArray			*catlist;
 	GsPluginJob			*plugin_job;
-	gboolean			 anything_ran;
+	gint				 anything_ran;  /* (atomic) */
 	gchar				**tokens;
+	GsAppList			*list;		/* (owned) (nullable) */
 } GsPluginLoaderHelper;
 
 static GsPluginLoaderHelper *
@@ -256,6 +303,7 @@ gs_plugin_loader_helper_free (GsPluginLoaderHelper *helper)
 	if (helper->catlist != NULL)
 		g_ptr_array_unref (helper->catlist);
 	g_strfreev (helper->tokens);
+	g_clear_object (&helper->list);
 	g_slice_free (GsPluginLoaderHelper, helper);
 }
 
@@ -584,7 +632,11 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 		return TRUE;
 
 	/* at least one plugin supports this vfunc */
-	helper->anything_ran = TRUE;
+	g_atomic_int_set (&helper->anything_ran, TRUE);
+
+	/* set what plugin is running on the job, unless several are */
+	if (list == NULL)
+		gs_plugin_job_set_plugin (helper->plugin_job, plugin);
 
 	/* fallback if unset */
 	if (app == NULL)
@@ -594,9 +646,6 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 	if (refine_flags == GS_PLUGIN_REFINE_FLAGS_NONE)
 		refine_flags = gs_plugin_job_get_refine_flags (helper->plugin_job);
 
-	/* set what plugin is running on the job */
-	gs_plugin_job_set_plugin (helper->plugin_job, plugin);
-
 	/* run the correct vfunc */
 	if (gs_plugin_job_get_interactive (helper->plugin_job))
 		gs_plugin_interactive_inc (plugin);
@@ -718,17 +767,245 @@ gs_plugin_loader_job_sorted_truncation (GsPluginJob *plugin_job,
 	gs_app_list_truncate (list, max_results);
 }
 
+/* Adds the enabled plugins which @plugin has to run after, according to the
+ * %GS_PLUGIN_RULE_RUN_AFTER rules of @plugin and the %GS_PLUGIN_RULE_RUN_BEFORE
+ * rules of all the other plugins. */
+static void
+gs_plugin_loader_add_plugin_deps (GsPluginLoader *plugin_loader,
+				  GsPlugin *plugin,
+				  GPtrArray *deps)
+{
+	GPtrArray *rules = gs_plugin_get_rules (plugin, GS_PLUGIN_RULE_RUN_AFTER);
+
+	for (guint i = 0; i < rules->len; i++) {
+		const gchar *plugin_name = g_ptr_array_index (rules, i);
+		GsPlugin *dep = gs_plugin_loader_find_plugin (plugin_loader, plugin_name);
+		if (dep != NULL && gs_plugin_get_enabled (dep))
+			g_ptr_array_add (deps, dep);
+	}
+	for (guint i = 0; i < plugin_loader->plugins->len; i++) {
+		GsPlugin *dep = g_ptr_array_index (plugin_loader->plugins, i);
+		if (dep == plugin || !gs_plugin_get_enabled (dep))
+			continue;
+		rules = gs_plugin_get_rules (dep, GS_PLUGIN_RULE_RUN_BEFORE);
+		for (guint j = 0; j < rules->len; j++) {
+			const gchar *plugin_name = g_ptr_array_index (rules, j);
+			if (g_strcmp0 (plugin_name, gs_plugin_get_name (plugin)) == 0)
+				g_ptr_array_add (deps, dep);
+		}
+	}
+}
+
+static gboolean
+gs_plugin_loader_plugin_runs_after_internal (GsPluginLoader *plugin_loader,
+					     GsPlugin *plugin,
+					     GsPlugin *dep,
+					     GHashTable *visited)
+{
+	g_autoptr(GPtrArray) deps = g_ptr_array_new ();
+
+	if (!g_hash_table_add (visited, plugin))
+		return FALSE;
+	gs_plugin_loader_add_plugin_deps (plugin_loader, plugin, deps);
+	for (guint i = 0; i < deps->len; i++) {
+		GsPlugin *plugin_tmp = g_ptr_array_index (deps, i);
+		if (plugin_tmp == dep ||
+		    gs_plugin_loader_plugin_runs_after_internal (plugin_loader, plugin_tmp, dep, visited))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* Whether the rules require @plugin to run after @dep, directly or through
+ * other plugins. */
+static gboolean
+gs_plugin_loader_plugin_runs_after (GsPluginLoader *plugin_loader,
+				    GsPlugin *plugin,
+				    GsPlugin *dep)
+{
+	g_autoptr(GHashTable) visited = g_hash_table_new (g_direct_hash, g_direct_equal);
+	return gs_plugin_loader_plugin_runs_after_internal (plugin_loader, plugin, dep, visited);
+}
+
+/* Actions whose vfuncs only add results to the list they are given, so plugins
+ * which are not ordered by rules can run at the same time. */
+static gboolean
+gs_plugin_loader_action_can_run_parallel (GsPluginAction action)
+{
+	switch (action) {
+	case GS_PLUGIN_ACTION_GET_UPDATES:
+	case GS_PLUGIN_ACTION_GET_UPDATES_HISTORICAL:
+	case GS_PLUGIN_ACTION_GET_SOURCES:
+	case GS_PLUGIN_ACTION_FILE_TO_APP:
+	case GS_PLUGIN_ACTION_URL_TO_APP:
+	case GS_PLUGIN_ACTION_GET_LANGPACKS:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+typedef struct {
+	GsPluginLoaderHelper	*helper;
+	GCancellable		*cancellable;
+	GThreadPool		*pool;		/* (unowned) */
+	GMutex			 mutex;
+	GCond			 cond;
+	guint			 n_pending;	/* (mutex mutex); nodes which have not finished */
+} GsPluginLoaderRunGraph;
+
+typedef struct _GsPluginLoaderRunNode GsPluginLoaderRunNode;
+struct _GsPluginLoaderRunNode {
+	GsPluginLoaderRunGraph	*graph;
+	GsPlugin		*plugin;
+	GPtrArray		*dependents;	/* (owned) (element-type GsPluginLoaderRunNode); nodes which run after this one */
+	guint			 n_deps_pending;  /* (mutex graph->mutex) */
+	gboolean		 deps_failed;	/* (mutex graph->mutex) */
+	GsAppList		*list;		/* (owned) */
+	gboolean		 ret;
+	GError			*error;		/* (owned) (nullable) */
+};
+
+static void
+gs_plugin_loader_run_node_free (GsPluginLoaderRunNode *node)
+{
+	g_ptr_array_unref (node->dependents);
+	g_object_unref (node->list);
+	g_clear_error (&node->error);
+	g_free (node);
+}
+
+/* Run in @plugin_loader->run_pool. A node is only pushed to the pool once all
+ * the nodes it depends on have finished, so it never blocks a pool thread
+ * waiting for another node. */
+static void
+gs_plugin_loader_run_node_cb (gpointer data,
+			      gpointer user_data)
+{
+	GsPluginLoaderRunNode *node = data;
+	GsPluginLoaderRunGraph *graph = node->graph;
+	gboolean deps_failed;
+
+	g_mutex_lock (&graph->mutex);
+	deps_failed = node->deps_failed;
+	g_mutex_unlock (&graph->mutex);
+
+	/* the action has already failed, so don't bother */
+	if (deps_failed) {
+		node->ret = TRUE;
+	} else if (g_cancellable_set_error_if_cancelled (graph->cancellable, &node->error)) {
+		gs_utils_error_convert_gio (&node->error);
+		node->ret = FALSE;
+	} else {
+		g_autoptr(GMainContext) context = g_main_context_new ();
+		g_autoptr(GMainContextPusher) pusher = g_main_context_pusher_new (context);
+
+		gs_ioprio_set (G_PRIORITY_LOW);
+		node->ret = gs_plugin_loader_call_vfunc (graph->helper, node->plugin,
+							 NULL, node->list,
+							 GS_PLUGIN_REFINE_FLAGS_NONE,
+							 graph->cancellable, &node->error);
+		if (node->ret)
+			gs_plugin_status_update (node->plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
+	}
+
+	/* start the nodes which were waiting for this one */
+	g_mutex_lock (&graph->mutex);
+	for (guint i = 0; i < node->dependents->len; i++) {
+		GsPluginLoaderRunNode *dependent = g_ptr_array_index (node->dependents, i);
+
+		if (!node->ret || node->deps_failed)
+			dependent->deps_failed = TRUE;
+		if (--dependent->n_deps_pending == 0)
+			g_thread_pool_push (graph->pool, dependent, NULL);
+	}
+	if (--graph->n_pending == 0)
+		g_cond_broadcast (&graph->cond);
+	g_mutex_unlock (&graph->mutex);
+}
+
+/* Runs every plugin implementing the vfunc on @plugin_loader->run_pool, as
+ * soon as the plugins it has to run after have finished. The pool is shared
+ * by all jobs and bounded, so concurrent jobs can’t start an unbounded number
+ * of threads. Each plugin adds its results to its own list, and the lists are
+ * merged into the job list in plugin order afterwards, so the results are the
+ * same as running the plugins in turn. */
+static gboolean
+gs_plugin_loader_run_results_parallel (GsPluginLoaderHelper *helper,
+				       GPtrArray *plugins,
+				       GCancellable *cancellable,
+				       GError **error)
+{
+	GsPluginLoader *plugin_loader = helper->plugin_loader;
+	GsAppList *list = gs_plugin_job_get_list (helper->plugin_job);
+	GsPluginLoaderRunGraph graph = { helper, cancellable, plugin_loader->run_pool, };
+	g_autoptr(GPtrArray) nodes = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_plugin_loader_run_node_free);
+
+	g_mutex_init (&graph.mutex);
+	g_cond_init (&graph.cond);
+	g_atomic_int_set (&helper->anything_ran, TRUE);
+
+	/* build the graph; plugins are sorted by order, so a plugin can only
+	 * depend on the ones before it */
+	for (guint i = 0; i < plugins->len; i++) {
+		GsPluginLoaderRunNode *node = g_new0 (GsPluginLoaderRunNode, 1);
+		node->graph = &graph;
+		node->plugin = g_ptr_array_index (plugins, i);
+		node->dependents = g_ptr_array_new ();
+		node->list = gs_app_list_new ();
+		for (guint j = 0; j < nodes->len; j++) {
+			GsPluginLoaderRunNode *node_tmp = g_ptr_array_index (nodes, j);
+			if (gs_plugin_loader_plugin_runs_after (plugin_loader, node->plugin, node_tmp->plugin)) {
+				g_ptr_array_add (node_tmp->dependents, node);
+				node->n_deps_pending++;
+			}
+		}
+		g_ptr_array_add (nodes, node);
+	}
+
+	/* start the nodes with no dependencies, and wait for all of them to
+	 * finish */
+	g_mutex_lock (&graph.mutex);
+	graph.n_pending = nodes->len;
+	for (guint i = 0; i < nodes->len; i++) {
+		GsPluginLoaderRunNode *node = g_ptr_array_index (nodes, i);
+		if (node->n_deps_pending == 0)
+			g_thread_pool_push (graph.pool, node, NULL);
+	}
+	while (graph.n_pending > 0)
+		g_cond_wait (&graph.cond, &graph.mutex);
+	g_mutex_unlock (&graph.mutex);
+
+	g_mutex_clear (&graph.mutex);
+	g_cond_clear (&graph.cond);
+
+	/* merge the results, stopping at the first failure like a sequential
+	 * run would */
+	for (guint i = 0; i < nodes->len; i++) {
+		GsPluginLoaderRunNode *node = g_ptr_array_index (nodes, i);
+		if (!node->ret) {
+			g_propagate_error (error, g_steal_pointer (&node->error));
+			return FALSE;
+		}
+		gs_app_list_add_list (list, node->list);
+	}
+
+	return TRUE;
+}
+
 static gboolean
 gs_plugin_loader_run_results (GsPluginLoaderHelper *helper,
 			      GCancellable *cancellable,
 			      GError **error)
 {
 	GsPluginLoader *plugin_loader = helper->plugin_loader;
+	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
+	g_autoptr(GPtrArray) plugins = g_ptr_array_new ();
 	g_autofree gchar *sysprof_name = NULL;
 	g_autofree gchar *sysprof_message = NULL;
 
 	sysprof_name = g_strconcat ("run-results:",
-				    gs_plugin_action_to_string (gs_plugin_job_get_action (helper->plugin_job)),
+				    gs_plugin_action_to_string (action),
 				    NULL);
 	sysprof_message = gs_plugin_job_to_string (helper->plugin_job);
 
@@ -737,19 +1014,44 @@ gs_plugin_loader_run_results (GsPluginLoaderHelper *helper,
 	/* Refining is done separately as it’s a special action */
 	g_assert (!GS_IS_PLUGIN_JOB_REFINE (helper->plugin_job));
 
-	/* run each plugin */
-	for (guint i = 0; i < plugin_loader->plugins->len; i++) {
-		GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, i);
+	/* find the plugins which implement the vfunc, if they can be run in
+	 * parallel */
+	if (gs_plugin_loader_action_can_run_parallel (action) &&
+	    gs_plugin_job_get_list (helper->plugin_job) != NULL) {
+		for (guint i = 0; i < plugin_loader->plugins->len; i++) {
+			GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, i);
+			if (gs_plugin_get_symbol (plugin, helper->function_name) != NULL)
+				g_ptr_array_add (plugins, plugin);
+		}
+	}
+
+	if (plugins->len > 1) {
 		if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
 			gs_utils_error_convert_gio (error);
 			return FALSE;
 		}
-		if (!gs_plugin_loader_call_vfunc (helper, plugin, NULL, NULL,
-						  GS_PLUGIN_REFINE_FLAGS_NONE,
-						  cancellable, error)) {
+		for (guint i = 0; i < plugin_loader->plugins->len; i++) {
+			GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, i);
+			if (!g_ptr_array_find (plugins, plugin, NULL))
+				gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
+		}
+		if (!gs_plugin_loader_run_results_parallel (helper, plugins, cancellable, error))
 			return FALSE;
+	} else {
+		/* run each plugin */
+		for (guint i = 0; i < plugin_loader->plugins->len; i++) {
+			GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, i);
+			if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+				gs_utils_error_convert_gio (error);
+				return FALSE;
+			}
+			if (!gs_plugin_loader_call_vfunc (helper, plugin, NULL, NULL,
+							  GS_PLUGIN_REFINE_FLAGS_NONE,
+							  cancellable, error)) {
+				return FALSE;
+			}
+			gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
 		}
-		gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
 	}
 
 	GS_PROFILER_END_SCOPED (PluginLoader);
@@ -1055,17 +1357,6 @@ gs_plugin_loader_pending_apps_remove (GsPluginLoader *plugin_loader,
 	g_idle_add (emit_pending_apps_idle, g_object_ref (plugin_loader));
 }
 
-static void
-async_result_cb (GObject      *source_object,
-                 GAsyncResult *result,
-                 gpointer      user_data)
-{
-	GAsyncResult **result_out = user_data;
-
-	*result_out = g_object_ref (result);
-	g_main_context_wakeup (g_main_context_get_thread_default ());
-}
-
 /* This will load the install queue and add it to #GsPluginLoader.pending_apps,
  * but it won’t refine the loaded apps. */
 static GsAppList *
@@ -1467,6 +1758,132 @@ gs_plugin_loader_job_updates_changed_delay_cb (gpointer user_data)
 	return FALSE;
 }
 
+/* Marks @key as the most recently used cache entry.
+ *
+ * Must be called with @plugin_loader->list_apps_cache_mutex held. */
+static void
+list_apps_cache_touch_unlocked (GsPluginLoader *plugin_loader,
+				const gchar *key)
+{
+	GList *link = g_queue_find_custom (&plugin_loader->list_apps_cache_lru, key,
+					   (GCompareFunc) g_strcmp0);
+
+	if (link != NULL) {
+		g_queue_unlink (&plugin_loader->list_apps_cache_lru, link);
+	} else {
+		link = g_list_alloc ();
+		link->data = g_strdup (key);
+	}
+	g_queue_push_head_link (&plugin_loader->list_apps_cache_lru, link);
+}
+
+/**
+ * gs_plugin_loader_lookup_list_apps_cache:
+ * @plugin_loader: a #GsPluginLoader
+ * @key: cache key for the query
+ * @generation_out: (out) (optional): return location for the current
+ *   generation of the cache
+ *
+ * Look up the refined, but not yet filtered or sorted, results of an earlier
+ * #GsPluginJobListApps with the same @key.
+ *
+ * @generation_out is set even if nothing is cached, and should be passed to
+ * gs_plugin_loader_add_list_apps_cache() when adding the results of the
+ * query, so that results computed before an invalidation are not cached.
+ *
+ * This function is thread-safe.
+ *
+ * Returns: (transfer full) (nullable): a copy of the cached results, or %NULL
+ * Since: 44
+ */
+GsAppList *
+gs_plugin_loader_lookup_list_apps_cache (GsPluginLoader *plugin_loader,
+					 const gchar *key,
+					 guint *generation_out)
+{
+	GsAppList *list;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_PLUGIN_LOADER (plugin_loader), NULL);
+	g_return_val_if_fail (key != NULL, NULL);
+
+	locker = g_mutex_locker_new (&plugin_loader->list_apps_cache_mutex);
+	if (generation_out != NULL)
+		*generation_out = plugin_loader->list_apps_cache_generation;
+	list = g_hash_table_lookup (plugin_loader->list_apps_cache, key);
+	if (list == NULL)
+		return NULL;
+	list_apps_cache_touch_unlocked (plugin_loader, key);
+	return gs_app_list_copy (list);
+}
+
+/**
+ * gs_plugin_loader_add_list_apps_cache:
+ * @plugin_loader: a #GsPluginLoader
+ * @key: cache key for the query
+ * @generation: the generation returned by
+ *   gs_plugin_loader_lookup_list_apps_cache() before the query was run
+ * @list: the refined results of the query
+ *
+ * Add the results of a #GsPluginJobListApps to the cache. They are ignored if
+ * the cache has been invalidated since @generation was returned.
+ *
+ * At most %GS_PLUGIN_LOADER_LIST_APPS_CACHE_MAX_ENTRIES results are kept; the
+ * least recently used ones are dropped first.
+ *
+ * This function is thread-safe.
+ *
+ * Since: 44
+ */
+void
+gs_plugin_loader_add_list_apps_cache (GsPluginLoader *plugin_loader,
+				      const gchar *key,
+				      guint generation,
+				      GsAppList *list)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_PLUGIN_LOADER (plugin_loader));
+	g_return_if_fail (key != NULL);
+	g_return_if_fail (GS_IS_APP_LIST (list));
+
+	locker = g_mutex_locker_new (&plugin_loader->list_apps_cache_mutex);
+	if (generation != plugin_loader->list_apps_cache_generation)
+		return;
+	g_hash_table_replace (plugin_loader->list_apps_cache,
+			      g_strdup (key), gs_app_list_copy (list));
+	list_apps_cache_touch_unlocked (plugin_loader, key);
+
+	while (plugin_loader->list_apps_cache_lru.length > GS_PLUGIN_LOADER_LIST_APPS_CACHE_MAX_ENTRIES) {
+		g_autofree gchar *key_old = g_queue_pop_tail (&plugin_loader->list_apps_cache_lru);
+		g_hash_table_remove (plugin_loader->list_apps_cache, key_old);
+	}
+}
+
+/**
+ * gs_plugin_loader_invalidate_list_apps_cache:
+ * @plugin_loader: a #GsPluginLoader
+ *
+ * Drop all the cached #GsPluginJobListApps results. This is done
+ * automatically when a plugin signals that its data has changed.
+ *
+ * This function is thread-safe.
+ *
+ * Since: 44
+ */
+void
+gs_plugin_loader_invalidate_list_apps_cache (GsPluginLoader *plugin_loader)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (GS_IS_PLUGIN_LOADER (plugin_loader));
+
+	locker = g_mutex_locker_new (&plugin_loader->list_apps_cache_mutex);
+	plugin_loader->list_apps_cache_generation++;
+	g_hash_table_remove_all (plugin_loader->list_apps_cache);
+	g_queue_clear_full (&plugin_loader->list_apps_cache_lru, g_free);
+}
+
 static void
 gs_plugin_loader_updates_changed (GsPluginLoader *plugin_loader)
 {
@@ -1484,6 +1901,8 @@ static void
 gs_plugin_loader_job_updates_changed_cb (GsPlugin *plugin,
 					 GsPluginLoader *plugin_loader)
 {
+	gs_plugin_loader_invalidate_list_apps_cache (plugin_loader);
+
 	plugin_loader->updates_changed_cnt++;
 
 	/* Schedule emit of updates changed when no job is active.
@@ -1512,6 +1931,8 @@ static void
 gs_plugin_loader_reload_cb (GsPlugin *plugin,
 			    GsPluginLoader *plugin_loader)
 {
+	gs_plugin_loader_invalidate_list_apps_cache (plugin_loader);
+
 	if (plugin_loader->reload_id != 0)
 		return;
 	plugin_loader->reload_id =
@@ -1527,6 +1948,8 @@ gs_plugin_loader_repository_changed_cb (GsPlugin *plugin,
 {
 	GApplication *application = g_application_get_default ();
 
+	gs_plugin_loader_invalidate_list_apps_cache (plugin_loader);
+
 	/* Can be NULL when running the self tests */
 	if (application) {
 		g_signal_emit_by_name (application,
@@ -1535,6 +1958,13 @@ gs_plugin_loader_repository_changed_cb (GsPlugin *plugin,
 	}
 }
 
+static void
+gs_plugin_loader_metadata_changed_cb (GsPlugin *plugin,
+				      GsPluginLoader *plugin_loader)
+{
+	gs_plugin_loader_invalidate_list_apps_cache (plugin_loader);
+}
+
 static void
 gs_plugin_loader_open_plugin (GsPluginLoader *plugin_loader,
 			      const gchar *filename)
@@ -1575,6 +2005,9 @@ gs_plugin_loader_open_plugin (GsPluginLoader *plugin_loader,
 	g_signal_connect (plugin, "ask-untrusted",
 			  G_CALLBACK (gs_plugin_loader_ask_untrusted_cb),
 			  plugin_loader);
+	g_signal_connect (plugin, "metadata-changed",
+			  G_CALLBACK (gs_plugin_loader_metadata_changed_cb),
+			  plugin_loader);
 	gs_plugin_set_language (plugin, plugin_loader->language);
 	gs_plugin_set_scale (plugin, gs_plugin_loader_get_scale (plugin_loader));
 	gs_plugin_set_network_monitor (plugin, plugin_loader->network_monitor);
@@ -1684,6 +2117,7 @@ gs_plugin_loader_clear_caches (GsPluginLoader *plugin_loader)
 		GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, i);
 		gs_plugin_cache_invalidate (plugin);
 	}
+	gs_plugin_loader_invalidate_list_apps_cache (plugin_loader);
 }
 
 static void
@@ -1811,13 +2245,27 @@ gs_plugin_loader_find_plugins (const gchar *path, GError **error)
 	return g_steal_pointer (&fns);
 }
 
+typedef struct {
+	GsPlugin *plugin;  /* (owned) */
+#ifdef HAVE_SYSPROF
+	gint64 begin_time_nsec;
+#endif
+} SetupPluginOp;
+
+static void
+setup_plugin_op_free (SetupPluginOp *op)
+{
+	g_object_unref (op->plugin);
+	g_free (op);
+}
+
 typedef struct {
 	guint n_pending;
 	gchar **allowlist;
 	gchar **blocklist;
+	GPtrArray *plugin_ops;  /* (owned) (element-type SetupPluginOp) */
 #ifdef HAVE_SYSPROF
 	gint64 setup_begin_time_nsec;
-	gint64 plugins_begin_time_nsec;
 #endif
 } SetupData;
 
@@ -1826,6 +2274,7 @@ setup_data_free (SetupData *data)
 {
 	g_clear_pointer (&data->allowlist, g_strfreev);
 	g_clear_pointer (&data->blocklist, g_strfreev);
+	g_clear_pointer (&data->plugin_ops, g_ptr_array_unref);
 	g_free (data);
 }
 
@@ -2182,11 +2631,10 @@ finish_setup_get_bus (GTask *task)
 		}
 	} while (changes);
 
-	/* run setup */
+	/* run setup; the plugins are all set up concurrently, and each one
+	 * gets a profiler mark of its own so the slowest is visible */
 	data->n_pending = 1;  /* incremented until all operations have been started */
-#ifdef HAVE_SYSPROF
-	data->plugins_begin_time_nsec = SYSPROF_CAPTURE_CURRENT_TIME;
-#endif
+	data->plugin_ops = g_ptr_array_new_with_free_func ((GDestroyNotify) setup_plugin_op_free);
 
 	for (i = 0; i < plugin_loader->plugins->len; i++) {
 		plugin = GS_PLUGIN (plugin_loader->plugins->pdata[i]);
@@ -2195,6 +2643,13 @@ finish_setup_get_bus (GTask *task)
 			continue;
 
 		if (GS_PLUGIN_GET_CLASS (plugin)->setup_async != NULL) {
+			SetupPluginOp *op = g_new0 (SetupPluginOp, 1);
+			op->plugin = g_object_ref (plugin);
+#ifdef HAVE_SYSPROF
+			op->begin_time_nsec = SYSPROF_CAPTURE_CURRENT_TIME;
+#endif
+			g_ptr_array_add (data->plugin_ops, op);
+
 			data->n_pending++;
 			GS_PLUGIN_GET_CLASS (plugin)->setup_async (plugin, cancellable,
 								   plugin_setup_cb, g_object_ref (task));
@@ -2223,11 +2678,22 @@ plugin_setup_cb (GObject      *source_object,
 		gs_plugin_set_enabled (plugin, FALSE);
 	}
 
-	GS_PROFILER_ADD_MARK (PluginLoader,
-			      data->plugins_begin_time_nsec,
-			      "setup-plugin", NULL);
-
 	/* Indicate this plugin has finished setting up. */
+	for (guint i = 0; i < data->plugin_ops->len; i++) {
+		SetupPluginOp *op = g_ptr_array_index (data->plugin_ops, i);
+
+		if (op->plugin != plugin)
+			continue;
+
+		GS_PROFILER_ADD_MARK_TAKE (PluginLoader,
+					   op->begin_time_nsec,
+					   g_strdup_printf ("setup-plugin:%s",
+							    gs_plugin_get_name (plugin)),
+					   NULL);
+		g_ptr_array_remove_index (data->plugin_ops, i);
+		break;
+	}
+
 	finish_setup_op (task);
 }
 
@@ -2363,6 +2829,7 @@ gs_plugin_loader_dump_state (GsPluginLoader *plugin_loader)
 {
 	g_autoptr(GString) str_enabled = g_string_new (NULL);
 	g_autoptr(GString) str_disabled = g_string_new (NULL);
+	guint64 cache_n_hits, cache_n_misses, cache_n_evicted, cache_size;
 
 	/* print what the priorities are if verbose */
 	for (guint i = 0; i < plugin_loader->plugins->len; i++) {
@@ -2380,6 +2847,29 @@ gs_plugin_loader_dump_state (GsPluginLoader *plugin_loader)
 		g_string_truncate (str_disabled, str_disabled->len - 2);
 	g_info ("enabled plugins: %s", str_enabled->str);
 	g_info ("disabled plugins: %s", str_disabled->str);
+	g_info ("refines coalesced: %u, merged into follow-ups: %u",
+		gs_job_manager_get_n_refines_coalesced (plugin_loader->job_manager),
+		gs_job_manager_get_n_refines_merged (plugin_loader->job_manager));
+
+	gs_cache_manager_get_stats (gs_cache_manager_get_default (),
+				    &cache_n_hits, &cache_n_misses,
+				    &cache_n_evicted, &cache_size);
+	g_info ("cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses, "
+		"%" G_GUINT64_FORMAT " evicted, %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " bytes",
+		cache_n_hits, cache_n_misses, cache_n_evicted, cache_size,
+		gs_cache_manager_get_max_size (gs_cache_manager_get_default ()));
+
+	g_mutex_lock (&plugin_loader->queue_mutex);
+	for (guint i = 0; i < GS_PLUGIN_LOADER_N_LANES; i++) {
+		GsPluginLoaderQueue *queue = &plugin_loader->queues[i];
+
+		g_info ("%s ops: %u queued, %u running, %u started, "
+			"queue wait avg %" G_GINT64_FORMAT "ms max %" G_GINT64_FORMAT "ms",
+			lane_names[i], queue->n_queued, queue->n_running, queue->n_started,
+			(queue->n_started > 0) ? queue->total_wait_usec / queue->n_started / 1000 : 0,
+			queue->max_wait_usec / 1000);
+	}
+	g_mutex_unlock (&plugin_loader->queue_mutex);
 }
 
 static void
@@ -2475,11 +2965,22 @@ gs_plugin_loader_dispose (GObject *object)
 					     plugin_loader->network_metered_notify_handler);
 		plugin_loader->network_metered_notify_handler = 0;
 	}
-	if (plugin_loader->queued_ops_pool != NULL) {
+	for (guint i = 0; i < GS_PLUGIN_LOADER_N_LANES; i++) {
+		GsPluginLoaderQueue *queue = &plugin_loader->queues[i];
+
+		if (queue->pool == NULL)
+			continue;
+
 		/* stop accepting more requests and wait until any currently
-		 * running ones are finished */
-		g_thread_pool_free (plugin_loader->queued_ops_pool, TRUE, TRUE);
-		plugin_loader->queued_ops_pool = NULL;
+		 * running ones are finished; the interactive lane goes first so
+		 * background ops waiting for it are released */
+		g_thread_pool_free (queue->pool, TRUE, TRUE);
+		queue->pool = NULL;
+	}
+	if (plugin_loader->run_pool != NULL) {
+		/* the ops have all finished, so nothing is waiting on this */
+		g_thread_pool_free (plugin_loader->run_pool, FALSE, TRUE);
+		plugin_loader->run_pool = NULL;
 	}
 	g_clear_object (&plugin_loader->network_monitor);
 	g_clear_object (&plugin_loader->settings);
@@ -2507,9 +3008,14 @@ gs_plugin_loader_finalize (GObject *object)
 	g_ptr_array_unref (plugin_loader->file_monitors);
 	g_hash_table_unref (plugin_loader->events_by_id);
 	g_hash_table_unref (plugin_loader->disallow_updates);
+	g_hash_table_unref (plugin_loader->list_apps_cache);
+	g_queue_clear_full (&plugin_loader->list_apps_cache_lru, g_free);
 
 	g_mutex_clear (&plugin_loader->pending_apps_mutex);
 	g_mutex_clear (&plugin_loader->events_by_id_mutex);
+	g_mutex_clear (&plugin_loader->list_apps_cache_mutex);
+	g_mutex_clear (&plugin_loader->queue_mutex);
+	g_cond_clear (&plugin_loader->queue_cond);
 
 	G_OBJECT_CLASS (gs_plugin_loader_parent_class)->finalize (object);
 }
@@ -2649,6 +3155,13 @@ gs_plugin_loader_allow_updates_recheck (GsPluginLoader *plugin_loader)
 	}
 }
 
+static void
+gs_plugin_loader_update_cache_size_maximum (GsPluginLoader *plugin_loader)
+{
+	guint64 max_size_mib = g_settings_get_uint (plugin_loader->settings, "cache-size-maximum");
+	gs_cache_manager_set_max_size (gs_cache_manager_get_default (), max_size_mib * 1024 * 1024);
+}
+
 static void
 gs_plugin_loader_settings_changed_cb (GSettings *settings,
 				      const gchar *key,
@@ -2656,6 +3169,8 @@ gs_plugin_loader_settings_changed_cb (GSettings *settings,
 {
 	if (g_strcmp0 (key, "allow-updates") == 0)
 		gs_plugin_loader_allow_updates_recheck (plugin_loader);
+	else if (g_strcmp0 (key, "cache-size-maximum") == 0)
+		gs_plugin_loader_update_cache_size_maximum (plugin_loader);
 }
 
 static gint
@@ -2686,20 +3201,32 @@ gs_plugin_loader_init (GsPluginLoader *plugin_loader)
 	plugin_loader->scale = 1;
 	plugin_loader->plugins = g_ptr_array_new_with_free_func (g_object_unref);
 	plugin_loader->pending_apps = NULL;
-	plugin_loader->queued_ops_pool = g_thread_pool_new (gs_plugin_loader_process_in_thread_pool_cb,
-						   NULL,
-						   get_max_parallel_ops (),
-						   FALSE,
-						   NULL);
+	g_mutex_init (&plugin_loader->queue_mutex);
+	g_cond_init (&plugin_loader->queue_cond);
+	for (i = 0; i < GS_PLUGIN_LOADER_N_LANES; i++) {
+		plugin_loader->queues[i].pool = g_thread_pool_new_full (gs_plugin_loader_process_in_thread_pool_cb,
+									plugin_loader,
+									(GDestroyNotify) gs_plugin_loader_queued_op_free,
+									get_max_parallel_ops (),
+									FALSE,
+									NULL);
+	}
+	plugin_loader->run_pool = g_thread_pool_new (gs_plugin_loader_run_node_cb, NULL,
+						     (gint) MAX (g_get_num_processors (), 2),
+						     FALSE, NULL);
 	plugin_loader->file_monitors = g_ptr_array_new_with_free_func (g_object_unref);
 	plugin_loader->locations = g_ptr_array_new_with_free_func (g_free);
 	plugin_loader->settings = g_settings_new ("org.gnome.software");
 	g_signal_connect (plugin_loader->settings, "changed",
 			  G_CALLBACK (gs_plugin_loader_settings_changed_cb), plugin_loader);
+	gs_plugin_loader_update_cache_size_maximum (plugin_loader);
 	plugin_loader->events_by_id = g_hash_table_new_full ((GHashFunc) as_utils_data_id_hash,
 							     (GEqualFunc) as_utils_data_id_equal,
 							     g_free,
 							     (GDestroyNotify) g_object_unref);
+	plugin_loader->list_apps_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+								g_free, g_object_unref);
+	g_queue_init (&plugin_loader->list_apps_cache_lru);
 
 	/* get the job manager */
 	plugin_loader->job_manager = gs_job_manager_new ();
@@ -2762,6 +3289,7 @@ gs_plugin_loader_init (GsPluginLoader *plugin_loader)
 
 	g_mutex_init (&plugin_loader->pending_apps_mutex);
 	g_mutex_init (&plugin_loader->events_by_id_mutex);
+	g_mutex_init (&plugin_loader->list_apps_cache_mutex);
 
 	/* monitor the network as the many UI operations need the network */
 	gs_plugin_loader_monitor_network (plugin_loader);
@@ -3033,24 +3561,26 @@ gs_plugin_loader_inherit_list_props (GsAppList *des_list,
 	gs_app_list_set_size_peak (des_list, gs_app_list_get_size_peak (src_list));
 }
 
-static void
-gs_plugin_loader_process_thread_cb (GTask *task,
-				    gpointer object,
-				    gpointer task_data,
-				    GCancellable *cancellable)
+/* Runs the plugins for the job and does the post-processing which doesn’t need
+ * the results to be refined.
+ *
+ * This is the only part of processing a job which blocks, so it is run in a
+ * worker thread, either from the #GTask thread pool or from
+ * one of the #GsPluginLoader.queues lanes. Everything after it is chained
+ * asynchronously in the context the job was started from. */
+static gboolean
+gs_plugin_loader_process_run_plugins (GsPluginLoaderHelper *helper,
+				      GCancellable *cancellable,
+				      GError **error)
 {
-	GError *error = NULL;
-	GsPluginLoaderHelper *helper = (GsPluginLoaderHelper *) task_data;
-	GsAppListFilterFlags dedupe_flags;
-	g_autoptr(GsAppList) list = g_object_ref (gs_plugin_job_get_list (helper->plugin_job));
+	GsAppList *list = gs_plugin_job_get_list (helper->plugin_job);
 	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
-	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (object);
+	GsPluginLoader *plugin_loader = helper->plugin_loader;
 	gboolean add_to_pending_array = FALSE;
 	g_autoptr(GMainContext) context = g_main_context_new ();
 	g_autoptr(GMainContextPusher) pusher = g_main_context_pusher_new (context);
 	g_autofree gchar *sysprof_name = NULL;
 	g_autofree gchar *sysprof_message = NULL;
-	g_autofree gchar *job_debug = NULL;
 
 	sysprof_name = g_strconcat ("process-thread:", gs_plugin_action_to_string (action), NULL);
 	sysprof_message = gs_plugin_job_to_string (helper->plugin_job);
@@ -3073,15 +3603,12 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 
 	/* run each plugin */
 	if (!GS_IS_PLUGIN_JOB_REFINE (helper->plugin_job)) {
-		if (!gs_plugin_loader_run_results (helper, cancellable, &error)) {
+		if (!gs_plugin_loader_run_results (helper, cancellable, error)) {
 			if (add_to_pending_array) {
 				gs_app_set_state_recover (gs_plugin_job_get_app (helper->plugin_job));
 				gs_plugin_loader_pending_apps_remove (plugin_loader, helper);
 			}
-			gs_utils_error_convert_gio (&error);
-			g_task_return_error (task, error);
-			gs_job_manager_remove_job (plugin_loader->job_manager, helper->plugin_job);
-			return;
+			return FALSE;
 		}
 
 		if (action == GS_PLUGIN_ACTION_URL_TO_APP) {
@@ -3137,19 +3664,17 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 	case GS_PLUGIN_ACTION_INSTALL:
 	case GS_PLUGIN_ACTION_LAUNCH:
 	case GS_PLUGIN_ACTION_REMOVE:
-		if (!helper->anything_ran) {
-			g_set_error (&error,
+		if (!g_atomic_int_get (&helper->anything_ran)) {
+			g_set_error (error,
 				     GS_PLUGIN_ERROR,
 				     GS_PLUGIN_ERROR_NOT_SUPPORTED,
 				     "no plugin could handle %s",
 				     gs_plugin_action_to_string (action));
-			g_task_return_error (task, error);
-			gs_job_manager_remove_job (plugin_loader->job_manager, helper->plugin_job);
-			return;
+			return FALSE;
 		}
 		break;
 	default:
-		if (!helper->anything_ran && !GS_IS_PLUGIN_JOB_REFINE (helper->plugin_job)) {
+		if (!g_atomic_int_get (&helper->anything_ran) && !GS_IS_PLUGIN_JOB_REFINE (helper->plugin_job)) {
 			g_debug ("no plugin could handle %s",
 				 gs_plugin_action_to_string (action));
 		}
@@ -3183,93 +3708,180 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 		break;
 	}
 
+	GS_PROFILER_END_SCOPED (PluginLoader);
+
+	return TRUE;
+}
+
+static void
+gs_plugin_loader_process_thread_cb (GTask *run_task,
+				    gpointer object,
+				    gpointer task_data,
+				    GCancellable *cancellable)
+{
+	GTask *task = G_TASK (task_data);
+	GsPluginLoaderHelper *helper = g_task_get_task_data (task);
+	g_autoptr(GError) local_error = NULL;
+
+	if (!gs_plugin_loader_process_run_plugins (helper, cancellable, &local_error))
+		g_task_return_error (run_task, g_steal_pointer (&local_error));
+	else
+		g_task_return_boolean (run_task, TRUE);
+}
+
+static void
+gs_plugin_loader_process_return_error (GTask *task,
+				       GError *error)
+{
+	GsPluginLoaderHelper *helper = g_task_get_task_data (task);
+
+	gs_utils_error_convert_gio (&error);
+	g_task_return_error (task, error);
+	gs_job_manager_remove_job (helper->plugin_loader->job_manager, helper->plugin_job);
+}
+
+static void process_refine_cb (GObject      *source_object,
+                               GAsyncResult *result,
+                               gpointer      user_data);
+static void process_refine_icons (GTask *task);
+static void process_refine_icons_cb (GObject      *source_object,
+                                     GAsyncResult *result,
+                                     gpointer      user_data);
+static void process_finish (GTask *task);
+
+/* Called in the context the job was started from, once the plugins have run. */
+static void
+process_run_plugins_cb (GObject      *source_object,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source_object);
+	g_autoptr(GTask) task = g_steal_pointer (&user_data);
+	GsPluginLoaderHelper *helper = g_task_get_task_data (task);
+	GCancellable *cancellable = g_task_get_cancellable (task);
+	g_autoptr(GError) local_error = NULL;
+
+	if (!g_task_propagate_boolean (G_TASK (result), &local_error)) {
+		gs_plugin_loader_process_return_error (task, g_steal_pointer (&local_error));
+		return;
+	}
+
+	helper->list = g_object_ref (gs_plugin_job_get_list (helper->plugin_job));
+
 	/* run refine() on each one if required */
 	if (gs_plugin_job_get_refine_flags (helper->plugin_job) != 0 &&
-	    list != NULL &&
-	    gs_app_list_length (list) > 0) {
+	    gs_app_list_length (helper->list) > 0) {
 		g_autoptr(GsPluginJob) refine_job = NULL;
-		g_autoptr(GAsyncResult) refine_result = NULL;
-		g_autoptr(GsAppList) new_list = NULL;
 
-		refine_job = gs_plugin_job_refine_new (list, gs_plugin_job_get_refine_flags (helper->plugin_job) | GS_PLUGIN_REFINE_FLAGS_DISABLE_FILTERING);
+		refine_job = gs_plugin_job_refine_new (helper->list, gs_plugin_job_get_refine_flags (helper->plugin_job) | GS_PLUGIN_REFINE_FLAGS_DISABLE_FILTERING);
 		gs_plugin_loader_job_process_async (plugin_loader, refine_job,
 						    cancellable,
-						    async_result_cb,
-						    &refine_result);
-
-		/* FIXME: Make this sync until the enclosing function is
-		 * refactored to be async. */
-		while (refine_result == NULL)
-			g_main_context_iteration (g_main_context_get_thread_default (), TRUE);
-
-		new_list = gs_plugin_loader_job_process_finish (plugin_loader, refine_result, &error);
-		if (new_list == NULL) {
-			gs_utils_error_convert_gio (&error);
-			g_task_return_error (task, g_steal_pointer (&error));
-			gs_job_manager_remove_job (plugin_loader->job_manager, helper->plugin_job);
-			return;
-		}
+						    process_refine_cb,
+						    g_steal_pointer (&task));
+		return;
+	}
 
-		gs_plugin_loader_inherit_list_props (new_list, list);
+	g_debug ("no refine flags set for transaction");
+	process_refine_icons (g_steal_pointer (&task));
+}
 
-		/* Update the app list in case the refine resolved any wildcards. */
-		g_set_object (&list, new_list);
-	} else {
-		g_debug ("no refine flags set for transaction");
+/* Replaces the list being processed with the refined one. */
+static gboolean
+process_refine_finish (GTask         *task,
+                       GAsyncResult  *result)
+{
+	GsPluginLoaderHelper *helper = g_task_get_task_data (task);
+	g_autoptr(GsAppList) new_list = NULL;
+	g_autoptr(GError) local_error = NULL;
+
+	new_list = gs_plugin_loader_job_process_finish (helper->plugin_loader, result, &local_error);
+	if (new_list == NULL) {
+		gs_plugin_loader_process_return_error (task, g_steal_pointer (&local_error));
+		return FALSE;
 	}
 
-	/* check the local files have an icon set */
-	switch (action) {
-	case GS_PLUGIN_ACTION_URL_TO_APP:
-	case GS_PLUGIN_ACTION_FILE_TO_APP: {
-		g_autoptr(GsPluginJob) refine_job = NULL;
-		g_autoptr(GAsyncResult) refine_result = NULL;
-		g_autoptr(GsAppList) new_list = NULL;
+	gs_plugin_loader_inherit_list_props (new_list, helper->list);
 
-		for (guint j = 0; j < gs_app_list_length (list); j++) {
-			GsApp *app = gs_app_list_index (list, j);
-			if (gs_app_get_icons (app) == NULL) {
-				g_autoptr(GIcon) ic = NULL;
-				const gchar *icon_name;
-				if (gs_app_has_quirk (app, GS_APP_QUIRK_HAS_SOURCE))
-					icon_name = "x-package-repository";
-				else
-					icon_name = "system-component-application";
-				ic = g_themed_icon_new (icon_name);
-				gs_app_add_icon (app, ic);
-			}
-		}
+	/* Update the app list in case the refine resolved any wildcards. */
+	g_set_object (&helper->list, new_list);
 
-		refine_job = gs_plugin_job_refine_new (list, GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON | GS_PLUGIN_REFINE_FLAGS_DISABLE_FILTERING);
-		gs_plugin_loader_job_process_async (plugin_loader, refine_job,
-						    cancellable,
-						    async_result_cb,
-						    &refine_result);
-
-		/* FIXME: Make this sync until the enclosing function is
-		 * refactored to be async. */
-		while (refine_result == NULL)
-			g_main_context_iteration (g_main_context_get_thread_default (), TRUE);
-
-		new_list = gs_plugin_loader_job_process_finish (plugin_loader, refine_result, &error);
-		if (new_list == NULL) {
-			gs_utils_error_convert_gio (&error);
-			g_task_return_error (task, g_steal_pointer (&error));
-			gs_job_manager_remove_job (plugin_loader->job_manager, helper->plugin_job);
-			return;
-		}
+	return TRUE;
+}
+
+static void
+process_refine_cb (GObject      *source_object,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+	g_autoptr(GTask) task = g_steal_pointer (&user_data);
 
-		gs_plugin_loader_inherit_list_props (new_list, list);
+	if (!process_refine_finish (task, result))
+		return;
 
-		/* Update the app list in case the refine resolved any wildcards. */
-		g_set_object (&list, new_list);
+	process_refine_icons (g_steal_pointer (&task));
+}
 
-		break;
+static void
+process_refine_icons (GTask *task_in)
+{
+	g_autoptr(GTask) task = task_in;
+	GsPluginLoaderHelper *helper = g_task_get_task_data (task);
+	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
+	GsAppList *list = helper->list;
+	g_autoptr(GsPluginJob) refine_job = NULL;
+
+	/* check the local files have an icon set */
+	if (action != GS_PLUGIN_ACTION_URL_TO_APP &&
+	    action != GS_PLUGIN_ACTION_FILE_TO_APP) {
+		process_finish (g_steal_pointer (&task));
+		return;
 	}
-	default:
-		break;
+
+	for (guint j = 0; j < gs_app_list_length (list); j++) {
+		GsApp *app = gs_app_list_index (list, j);
+		if (gs_app_get_icons (app) == NULL) {
+			g_autoptr(GIcon) ic = NULL;
+			const gchar *icon_name;
+			if (gs_app_has_quirk (app, GS_APP_QUIRK_HAS_SOURCE))
+				icon_name = "x-package-repository";
+			else
+				icon_name = "system-component-application";
+			ic = g_themed_icon_new (icon_name);
+			gs_app_add_icon (app, ic);
+		}
 	}
 
+	refine_job = gs_plugin_job_refine_new (list, GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON | GS_PLUGIN_REFINE_FLAGS_DISABLE_FILTERING);
+	gs_plugin_loader_job_process_async (helper->plugin_loader, refine_job,
+					    g_task_get_cancellable (task),
+					    process_refine_icons_cb,
+					    g_steal_pointer (&task));
+}
+
+static void
+process_refine_icons_cb (GObject      *source_object,
+                         GAsyncResult *result,
+                         gpointer      user_data)
+{
+	g_autoptr(GTask) task = g_steal_pointer (&user_data);
+
+	if (!process_refine_finish (task, result))
+		return;
+
+	process_finish (g_steal_pointer (&task));
+}
+
+static void
+process_finish (GTask *task_in)
+{
+	g_autoptr(GTask) task = task_in;
+	GsPluginLoaderHelper *helper = g_task_get_task_data (task);
+	GsPluginLoader *plugin_loader = helper->plugin_loader;
+	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
+	GsAppList *list = helper->list;
+	GsAppListFilterFlags dedupe_flags;
+	g_autofree gchar *job_debug = NULL;
+
 	/* filter package list */
 	switch (action) {
 	case GS_PLUGIN_ACTION_URL_TO_APP:
@@ -3310,8 +3922,6 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 	if (dedupe_flags != GS_APP_LIST_FILTER_FLAG_NONE)
 		gs_app_list_filter_duplicates (list, dedupe_flags);
 
-	GS_PROFILER_END_SCOPED (PluginLoader);
-
 	/* show elapsed time */
 	job_debug = gs_plugin_job_to_string (helper->plugin_job);
 	g_debug ("%s", job_debug);
@@ -3321,27 +3931,114 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 	gs_job_manager_remove_job (plugin_loader->job_manager, helper->plugin_job);
 }
 
+/* A background op yields to interactive ops here, before it starts. It stops
+ * waiting if it is cancelled, so it can be preempted by cancelling it too. */
 static void
-gs_plugin_loader_process_in_thread_pool_cb (gpointer data,
-					    gpointer user_data)
+gs_plugin_loader_wait_for_interactive_ops (GsPluginLoader *plugin_loader,
+                                           GCancellable   *cancellable)
 {
-	GTask *task = data;
-	gpointer source_object = g_task_get_source_object (task);
-	gpointer task_data = g_task_get_task_data (task);
-	GCancellable *cancellable = g_task_get_cancellable (task);
-	GsPluginLoaderHelper *helper = g_task_get_task_data (task);
-	GsApp *app = gs_plugin_job_get_app (helper->plugin_job);
-	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
+	GsPluginLoaderQueue *interactive = &plugin_loader->queues[GS_PLUGIN_LOADER_LANE_INTERACTIVE];
 
-	gs_ioprio_set (G_PRIORITY_LOW);
+	while (plugin_loader->preempt_background_ops &&
+	       interactive->n_queued + interactive->n_running > 0 &&
+	       !g_cancellable_is_cancelled (cancellable)) {
+		gint64 end_time = g_get_monotonic_time () + 100 * G_TIME_SPAN_MILLISECOND;
+		g_cond_wait_until (&plugin_loader->queue_cond, &plugin_loader->queue_mutex, end_time);
+	}
+}
 
-	gs_plugin_loader_process_thread_cb (task, source_object, task_data, cancellable);
+/* Releases the slot @op held in its lane, and frees it. */
+static void
+gs_plugin_loader_queued_op_finish (GsPluginLoader         *plugin_loader,
+                                   GsPluginLoaderQueuedOp *op)
+{
+	GsPluginLoaderQueue *queue = &plugin_loader->queues[op->lane];
+	GsApp *app = gs_plugin_job_get_app (op->plugin_job);
+	GsPluginAction action = gs_plugin_job_get_action (op->plugin_job);
 
 	/* Clear any pending action set in gs_plugin_loader_schedule_task() */
 	if (app != NULL && gs_app_get_pending_action (app) == action)
 		gs_app_set_pending_action (app, GS_PLUGIN_ACTION_UNKNOWN);
 
-	g_object_unref (task);
+	g_mutex_lock (&plugin_loader->queue_mutex);
+	queue->n_running--;
+	g_cond_broadcast (&plugin_loader->queue_cond);
+	g_mutex_unlock (&plugin_loader->queue_mutex);
+
+	gs_plugin_loader_queued_op_free (op);
+}
+
+static void run_job_cb (GObject      *source_object,
+                        GAsyncResult *result,
+                        gpointer      user_data);
+
+static void
+queued_job_run_cb (GObject      *source_object,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+	GsPluginLoaderQueuedOp *op = user_data;
+	GsPluginLoader *plugin_loader = g_task_get_source_object (op->task);
+
+	run_job_cb (source_object, result, g_object_ref (op->task));
+	gs_plugin_loader_queued_op_finish (plugin_loader, op);
+}
+
+static gboolean
+queued_job_start_cb (gpointer user_data)
+{
+	GsPluginLoaderQueuedOp *op = user_data;
+	GsPluginJobClass *job_class = GS_PLUGIN_JOB_GET_CLASS (op->plugin_job);
+
+	job_class->run_async (op->plugin_job, g_task_get_source_object (op->task),
+			      g_task_get_cancellable (op->task),
+			      queued_job_run_cb, op);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+gs_plugin_loader_process_in_thread_pool_cb (gpointer data,
+					    gpointer user_data)
+{
+	GsPluginLoaderQueuedOp *op = data;
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (user_data);
+	GsPluginLoaderQueue *queue = &plugin_loader->queues[op->lane];
+	GCancellable *cancellable = g_task_get_cancellable ((op->run_task != NULL) ? op->run_task : op->task);
+	GsPluginAction action = gs_plugin_job_get_action (op->plugin_job);
+	gint64 wait_usec;
+
+	g_mutex_lock (&plugin_loader->queue_mutex);
+	if (op->lane == GS_PLUGIN_LOADER_LANE_BACKGROUND)
+		gs_plugin_loader_wait_for_interactive_ops (plugin_loader, cancellable);
+
+	wait_usec = g_get_monotonic_time () - op->queued_time_usec;
+	queue->n_queued--;
+	queue->n_running++;
+	queue->n_started++;
+	queue->total_wait_usec += wait_usec;
+	queue->max_wait_usec = MAX (queue->max_wait_usec, wait_usec);
+	g_mutex_unlock (&plugin_loader->queue_mutex);
+
+	g_debug ("%s op %s waited %" G_GINT64_FORMAT "ms in the queue",
+		 lane_names[op->lane],
+		 (op->run_task != NULL) ? gs_plugin_action_to_string (action) : G_OBJECT_TYPE_NAME (op->plugin_job),
+		 wait_usec / 1000);
+
+	/* Jobs with a run_async() are started in the context they were
+	 * submitted from, as their signals are emitted there. They keep their
+	 * slot in the lane until they finish, but not the thread, so they
+	 * aren’t limited by the number of threads in the lane, and can’t
+	 * deadlock waiting on another op queued behind them. */
+	if (op->task != NULL) {
+		g_main_context_invoke (g_task_get_context (op->task), queued_job_start_cb, op);
+		return;
+	}
+
+	gs_ioprio_set ((op->lane == GS_PLUGIN_LOADER_LANE_INTERACTIVE) ? G_PRIORITY_DEFAULT : G_PRIORITY_LOW);
+	gs_plugin_loader_process_thread_cb (op->run_task, plugin_loader,
+					    g_task_get_task_data (op->run_task), cancellable);
+	gs_plugin_loader_queued_op_finish (plugin_loader, op);
 }
 
 static void
@@ -3355,12 +4052,52 @@ gs_plugin_loader_cancelled_cb (GCancellable *cancellable,
 	g_cancellable_cancel (child_cancellable);
 }
 
+/* the newer job types carry the interactive bit in their own flags */
+static gboolean
+gs_plugin_loader_job_is_interactive (GsPluginJob *plugin_job)
+{
+	if (GS_IS_PLUGIN_JOB_LIST_APPS (plugin_job)) {
+		GsPluginListAppsFlags flags;
+
+		g_object_get (plugin_job, "flags", &flags, NULL);
+		return (flags & GS_PLUGIN_LIST_APPS_FLAGS_INTERACTIVE) != 0;
+	}
+	if (GS_IS_PLUGIN_JOB_REFRESH_METADATA (plugin_job)) {
+		GsPluginRefreshMetadataFlags flags;
+
+		g_object_get (plugin_job, "flags", &flags, NULL);
+		return (flags & GS_PLUGIN_REFRESH_METADATA_FLAGS_INTERACTIVE) != 0;
+	}
+
+	return gs_plugin_job_get_interactive (plugin_job);
+}
+
+static void
+gs_plugin_loader_push_queued_op (GsPluginLoader         *plugin_loader,
+                                 GsPluginLoaderQueuedOp *op)
+{
+	/* interactive ops get their own lane, so they overtake any queued
+	 * background ops rather than waiting behind them */
+	op->lane = gs_plugin_loader_job_is_interactive (op->plugin_job) ? GS_PLUGIN_LOADER_LANE_INTERACTIVE :
+									  GS_PLUGIN_LOADER_LANE_BACKGROUND;
+	op->queued_time_usec = g_get_monotonic_time ();
+
+	g_mutex_lock (&plugin_loader->queue_mutex);
+	plugin_loader->queues[op->lane].n_queued++;
+	g_mutex_unlock (&plugin_loader->queue_mutex);
+
+	g_thread_pool_push (plugin_loader->queues[op->lane].pool, op, NULL);
+}
+
+/* @run_task runs gs_plugin_loader_process_thread_cb(), and has the job’s task
+ * as its task data */
 static void
 gs_plugin_loader_schedule_task (GsPluginLoader *plugin_loader,
-				GTask *task)
+				GTask *run_task)
 {
-	GsPluginLoaderHelper *helper = g_task_get_task_data (task);
+	GsPluginLoaderHelper *helper = g_task_get_task_data (g_task_get_task_data (run_task));
 	GsApp *app = gs_plugin_job_get_app (helper->plugin_job);
+	GsPluginLoaderQueuedOp *op;
 
 	if (app != NULL) {
 		/* set the pending-action to the app */
@@ -3371,7 +4108,77 @@ gs_plugin_loader_schedule_task (GsPluginLoader *plugin_loader,
 		    gs_app_get_state (app) != GS_APP_STATE_AVAILABLE_LOCAL)
 			add_app_to_install_queue (plugin_loader, app);
 	}
-	g_thread_pool_push (plugin_loader->queued_ops_pool, g_object_ref (task), NULL);
+
+	op = g_new0 (GsPluginLoaderQueuedOp, 1);
+	op->run_task = g_object_ref (run_task);
+	op->plugin_job = g_object_ref (helper->plugin_job);
+	gs_plugin_loader_push_queued_op (plugin_loader, op);
+}
+
+/* @task is the job’s task, and @plugin_job has a run_async() which is called
+ * once the job reaches the front of its lane */
+static void
+gs_plugin_loader_schedule_job (GsPluginLoader *plugin_loader,
+                               GsPluginJob    *plugin_job,
+                               GTask          *task)
+{
+	GsPluginLoaderQueuedOp *op;
+
+	op = g_new0 (GsPluginLoaderQueuedOp, 1);
+	op->task = g_object_ref (task);
+	op->plugin_job = g_object_ref (plugin_job);
+	gs_plugin_loader_push_queued_op (plugin_loader, op);
+}
+
+static void job_process_cb (GTask *task);
+
+static void
+shared_refine_cb (GObject      *source_object,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source_object);
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GError) local_error = NULL;
+
+	/* the results are returned to the coalesced refines from run_job_cb() */
+	list = gs_plugin_loader_job_process_finish (plugin_loader, result, &local_error);
+	if (list == NULL)
+		g_debug ("Shared refine failed: %s", local_error->message);
+}
+
+/* Return the results of @plugin_job to the refines which were coalesced with
+ * it, and start any follow-up refine for the ones which needed more. The
+ * refine is only cancelled once all of them have been cancelled, so a failure
+ * is returned to all of them. */
+static void
+finish_coalesced_refines (GsPluginLoader    *plugin_loader,
+                          GsPluginJobRefine *plugin_job,
+                          const GError      *error)
+{
+	g_autoptr(GPtrArray) tasks = NULL;
+	g_autoptr(GsPluginJob) follow_up_job = NULL;
+	g_autoptr(GCancellable) follow_up_cancellable = NULL;
+	GsAppList *list = gs_plugin_job_refine_get_result_list (plugin_job);
+
+	tasks = gs_job_manager_complete_refine (plugin_loader->job_manager,
+						GS_PLUGIN_JOB (plugin_job),
+						&follow_up_job,
+						&follow_up_cancellable);
+
+	for (guint i = 0; i < tasks->len; i++) {
+		GTask *task = g_ptr_array_index (tasks, i);
+
+		if (error == NULL)
+			g_task_return_pointer (task, gs_app_list_copy (list), (GDestroyNotify) g_object_unref);
+		else
+			g_task_return_error (task, g_error_copy (error));
+	}
+
+	if (follow_up_job != NULL) {
+		gs_plugin_loader_job_process_async (plugin_loader, follow_up_job, follow_up_cancellable,
+						    shared_refine_cb, NULL);
+	}
 }
 
 static void
@@ -3382,6 +4189,7 @@ run_job_cb (GObject      *source_object,
 	GsPluginJob *plugin_job = GS_PLUGIN_JOB (source_object);
 	GsPluginJobClass *job_class;
 	g_autoptr(GTask) task = g_steal_pointer (&user_data);
+	gboolean success;
 	g_autoptr(GError) local_error = NULL;
 
 	GS_PROFILER_ADD_MARK_TAKE (PluginLoader,
@@ -3395,7 +4203,14 @@ run_job_cb (GObject      *source_object,
 
 	g_assert (job_class->run_finish != NULL);
 
-	if (!job_class->run_finish (plugin_job, result, &local_error)) {
+	success = job_class->run_finish (plugin_job, result, &local_error);
+
+	if (GS_IS_PLUGIN_JOB_REFINE (plugin_job))
+		finish_coalesced_refines (g_task_get_source_object (task),
+					  GS_PLUGIN_JOB_REFINE (plugin_job),
+					  success ? NULL : local_error);
+
+	if (!success) {
 		g_task_return_error (task, g_steal_pointer (&local_error));
 		return;
 	}
@@ -3466,7 +4281,6 @@ plugin_loader_task_freed_cb (gpointer user_data,
 
 static gboolean job_process_setup_complete_cb (GCancellable *cancellable,
                                                gpointer      user_data);
-static void job_process_cb (GTask *task);
 
 /**
  * gs_plugin_loader_job_process_async:
@@ -3526,8 +4340,6 @@ gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
 		}
 	}
 
-	gs_job_manager_add_job (plugin_loader->job_manager, plugin_job);
-
 	task = g_task_new (plugin_loader, cancellable_job, callback, user_data);
 	g_task_set_name (task, task_name);
 	g_task_set_task_data (task, g_object_ref (plugin_job), (GDestroyNotify) g_object_unref);
@@ -3536,6 +4348,24 @@ gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
 	g_object_weak_ref (G_OBJECT (task),
 		plugin_loader_task_freed_cb, g_object_ref (plugin_loader));
 
+	/* If an identical refine is already running, wait for its results
+	 * rather than refining the app again. Otherwise, this becomes the
+	 * shared refine for the app, which is run with a cancellable that is
+	 * only cancelled once everyone waiting for it has cancelled. */
+	if (GS_IS_PLUGIN_JOB_REFINE (plugin_job)) {
+		g_autoptr(GCancellable) shared_cancellable = NULL;
+
+		if (gs_job_manager_coalesce_refine (plugin_loader->job_manager, plugin_job,
+						    task, &shared_cancellable)) {
+			if (shared_cancellable != NULL)
+				gs_plugin_loader_job_process_async (plugin_loader, plugin_job, shared_cancellable,
+								    shared_refine_cb, NULL);
+			return;
+		}
+	}
+
+	gs_job_manager_add_job (plugin_loader->job_manager, plugin_job);
+
 	/* Wait until the plugin has finished setting up.
 	 *
 	 * Do this using a #GCancellable. While we’re not using the #GCancellable
@@ -3570,6 +4400,7 @@ job_process_cb (GTask *task)
 	GsPluginJobClass *job_class;
 	GsPluginAction action;
 	GsPluginLoaderHelper *helper;
+	g_autoptr(GTask) run_task = NULL;
 
 	job_class = GS_PLUGIN_JOB_GET_CLASS (plugin_job);
 	action = gs_plugin_job_get_action (plugin_job);
@@ -3586,6 +4417,14 @@ job_process_cb (GTask *task)
 		g_task_set_task_data (task, GSIZE_TO_POINTER (begin_time_nsec), NULL);
 #endif
 
+		/* refreshes and app lists can be slow, so they queue in the
+		 * lanes with the other long-running ops */
+		if (GS_IS_PLUGIN_JOB_REFRESH_METADATA (plugin_job) ||
+		    GS_IS_PLUGIN_JOB_LIST_APPS (plugin_job)) {
+			gs_plugin_loader_schedule_job (plugin_loader, plugin_job, task);
+			return;
+		}
+
 		job_class->run_async (plugin_job, plugin_loader, cancellable,
 				      run_job_cb, g_object_ref (task));
 		return;
@@ -3656,19 +4495,27 @@ job_process_cb (GTask *task)
 	g_task_set_check_cancellable (task, FALSE);
 	g_task_set_return_on_cancel (task, FALSE);
 
+	/* only the plugins are run in a thread; the rest of the processing is
+	 * chained asynchronously from process_run_plugins_cb() in this context,
+	 * so no worker thread sits waiting for a refine to finish */
+	run_task = g_task_new (plugin_loader, cancellable, process_run_plugins_cb, g_object_ref (task));
+	g_task_set_name (run_task, g_task_get_name (task));
+	g_task_set_task_data (run_task, g_object_ref (task), g_object_unref);
+	g_task_set_check_cancellable (run_task, FALSE);
+
 	switch (action) {
 	case GS_PLUGIN_ACTION_INSTALL:
 	case GS_PLUGIN_ACTION_UPGRADE_DOWNLOAD:
 		/* these actions must be performed by the thread pool because we
 		 * want to limit the number of them running in parallel */
-		gs_plugin_loader_schedule_task (plugin_loader, task);
+		gs_plugin_loader_schedule_task (plugin_loader, run_task);
 		return;
 	default:
 		break;
 	}
 
 	/* run in a thread */
-	g_task_run_in_thread (task, gs_plugin_loader_process_thread_cb);
+	g_task_run_in_thread (run_task, gs_plugin_loader_process_thread_cb);
 }
 
 /******************************************************************************/
@@ -3908,19 +4755,51 @@ gs_plugin_loader_get_odrs_provider (GsPluginLoader *plugin_loader)
  * @plugin_loader: a #GsPluginLoader
  * @max_ops: the maximum number of parallel operations
  *
- * Sets the number of maximum number of queued operations (install/update/upgrade-download)
- * to be processed at a time. If @max_ops is 0, then it will set the default maximum number.
+ * Sets the number of maximum number of queued operations (install, upgrade-download,
+ * refresh-metadata and list-apps) to be processed at a time. If @max_ops is 0,
+ * then it will set the default maximum number.
+ *
+ * The limit applies separately to the interactive and background lanes. Jobs
+ * which run asynchronously only count against it while they are being
+ * started, so any number of them can run at once.
  */
 void
 gs_plugin_loader_set_max_parallel_ops (GsPluginLoader *plugin_loader,
 				       guint max_ops)
 {
-	g_autoptr(GError) error = NULL;
 	if (max_ops == 0)
 		max_ops = get_max_parallel_ops ();
-	if (!g_thread_pool_set_max_threads (plugin_loader->queued_ops_pool, max_ops, &error))
-		g_warning ("Failed to set the maximum number of ops in parallel: %s",
-			   error->message);
+	for (guint i = 0; i < GS_PLUGIN_LOADER_N_LANES; i++) {
+		g_autoptr(GError) error = NULL;
+
+		if (!g_thread_pool_set_max_threads (plugin_loader->queues[i].pool, max_ops, &error))
+			g_warning ("Failed to set the maximum number of %s ops in parallel: %s",
+				   lane_names[i], error->message);
+	}
+}
+
+/**
+ * gs_plugin_loader_set_preempt_background_ops:
+ * @plugin_loader: a #GsPluginLoader
+ * @preempt: %TRUE to hold back background operations
+ *
+ * Sets whether queued background operations should wait until there are no
+ * interactive operations queued or running before they start. Background
+ * operations which are already running are not interrupted; cancel them to
+ * preempt them.
+ *
+ * Since: 44
+ */
+void
+gs_plugin_loader_set_preempt_background_ops (GsPluginLoader *plugin_loader,
+					     gboolean        preempt)
+{
+	g_return_if_fail (GS_IS_PLUGIN_LOADER (plugin_loader));
+
+	g_mutex_lock (&plugin_loader->queue_mutex);
+	plugin_loader->preempt_background_ops = preempt;
+	g_cond_broadcast (&plugin_loader->queue_cond);
+	g_mutex_unlock (&plugin_loader->queue_mutex);
 }
 
 /**
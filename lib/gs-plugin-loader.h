@@ -98,6 +98,9 @@ GsPlugin	*gs_plugin_loader_find_plugin		(GsPluginLoader	*plugin_loader,
 							 const gchar	*plugin_name);
 void            gs_plugin_loader_set_max_parallel_ops  (GsPluginLoader *plugin_loader,
                                                         guint           max_ops);
+void		 gs_plugin_loader_set_preempt_background_ops
+							(GsPluginLoader	*plugin_loader,
+							 gboolean	 preempt);
 
 GsJobManager	*gs_plugin_loader_get_job_manager	(GsPluginLoader	*plugin_loader);
 
@@ -122,4 +125,23 @@ void		 gs_plugin_loader_run_adopt		(GsPluginLoader *plugin_loader,
 							 GsAppList *list);
 void		 gs_plugin_loader_emit_updates_changed	(GsPluginLoader *self);
 
+/**
+ * GS_PLUGIN_LOADER_LIST_APPS_CACHE_MAX_ENTRIES:
+ *
+ * The maximum number of #GsPluginJobListApps results which are cached.
+ *
+ * Since: 44
+ */
+#define GS_PLUGIN_LOADER_LIST_APPS_CACHE_MAX_ENTRIES 64
+
+GsAppList	*gs_plugin_loader_lookup_list_apps_cache (GsPluginLoader *plugin_loader,
+							 const gchar	*key,
+							 guint		*generation_out);
+void		 gs_plugin_loader_add_list_apps_cache	(GsPluginLoader *plugin_loader,
+							 const gchar	*key,
+							 guint		 generation,
+							 GsAppList	*list);
+void		 gs_plugin_loader_invalidate_list_apps_cache
+							(GsPluginLoader *plugin_loader);
+
 G_END_DECLS
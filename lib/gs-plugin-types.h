@@ -317,6 +317,9 @@ typedef void (* GsPluginAppNeedsUserActionCallback)	(GsPlugin	*plugin,
  * @GS_PLUGIN_RULE_BETTER_THAN:		Results are better than another
  *
  * The rules used for ordering plugins.
+ *
+ * %GS_PLUGIN_RULE_RUN_AFTER and %GS_PLUGIN_RULE_RUN_BEFORE only order the
+ * vfunc calls made on plugins; plugins are always set up concurrently.
  * Plugins are expected to add rules in the init function for their #GsPlugin
  * subclass.
  **/
@@ -91,6 +91,7 @@ enum {
 	SIGNAL_BASIC_AUTH_START,
 	SIGNAL_REPOSITORY_CHANGED,
 	SIGNAL_ASK_UNTRUSTED,
+	SIGNAL_METADATA_CHANGED,
 	SIGNAL_LAST
 };
 
@@ -645,6 +646,8 @@ gs_plugin_remove_flags (GsPlugin *plugin, GsPluginFlags flags)
  * for example the plugin specified by @name will be ordered after this plugin
  * when %GS_PLUGIN_RULE_RUN_AFTER is used.
  *
+ * Plugins are always set up concurrently, whatever their rules.
+ *
  * NOTE: The depsolver is iterative and may not solve overly-complicated rules;
  * If depsolving fails then gnome-software will not start.
  *
@@ -1948,6 +1951,23 @@ gs_plugin_class_init (GsPluginClass *klass)
 			      G_STRUCT_OFFSET (GsPluginClass, ask_untrusted),
 			      NULL, NULL, g_cclosure_marshal_generic,
 			      G_TYPE_BOOLEAN, 4, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+
+	/**
+	 * GsPlugin::metadata-changed:
+	 * @plugin: the #GsPlugin which emitted the signal
+	 *
+	 * Emitted when the app metadata provided by the plugin has changed, for
+	 * example because its silo was regenerated. Unlike #GsPlugin::reload,
+	 * this is emitted synchronously in the thread which detected the
+	 * change.
+	 *
+	 * Since: 44
+	 */
+	signals [SIGNAL_METADATA_CHANGED] =
+		g_signal_new ("metadata-changed",
+			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
+			      0, NULL, NULL, g_cclosure_marshal_VOID__VOID,
+			      G_TYPE_NONE, 0);
 }
 
 static void
@@ -2057,6 +2077,26 @@ gs_plugin_repository_changed (GsPlugin *plugin,
 	g_source_attach (idle_source, NULL);
 }
 
+/**
+ * gs_plugin_metadata_changed:
+ * @plugin: a #GsPlugin
+ *
+ * Emit the #GsPlugin::metadata-changed signal, so that any results cached
+ * from earlier queries to the plugin are dropped.
+ *
+ * This may be called from any thread, and the signal is emitted in the calling
+ * thread.
+ *
+ * Since: 44
+ **/
+void
+gs_plugin_metadata_changed (GsPlugin *plugin)
+{
+	g_return_if_fail (GS_IS_PLUGIN (plugin));
+
+	g_signal_emit (plugin, signals[SIGNAL_METADATA_CHANGED], 0);
+}
+
 /**
  * gs_plugin_update_cache_state_for_repository:
  * @plugin: a #GsPlugin
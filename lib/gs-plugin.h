@@ -337,6 +337,7 @@ void		 gs_plugin_basic_auth_start		(GsPlugin	*plugin,
 							 gpointer	 user_data);
 void		gs_plugin_repository_changed		(GsPlugin	*plugin,
 							 GsApp		*repository);
+void		gs_plugin_metadata_changed		(GsPlugin	*plugin);
 void		gs_plugin_update_cache_state_for_repository
 							(GsPlugin *plugin,
 							 GsApp *repository);
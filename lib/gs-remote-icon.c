@@ -39,6 +39,7 @@
 #include <sys/stat.h>
 #include <libsoup/soup.h>
 
+#include "gs-cache-manager.h"
 #include "gs-remote-icon.h"
 #include "gs-utils.h"
 
@@ -175,10 +176,11 @@ gs_remote_icon_get_cache_filename (const gchar  *uri,
 	if (create_directory)
 		flags |= GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY;
 
-	return gs_utils_get_cache_filename ("icons",
-					    cache_basename,
-					    flags,
-					    error);
+	return gs_cache_manager_get_filename (gs_cache_manager_get_default (),
+					      "icons",
+					      cache_basename,
+					      flags,
+					      error);
 }
 
 /**
@@ -360,12 +362,15 @@ gs_remote_icon_ensure_cached (GsRemoteIcon  *self,
 			g_object_set_data (G_OBJECT (self), "width", GINT_TO_POINTER (width));
 			g_object_set_data (G_OBJECT (self), "height", GINT_TO_POINTER (height));
 		}
+		gs_cache_manager_note_hit (gs_cache_manager_get_default (), cache_filename);
 		return TRUE;
 	}
 
+	gs_cache_manager_note_miss (gs_cache_manager_get_default ());
 	cached_pixbuf = gs_icon_download (soup_session, uri, cache_filename, maximum_icon_size, cancellable, error);
 	if (cached_pixbuf == NULL)
 		return FALSE;
+	gs_cache_manager_add_file (gs_cache_manager_get_default (), cache_filename);
 
 	/* Ensure the dimensions are set correctly on the icon. */
 	g_object_set_data (G_OBJECT (self), "width", GUINT_TO_POINTER (gdk_pixbuf_get_width (cached_pixbuf)));
@@ -9,9 +9,16 @@
 
 #include "config.h"
 
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
 #include "gnome-software-private.h"
 
 #include "gs-debug.h"
+#include "gs-key-colors-private.h"
 #include "gs-test.h"
 
 static gboolean
@@ -131,6 +138,920 @@ gs_utils_cache_func (void)
 	g_assert (g_str_has_suffix (fn2, "test/295099f59d12b3eb0b955325fcb699cd23792a89-baz"));
 }
 
+static guint64
+gs_utils_file_size_add_file (const gchar *dir,
+			     const gchar *name,
+			     gsize        len)
+{
+	g_autofree gchar *fn = g_build_filename (dir, name, NULL);
+	g_autofree gchar *contents = g_malloc0 (len);
+	g_autoptr(GError) error = NULL;
+	GStatBuf st;
+
+	g_file_set_contents (fn, contents, len, &error);
+	g_assert_no_error (error);
+	g_assert_cmpint (g_lstat (fn, &st), ==, 0);
+	return (guint64) st.st_blocks * 512;
+}
+
+/* Sets the modification time of @dir to a minute ago, as gs_utils_get_file_size()
+ * only caches directories which haven’t been modified recently. */
+static void
+gs_utils_file_size_backdate (const gchar *dir)
+{
+	g_autoptr(GFile) file = g_file_new_for_path (dir);
+	g_autoptr(GError) error = NULL;
+
+	g_file_set_attribute_uint64 (file, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				     (guint64) (g_get_real_time () / G_USEC_PER_SEC - 60),
+				     G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, &error);
+	g_assert_no_error (error);
+}
+
+static gboolean
+gs_utils_file_size_include_cb (const gchar *filename,
+			       GFileTest    file_kind,
+			       gpointer     user_data)
+{
+	return g_strcmp0 (filename, "sub") != 0;
+}
+
+static void
+gs_utils_file_size_func (void)
+{
+	g_autofree gchar *tmpdir = NULL;
+	g_autofree gchar *subdir = NULL;
+	g_autofree gchar *deeperdir = NULL;
+	g_autofree gchar *link = NULL;
+	g_autofree gchar *file = NULL;
+	g_autoptr(GError) error = NULL;
+	guint64 size_top, size_sub, size_c, size_link, size_hidden;
+	struct timespec times[2] = { { 0, }, };
+	GStatBuf st;
+	FILE *fp;
+	static const gchar padding[30000] = { 0, };
+
+	tmpdir = g_dir_make_tmp ("gs-self-test-file-size-XXXXXX", &error);
+	g_assert_no_error (error);
+	subdir = g_build_filename (tmpdir, "sub", NULL);
+	deeperdir = g_build_filename (subdir, "deeper", NULL);
+	g_assert_cmpint (g_mkdir_with_parents (deeperdir, 0700), ==, 0);
+
+	size_top = gs_utils_file_size_add_file (tmpdir, "a", 5000);
+	size_c = gs_utils_file_size_add_file (deeperdir, "c", 70000);
+	size_sub = gs_utils_file_size_add_file (subdir, "b", 10000) + size_c;
+
+	/* a symlinked directory is counted as the link, not the target */
+	link = g_build_filename (tmpdir, "link", NULL);
+	g_assert_cmpint (symlink ("sub", link), ==, 0);
+	g_assert_cmpint (g_lstat (link, &st), ==, 0);
+	size_link = (guint64) st.st_blocks * 512;
+
+	g_assert_cmpuint (gs_utils_get_file_size (tmpdir, NULL, NULL, NULL), ==,
+			  size_top + size_sub + size_link);
+	g_assert_cmpuint (gs_utils_get_file_size (tmpdir, gs_utils_file_size_include_cb, NULL, NULL), ==,
+			  size_top + size_link);
+
+	/* an added file is noticed on the next call */
+	size_sub += gs_utils_file_size_add_file (deeperdir, "d", 20000);
+	g_assert_cmpuint (gs_utils_get_file_size (tmpdir, NULL, NULL, NULL), ==,
+			  size_top + size_sub + size_link);
+
+	/* directories which haven’t been modified recently are cached */
+	gs_utils_file_size_backdate (deeperdir);
+	gs_utils_file_size_backdate (subdir);
+	gs_utils_file_size_backdate (tmpdir);
+	g_assert_cmpuint (gs_utils_get_file_size (tmpdir, NULL, NULL, NULL), ==,
+			  size_top + size_sub + size_link);
+
+	/* a file growing in place is noticed, even though its directory
+	 * isn’t modified, so its cached listing is used */
+	file = g_build_filename (deeperdir, "c", NULL);
+	fp = fopen (file, "ab");
+	g_assert_nonnull (fp);
+	g_assert_cmpuint (fwrite (padding, 1, sizeof (padding), fp), ==, sizeof (padding));
+	g_assert_cmpint (fclose (fp), ==, 0);
+	g_assert_cmpint (g_lstat (file, &st), ==, 0);
+	size_sub += (guint64) st.st_blocks * 512 - size_c;
+	g_assert_cmpuint (gs_utils_get_file_size (tmpdir, NULL, NULL, NULL), ==,
+			  size_top + size_sub + size_link);
+	g_clear_pointer (&file, g_free);
+
+	/* the listing is cached: a file added behind its back, by putting the
+	 * directory’s modification time back, isn’t counted */
+	g_assert_cmpint (g_lstat (deeperdir, &st), ==, 0);
+	size_hidden = gs_utils_file_size_add_file (deeperdir, "hidden", 20000);
+	times[0].tv_nsec = UTIME_OMIT;
+	times[1] = st.st_mtim;
+	g_assert_cmpint (utimensat (AT_FDCWD, deeperdir, times, 0), ==, 0);
+	g_assert_cmpuint (gs_utils_get_file_size (tmpdir, NULL, NULL, NULL), ==,
+			  size_top + size_sub + size_link);
+
+	/* until something is added to or removed from the directory */
+	size_sub += size_hidden;
+	size_sub += gs_utils_file_size_add_file (deeperdir, "e", 20000);
+	g_assert_cmpuint (gs_utils_get_file_size (tmpdir, NULL, NULL, NULL), ==,
+			  size_top + size_sub + size_link);
+
+	/* plain files and missing files */
+	file = g_build_filename (tmpdir, "a", NULL);
+	g_assert_cmpuint (gs_utils_get_file_size (file, NULL, NULL, NULL), ==, size_top);
+	g_assert_cmpuint (gs_utils_get_file_size ("/nonexistent", NULL, NULL, NULL), ==, 0);
+
+	gs_utils_rmtree (tmpdir, &error);
+	g_assert_no_error (error);
+}
+
+static gchar *
+gs_cache_manager_add_test_file (GsCacheManager *manager,
+				const gchar    *dir,
+				const gchar    *name)
+{
+	g_autofree gchar *contents = g_malloc0 (4000);
+	g_autofree gchar *fn = NULL;
+	g_autoptr(GError) error = NULL;
+
+	g_assert_cmpint (g_mkdir_with_parents (dir, 0700), ==, 0);
+	fn = g_build_filename (dir, name, NULL);
+	g_file_set_contents (fn, contents, 4000, &error);
+	g_assert_no_error (error);
+	gs_cache_manager_add_file (manager, fn);
+	return g_steal_pointer (&fn);
+}
+
+static void
+gs_cache_manager_func (void)
+{
+	GsCacheManager *manager;
+	gpointer weak_manager;
+	g_autofree gchar *tmpdir = NULL;
+	g_autofree gchar *dir_a = NULL;
+	g_autofree gchar *dir_b = NULL;
+	g_autofree gchar *fn_a = NULL;
+	g_autofree gchar *fn_b = NULL;
+	g_autofree gchar *fn_c = NULL;
+	g_autofree gchar *fn_d = NULL;
+	g_autofree gchar *index_fn = NULL;
+	g_autofree gchar *fn_unsharded = NULL;
+	g_autofree gchar *fn_sharded = NULL;
+	g_autoptr(GError) error = NULL;
+	guint64 n_hits, n_misses, n_evicted, size;
+
+	tmpdir = g_dir_make_tmp ("gs-self-test-cache-manager-XXXXXX", &error);
+	g_assert_no_error (error);
+	dir_a = g_build_filename (tmpdir, "icons", "aa", NULL);
+	dir_b = g_build_filename (tmpdir, "icons", "bb", NULL);
+
+	manager = gs_cache_manager_new (tmpdir);
+	gs_cache_manager_set_max_size (manager, 10000);
+	gs_cache_manager_evict (manager, NULL, &error);
+	g_assert_no_error (error);
+
+	/* 'a' is used again after 'b' was added, so 'b' goes first */
+	fn_a = gs_cache_manager_add_test_file (manager, dir_a, "aa-one.png");
+	fn_b = gs_cache_manager_add_test_file (manager, dir_b, "bb-two.png");
+	gs_cache_manager_note_hit (manager, fn_a);
+	gs_cache_manager_note_miss (manager);
+	fn_c = gs_cache_manager_add_test_file (manager, dir_a, "aa-three.png");
+	gs_cache_manager_evict (manager, NULL, &error);
+	g_assert_no_error (error);
+
+	g_assert_true (g_file_test (fn_a, G_FILE_TEST_EXISTS));
+	g_assert_false (g_file_test (fn_b, G_FILE_TEST_EXISTS));
+	g_assert_true (g_file_test (fn_c, G_FILE_TEST_EXISTS));
+	gs_cache_manager_get_stats (manager, &n_hits, &n_misses, &n_evicted, &size);
+	g_assert_cmpuint (n_hits, ==, 1);
+	g_assert_cmpuint (n_misses, ==, 1);
+	g_assert_cmpuint (n_evicted, ==, 1);
+	g_assert_cmpuint (size, ==, 8000);
+
+	/* wait for any background eviction to finish */
+	weak_manager = manager;
+	g_object_add_weak_pointer (G_OBJECT (manager), &weak_manager);
+	g_object_unref (manager);
+	while (weak_manager != NULL)
+		g_main_context_iteration (NULL, TRUE);
+
+	/* the index is loaded again by the worker, and files added before it
+	 * is loaded are kept */
+	manager = gs_cache_manager_new (tmpdir);
+	fn_d = gs_cache_manager_add_test_file (manager, dir_b, "bb-four.png");
+	gs_cache_manager_evict (manager, NULL, &error);
+	g_assert_no_error (error);
+	gs_cache_manager_get_stats (manager, NULL, NULL, NULL, &size);
+	g_assert_cmpuint (size, ==, 12000);
+
+	/* wait for the background maintenance, which saves the index */
+	weak_manager = manager;
+	g_object_add_weak_pointer (G_OBJECT (manager), &weak_manager);
+	g_object_unref (manager);
+	while (weak_manager != NULL)
+		g_main_context_iteration (NULL, TRUE);
+
+	/* without an index, files from before the cache was sharded are
+	 * moved into their shard */
+	index_fn = g_build_filename (tmpdir, "cache-index.gvariant", NULL);
+	g_assert_cmpint (g_unlink (index_fn), ==, 0);
+	fn_unsharded = g_build_filename (tmpdir, "icons", "cc-five.png", NULL);
+	g_file_set_contents (fn_unsharded, "icon", -1, &error);
+	g_assert_no_error (error);
+	fn_sharded = g_build_filename (tmpdir, "icons", "cc", "cc-five.png", NULL);
+	manager = gs_cache_manager_new (tmpdir);
+	gs_cache_manager_evict (manager, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_false (g_file_test (fn_unsharded, G_FILE_TEST_EXISTS));
+	g_assert_true (g_file_test (fn_sharded, G_FILE_TEST_EXISTS));
+	gs_cache_manager_get_stats (manager, NULL, NULL, NULL, &size);
+	g_assert_cmpuint (size, ==, 12004);
+	g_object_unref (manager);
+
+	gs_utils_rmtree (tmpdir, &error);
+	g_assert_no_error (error);
+}
+
+typedef struct {
+	GBytes *content;  /* (owned) */
+	const gchar *etag;
+	gsize drop_after;  /* 0 to send the whole response */
+	goffset last_range_start;  /* -1 if the whole file was sent */
+} GsDownloadTestServer;
+
+#if SOUP_CHECK_VERSION(3, 0, 0)
+static void
+gs_download_test_server_cb (SoupServer        *server,
+			    SoupServerMessage *msg,
+			    const char        *path,
+			    GHashTable        *query,
+			    gpointer           user_data)
+#else
+static void
+gs_download_test_server_cb (SoupServer        *server,
+			    SoupMessage       *msg,
+			    const char        *path,
+			    GHashTable        *query,
+			    SoupClientContext *client,
+			    gpointer           user_data)
+#endif
+{
+	GsDownloadTestServer *test_server = user_data;
+	SoupMessageHeaders *request_headers, *response_headers;
+	SoupMessageBody *response_body;
+	SoupRange *ranges = NULL;
+	gint n_ranges = 0;
+	const guint8 *content;
+	gsize content_size, length;
+	goffset start = 0;
+
+#if SOUP_CHECK_VERSION(3, 0, 0)
+	request_headers = soup_server_message_get_request_headers (msg);
+	response_headers = soup_server_message_get_response_headers (msg);
+	response_body = soup_server_message_get_response_body (msg);
+#else
+	request_headers = msg->request_headers;
+	response_headers = msg->response_headers;
+	response_body = msg->response_body;
+#endif
+
+	/* only send a range if the client has the current version; the
+	 * Range header is removed so #SoupServer doesn’t apply it anyway */
+	content = g_bytes_get_data (test_server->content, &content_size);
+	if (g_strcmp0 (soup_message_headers_get_one (request_headers, "If-Range"), test_server->etag) == 0 &&
+	    soup_message_headers_get_ranges (request_headers, content_size, &ranges, &n_ranges)) {
+		start = ranges[0].start;
+		soup_message_headers_free_ranges (request_headers, ranges);
+	}
+	soup_message_headers_remove (request_headers, "Range");
+	test_server->last_range_start = (start > 0) ? start : -1;
+
+	soup_message_headers_replace (response_headers, "ETag", test_server->etag);
+	soup_message_headers_set_content_length (response_headers, content_size - start);
+	if (start > 0)
+		soup_message_headers_set_content_range (response_headers, start, content_size - 1, content_size);
+
+	/* drop the connection part-way through the body */
+	length = content_size - start;
+	if (test_server->drop_after > 0) {
+		length = MIN (length, test_server->drop_after);
+		test_server->drop_after = 0;
+		soup_message_headers_replace (response_headers, "Connection", "close");
+	}
+	soup_message_body_append (response_body, SOUP_MEMORY_COPY, content + start, length);
+
+#if SOUP_CHECK_VERSION(3, 0, 0)
+	soup_server_message_set_status (msg, (start > 0) ? SOUP_STATUS_PARTIAL_CONTENT : SOUP_STATUS_OK, NULL);
+#else
+	soup_message_set_status (msg, (start > 0) ? SOUP_STATUS_PARTIAL_CONTENT : SOUP_STATUS_OK);
+#endif
+}
+
+static GBytes *
+gs_download_test_content_new (guint seed)
+{
+	gsize size = 64 * 1024;
+	guint8 *content = g_malloc (size);
+
+	for (gsize i = 0; i < size; i++)
+		content[i] = (i * seed) % 251;
+	return g_bytes_new_take (content, size);
+}
+
+static void
+gs_download_test_result_cb (GObject      *source_object,
+			    GAsyncResult *result,
+			    gpointer      user_data)
+{
+	GAsyncResult **result_out = user_data;
+
+	*result_out = g_object_ref (result);
+}
+
+static gboolean
+gs_download_test_file (SoupSession  *session,
+		       const gchar  *uri,
+		       GFile        *output_file,
+		       GError      **error)
+{
+	g_autoptr(GAsyncResult) result = NULL;
+
+	gs_download_file_async (session, uri, output_file, G_PRIORITY_DEFAULT,
+				NULL, NULL, NULL, gs_download_test_result_cb, &result);
+	while (result == NULL)
+		g_main_context_iteration (NULL, TRUE);
+	return gs_download_file_finish (session, result, error);
+}
+
+static void
+gs_download_file_resume_func (void)
+{
+	GsDownloadTestServer test_server = { NULL, };
+	g_autoptr(SoupServer) server = NULL;
+	g_autoptr(SoupSession) session = NULL;
+	g_autoptr(GFile) output_file = NULL;
+	g_autoptr(GFile) partial_file = NULL;
+	g_autoptr(GAsyncResult) result1 = NULL;
+	g_autoptr(GAsyncResult) result2 = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autofree gchar *tmpdir = NULL;
+	g_autofree gchar *output_path = NULL;
+	g_autofree gchar *partial_path = NULL;
+	g_autofree gchar *uri = NULL;
+	g_autofree gchar *contents = NULL;
+	gsize contents_size;
+	GSList *uris;
+	guint port;
+
+	tmpdir = g_dir_make_tmp ("gs-self-test-download-XXXXXX", &error);
+	g_assert_no_error (error);
+	output_path = g_build_filename (tmpdir, "download.bin", NULL);
+	partial_path = g_build_filename (tmpdir, "download.bin.partial", NULL);
+	output_file = g_file_new_for_path (output_path);
+	partial_file = g_file_new_for_path (partial_path);
+
+	/* resuming needs extended attributes to store the validator in */
+	g_file_set_contents (partial_path, "", 0, &error);
+	g_assert_no_error (error);
+	if (!gs_utils_set_file_etag (partial_file, "test", NULL)) {
+		g_test_skip ("Extended attributes are not supported in the temporary directory");
+		gs_utils_rmtree (tmpdir, NULL);
+		return;
+	}
+	g_assert_cmpint (g_unlink (partial_path), ==, 0);
+
+	/* serve a file which is interrupted the first time */
+	test_server.content = gs_download_test_content_new (7);
+	test_server.etag = "\"one\"";
+	test_server.drop_after = 20000;
+
+	server = soup_server_new (NULL, NULL);
+	soup_server_add_handler (server, NULL, gs_download_test_server_cb, &test_server, NULL);
+	soup_server_listen_local (server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY, &error);
+	g_assert_no_error (error);
+	uris = soup_server_get_uris (server);
+#if SOUP_CHECK_VERSION(3, 0, 0)
+	port = g_uri_get_port (uris->data);
+	g_slist_free_full (uris, (GDestroyNotify) g_uri_unref);
+#else
+	port = soup_uri_get_port (uris->data);
+	g_slist_free_full (uris, (GDestroyNotify) soup_uri_free);
+#endif
+	uri = g_strdup_printf ("http://127.0.0.1:%u/download.bin", port);
+	session = gs_build_soup_session ();
+
+	/* the connection drops, and what was received is kept */
+	g_assert_false (gs_download_test_file (session, uri, output_file, &error));
+	g_assert_nonnull (error);
+	g_clear_error (&error);
+	g_assert_false (g_file_test (output_path, G_FILE_TEST_EXISTS));
+	g_file_get_contents (partial_path, &contents, &contents_size, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (contents_size, ==, 20000);
+	g_clear_pointer (&contents, g_free);
+
+	/* a retry which never reaches the server keeps the partial file */
+	g_assert_false (gs_download_test_file (session, "http://127.0.0.1:1/download.bin", output_file, &error));
+	g_assert_nonnull (error);
+	g_clear_error (&error);
+	g_file_get_contents (partial_path, &contents, &contents_size, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (contents_size, ==, 20000);
+	g_clear_pointer (&contents, g_free);
+
+	/* the next download only fetches the rest of the file */
+	g_assert_true (gs_download_test_file (session, uri, output_file, &error));
+	g_assert_no_error (error);
+	g_assert_cmpint (test_server.last_range_start, ==, 20000);
+	g_assert_false (g_file_test (partial_path, G_FILE_TEST_EXISTS));
+	g_file_get_contents (output_path, &contents, &contents_size, &error);
+	g_assert_no_error (error);
+	g_assert_cmpmem (contents, contents_size,
+			 g_bytes_get_data (test_server.content, NULL),
+			 g_bytes_get_size (test_server.content));
+	g_clear_pointer (&contents, g_free);
+
+	/* interrupt a download again, then change the file on the server */
+	test_server.drop_after = 20000;
+	g_assert_false (gs_download_test_file (session, uri, output_file, &error));
+	g_clear_error (&error);
+	g_assert_true (g_file_test (partial_path, G_FILE_TEST_EXISTS));
+	g_bytes_unref (test_server.content);
+	test_server.content = gs_download_test_content_new (13);
+	test_server.etag = "\"two\"";
+
+	/* the partial file is out of date, so the whole file is fetched */
+	g_assert_true (gs_download_test_file (session, uri, output_file, &error));
+	g_assert_no_error (error);
+	g_assert_cmpint (test_server.last_range_start, ==, -1);
+	g_file_get_contents (output_path, &contents, &contents_size, &error);
+	g_assert_no_error (error);
+	g_assert_cmpmem (contents, contents_size,
+			 g_bytes_get_data (test_server.content, NULL),
+			 g_bytes_get_size (test_server.content));
+	g_clear_pointer (&contents, g_free);
+
+	/* a second concurrent download of the same file doesn’t append to
+	 * the first one’s partial file */
+	g_assert_cmpint (g_unlink (output_path), ==, 0);
+	gs_download_file_async (session, uri, output_file, G_PRIORITY_DEFAULT,
+				NULL, NULL, NULL, gs_download_test_result_cb, &result1);
+	gs_download_file_async (session, uri, output_file, G_PRIORITY_DEFAULT,
+				NULL, NULL, NULL, gs_download_test_result_cb, &result2);
+	while (result1 == NULL || result2 == NULL)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_true (gs_download_file_finish (session, result1, &error));
+	g_assert_no_error (error);
+	g_assert_false (gs_download_file_finish (session, result2, &error));
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_BUSY);
+	g_clear_error (&error);
+	g_file_get_contents (output_path, &contents, &contents_size, &error);
+	g_assert_no_error (error);
+	g_assert_cmpmem (contents, contents_size,
+			 g_bytes_get_data (test_server.content, NULL),
+			 g_bytes_get_size (test_server.content));
+
+	g_bytes_unref (test_server.content);
+	gs_utils_rmtree (tmpdir, &error);
+	g_assert_no_error (error);
+}
+
+typedef struct {
+	GBytes *png;  /* (owned) */
+	GHashTable *n_requests;  /* (owned) (element-type utf8 guint) */
+	GPtrArray *requests;  /* (owned) (element-type utf8); request paths, in order */
+	GPtrArray *paused;  /* (owned); messages for a path containing “block” */
+} GsIconDownloaderTestServer;
+
+#if SOUP_CHECK_VERSION(3, 0, 0)
+static void
+gs_icon_downloader_test_server_cb (SoupServer        *server,
+				   SoupServerMessage *msg,
+				   const char        *path,
+				   GHashTable        *query,
+				   gpointer           user_data)
+#else
+static void
+gs_icon_downloader_test_server_cb (SoupServer        *server,
+				   SoupMessage       *msg,
+				   const char        *path,
+				   GHashTable        *query,
+				   SoupClientContext *client,
+				   gpointer           user_data)
+#endif
+{
+	GsIconDownloaderTestServer *test_server = user_data;
+	guint n_requests;
+
+	n_requests = GPOINTER_TO_UINT (g_hash_table_lookup (test_server->n_requests, path));
+	g_hash_table_replace (test_server->n_requests, g_strdup (path), GUINT_TO_POINTER (n_requests + 1));
+	g_ptr_array_add (test_server->requests, g_strdup (path));
+
+#if SOUP_CHECK_VERSION(3, 0, 0)
+	soup_server_message_set_response (msg, "image/png", SOUP_MEMORY_COPY,
+					  g_bytes_get_data (test_server->png, NULL),
+					  g_bytes_get_size (test_server->png));
+	soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+#else
+	soup_message_set_response (msg, "image/png", SOUP_MEMORY_COPY,
+				   g_bytes_get_data (test_server->png, NULL),
+				   g_bytes_get_size (test_server->png));
+	soup_message_set_status (msg, SOUP_STATUS_OK);
+#endif
+
+	/* hold the response back until the test lets it through */
+	if (strstr (path, "block") != NULL) {
+		g_ptr_array_add (test_server->paused, g_object_ref (msg));
+#if SOUP_CHECK_VERSION(3, 2, 0)
+		soup_server_message_pause (msg);
+#else
+		soup_server_pause_message (server, msg);
+#endif
+	}
+}
+
+static void
+gs_icon_downloader_test_unpause (SoupServer                 *server,
+				 GsIconDownloaderTestServer *test_server,
+				 guint                       n_messages)
+{
+	for (guint i = 0; i < n_messages; i++) {
+		g_autoptr(GObject) msg = g_ptr_array_steal_index (test_server->paused, 0);
+
+#if SOUP_CHECK_VERSION(3, 2, 0)
+		soup_server_message_unpause (SOUP_SERVER_MESSAGE (msg));
+#elif SOUP_CHECK_VERSION(3, 0, 0)
+		soup_server_unpause_message (server, SOUP_SERVER_MESSAGE (msg));
+#else
+		soup_server_unpause_message (server, SOUP_MESSAGE (msg));
+#endif
+	}
+}
+
+static GsApp *
+gs_icon_downloader_test_app_new (const gchar *base_uri,
+				 const gchar *id,
+				 const gchar *icon_name)
+{
+	GsApp *app = gs_app_new (id);
+	g_autofree gchar *uri = g_strdup_printf ("%s/%s.png", base_uri, icon_name);
+	g_autoptr(GIcon) icon = gs_remote_icon_new (uri);
+
+	gs_app_add_icon (app, icon);
+
+	return app;
+}
+
+static guint
+gs_icon_downloader_test_get_width (GsApp *app)
+{
+	GIcon *icon = g_ptr_array_index (gs_app_get_icons (app), 0);
+
+	return GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (icon), "width"));
+}
+
+static void
+gs_icon_downloader_test_wait_for_icons (GsApp *app)
+{
+	while (gs_app_get_icons_state (app) != GS_APP_ICONS_STATE_AVAILABLE)
+		g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+gs_icon_downloader_func (void)
+{
+	GsIconDownloaderTestServer test_server = { NULL, };
+	g_autoptr(SoupServer) server = NULL;
+	g_autoptr(SoupSession) session = NULL;
+	g_autoptr(GsIconDownloader) downloader = NULL;
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	g_autoptr(GPtrArray) apps = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GAsyncResult) result = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autofree gchar *base_uri = NULL;
+	g_autofree gchar *path = NULL;
+	gchar *png_data = NULL;
+	gsize png_size;
+	GsApp *app1, *app2, *app_block4, *app_c, *app_d, *app_e, *app_f;
+	GSList *uris;
+	guint port;
+
+	/* a 48×48px icon, which doesn’t need scaling down */
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 48, 48);
+	gdk_pixbuf_fill (pixbuf, 0x3366ccff);
+	gdk_pixbuf_save_to_buffer (pixbuf, &png_data, &png_size, "png", &error, NULL);
+	g_assert_no_error (error);
+	test_server.png = g_bytes_new_take (png_data, png_size);
+	test_server.n_requests = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	test_server.requests = g_ptr_array_new_with_free_func (g_free);
+	test_server.paused = g_ptr_array_new_with_free_func (g_object_unref);
+
+	server = soup_server_new (NULL, NULL);
+	soup_server_add_handler (server, NULL, gs_icon_downloader_test_server_cb, &test_server, NULL);
+	soup_server_listen_local (server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY, &error);
+	g_assert_no_error (error);
+	uris = soup_server_get_uris (server);
+#if SOUP_CHECK_VERSION(3, 0, 0)
+	port = g_uri_get_port (uris->data);
+	g_slist_free_full (uris, (GDestroyNotify) g_uri_unref);
+#else
+	port = soup_uri_get_port (uris->data);
+	g_slist_free_full (uris, (GDestroyNotify) soup_uri_free);
+#endif
+
+	/* a fresh path, so nothing is in the icon cache yet */
+	base_uri = g_strdup_printf ("http://127.0.0.1:%u/%08x", port, g_random_int ());
+
+	/* allow all the downloads to reach the server at once */
+	session = soup_session_new_with_options ("max-conns-per-host", 8, NULL);
+	downloader = gs_icon_downloader_new (session, 64);
+
+	/* two apps with the same icon share one download, and both get its
+	 * dimensions */
+	app1 = gs_icon_downloader_test_app_new (base_uri, "app1", "shared");
+	app2 = gs_icon_downloader_test_app_new (base_uri, "app2", "shared");
+	g_ptr_array_add (apps, app1);
+	g_ptr_array_add (apps, app2);
+	gs_icon_downloader_queue_app (downloader, app1, FALSE);
+	gs_icon_downloader_queue_app (downloader, app2, FALSE);
+	gs_icon_downloader_test_wait_for_icons (app1);
+	gs_icon_downloader_test_wait_for_icons (app2);
+	path = g_strdup_printf ("%s/shared.png", strchr (base_uri + strlen ("http://"), '/'));
+	g_assert_cmpuint (GPOINTER_TO_UINT (g_hash_table_lookup (test_server.n_requests, path)), ==, 1);
+	g_assert_cmpuint (gs_icon_downloader_test_get_width (app1), ==, 48);
+	g_assert_cmpuint (gs_icon_downloader_test_get_width (app2), ==, 48);
+	g_clear_pointer (&path, g_free);
+
+	/* keep all the download threads busy */
+	for (guint i = 0; i < 4; i++) {
+		g_autofree gchar *id = g_strdup_printf ("block%u", i);
+		GsApp *app = gs_icon_downloader_test_app_new (base_uri, id, id);
+
+		g_ptr_array_add (apps, app);
+		gs_icon_downloader_queue_app (downloader, app, FALSE);
+	}
+	while (test_server.paused->len < 4)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_cmpuint (test_server.requests->len, ==, 5);
+
+	/* an interactive request for an icon which is queued in the
+	 * background moves it to the front of the queue */
+	app_c = gs_icon_downloader_test_app_new (base_uri, "c", "c");
+	app_d = gs_icon_downloader_test_app_new (base_uri, "d", "d");
+	app_e = gs_icon_downloader_test_app_new (base_uri, "e", "d");
+	g_ptr_array_add (apps, app_c);
+	g_ptr_array_add (apps, app_d);
+	g_ptr_array_add (apps, app_e);
+	gs_icon_downloader_queue_app (downloader, app_c, FALSE);
+	gs_icon_downloader_queue_app (downloader, app_d, FALSE);
+	gs_icon_downloader_queue_app (downloader, app_e, TRUE);
+	g_assert_cmpint (gs_app_get_icons_state (app_c), ==, GS_APP_ICONS_STATE_PENDING_DOWNLOAD);
+
+	gs_icon_downloader_test_unpause (server, &test_server, 1);
+	while (test_server.requests->len < 6)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_true (g_str_has_suffix (g_ptr_array_index (test_server.requests, 5), "/d.png"));
+	gs_icon_downloader_test_wait_for_icons (app_d);
+	gs_icon_downloader_test_wait_for_icons (app_e);
+	g_assert_cmpuint (gs_icon_downloader_test_get_width (app_e), ==, 48);
+
+	/* then the background download */
+	gs_icon_downloader_test_wait_for_icons (app_c);
+	g_assert_cmpuint (test_server.requests->len, ==, 7);
+	g_assert_true (g_str_has_suffix (g_ptr_array_index (test_server.requests, 6), "/c.png"));
+
+	/* keep the free download thread busy again, and queue another icon */
+	app_block4 = gs_icon_downloader_test_app_new (base_uri, "block4", "block4");
+	g_ptr_array_add (apps, app_block4);
+	gs_icon_downloader_queue_app (downloader, app_block4, FALSE);
+	while (test_server.paused->len < 4)
+		g_main_context_iteration (NULL, TRUE);
+	app_f = gs_icon_downloader_test_app_new (base_uri, "f", "f");
+	g_ptr_array_add (apps, app_f);
+	gs_icon_downloader_queue_app (downloader, app_f, FALSE);
+
+	/* shutting down finishes the running downloads, and cancels the one
+	 * which hasn’t started */
+	gs_icon_downloader_shutdown_async (downloader, NULL, gs_download_test_result_cb, &result);
+	gs_icon_downloader_test_unpause (server, &test_server, 4);
+	while (result == NULL)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_true (gs_icon_downloader_shutdown_finish (downloader, result, &error));
+	g_assert_no_error (error);
+	g_assert_cmpuint (test_server.requests->len, ==, 8);
+	for (guint i = 0; i < test_server.requests->len; i++)
+		g_assert_false (g_str_has_suffix (g_ptr_array_index (test_server.requests, i), "/f.png"));
+
+	/* every app is done with, whether its icons were downloaded or not */
+	for (guint i = 0; i < apps->len; i++)
+		gs_icon_downloader_test_wait_for_icons (g_ptr_array_index (apps, i));
+
+	g_bytes_unref (test_server.png);
+	g_hash_table_unref (test_server.n_requests);
+	g_ptr_array_unref (test_server.requests);
+	g_ptr_array_unref (test_server.paused);
+}
+
+static void
+gs_odrs_provider_test_write_ratings (const gchar *filename,
+				     guint        star5)
+{
+	g_autofree gchar *json = NULL;
+	g_autoptr(GError) error = NULL;
+
+	/* an entry without all the star counts is skipped */
+	json = g_strdup_printf ("{"
+				"\"org.example.Two\": {\"star0\": 0, \"star1\": 2, \"star2\": 0, \"star3\": 0, \"star4\": 0, \"star5\": 0},"
+				"\"org.example.One\": {\"star0\": 0, \"star1\": 0, \"star2\": 0, \"star3\": 1, \"star4\": 0, \"star5\": %u},"
+				"\"org.example.Three\": {\"star0\": 0, \"star1\": 0, \"star2\": 3, \"star3\": 0, \"star4\": 0, \"star5\": 0},"
+				"\"org.example.Broken\": {\"star0\": 1}"
+				"}", star5);
+	g_file_set_contents (filename, json, -1, &error);
+	g_assert_no_error (error);
+}
+
+/* Returns the number of 5-star ratings of @app_id, or -1 if it has none */
+static gint
+gs_odrs_provider_test_get_star5 (SoupSession *session,
+				 const gchar *app_id)
+{
+	g_autoptr(GsOdrsProvider) provider = NULL;
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsApp) app = gs_app_new (app_id);
+	g_autoptr(GAsyncResult) result = NULL;
+	g_autoptr(GError) error = NULL;
+	GArray *review_ratings;
+
+	/* a new provider, so the ratings are loaded again; only reviews would
+	 * be fetched from the server */
+	provider = gs_odrs_provider_new ("http://127.0.0.1:1", "hash", "distro", 0, 10, session);
+	gs_app_list_add (list, app);
+	gs_odrs_provider_refine_async (provider, list, GS_ODRS_PROVIDER_REFINE_FLAGS_GET_RATINGS,
+				       NULL, gs_download_test_result_cb, &result);
+	while (result == NULL)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_true (gs_odrs_provider_refine_finish (provider, result, &error));
+	g_assert_no_error (error);
+
+	review_ratings = gs_app_get_review_ratings (app);
+	if (review_ratings == NULL)
+		return -1;
+	g_assert_cmpuint (review_ratings->len, ==, 6);
+	return (gint) g_array_index (review_ratings, guint32, 5);
+}
+
+static void
+gs_odrs_provider_ratings_cache_func (void)
+{
+	g_autoptr(SoupSession) session = gs_build_soup_session ();
+	g_autofree gchar *filename = NULL;
+	g_autofree gchar *binary_filename = NULL;
+	g_autofree gchar *cache_dir = NULL;
+	g_autofree gchar *json = NULL;
+	GStatBuf st_old, st_new;
+	struct timespec times[2];
+	g_autoptr(GError) error = NULL;
+
+	filename = gs_utils_get_cache_filename ("odrs", "ratings.json",
+						GS_UTILS_CACHE_FLAG_WRITEABLE |
+						GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+						&error);
+	g_assert_no_error (error);
+	cache_dir = g_path_get_dirname (filename);
+	binary_filename = g_build_filename (cache_dir, "ratings.bin", NULL);
+	g_unlink (binary_filename);
+
+	/* the JSON is converted into the binary cache file, which is searched */
+	gs_odrs_provider_test_write_ratings (filename, 5);
+	g_assert_cmpint (gs_odrs_provider_test_get_star5 (session, "org.example.One"), ==, 5);
+	g_assert_true (g_file_test (binary_filename, G_FILE_TEST_EXISTS));
+	g_assert_cmpint (gs_odrs_provider_test_get_star5 (session, "org.example.Two"), ==, 0);
+	g_assert_cmpint (gs_odrs_provider_test_get_star5 (session, "org.example.Three"), ==, 0);
+	g_assert_cmpint (gs_odrs_provider_test_get_star5 (session, "org.example.Broken"), ==, -1);
+	g_assert_cmpint (gs_odrs_provider_test_get_star5 (session, "org.example.Missing"), ==, -1);
+
+	/* without the JSON, the ratings round-trip through the binary cache
+	 * file alone */
+	g_file_get_contents (filename, &json, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_cmpint (g_unlink (filename), ==, 0);
+	g_assert_cmpint (gs_odrs_provider_test_get_star5 (session, "org.example.One"), ==, 5);
+	g_assert_cmpint (gs_odrs_provider_test_get_star5 (session, "org.example.Missing"), ==, -1);
+
+	/* a change to the JSON which keeps its size is noticed, even within
+	 * the same second, so only the sub-second mtime tells them apart */
+	g_file_set_contents (filename, json, -1, &error);
+	g_assert_no_error (error);
+	g_assert_cmpint (gs_odrs_provider_test_get_star5 (session, "org.example.One"), ==, 5);
+	g_assert_cmpint (g_stat (filename, &st_old), ==, 0);
+	gs_odrs_provider_test_write_ratings (filename, 7);
+	times[0].tv_nsec = UTIME_OMIT;
+	times[1].tv_sec = st_old.st_mtim.tv_sec;
+	times[1].tv_nsec = (st_old.st_mtim.tv_nsec + 1) % 1000000000;
+	g_assert_cmpint (utimensat (AT_FDCWD, filename, times, 0), ==, 0);
+	g_assert_cmpint (g_stat (filename, &st_new), ==, 0);
+	g_assert_cmpint (st_new.st_size, ==, st_old.st_size);
+	g_assert_cmpint (st_new.st_mtim.tv_sec, ==, st_old.st_mtim.tv_sec);
+	g_assert_cmpint (gs_odrs_provider_test_get_star5 (session, "org.example.One"), ==, 7);
+
+	g_unlink (filename);
+	g_unlink (binary_filename);
+}
+
+static void
+gs_key_colors_assert_equal (GArray *colors1,
+			    GArray *colors2)
+{
+	g_assert_cmpuint (colors1->len, ==, colors2->len);
+	for (guint i = 0; i < colors1->len; i++)
+		g_assert_true (gdk_rgba_equal (&g_array_index (colors1, GdkRGBA, i),
+					       &g_array_index (colors2, GdkRGBA, i)));
+}
+
+static void
+gs_key_colors_cached_func (void)
+{
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	g_autoptr(GdkPixbuf) top_half = NULL;
+	g_autoptr(GArray) colors1 = NULL;
+	g_autoptr(GArray) colors2 = NULL;
+	g_autoptr(GArray) colors3 = NULL;
+	g_autoptr(GArray) colors4 = NULL;
+	g_autoptr(GArray) colors5 = NULL;
+
+	/* two solid halves */
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 32, 32);
+	gdk_pixbuf_fill (pixbuf, 0x3366ccff);
+	top_half = gdk_pixbuf_new_subpixbuf (pixbuf, 0, 0, 32, 16);
+	gdk_pixbuf_fill (top_half, 0xff8800ff);
+
+	colors1 = gs_calculate_key_colors (pixbuf);
+	g_assert_cmpuint (colors1->len, >, 0);
+
+	/* the first call calculates them and stores them in the background,
+	 * the second reuses them */
+	colors2 = gs_calculate_key_colors_cached (pixbuf);
+	colors3 = gs_calculate_key_colors_cached (pixbuf);
+	g_assert_cmpuint (colors2->len, >, 0);
+	gs_key_colors_assert_equal (colors2, colors3);
+
+	/* the index file is written in the background, and a new process
+	 * loads the same colors back from it */
+	gs_key_colors_cache_reload_for_test ();
+	colors4 = gs_key_colors_cache_lookup_for_test (pixbuf);
+	g_assert_nonnull (colors4);
+	gs_key_colors_assert_equal (colors2, colors4);
+
+	/* an icon which was never seen isn’t in it */
+	gdk_pixbuf_fill (pixbuf, 0x00ff00ff);
+	colors5 = gs_key_colors_cache_lookup_for_test (pixbuf);
+	g_assert_null (colors5);
+}
+
+static void
+gs_key_colors_kernels_func (void)
+{
+	const gsize n_pixels = 1001;  /* not a multiple of the vector widths */
+	g_autofree guint8 *pixels = g_malloc (n_pixels * 4);
+	g_autofree guint8 *expected = g_malloc (n_pixels * 4);
+	g_autofree guint8 *actual = g_malloc (n_pixels * 4);
+	guint8 centres[3 * 3];
+	const GsKeyColorsKernel kernels[] = { GS_KEY_COLORS_KERNEL_SSE2, GS_KEY_COLORS_KERNEL_AVX2 };
+	g_autoptr(GRand) rand = g_rand_new_with_seed (42);
+
+	for (guint run = 0; run < 100; run++) {
+		guint expected_n_changed;
+
+		/* random colors, with some pixels transparent (cluster 3);
+		 * a few runs have duplicate centres, to check ties */
+		for (gsize i = 0; i < n_pixels * 4; i += 4) {
+			pixels[i] = g_rand_int_range (rand, 0, 256);
+			pixels[i + 1] = g_rand_int_range (rand, 0, 256);
+			pixels[i + 2] = g_rand_int_range (rand, 0, 256);
+			pixels[i + 3] = g_rand_int_range (rand, 0, 4);
+		}
+		for (gsize i = 0; i < G_N_ELEMENTS (centres); i++)
+			centres[i] = g_rand_int_range (rand, 0, 256);
+		if (run % 10 == 0)
+			memcpy (centres + 3, centres, 3);
+
+		memcpy (expected, pixels, n_pixels * 4);
+		g_assert_true (gs_key_colors_assign_clusters_for_test (GS_KEY_COLORS_KERNEL_SCALAR,
+									expected, n_pixels,
+									centres, 3,
+									&expected_n_changed));
+
+		for (gsize k = 0; k < G_N_ELEMENTS (kernels); k++) {
+			guint actual_n_changed;
+
+			memcpy (actual, pixels, n_pixels * 4);
+			if (!gs_key_colors_assign_clusters_for_test (kernels[k], actual, n_pixels,
+								     centres, 3, &actual_n_changed))
+				continue;
+
+			g_assert_cmpmem (actual, n_pixels * 4, expected, n_pixels * 4);
+			g_assert_cmpuint (actual_n_changed, ==, expected_n_changed);
+		}
+	}
+}
+
 static void
 gs_utils_error_func (void)
 {
@@ -734,6 +1655,147 @@ gs_app_list_performance_func (void)
 	g_print ("%.2fms ", g_timer_elapsed (timer, NULL) * 1000);
 }
 
+static void
+gs_app_list_performance_large_func (void)
+{
+	g_autoptr(GPtrArray) apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GTimer) timer = NULL;
+	const guint n_apps = 50000;
+
+	/* create lots of apps with full unique IDs */
+	for (guint i = 0; i < n_apps; i++) {
+		g_autofree gchar *id = g_strdup_printf ("org.example.App%05u", i);
+		GsApp *app = gs_app_new (id);
+		gs_app_set_scope (app, AS_COMPONENT_SCOPE_SYSTEM);
+		gs_app_set_bundle_kind (app, AS_BUNDLE_KIND_FLATPAK);
+		gs_app_set_origin (app, (i % 2 == 0) ? "flathub" : "fedora");
+		gs_app_set_branch (app, "stable");
+		g_ptr_array_add (apps, app);
+	}
+
+	/* add them to the list */
+	timer = g_timer_new ();
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		gs_app_list_add (list, app);
+	}
+	g_assert_cmpint (gs_app_list_length (list), ==, n_apps);
+	g_print ("add %.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+
+	/* adding them again is a no-op */
+	g_timer_reset (timer);
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		gs_app_list_add (list, app);
+	}
+	g_assert_cmpint (gs_app_list_length (list), ==, n_apps);
+	g_print ("re-add %.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+
+	/* look them up using wildcards */
+	g_timer_reset (timer);
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		g_autofree gchar *unique_id = g_strdup_printf ("*/*/*/%s/*", gs_app_get_id (app));
+		g_assert_true (gs_app_list_lookup (list, unique_id) == app);
+	}
+	g_assert_null (gs_app_list_lookup (list, "*/*/*/org.example.Missing/*"));
+	g_print ("lookup %.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+
+	/* every app has a different unique ID, so nothing is filtered */
+	g_timer_reset (timer);
+	gs_app_list_filter_duplicates (list, GS_APP_LIST_FILTER_FLAG_NONE);
+	g_assert_cmpint (gs_app_list_length (list), ==, n_apps);
+	g_print ("dedupe %.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+}
+
+static void
+gs_app_interned_strings_func (void)
+{
+	g_autoptr(GPtrArray) apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	g_autoptr(GHashTable) distinct = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_autoptr(GTimer) timer = NULL;
+	const gchar *origins[] = { "flathub", "fedora", "fedora-updates", "gnome-nightly" };
+	const gchar *licenses[] = { "GPL-2.0-or-later", "GPL-3.0-or-later", "MIT", "LicenseRef-proprietary" };
+	const gchar *categories[] = { "AudioVideo", "Development", "Game", "Graphics", "Office", "Utility" };
+	const guint n_apps = 30000;
+	gsize bytes_duplicated = 0;
+	gsize bytes_distinct = 0;
+	GHashTableIter iter;
+	gpointer key;
+
+	/* load a synthetic catalog, with freshly allocated strings for each app
+	 * as a parser would provide them */
+	timer = g_timer_new ();
+	for (guint i = 0; i < n_apps; i++) {
+		g_autofree gchar *id = g_strdup_printf ("org.example.App%05u", i);
+		g_autofree gchar *origin = g_strdup (origins[i % G_N_ELEMENTS (origins)]);
+		g_autofree gchar *license = g_strdup (licenses[i % G_N_ELEMENTS (licenses)]);
+		g_autofree gchar *developer_name = g_strdup_printf ("Developer %u", i % 100);
+		GsApp *app = gs_app_new (id);
+
+		gs_app_set_origin (app, origin);
+		gs_app_set_origin_ui (app, origin);
+		gs_app_set_origin_appstream (app, origin);
+		gs_app_set_origin_hostname (app, "https://dl.example.org/repo");
+		gs_app_set_branch (app, "stable");
+		gs_app_set_developer_name (app, developer_name);
+		gs_app_set_project_group (app, "GNOME");
+		gs_app_set_license (app, GS_APP_QUALITY_NORMAL, license);
+		gs_app_add_category (app, categories[i % G_N_ELEMENTS (categories)]);
+		gs_app_add_category (app, categories[(i + 1) % G_N_ELEMENTS (categories)]);
+		g_ptr_array_add (apps, app);
+	}
+	g_print ("load %.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+
+	/* the getters return the same string as before */
+	g_assert_cmpstr (gs_app_get_origin (g_ptr_array_index (apps, 1)), ==, "fedora");
+	g_assert_cmpstr (gs_app_get_origin_hostname (g_ptr_array_index (apps, 1)), ==, "dl.example.org");
+	g_assert_cmpstr (gs_app_get_license (g_ptr_array_index (apps, 2)), ==, "MIT");
+	g_assert_true (gs_app_has_category (g_ptr_array_index (apps, 0), "Development"));
+
+	/* equal values are shared between apps */
+	g_assert_true (gs_app_get_origin (g_ptr_array_index (apps, 0)) ==
+		       gs_app_get_origin (g_ptr_array_index (apps, 4)));
+	g_assert_true (gs_app_get_origin (g_ptr_array_index (apps, 0)) ==
+		       gs_app_get_origin_appstream (g_ptr_array_index (apps, 0)));
+
+	/* work out how much memory the strings would use without interning */
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		GPtrArray *app_categories = gs_app_get_categories (app);
+		const gchar *values[] = {
+			gs_app_get_origin (app),
+			gs_app_get_origin_appstream (app),
+			gs_app_get_origin_hostname (app),
+			gs_app_get_branch (app),
+			gs_app_get_developer_name (app),
+			gs_app_get_project_group (app),
+			gs_app_get_license (app),
+		};
+
+		for (guint j = 0; j < G_N_ELEMENTS (values); j++) {
+			bytes_duplicated += strlen (values[j]) + 1;
+			g_hash_table_add (distinct, (gpointer) values[j]);
+		}
+		for (guint j = 0; j < app_categories->len; j++) {
+			const gchar *category = g_ptr_array_index (app_categories, j);
+			bytes_duplicated += strlen (category) + 1;
+			g_hash_table_add (distinct, (gpointer) category);
+		}
+	}
+
+	g_hash_table_iter_init (&iter, distinct);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		bytes_distinct += strlen (key) + 1;
+
+	g_assert_cmpuint (g_hash_table_size (distinct), <=,
+			  G_N_ELEMENTS (origins) + G_N_ELEMENTS (licenses) +
+			  G_N_ELEMENTS (categories) + 100 + 3);
+	g_print ("strings %" G_GSIZE_FORMAT "KiB -> %" G_GSIZE_FORMAT "KiB ",
+		 bytes_duplicated / 1024, bytes_distinct / 1024);
+}
+
 static void
 gs_app_list_related_func (void)
 {
@@ -754,6 +1816,49 @@ gs_app_list_related_func (void)
 	g_assert_cmpint (gs_app_list_get_progress (list), ==, 50);
 }
 
+static void
+gs_app_list_watched_totals_func (void)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsApp) app1 = gs_app_new ("app1");
+	g_autoptr(GsApp) app2 = gs_app_new ("app2");
+	g_autoptr(GsApp) app3 = gs_app_new ("app3");
+
+	gs_app_list_add_flag (list, GS_APP_LIST_FLAG_WATCH_APPS);
+	gs_app_list_add (list, app1);
+	gs_app_list_add (list, app2);
+	gs_app_list_add (list, app3);
+
+	/* any unknown progress makes the total unknown */
+	gs_app_set_progress (app1, 10);
+	gs_app_set_progress (app2, 20);
+	gs_test_flush_main_context ();
+	g_assert_cmpint (gs_app_list_get_progress (list), ==, GS_APP_PROGRESS_UNKNOWN);
+	gs_app_set_progress (app3, 90);
+	gs_test_flush_main_context ();
+	g_assert_cmpint (gs_app_list_get_progress (list), ==, 40);
+
+	/* the totals follow changes to a single app */
+	gs_app_set_progress (app1, 40);
+	gs_test_flush_main_context ();
+	g_assert_cmpint (gs_app_list_get_progress (list), ==, 50);
+
+	gs_app_set_state (app2, GS_APP_STATE_AVAILABLE);
+	gs_app_set_state (app2, GS_APP_STATE_INSTALLING);
+	gs_test_flush_main_context ();
+	g_assert_cmpint (gs_app_list_get_state (list), ==, GS_APP_STATE_INSTALLING);
+
+	/* removed apps stop counting, and are no longer watched */
+	gs_app_list_remove (list, app3);
+	g_assert_cmpint (gs_app_list_get_progress (list), ==, 30);
+	gs_app_list_truncate (list, 1);
+	g_assert_cmpint (gs_app_list_get_progress (list), ==, 40);
+	g_assert_cmpint (gs_app_list_get_state (list), ==, GS_APP_STATE_UNKNOWN);
+	gs_app_set_progress (app2, 100);
+	gs_test_flush_main_context ();
+	g_assert_cmpint (gs_app_list_get_progress (list), ==, 40);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -767,6 +1872,13 @@ main (int argc, char **argv)
 	g_test_add_func ("/gnome-software/lib/utils{error}", gs_utils_error_func);
 	g_test_add_func ("/gnome-software/lib/utils{cache}", gs_utils_cache_func);
 	g_test_add_func ("/gnome-software/lib/utils{append-kv}", gs_utils_append_kv_func);
+	g_test_add_func ("/gnome-software/lib/utils{file-size}", gs_utils_file_size_func);
+	g_test_add_func ("/gnome-software/lib/key-colors{cached}", gs_key_colors_cached_func);
+	g_test_add_func ("/gnome-software/lib/key-colors{kernels}", gs_key_colors_kernels_func);
+	g_test_add_func ("/gnome-software/lib/cache-manager", gs_cache_manager_func);
+	g_test_add_func ("/gnome-software/lib/download{resume}", gs_download_file_resume_func);
+	g_test_add_func ("/gnome-software/lib/icon-downloader", gs_icon_downloader_func);
+	g_test_add_func ("/gnome-software/lib/odrs-provider{ratings-cache}", gs_odrs_provider_ratings_cache_func);
 	g_test_add_func ("/gnome-software/lib/os-release", gs_os_release_func);
 	g_test_add_func ("/gnome-software/lib/app", gs_app_func);
 	g_test_add_func ("/gnome-software/lib/app/progress-clamping", gs_app_progress_clamping_func);
@@ -776,7 +1888,10 @@ main (int argc, char **argv)
 	g_test_add_func ("/gnome-software/lib/app{list}", gs_app_list_func);
 	g_test_add_func ("/gnome-software/lib/app{list-wildcard-dedupe}", gs_app_list_wildcard_dedupe_func);
 	g_test_add_func ("/gnome-software/lib/app{list-performance}", gs_app_list_performance_func);
+	g_test_add_func ("/gnome-software/lib/app{list-performance-large}", gs_app_list_performance_large_func);
+	g_test_add_func ("/gnome-software/lib/app{interned-strings}", gs_app_interned_strings_func);
 	g_test_add_func ("/gnome-software/lib/app{list-related}", gs_app_list_related_func);
+	g_test_add_func ("/gnome-software/lib/app{list-watched-totals}", gs_app_list_watched_totals_func);
 	g_test_add_func ("/gnome-software/lib/plugin", gs_plugin_func);
 	g_test_add_func ("/gnome-software/lib/plugin{download-rewrite}", gs_plugin_download_rewrite_func);
 
@@ -20,10 +20,14 @@
 
 #include "config.h"
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <fnmatch.h>
 #include <math.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <glib/gstdio.h>
 #include <json-glib/json-glib.h>
 
@@ -1385,6 +1389,270 @@ gs_utils_pixbuf_blur (GdkPixbuf *src, guint radius, guint iterations)
 		gs_pixbuf_blur_private (src, tmp, radius, div_kernel_size);
 }
 
+/* Per-directory cache for gs_utils_get_file_size(). A directory’s modification
+ * time changes whenever an entry is added to, removed from or renamed within
+ * it, so while it’s unchanged the directory doesn’t need to be listed again.
+ * Its files are still stat-ed on each call, as they can grow or shrink in
+ * place without the directory being modified. */
+typedef struct {
+	dev_t		 dev;
+	ino_t		 ino;
+} GsFileSizeCacheKey;
+
+typedef struct {
+	GsFileSizeCacheKey	 key;
+	struct timespec		 mtime;
+	GStrv			 files;  /* (owned); the non-directories directly in the directory */
+	GStrv			 subdirs;  /* (owned) */
+	guint64			 last_used;  /* (lock file_size_cache_mutex); from file_size_cache_clock */
+} GsFileSizeCacheEntry;
+
+/* Directories modified more recently than this are not cached, as a change
+ * within the same timestamp granularity would go unnoticed. */
+#define FILE_SIZE_CACHE_MIN_AGE_SECS 2
+
+/* The most directories to cache. Once reached, the least recently used half
+ * are dropped, which also drops the directories which have been deleted. */
+#define FILE_SIZE_CACHE_MAX_ENTRIES 16384
+
+static GMutex file_size_cache_mutex;
+static GHashTable *file_size_cache = NULL;  /* (owned) (lock file_size_cache_mutex) */
+static guint64 file_size_cache_clock = 0;  /* (lock file_size_cache_mutex); ticks on each use of an entry */
+
+static guint
+gs_file_size_cache_key_hash (gconstpointer key)
+{
+	const GsFileSizeCacheKey *k = key;
+	return (guint) ((guint64) k->ino ^ ((guint64) k->ino >> 32) ^ (guint64) k->dev);
+}
+
+static gboolean
+gs_file_size_cache_key_equal (gconstpointer a,
+			      gconstpointer b)
+{
+	const GsFileSizeCacheKey *ka = a;
+	const GsFileSizeCacheKey *kb = b;
+	return ka->dev == kb->dev && ka->ino == kb->ino;
+}
+
+static void
+gs_file_size_cache_entry_free (GsFileSizeCacheEntry *entry)
+{
+	g_strfreev (entry->files);
+	g_strfreev (entry->subdirs);
+	g_free (entry);
+}
+
+/* Must be called with @file_size_cache_mutex held */
+static void
+gs_file_size_cache_prune_unlocked (void)
+{
+	GHashTableIter iter;
+	GsFileSizeCacheEntry *entry;
+	guint64 threshold;
+
+	if (g_hash_table_size (file_size_cache) < FILE_SIZE_CACHE_MAX_ENTRIES)
+		return;
+
+	/* each tick of the clock uses one entry, so at most half the maximum
+	 * number of entries have been used since the threshold */
+	threshold = file_size_cache_clock - FILE_SIZE_CACHE_MAX_ENTRIES / 2;
+	g_hash_table_iter_init (&iter, file_size_cache);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry)) {
+		if (entry->last_used <= threshold)
+			g_hash_table_iter_remove (&iter);
+	}
+}
+
+/* State shared by all the threads walking one tree. */
+typedef struct {
+	int			 root_fd;
+	GsFileSizeIncludeFunc	 include_func;
+	gpointer		 user_data;
+	GCancellable		*cancellable;
+	GThreadPool		*pool;  /* (owned) */
+
+	GMutex			 mutex;
+	GCond			 cond;
+	guint			 n_pending;  /* (lock mutex) */
+	guint64			 size;  /* (lock mutex) */
+} GsFileSizeWalk;
+
+static void
+gs_utils_file_size_walk_dir_done (GsFileSizeWalk *walk,
+				  guint64         size)
+{
+	g_mutex_lock (&walk->mutex);
+	walk->size += size;
+	if (--walk->n_pending == 0)
+		g_cond_signal (&walk->cond);
+	g_mutex_unlock (&walk->mutex);
+}
+
+static void
+gs_utils_file_size_walk_push (GsFileSizeWalk *walk,
+			      const gchar    *relpath,
+			      const gchar    *name)
+{
+	g_mutex_lock (&walk->mutex);
+	walk->n_pending++;
+	g_mutex_unlock (&walk->mutex);
+
+	g_thread_pool_push (walk->pool,
+			    (*relpath == '\0') ? g_strdup (name) :
+			    g_build_filename (relpath, name, NULL),
+			    NULL);
+}
+
+/* Returns the allocated size of @name in the directory @dir_fd, without
+ * following it if it’s a symlink, or 0 if it has gone. */
+static guint64
+gs_utils_file_size_stat (int          dir_fd,
+			 const gchar *name)
+{
+	struct stat st;
+
+	if (fstatat (dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+		return 0;
+	return (guint64) st.st_blocks * 512;
+}
+
+/* Returns the allocated size of the files directly in @relpath, and queues
+ * its subdirectories on the pool. Symlinks are never followed. */
+static guint64
+gs_utils_file_size_walk_dir (GsFileSizeWalk *walk,
+			     const gchar    *relpath)
+{
+	DIR *dir;
+	struct dirent *de;
+	struct stat dir_st;
+	gboolean cacheable;
+	guint64 size = 0;
+	int fd;
+	g_autoptr(GPtrArray) files = NULL;
+	g_autoptr(GPtrArray) subdirs = NULL;
+
+	if (g_cancellable_is_cancelled (walk->cancellable))
+		return 0;
+
+	fd = openat (walk->root_fd, (*relpath == '\0') ? "." : relpath,
+		     O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	if (fstat (fd, &dir_st) != 0) {
+		close (fd);
+		return 0;
+	}
+
+	/* the results depend on the @include_func, so can only be cached
+	 * without one */
+	cacheable = walk->include_func == NULL &&
+		    dir_st.st_mtim.tv_sec < g_get_real_time () / G_USEC_PER_SEC - FILE_SIZE_CACHE_MIN_AGE_SECS;
+	if (walk->include_func == NULL) {
+		GsFileSizeCacheKey key = { dir_st.st_dev, dir_st.st_ino };
+		GsFileSizeCacheEntry *entry;
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&file_size_cache_mutex);
+
+		entry = (file_size_cache != NULL) ? g_hash_table_lookup (file_size_cache, &key) : NULL;
+		if (entry != NULL &&
+		    entry->mtime.tv_sec == dir_st.st_mtim.tv_sec &&
+		    entry->mtime.tv_nsec == dir_st.st_mtim.tv_nsec) {
+			entry->last_used = ++file_size_cache_clock;
+			for (guint i = 0; entry->files[i] != NULL; i++)
+				size += gs_utils_file_size_stat (fd, entry->files[i]);
+			for (guint i = 0; entry->subdirs[i] != NULL; i++)
+				gs_utils_file_size_walk_push (walk, relpath, entry->subdirs[i]);
+			close (fd);
+			return size;
+		}
+	}
+
+	dir = fdopendir (fd);
+	if (dir == NULL) {
+		close (fd);
+		return 0;
+	}
+
+	files = g_ptr_array_new_with_free_func (g_free);
+	subdirs = g_ptr_array_new_with_free_func (g_free);
+	while ((de = readdir (dir)) != NULL) {
+		g_autofree gchar *child_relpath = NULL;
+		struct stat st;
+		GFileTest file_kind;
+
+		if (g_cancellable_is_cancelled (walk->cancellable)) {
+			cacheable = FALSE;
+			break;
+		}
+		if (g_str_equal (de->d_name, ".") || g_str_equal (de->d_name, ".."))
+			continue;
+
+		/* directories are not counted, so don’t need a stat */
+		if (de->d_type == DT_DIR) {
+			st.st_mode = S_IFDIR;
+		} else if (fstatat (dirfd (dir), de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+			continue;
+		}
+
+		file_kind = S_ISLNK (st.st_mode) ? G_FILE_TEST_IS_SYMLINK :
+			    S_ISDIR (st.st_mode) ? G_FILE_TEST_IS_DIR :
+			    G_FILE_TEST_IS_REGULAR;
+		if (walk->include_func != NULL) {
+			child_relpath = (*relpath == '\0') ? g_strdup (de->d_name) :
+					g_build_filename (relpath, de->d_name, NULL);
+			if (!walk->include_func (child_relpath, file_kind, walk->user_data))
+				continue;
+		}
+
+		/* symlinks are counted as themselves, rather than what they
+		 * point to, as that can be shared storage */
+		if (file_kind == G_FILE_TEST_IS_DIR) {
+			g_ptr_array_add (subdirs, g_strdup (de->d_name));
+		} else {
+			g_ptr_array_add (files, g_strdup (de->d_name));
+			size += (guint64) st.st_blocks * 512;
+		}
+	}
+	closedir (dir);
+
+	for (guint i = 0; i < subdirs->len; i++)
+		gs_utils_file_size_walk_push (walk, relpath, g_ptr_array_index (subdirs, i));
+
+	if (cacheable) {
+		GsFileSizeCacheEntry *entry = g_new0 (GsFileSizeCacheEntry, 1);
+		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&file_size_cache_mutex);
+
+		entry->key.dev = dir_st.st_dev;
+		entry->key.ino = dir_st.st_ino;
+		entry->mtime = dir_st.st_mtim;
+		g_ptr_array_add (files, NULL);
+		entry->files = (GStrv) g_ptr_array_free (g_steal_pointer (&files), FALSE);
+		g_ptr_array_add (subdirs, NULL);
+		entry->subdirs = (GStrv) g_ptr_array_free (g_steal_pointer (&subdirs), FALSE);
+
+		if (file_size_cache == NULL)
+			file_size_cache = g_hash_table_new_full (gs_file_size_cache_key_hash,
+								 gs_file_size_cache_key_equal,
+								 NULL,
+								 (GDestroyNotify) gs_file_size_cache_entry_free);
+		gs_file_size_cache_prune_unlocked ();
+		entry->last_used = ++file_size_cache_clock;
+		g_hash_table_replace (file_size_cache, &entry->key, entry);
+	}
+
+	return size;
+}
+
+static void
+gs_utils_file_size_walk_thread_cb (gpointer data,
+				   gpointer user_data)
+{
+	g_autofree gchar *relpath = data;
+	GsFileSizeWalk *walk = user_data;
+
+	gs_utils_file_size_walk_dir_done (walk, gs_utils_file_size_walk_dir (walk, relpath));
+}
+
 /**
  * gs_utils_get_file_size:
  * @filename: a file name to get the size of; it can be a file or a directory
@@ -1392,10 +1660,16 @@ gs_utils_pixbuf_blur (GdkPixbuf *src, guint radius, guint iterations)
  * @user_data: user data passed to the @include_func
  * @cancellable: (nullable): an optional #GCancellable or %NULL
  *
- * Gets the size of the file or a directory identified by @filename.
+ * Gets the disk space allocated to the file or a directory identified by @filename.
  *
  * When the @include_func is not %NULL, it can limit which files are included
  * in the resulting size. When it's %NULL, all files and subdirectories are included.
+ * Symlinks are not followed.
+ *
+ * Subdirectories are walked in parallel, so @include_func may be called
+ * from several threads at once. Without an @include_func, directories which
+ * have not been modified since the last call are not listed again, though
+ * the files in them are still checked, in case they have changed size.
  *
  * Returns: disk size of the @filename; or 0 when not found
  *
@@ -1407,62 +1681,45 @@ gs_utils_get_file_size (const gchar *filename,
 			gpointer user_data,
 			GCancellable *cancellable)
 {
-	guint64 size = 0;
+	GsFileSizeWalk walk = { 0, };
+	GStatBuf st;
+	guint64 size;
 
 	g_return_val_if_fail (filename != NULL, 0);
 
-	if (g_file_test (filename, G_FILE_TEST_IS_DIR)) {
-		GSList *dirs_to_do = NULL;
-		gsize base_len = strlen (filename);
-
-		/* The `include_func()` expects a path relative to the `filename`, without
-		   a leading dir separator. As the `dirs_to_do` contains the full path,
-		   constructed with `g_build_filename()`, the added dir separator needs
-		   to be skipped, when it's not part of the `filename` already. */
-		if (!g_str_has_suffix (filename, G_DIR_SEPARATOR_S))
-			base_len++;
-
-		dirs_to_do = g_slist_prepend (dirs_to_do, g_strdup (filename));
-		while (dirs_to_do != NULL && !g_cancellable_is_cancelled (cancellable)) {
-			g_autofree gchar *path = NULL;
-			g_autoptr(GDir) dir = NULL;
-
-			/* Steal the top `path` out of the `dirs_to_do`. */
-			path = dirs_to_do->data;
-			dirs_to_do = g_slist_remove (dirs_to_do, path);
-
-			dir = g_dir_open (path, 0, NULL);
-			if (dir) {
-				const gchar *name;
-				while (name = g_dir_read_name (dir), name != NULL && !g_cancellable_is_cancelled (cancellable)) {
-					g_autofree gchar *full_path = g_build_filename (path, name, NULL);
-					GStatBuf st;
-
-					if (g_stat (full_path, &st) == 0 && (include_func == NULL ||
-					    include_func (full_path + base_len,
-							  g_file_test (full_path, G_FILE_TEST_IS_SYMLINK) ? G_FILE_TEST_IS_SYMLINK :
-							  S_ISDIR (st.st_mode) ? G_FILE_TEST_IS_DIR :
-							  G_FILE_TEST_IS_REGULAR,
-							  user_data))) {
-						if (S_ISDIR (st.st_mode)) {
-							/* Skip symlinks, they can point to a shared storage */
-							if (!g_file_test (full_path, G_FILE_TEST_IS_SYMLINK))
-								dirs_to_do = g_slist_prepend (dirs_to_do, g_steal_pointer (&full_path));
-						} else {
-							size += st.st_size;
-						}
-					}
-				}
-			}
-		}
-		g_slist_free_full (dirs_to_do, g_free);
-	} else {
-		GStatBuf st;
-
-		if (g_stat (filename, &st) == 0)
-			size = st.st_size;
+	walk.root_fd = open (filename, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (walk.root_fd < 0) {
+		if (errno == ENOTDIR && g_stat (filename, &st) == 0)
+			return (guint64) st.st_blocks * 512;
+		return 0;
 	}
 
+	walk.include_func = include_func;
+	walk.user_data = user_data;
+	walk.cancellable = cancellable;
+	g_mutex_init (&walk.mutex);
+	g_cond_init (&walk.cond);
+	walk.n_pending = 1;
+
+	/* non-exclusive, so the threads are shared with other walks */
+	walk.pool = g_thread_pool_new (gs_utils_file_size_walk_thread_cb, &walk,
+				       (gint) g_get_num_processors (), FALSE, NULL);
+
+	/* the top level is walked on this thread, which then waits for the
+	 * subdirectories it queued */
+	gs_utils_file_size_walk_dir_done (&walk, gs_utils_file_size_walk_dir (&walk, ""));
+
+	g_mutex_lock (&walk.mutex);
+	while (walk.n_pending > 0)
+		g_cond_wait (&walk.cond, &walk.mutex);
+	size = walk.size;
+	g_mutex_unlock (&walk.mutex);
+
+	g_thread_pool_free (walk.pool, FALSE, TRUE);
+	g_cond_clear (&walk.cond);
+	g_mutex_clear (&walk.mutex);
+	close (walk.root_fd);
+
 	return size;
 }
 
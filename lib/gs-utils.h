@@ -120,6 +120,8 @@ void		 gs_utils_pixbuf_blur		(GdkPixbuf	*src,
  * The @filename is a relative path to the file name passed to
  * the #GsFileSizeIncludeFunc.
  *
+ * This may be called from several threads at once.
+ *
  * Returns: Whether to include the @filename in the size calculation
  *
  * Since: 41
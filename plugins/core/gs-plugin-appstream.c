@@ -28,16 +28,60 @@
  *
  * Methods:     | AddCategory
  * Refines:     | [source]->[name,summary,pixbuf,id,kind]
+ *
+ * The AppStream data is split into layers, each compiled into its own silo:
+ * one per catalog, and a few buckets each for metainfo and desktop files.
+ * When a file changes only the layer containing it is recompiled. Queries run
+ * across all the layers; lookups of other components, such as the .desktop
+ * file an app inherits its icon from, or the addons which extend an app, use
+ * gs_appstream_refine_app_in_silos() to search every layer.
+ *
+ * Each layer only watches its own files. One more, empty, layer watches the
+ * directories, so that added and removed files are noticed.
  */
 
+/* number of layers to spread metainfo and desktop files across */
+#define GS_PLUGIN_APPSTREAM_N_BUCKETS 8
+
+typedef enum {
+	GS_PLUGIN_APPSTREAM_LAYER_KIND_CATALOG,
+	GS_PLUGIN_APPSTREAM_LAYER_KIND_METAINFO,
+	GS_PLUGIN_APPSTREAM_LAYER_KIND_DESKTOP,
+} GsPluginAppstreamLayerKind;
+
+typedef struct {
+	gchar		*key;  /* from gs_plugin_appstream_get_layer_key() */
+	XbSilo		*silo;  /* (owned) */
+} GsPluginAppstreamLayer;
+
+static GsPluginAppstreamLayer *
+gs_plugin_appstream_layer_new (const gchar *key,
+                               XbSilo      *silo)
+{
+	GsPluginAppstreamLayer *layer = g_new0 (GsPluginAppstreamLayer, 1);
+	layer->key = g_strdup (key);
+	layer->silo = g_object_ref (silo);
+	return layer;
+}
+
+static void
+gs_plugin_appstream_layer_free (GsPluginAppstreamLayer *layer)
+{
+	g_free (layer->key);
+	g_object_unref (layer->silo);
+	g_free (layer);
+}
+
 struct _GsPluginAppstream
 {
 	GsPlugin		 parent;
 
 	GsWorkerThread		*worker;  /* (owned) */
 
-	XbSilo			*silo;
+	GPtrArray		*silos;  /* (owned) (nullable) (element-type XbSilo) (lock silo_lock); one per layer */
 	GRWLock			 silo_lock;
+	GMutex			 silo_rebuild_mutex;  /* held while building new silos */
+	GHashTable		*layers;  /* (owned) (element-type utf8 GsPluginAppstreamLayer) (lock silo_rebuild_mutex) */
 	GSettings		*settings;
 };
 
@@ -51,9 +95,11 @@ gs_plugin_appstream_dispose (GObject *object)
 {
 	GsPluginAppstream *self = GS_PLUGIN_APPSTREAM (object);
 
-	g_clear_object (&self->silo);
+	g_clear_pointer (&self->silos, g_ptr_array_unref);
+	g_clear_pointer (&self->layers, g_hash_table_unref);
 	g_clear_object (&self->settings);
 	g_rw_lock_clear (&self->silo_lock);
+	g_mutex_clear (&self->silo_rebuild_mutex);
 	g_clear_object (&self->worker);
 
 	G_OBJECT_CLASS (gs_plugin_appstream_parent_class)->dispose (object);
@@ -64,9 +110,12 @@ gs_plugin_appstream_init (GsPluginAppstream *self)
 {
 	GApplication *application = g_application_get_default ();
 
-	/* XbSilo needs external locking as we destroy the silo and build a new
-	 * one when something changes */
+	/* XbSilo needs external locking as we replace the silos with new
+	 * ones when something changes */
 	g_rw_lock_init (&self->silo_lock);
+	g_mutex_init (&self->silo_rebuild_mutex);
+	self->layers = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      g_free, (GDestroyNotify) gs_plugin_appstream_layer_free);
 
 	/* need package name */
 	gs_plugin_add_rule (GS_PLUGIN (self), GS_PLUGIN_RULE_RUN_AFTER, "dpkg");
@@ -220,11 +269,7 @@ gs_plugin_appstream_load_appdata_fn (GsPluginAppstream  *self,
 
 	/* add source */
 	if (!xb_builder_source_load_file (source, file,
-#if LIBXMLB_CHECK_VERSION(0, 2, 0)
-					  XB_BUILDER_SOURCE_FLAG_WATCH_DIRECTORY,
-#else
 					  XB_BUILDER_SOURCE_FLAG_WATCH_FILE,
-#endif
 					  cancellable,
 					  error)) {
 		return FALSE;
@@ -248,9 +293,9 @@ gs_plugin_appstream_load_appdata_fn (GsPluginAppstream  *self,
 }
 
 static gboolean
-gs_plugin_appstream_load_appdata (GsPluginAppstream  *self,
-                                  XbBuilder          *builder,
+gs_plugin_appstream_list_appdata (GsPluginAppstream  *self,
                                   const gchar        *path,
+                                  GPtrArray          *filenames,
                                   GCancellable       *cancellable,
                                   GError            **error)
 {
@@ -262,7 +307,7 @@ gs_plugin_appstream_load_appdata (GsPluginAppstream  *self,
 		return TRUE;
 	}
 
-	g_debug ("appstream: Loading appdata path '%s'", path);
+	g_debug ("appstream: Scanning appdata path '%s'", path);
 
 	dir = g_dir_open (path, 0, error);
 	if (dir == NULL)
@@ -270,18 +315,8 @@ gs_plugin_appstream_load_appdata (GsPluginAppstream  *self,
 
 	while ((fn = g_dir_read_name (dir)) != NULL) {
 		if (g_str_has_suffix (fn, ".appdata.xml") ||
-		    g_str_has_suffix (fn, ".metainfo.xml")) {
-			g_autofree gchar *filename = g_build_filename (path, fn, NULL);
-			g_autoptr(GError) error_local = NULL;
-			if (!gs_plugin_appstream_load_appdata_fn (self,
-								  builder,
-								  filename,
-								  cancellable,
-								  &error_local)) {
-				g_debug ("ignoring %s: %s", filename, error_local->message);
-				continue;
-			}
-		}
+		    g_str_has_suffix (fn, ".metainfo.xml"))
+			g_ptr_array_add (filenames, g_build_filename (path, fn, NULL));
 	}
 
 	/* success */
@@ -336,11 +371,7 @@ gs_plugin_appstream_load_desktop_fn (GsPluginAppstream  *self,
 
 	/* add source */
 	if (!xb_builder_source_load_file (source, file,
-#if LIBXMLB_CHECK_VERSION(0, 2, 0)
-					  XB_BUILDER_SOURCE_FLAG_WATCH_DIRECTORY,
-#else
 					  XB_BUILDER_SOURCE_FLAG_WATCH_FILE,
-#endif
 					  cancellable,
 					  error)) {
 		return FALSE;
@@ -357,9 +388,9 @@ gs_plugin_appstream_load_desktop_fn (GsPluginAppstream  *self,
 }
 
 static gboolean
-gs_plugin_appstream_load_desktop (GsPluginAppstream  *self,
-                                  XbBuilder          *builder,
+gs_plugin_appstream_list_desktop (GsPluginAppstream  *self,
                                   const gchar        *path,
+                                  GPtrArray          *filenames,
                                   GCancellable       *cancellable,
                                   GError            **error)
 {
@@ -371,7 +402,7 @@ gs_plugin_appstream_load_desktop (GsPluginAppstream  *self,
 		return TRUE;
 	}
 
-	g_debug ("appstream: Loading desktop path '%s'", path);
+	g_debug ("appstream: Scanning desktop path '%s'", path);
 
 	dir = g_dir_open (path, 0, error);
 	if (dir == NULL)
@@ -379,18 +410,9 @@ gs_plugin_appstream_load_desktop (GsPluginAppstream  *self,
 
 	while ((fn = g_dir_read_name (dir)) != NULL) {
 		if (g_str_has_suffix (fn, ".desktop")) {
-			g_autofree gchar *filename = g_build_filename (path, fn, NULL);
-			g_autoptr(GError) error_local = NULL;
 			if (g_strcmp0 (fn, "mimeinfo.cache") == 0)
 				continue;
-			if (!gs_plugin_appstream_load_desktop_fn (self,
-								  builder,
-								  filename,
-								  cancellable,
-								  &error_local)) {
-				g_debug ("ignoring %s: %s", filename, error_local->message);
-				continue;
-			}
+			g_ptr_array_add (filenames, g_build_filename (path, fn, NULL));
 		}
 	}
 
@@ -490,11 +512,7 @@ gs_plugin_appstream_load_appstream_fn (GsPluginAppstream  *self,
 
 	/* add source */
 	if (!xb_builder_source_load_file (source, file,
-#if LIBXMLB_CHECK_VERSION(0, 2, 0)
-					  XB_BUILDER_SOURCE_FLAG_WATCH_DIRECTORY,
-#else
 					  XB_BUILDER_SOURCE_FLAG_WATCH_FILE,
-#endif
 					  cancellable,
 					  error)) {
 		return FALSE;
@@ -549,9 +567,9 @@ gs_plugin_appstream_load_appstream_fn (GsPluginAppstream  *self,
 }
 
 static gboolean
-gs_plugin_appstream_load_appstream (GsPluginAppstream  *self,
-                                    XbBuilder          *builder,
+gs_plugin_appstream_list_appstream (GsPluginAppstream  *self,
                                     const gchar        *path,
+                                    GPtrArray          *filenames,
                                     GCancellable       *cancellable,
                                     GError            **error)
 {
@@ -564,7 +582,7 @@ gs_plugin_appstream_load_appstream (GsPluginAppstream  *self,
 		g_debug ("appstream: Skipping appstream path '%s' as %s", path, g_cancellable_is_cancelled (cancellable) ? "cancelled" : "does not exist");
 		return TRUE;
 	}
-	g_debug ("appstream: Loading appstream path '%s'", path);
+	g_debug ("appstream: Scanning appstream path '%s'", path);
 	dir = g_dir_open (path, 0, error);
 	if (dir == NULL)
 		return FALSE;
@@ -580,18 +598,8 @@ gs_plugin_appstream_load_appstream (GsPluginAppstream  *self,
 		if (g_str_has_suffix (fn, ".xml") ||
 		    g_str_has_suffix (fn, ".yml") ||
 		    g_str_has_suffix (fn, ".yml.gz") ||
-		    g_str_has_suffix (fn, ".xml.gz")) {
-			g_autofree gchar *filename = g_build_filename (path, fn, NULL);
-			g_autoptr(GError) error_local = NULL;
-			if (!gs_plugin_appstream_load_appstream_fn (self,
-								    builder,
-								    filename,
-								    cancellable,
-								    &error_local)) {
-				g_debug ("ignoring %s: %s", filename, error_local->message);
-				continue;
-			}
-		}
+		    g_str_has_suffix (fn, ".xml.gz"))
+			g_ptr_array_add (filenames, g_build_filename (path, fn, NULL));
 	}
 
 	/* success */
@@ -643,33 +651,13 @@ gs_add_appstream_metainfo_location (GPtrArray *locations, const gchar *root)
 			 g_build_filename (root, "appdata", NULL));
 }
 
-static gboolean
-gs_plugin_appstream_check_silo (GsPluginAppstream  *self,
-                                GCancellable       *cancellable,
-                                GError            **error)
+static XbBuilder *
+gs_plugin_appstream_builder_new (void)
 {
-	const gchar *test_xml;
-	g_autofree gchar *blobfn = NULL;
-	g_autoptr(XbBuilder) builder = NULL;
-	g_autoptr(XbNode) n = NULL;
-	g_autoptr(GFile) file = NULL;
-	g_autoptr(GRWLockReaderLocker) reader_locker = NULL;
-	g_autoptr(GRWLockWriterLocker) writer_locker = NULL;
-	g_autoptr(GPtrArray) parent_appdata = g_ptr_array_new_with_free_func (g_free);
-	g_autoptr(GPtrArray) parent_appstream = g_ptr_array_new_with_free_func (g_free);
 	const gchar *const *locales = g_get_language_names ();
+	g_autoptr(XbBuilder) builder = NULL;
 	g_autoptr(GMainContext) old_thread_default = NULL;
 
-	reader_locker = g_rw_lock_reader_locker_new (&self->silo_lock);
-	/* everything is okay */
-	if (self->silo != NULL && xb_silo_is_valid (self->silo))
-		return TRUE;
-	g_clear_pointer (&reader_locker, g_rw_lock_reader_locker_free);
-
-	/* drat! silo needs regenerating */
-	writer_locker = g_rw_lock_writer_locker_new (&self->silo_lock);
-	g_clear_object (&self->silo);
-
 	/* FIXME: https://gitlab.gnome.org/GNOME/gnome-software/-/issues/1422 */
 	old_thread_default = g_main_context_ref_thread_default ();
 	if (old_thread_default == g_main_context_default ())
@@ -679,7 +667,6 @@ gs_plugin_appstream_check_silo (GsPluginAppstream  *self,
 	builder = xb_builder_new ();
 	if (old_thread_default != NULL)
 		g_main_context_push_thread_default (old_thread_default);
-	g_clear_pointer (&old_thread_default, g_main_context_unref);
 
 	/* verbose profiling */
 	if (g_getenv ("GS_XMLB_VERBOSE") != NULL) {
@@ -692,27 +679,402 @@ gs_plugin_appstream_check_silo (GsPluginAppstream  *self,
 	for (guint i = 0; locales[i] != NULL; i++)
 		xb_builder_add_locale (builder, locales[i]);
 
+	return g_steal_pointer (&builder);
+}
+
+static gboolean
+gs_plugin_appstream_load_test_xml (GsPluginAppstream  *self,
+                                   XbBuilder          *builder,
+                                   const gchar        *test_xml,
+                                   GError            **error)
+{
+	g_autoptr(XbBuilderFixup) fixup1 = NULL;
+	g_autoptr(XbBuilderFixup) fixup2 = NULL;
+	g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
+
+	if (!xb_builder_source_load_xml (source, test_xml,
+					 XB_BUILDER_SOURCE_FLAG_NONE,
+					 error))
+		return FALSE;
+	fixup1 = xb_builder_fixup_new ("AddOriginKeywords",
+				       gs_plugin_appstream_add_origin_keyword_cb,
+				       self, NULL);
+	xb_builder_fixup_set_max_depth (fixup1, 1);
+	xb_builder_source_add_fixup (source, fixup1);
+	fixup2 = xb_builder_fixup_new ("AddIcons",
+				       gs_plugin_appstream_add_icons_cb,
+				       self, NULL);
+	xb_builder_fixup_set_max_depth (fixup2, 2);
+	xb_builder_source_add_fixup (source, fixup2);
+	xb_builder_import_source (builder, source);
+
+	return TRUE;
+}
+
+/* Returns a key which changes whenever any of @filenames is added, removed or
+ * modified, so the layer built from them needs recompiling.
+ *
+ * The file contents aren’t checksummed, as that would mean reading every
+ * catalog each time the silo is checked. Instead the key uses the
+ * nanosecond mtime, size and inode of each file, which also change when a
+ * file is atomically replaced. */
+static gchar *
+gs_plugin_appstream_get_layer_key (GPtrArray *filenames)
+{
+	g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+	for (guint i = 0; i < filenames->len; i++) {
+		const gchar *filename = g_ptr_array_index (filenames, i);
+		GStatBuf buf;
+		gint64 stat_data[4] = { 0, };
+
+		if (g_stat (filename, &buf) == 0) {
+			stat_data[0] = buf.st_mtim.tv_sec;
+			stat_data[1] = buf.st_mtim.tv_nsec;
+			stat_data[2] = buf.st_size;
+			stat_data[3] = buf.st_ino;
+		}
+		g_checksum_update (checksum, (const guchar *) filename, -1);
+		g_checksum_update (checksum, (const guchar *) stat_data, sizeof (stat_data));
+	}
+
+	return g_strdup (g_checksum_get_string (checksum));
+}
+
+/* Compiles the files of one layer into a silo, reusing the on-disk blob if
+ * none of them have changed since it was written. */
+static XbSilo *
+gs_plugin_appstream_build_layer (GsPluginAppstream           *self,
+                                 const gchar                 *name,
+                                 GsPluginAppstreamLayerKind   kind,
+                                 const gchar                 *test_xml,
+                                 GPtrArray                   *filenames,
+                                 GPtrArray                   *watch_dirs,
+                                 GCancellable                *cancellable,
+                                 GError                     **error)
+{
+	g_autofree gchar *basename = NULL;
+	g_autofree gchar *blobfn = NULL;
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(XbBuilder) builder = gs_plugin_appstream_builder_new ();
+	g_autoptr(XbSilo) silo = NULL;
+	g_autoptr(GMainContext) old_thread_default = NULL;
+
+	if (test_xml != NULL &&
+	    !gs_plugin_appstream_load_test_xml (self, builder, test_xml, error))
+		return NULL;
+
+	for (guint i = 0; filenames != NULL && i < filenames->len; i++) {
+		const gchar *filename = g_ptr_array_index (filenames, i);
+		g_autoptr(GError) error_local = NULL;
+		gboolean ret = FALSE;
+
+		switch (kind) {
+		case GS_PLUGIN_APPSTREAM_LAYER_KIND_CATALOG:
+			ret = gs_plugin_appstream_load_appstream_fn (self, builder, filename,
+								     cancellable, &error_local);
+			break;
+		case GS_PLUGIN_APPSTREAM_LAYER_KIND_METAINFO:
+			ret = gs_plugin_appstream_load_appdata_fn (self, builder, filename,
+								   cancellable, &error_local);
+			break;
+		case GS_PLUGIN_APPSTREAM_LAYER_KIND_DESKTOP:
+			ret = gs_plugin_appstream_load_desktop_fn (self, builder, filename,
+								   cancellable, &error_local);
+			break;
+		default:
+			g_assert_not_reached ();
+		}
+		if (!ret)
+			g_debug ("ignoring %s: %s", filename, error_local->message);
+	}
+
+	/* regenerate with each minor release */
+	xb_builder_append_guid (builder, PACKAGE_VERSION);
+
+	/* create per-user cache */
+	basename = g_strdup_printf ("components-%s.xmlb", name);
+	blobfn = gs_utils_get_cache_filename ("appstream", basename,
+					      GS_UTILS_CACHE_FLAG_WRITEABLE |
+					      GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+					      error);
+	if (blobfn == NULL)
+		return NULL;
+	file = g_file_new_for_path (blobfn);
+	g_debug ("ensuring %s", blobfn);
+
+	/* FIXME: https://gitlab.gnome.org/GNOME/gnome-software/-/issues/1422 */
+	old_thread_default = g_main_context_ref_thread_default ();
+	if (old_thread_default == g_main_context_default ())
+		g_clear_pointer (&old_thread_default, g_main_context_unref);
+	if (old_thread_default != NULL)
+		g_main_context_pop_thread_default (old_thread_default);
+
+	silo = xb_builder_ensure (builder, file,
+				  XB_BUILDER_COMPILE_FLAG_IGNORE_INVALID |
+				  XB_BUILDER_COMPILE_FLAG_SINGLE_LANG,
+				  NULL, error);
+	if (silo == NULL) {
+		if (old_thread_default != NULL)
+			g_main_context_push_thread_default (old_thread_default);
+		return NULL;
+	}
+
+	/* watch all directories too, so added files are noticed */
+	for (guint i = 0; watch_dirs != NULL && i < watch_dirs->len; i++) {
+		const gchar *fn = g_ptr_array_index (watch_dirs, i);
+		g_autoptr(GFile) file_tmp = g_file_new_for_path (fn);
+		if (!xb_silo_watch_file (silo, file_tmp, cancellable, error)) {
+			if (old_thread_default != NULL)
+				g_main_context_push_thread_default (old_thread_default);
+			return NULL;
+		}
+	}
+
+	if (old_thread_default != NULL)
+		g_main_context_push_thread_default (old_thread_default);
+
+	return g_steal_pointer (&silo);
+}
+
+/* One layer to add to the new set of silos. */
+typedef struct {
+	GsPluginAppstream		*self;  /* (unowned) */
+	gchar				*name;  /* (owned) */
+	GsPluginAppstreamLayerKind	 kind;
+	const gchar			*test_xml;  /* (unowned) (nullable) */
+	GPtrArray			*filenames;  /* (owned) (nullable) */
+	GPtrArray			*watch_dirs;  /* (owned) (nullable) */
+	gchar				*key;  /* (owned) */
+	XbSilo				*silo;  /* (owned) (nullable); NULL until built */
+	GError				*error;  /* (owned) (nullable) */
+} GsPluginAppstreamLayerBuild;
+
+static void
+gs_plugin_appstream_layer_build_free (GsPluginAppstreamLayerBuild *build)
+{
+	g_free (build->name);
+	g_clear_pointer (&build->filenames, g_ptr_array_unref);
+	g_clear_pointer (&build->watch_dirs, g_ptr_array_unref);
+	g_free (build->key);
+	g_clear_object (&build->silo);
+	g_clear_error (&build->error);
+	g_free (build);
+}
+
+/* Adds one layer to @builds, reusing the current silo for it if its files
+ * haven’t changed. A layer with no @filenames or @test_xml is empty, and only
+ * watches @watch_dirs.
+ *
+ * Must be called with @self->silo_rebuild_mutex held. */
+static void
+gs_plugin_appstream_add_layer (GsPluginAppstream           *self,
+                               GPtrArray                   *builds,
+                               const gchar                 *name,
+                               GsPluginAppstreamLayerKind   kind,
+                               const gchar                 *test_xml,
+                               GPtrArray                   *filenames,
+                               GPtrArray                   *watch_dirs)
+{
+	GsPluginAppstreamLayer *old;
+	GsPluginAppstreamLayerBuild *build = g_new0 (GsPluginAppstreamLayerBuild, 1);
+
+	build->self = self;
+	build->name = g_strdup (name);
+	build->kind = kind;
+	build->test_xml = test_xml;
+	build->filenames = (filenames != NULL) ? g_ptr_array_ref (filenames) : NULL;
+	build->watch_dirs = (watch_dirs != NULL) ? g_ptr_array_ref (watch_dirs) : NULL;
+	if (test_xml != NULL)
+		build->key = g_compute_checksum_for_string (G_CHECKSUM_SHA256, test_xml, -1);
+	else if (filenames != NULL)
+		build->key = gs_plugin_appstream_get_layer_key (filenames);
+	else
+		build->key = gs_plugin_appstream_get_layer_key (watch_dirs);
+
+	/* an invalidated silo is still rebuilt, but xb_builder_ensure() will
+	 * reuse its blob without recompiling if the files are unchanged */
+	old = g_hash_table_lookup (self->layers, name);
+	if (old != NULL && g_strcmp0 (build->key, old->key) == 0 && xb_silo_is_valid (old->silo))
+		build->silo = g_object_ref (old->silo);
+
+	g_ptr_array_add (builds, build);
+}
+
+/* Adds @n_buckets layers of kind @kind to @builds, with the files in
+ * @filenames spread across them, so that changing one file only recompiles
+ * one of them. */
+static void
+gs_plugin_appstream_add_bucketed_layers (GsPluginAppstream           *self,
+                                         GPtrArray                   *builds,
+                                         const gchar                 *name,
+                                         GsPluginAppstreamLayerKind   kind,
+                                         guint                        n_buckets,
+                                         GPtrArray                   *filenames)
+{
+	g_autoptr(GPtrArray) buckets = g_ptr_array_new_with_free_func ((GDestroyNotify) g_ptr_array_unref);
+
+	for (guint i = 0; i < n_buckets; i++)
+		g_ptr_array_add (buckets, g_ptr_array_new_with_free_func (g_free));
+	for (guint i = 0; i < filenames->len; i++) {
+		const gchar *filename = g_ptr_array_index (filenames, i);
+		g_autofree gchar *fn = g_path_get_basename (filename);
+		GPtrArray *bucket = g_ptr_array_index (buckets, g_str_hash (fn) % n_buckets);
+		g_ptr_array_add (bucket, g_strdup (filename));
+	}
+
+	for (guint i = 0; i < n_buckets; i++) {
+		g_autofree gchar *layer_name = g_strdup_printf ("%s-%u", name, i);
+		gs_plugin_appstream_add_layer (self, builds, layer_name, kind, NULL,
+					       g_ptr_array_index (buckets, i), NULL);
+	}
+}
+
+/* Run in a thread from the pool in gs_plugin_appstream_build_layers(). */
+static void
+gs_plugin_appstream_build_layer_cb (gpointer data,
+                                    gpointer user_data)
+{
+	GsPluginAppstreamLayerBuild *build = data;
+	GCancellable *cancellable = user_data;
+
+	if (g_cancellable_set_error_if_cancelled (cancellable, &build->error))
+		return;
+
+	g_debug ("appstream: Rebuilding layer %s", build->name);
+	build->silo = gs_plugin_appstream_build_layer (build->self, build->name,
+						       build->kind, build->test_xml,
+						       build->filenames, build->watch_dirs,
+						       cancellable, &build->error);
+}
+
+/* Compiles all the layers in @builds which weren’t reused. Each layer has its
+ * own #XbBuilder, so the parsing and fixups of several layers run in parallel
+ * on a pool bounded by the number of CPUs. */
+static gboolean
+gs_plugin_appstream_build_layers (GPtrArray     *builds,
+                                  GCancellable  *cancellable,
+                                  GError       **error)
+{
+	g_autoptr(GPtrArray) to_build = g_ptr_array_new ();
+	GThreadPool *pool;
+
+	for (guint i = 0; i < builds->len; i++) {
+		GsPluginAppstreamLayerBuild *build = g_ptr_array_index (builds, i);
+		if (build->silo == NULL)
+			g_ptr_array_add (to_build, build);
+	}
+
+	/* not worth the threads */
+	if (to_build->len == 1) {
+		gs_plugin_appstream_build_layer_cb (g_ptr_array_index (to_build, 0), cancellable);
+	} else if (to_build->len > 1) {
+		pool = g_thread_pool_new (gs_plugin_appstream_build_layer_cb, cancellable,
+					  (gint) MIN (to_build->len, g_get_num_processors ()),
+					  TRUE, error);
+		if (pool == NULL)
+			return FALSE;
+		for (guint i = 0; i < to_build->len; i++)
+			g_thread_pool_push (pool, g_ptr_array_index (to_build, i), NULL);
+
+		/* wait for them all to finish */
+		g_thread_pool_free (pool, FALSE, TRUE);
+	}
+
+	for (guint i = 0; i < to_build->len; i++) {
+		GsPluginAppstreamLayerBuild *build = g_ptr_array_index (to_build, i);
+		if (build->error != NULL) {
+			g_propagate_error (error, g_steal_pointer (&build->error));
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* Deletes the cached blobs of layers which no longer exist, such as those of
+ * removed catalogs, as each layer has a blob of its own. */
+static void
+gs_plugin_appstream_prune_blobs (GPtrArray *builds)
+{
+	const gchar *fn;
+	g_autofree gchar *blobfn = NULL;
+	g_autofree gchar *cachedir = NULL;
+	g_autoptr(GDir) dir = NULL;
+	g_autoptr(GHashTable) current = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	blobfn = gs_utils_get_cache_filename ("appstream", "components.xmlb",
+					      GS_UTILS_CACHE_FLAG_WRITEABLE, NULL);
+	if (blobfn == NULL)
+		return;
+	cachedir = g_path_get_dirname (blobfn);
+	dir = g_dir_open (cachedir, 0, NULL);
+	if (dir == NULL)
+		return;
+
+	for (guint i = 0; i < builds->len; i++) {
+		GsPluginAppstreamLayerBuild *build = g_ptr_array_index (builds, i);
+		g_hash_table_add (current, g_strdup_printf ("components-%s.xmlb", build->name));
+	}
+
+	/* this includes the single components.xmlb from older versions */
+	while ((fn = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *filename = NULL;
+
+		if (!g_str_has_prefix (fn, "components") ||
+		    !g_str_has_suffix (fn, ".xmlb") ||
+		    g_hash_table_contains (current, fn))
+			continue;
+
+		filename = g_build_filename (cachedir, fn, NULL);
+		g_debug ("appstream: Removing stale blob %s", filename);
+		if (g_unlink (filename) != 0)
+			g_debug ("Failed to remove %s: %s", filename, g_strerror (errno));
+	}
+}
+
+/* Builds new silos from the current AppStream data, reusing the layers whose
+ * files haven’t changed. This doesn’t touch @self->silos, so it’s done without
+ * holding @self->silo_lock.
+ *
+ * Must be called with @self->silo_rebuild_mutex held. */
+static gboolean
+gs_plugin_appstream_build_silos (GsPluginAppstream  *self,
+                                 GPtrArray         **silos_out,
+                                 GHashTable        **layers_out,
+                                 GCancellable       *cancellable,
+                                 GError            **error)
+{
+	const gchar *test_xml;
+	const gchar *test_desktop_dir;
+	const gchar *test_metainfo_dir;
+	g_autoptr(GPtrArray) builds = NULL;
+	g_autoptr(GPtrArray) silos = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GPtrArray) watch_dirs = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GHashTable) layers = NULL;
+	g_autoptr(GPtrArray) parent_appdata = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GPtrArray) parent_appstream = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GPtrArray) parent_desktop = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GPtrArray) appstream_fns = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GPtrArray) appdata_fns = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GPtrArray) desktop_fns = g_ptr_array_new_with_free_func (g_free);
+
+	builds = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_plugin_appstream_layer_build_free);
+	layers = g_hash_table_new_full (g_str_hash, g_str_equal,
+					g_free, (GDestroyNotify) gs_plugin_appstream_layer_free);
+
 	/* only when in self test */
 	test_xml = g_getenv ("GS_SELF_TEST_APPSTREAM_XML");
+	test_desktop_dir = g_getenv ("GS_SELF_TEST_APPSTREAM_DESKTOP_DIR");
+	test_metainfo_dir = g_getenv ("GS_SELF_TEST_APPSTREAM_METAINFO_DIR");
 	if (test_xml != NULL) {
-		g_autoptr(XbBuilderFixup) fixup1 = NULL;
-		g_autoptr(XbBuilderFixup) fixup2 = NULL;
-		g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
-		if (!xb_builder_source_load_xml (source, test_xml,
-						 XB_BUILDER_SOURCE_FLAG_NONE,
-						 error))
-			return FALSE;
-		fixup1 = xb_builder_fixup_new ("AddOriginKeywords",
-					       gs_plugin_appstream_add_origin_keyword_cb,
-					       self, NULL);
-		xb_builder_fixup_set_max_depth (fixup1, 1);
-		xb_builder_source_add_fixup (source, fixup1);
-		fixup2 = xb_builder_fixup_new ("AddIcons",
-					       gs_plugin_appstream_add_icons_cb,
-					       self, NULL);
-		xb_builder_fixup_set_max_depth (fixup2, 2);
-		xb_builder_source_add_fixup (source, fixup2);
-		xb_builder_import_source (builder, source);
+		gs_plugin_appstream_add_layer (self, builds, "test",
+					       GS_PLUGIN_APPSTREAM_LAYER_KIND_CATALOG,
+					       test_xml, NULL, NULL);
+		if (test_desktop_dir != NULL)
+			g_ptr_array_add (parent_desktop, g_strdup (test_desktop_dir));
+		if (test_metainfo_dir != NULL)
+			g_ptr_array_add (parent_appdata, g_strdup (test_metainfo_dir));
 	} else {
 		g_autofree gchar *state_cache_dir = NULL;
 		g_autofree gchar *state_lib_dir = NULL;
@@ -777,88 +1139,179 @@ gs_plugin_appstream_check_silo (GsPluginAppstream  *self,
 			gs_add_appstream_catalog_location (parent_appstream, "/var/lib");
 		}
 
-		/* import all files */
-		for (guint i = 0; i < parent_appstream->len; i++) {
-			const gchar *fn = g_ptr_array_index (parent_appstream, i);
-			if (!gs_plugin_appstream_load_appstream (self, builder, fn,
-								 cancellable, error))
-				return FALSE;
-		}
-		for (guint i = 0; i < parent_appdata->len; i++) {
-			const gchar *fn = g_ptr_array_index (parent_appdata, i);
-			if (!gs_plugin_appstream_load_appdata (self, builder, fn,
-							       cancellable, error))
-				return FALSE;
-		}
-		if (!gs_plugin_appstream_load_desktop (self, builder,
-						       DATADIR "/applications",
-						       cancellable, error)) {
+		/* and desktop files without any metainfo */
+		g_ptr_array_add (parent_desktop, g_strdup (DATADIR "/applications"));
+		if (g_strcmp0 (DATADIR, "/usr/share") != 0)
+			g_ptr_array_add (parent_desktop, g_strdup ("/usr/share/applications"));
+	}
+
+	/* find all files */
+	for (guint i = 0; i < parent_appstream->len; i++) {
+		const gchar *fn = g_ptr_array_index (parent_appstream, i);
+		if (!gs_plugin_appstream_list_appstream (self, fn, appstream_fns,
+							 cancellable, error))
 			return FALSE;
-		}
-		if (g_strcmp0 (DATADIR, "/usr/share") != 0 &&
-		    !gs_plugin_appstream_load_desktop (self, builder,
-						       "/usr/share/applications",
-						       cancellable, error)) {
+	}
+	for (guint i = 0; i < parent_appdata->len; i++) {
+		const gchar *fn = g_ptr_array_index (parent_appdata, i);
+		if (!gs_plugin_appstream_list_appdata (self, fn, appdata_fns,
+						       cancellable, error))
+			return FALSE;
+	}
+	for (guint i = 0; i < parent_desktop->len; i++) {
+		const gchar *fn = g_ptr_array_index (parent_desktop, i);
+		if (!gs_plugin_appstream_list_desktop (self, fn, desktop_fns,
+						       cancellable, error))
 			return FALSE;
-		}
 	}
 
-	/* regenerate with each minor release */
-	xb_builder_append_guid (builder, PACKAGE_VERSION);
-
-	/* create per-user cache */
-	blobfn = gs_utils_get_cache_filename ("appstream", "components.xmlb",
-					      GS_UTILS_CACHE_FLAG_WRITEABLE |
-					      GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
-					      error);
-	if (blobfn == NULL)
+	/* catalogs are large but only change on a metadata refresh, whereas
+	 * metainfo and desktop files change with every package install; each
+	 * catalog gets a layer of its own, so that several can be compiled in
+	 * parallel and a refresh only recompiles the ones which changed */
+	for (guint i = 0; i < appstream_fns->len; i++) {
+		const gchar *fn = g_ptr_array_index (appstream_fns, i);
+		g_autofree gchar *hash = g_compute_checksum_for_string (G_CHECKSUM_MD5, fn, -1);
+		g_autofree gchar *layer_name = g_strdup_printf ("catalog-%s", hash);
+		g_autoptr(GPtrArray) layer_fns = g_ptr_array_new_with_free_func (g_free);
+
+		g_ptr_array_add (layer_fns, g_strdup (fn));
+		gs_plugin_appstream_add_layer (self, builds, layer_name,
+					       GS_PLUGIN_APPSTREAM_LAYER_KIND_CATALOG,
+					       NULL, layer_fns, NULL);
+	}
+	if (appdata_fns->len > 0)
+		gs_plugin_appstream_add_bucketed_layers (self, builds, "metainfo",
+							 GS_PLUGIN_APPSTREAM_LAYER_KIND_METAINFO,
+							 GS_PLUGIN_APPSTREAM_N_BUCKETS,
+							 appdata_fns);
+	if (desktop_fns->len > 0)
+		gs_plugin_appstream_add_bucketed_layers (self, builds, "desktop",
+							 GS_PLUGIN_APPSTREAM_LAYER_KIND_DESKTOP,
+							 GS_PLUGIN_APPSTREAM_N_BUCKETS,
+							 desktop_fns);
+
+	/* the layers above only watch their own files; watch the directories
+	 * from an empty layer, so that a file being added is noticed without
+	 * invalidating every layer of its kind */
+	g_ptr_array_extend (watch_dirs, parent_appstream, (GCopyFunc) g_strdup, NULL);
+	g_ptr_array_extend (watch_dirs, parent_appdata, (GCopyFunc) g_strdup, NULL);
+	g_ptr_array_extend (watch_dirs, parent_desktop, (GCopyFunc) g_strdup, NULL);
+	gs_plugin_appstream_add_layer (self, builds, "directories",
+				       GS_PLUGIN_APPSTREAM_LAYER_KIND_CATALOG,
+				       NULL, NULL, watch_dirs);
+
+	if (!gs_plugin_appstream_build_layers (builds, cancellable, error))
 		return FALSE;
-	file = g_file_new_for_path (blobfn);
-	g_debug ("ensuring %s", blobfn);
+	gs_plugin_appstream_prune_blobs (builds);
+
+	/* keep the layers in a stable order */
+	for (guint i = 0; i < builds->len; i++) {
+		GsPluginAppstreamLayerBuild *build = g_ptr_array_index (builds, i);
+		g_ptr_array_add (silos, g_object_ref (build->silo));
+		g_hash_table_insert (layers, g_strdup (build->name),
+				     gs_plugin_appstream_layer_new (build->key, build->silo));
+	}
 
-	/* FIXME: https://gitlab.gnome.org/GNOME/gnome-software/-/issues/1422 */
-	old_thread_default = g_main_context_ref_thread_default ();
-	if (old_thread_default == g_main_context_default ())
-		g_clear_pointer (&old_thread_default, g_main_context_unref);
-	if (old_thread_default != NULL)
-		g_main_context_pop_thread_default (old_thread_default);
+	*silos_out = g_steal_pointer (&silos);
+	*layers_out = g_steal_pointer (&layers);
 
-	self->silo = xb_builder_ensure (builder, file,
-					XB_BUILDER_COMPILE_FLAG_IGNORE_INVALID |
-					XB_BUILDER_COMPILE_FLAG_SINGLE_LANG,
-					NULL, error);
-	if (self->silo == NULL) {
-		if (old_thread_default != NULL)
-			g_main_context_push_thread_default (old_thread_default);
+	return TRUE;
+}
+
+/* Must be called with a lock held on @self->silo_lock */
+static gboolean
+gs_plugin_appstream_silos_are_valid_unlocked (GsPluginAppstream *self)
+{
+	if (self->silos == NULL)
 		return FALSE;
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!xb_silo_is_valid (g_ptr_array_index (self->silos, i)))
+			return FALSE;
 	}
+	return TRUE;
+}
 
-	/* watch all directories too */
-	for (guint i = 0; i < parent_appstream->len; i++) {
-		const gchar *fn = g_ptr_array_index (parent_appstream, i);
-		g_autoptr(GFile) file_tmp = g_file_new_for_path (fn);
-		if (!xb_silo_watch_file (self->silo, file_tmp, cancellable, error)) {
-			if (old_thread_default != NULL)
-				g_main_context_push_thread_default (old_thread_default);
-			return FALSE;
-		}
+/* Must be called with a lock held on @self->silo_lock */
+static gboolean
+gs_plugin_appstream_silos_have_components_unlocked (GsPluginAppstream *self)
+{
+	for (guint i = 0; i < self->silos->len; i++) {
+		g_autoptr(XbNode) n = NULL;
+
+		n = xb_silo_query_first (g_ptr_array_index (self->silos, i), "components/component", NULL);
+		if (n != NULL)
+			return TRUE;
 	}
-	for (guint i = 0; i < parent_appdata->len; i++) {
-		const gchar *fn = g_ptr_array_index (parent_appdata, i);
-		g_autoptr(GFile) file_tmp = g_file_new_for_path (fn);
-		if (!xb_silo_watch_file (self->silo, file_tmp, cancellable, error)) {
-			if (old_thread_default != NULL)
-				g_main_context_push_thread_default (old_thread_default);
-			return FALSE;
-		}
+	return FALSE;
+}
+
+static gboolean
+gs_plugin_appstream_check_silo (GsPluginAppstream  *self,
+                                GCancellable       *cancellable,
+                                GError            **error)
+{
+	g_autoptr(GPtrArray) silos = NULL;
+	g_autoptr(GHashTable) layers = NULL;
+	g_autoptr(GRWLockReaderLocker) reader_locker = NULL;
+	g_autoptr(GRWLockWriterLocker) writer_locker = NULL;
+	gboolean have_old_silos;
+
+	reader_locker = g_rw_lock_reader_locker_new (&self->silo_lock);
+	/* everything is okay */
+	if (gs_plugin_appstream_silos_are_valid_unlocked (self))
+		return TRUE;
+	have_old_silos = (self->silos != NULL);
+	g_clear_pointer (&reader_locker, g_rw_lock_reader_locker_free);
+
+	/* drat! silos need regenerating; if another thread is already doing
+	 * that, keep using the old silos rather than waiting for it */
+	if (have_old_silos) {
+		if (!g_mutex_trylock (&self->silo_rebuild_mutex))
+			return TRUE;
+	} else {
+		g_mutex_lock (&self->silo_rebuild_mutex);
 	}
 
-	if (old_thread_default != NULL)
-		g_main_context_push_thread_default (old_thread_default);
+	/* they may have been rebuilt while waiting */
+	reader_locker = g_rw_lock_reader_locker_new (&self->silo_lock);
+	if (gs_plugin_appstream_silos_are_valid_unlocked (self)) {
+		g_mutex_unlock (&self->silo_rebuild_mutex);
+		return TRUE;
+	}
+	g_clear_pointer (&reader_locker, g_rw_lock_reader_locker_free);
+
+	/* readers keep using the old silos while the new ones are built */
+	if (!gs_plugin_appstream_build_silos (self, &silos, &layers, cancellable, error)) {
+		g_mutex_unlock (&self->silo_rebuild_mutex);
+		return FALSE;
+	}
+
+	/* index them now, rather than on the first search; a failure here is
+	 * reported again by that search */
+	for (guint i = 0; i < silos->len; i++) {
+		g_autoptr(GError) error_local = NULL;
+		if (!gs_appstream_build_search_indexes (g_ptr_array_index (silos, i), &error_local))
+			g_debug ("failed to build search index: %s", error_local->message);
+	}
+
+	g_clear_pointer (&self->layers, g_hash_table_unref);
+	self->layers = g_steal_pointer (&layers);
+
+	/* publish them; readers still using the old silos hold the reader lock,
+	 * so they’re only freed once they are done */
+	writer_locker = g_rw_lock_writer_locker_new (&self->silo_lock);
+	g_clear_pointer (&self->silos, g_ptr_array_unref);
+	self->silos = g_steal_pointer (&silos);
+	g_clear_pointer (&writer_locker, g_rw_lock_writer_locker_free);
+	g_mutex_unlock (&self->silo_rebuild_mutex);
+
+	/* any results computed from the old silos are now stale */
+	gs_plugin_metadata_changed (GS_PLUGIN (self));
 
 	/* test we found something */
-	n = xb_silo_query_first (self->silo, "components/component", NULL);
-	if (n == NULL) {
+	reader_locker = g_rw_lock_reader_locker_new (&self->silo_lock);
+	if (!gs_plugin_appstream_silos_have_components_unlocked (self)) {
 		g_warning ("No AppStream data, try 'make install-sample-data' in data/");
 		g_set_error (error,
 			     GS_PLUGIN_ERROR,
@@ -992,7 +1445,13 @@ gs_plugin_url_to_app (GsPlugin *plugin,
 
 	locker = g_rw_lock_reader_locker_new (&self->silo_lock);
 
-	return gs_appstream_url_to_app (plugin, self->silo, list, url, cancellable, error);
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!gs_appstream_url_to_app (plugin, g_ptr_array_index (self->silos, i),
+					      list, url, cancellable, error))
+			return FALSE;
+	}
+
+	return TRUE;
 }
 
 static void
@@ -1046,9 +1505,7 @@ gs_plugin_appstream_refine_state (GsPluginAppstream  *self,
                                   GError            **error)
 {
 	g_autofree gchar *xpath = NULL;
-	g_autoptr(GError) error_local = NULL;
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
-	g_autoptr(XbNode) component = NULL;
 
 	/* Ignore apps with no ID */
 	if (gs_app_get_id (app) == NULL)
@@ -1057,14 +1514,20 @@ gs_plugin_appstream_refine_state (GsPluginAppstream  *self,
 	locker = g_rw_lock_reader_locker_new (&self->silo_lock);
 
 	xpath = g_strdup_printf ("component/id[text()='%s']", gs_app_get_id (app));
-	component = xb_silo_query_first (self->silo, xpath, &error_local);
-	if (component == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return TRUE;
-		g_propagate_error (error, g_steal_pointer (&error_local));
-		return FALSE;
+	for (guint i = 0; i < self->silos->len; i++) {
+		g_autoptr(GError) error_local = NULL;
+		g_autoptr(XbNode) component = NULL;
+
+		component = xb_silo_query_first (g_ptr_array_index (self->silos, i), xpath, &error_local);
+		if (component == NULL) {
+			if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+				continue;
+			g_propagate_error (error, g_steal_pointer (&error_local));
+			return FALSE;
+		}
+		gs_app_set_state (app, GS_APP_STATE_INSTALLED);
+		break;
 	}
-	gs_app_set_state (app, GS_APP_STATE_INSTALLED);
 	return TRUE;
 }
 
@@ -1076,10 +1539,9 @@ gs_plugin_refine_from_id (GsPluginAppstream    *self,
                           GError              **error)
 {
 	const gchar *id, *origin;
-	g_autoptr(GError) error_local = NULL;
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
 	g_autoptr(GString) xpath = g_string_new (NULL);
-	g_autoptr(GPtrArray) components = NULL;
+	gboolean found_any = FALSE;
 
 	/* not enough info to find */
 	id = gs_app_get_id (app);
@@ -1099,20 +1561,28 @@ gs_plugin_refine_from_id (GsPluginAppstream    *self,
 		xb_string_append_union (xpath, "components/component[@type='web-application']/id[text()='%s']/..", id);
 	}
 	xb_string_append_union (xpath, "component/id[text()='%s']/..", id);
-	components = xb_silo_query (self->silo, xpath->str, 0, &error_local);
-	if (components == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return TRUE;
-		g_propagate_error (error, g_steal_pointer (&error_local));
-		return FALSE;
-	}
-	for (guint i = 0; i < components->len; i++) {
-		XbNode *component = g_ptr_array_index (components, i);
-		if (!gs_appstream_refine_app (GS_PLUGIN (self), app, self->silo,
-					      component, flags, error))
+	for (guint j = 0; j < self->silos->len; j++) {
+		g_autoptr(GError) error_local = NULL;
+		g_autoptr(GPtrArray) components = NULL;
+
+		components = xb_silo_query (g_ptr_array_index (self->silos, j), xpath->str, 0, &error_local);
+		if (components == NULL) {
+			if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+				continue;
+			g_propagate_error (error, g_steal_pointer (&error_local));
 			return FALSE;
-		gs_plugin_appstream_set_compulsory_quirk (app, component);
+		}
+		for (guint i = 0; i < components->len; i++) {
+			XbNode *component = g_ptr_array_index (components, i);
+			if (!gs_appstream_refine_app_in_silos (GS_PLUGIN (self), app, self->silos,
+							       component, flags, error))
+				return FALSE;
+			gs_plugin_appstream_set_compulsory_quirk (app, component);
+		}
+		found_any = TRUE;
 	}
+	if (!found_any)
+		return TRUE;
 
 	/* if an installed desktop or appdata file exists set to installed */
 	if (gs_app_get_state (app) == GS_APP_STATE_UNKNOWN) {
@@ -1132,7 +1602,6 @@ gs_plugin_refine_from_pkgname (GsPluginAppstream    *self,
                                GError              **error)
 {
 	GPtrArray *sources = gs_app_get_sources (app);
-	g_autoptr(GError) error_local = NULL;
 
 	/* not enough info to find */
 	if (sources->len == 0)
@@ -1152,14 +1621,19 @@ gs_plugin_refine_from_pkgname (GsPluginAppstream    *self,
 		xb_string_append_union (xpath, "components/component[@type='console-application']/pkgname[text()='%s']/..", pkgname);
 		xb_string_append_union (xpath, "components/component[@type='web-application']/pkgname[text()='%s']/..", pkgname);
 		xb_string_append_union (xpath, "components/component/pkgname[text()='%s']/..", pkgname);
-		component = xb_silo_query_first (self->silo, xpath->str, &error_local);
-		if (component == NULL) {
-			if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-				continue;
-			g_propagate_error (error, g_steal_pointer (&error_local));
-			return FALSE;
+		for (guint i = 0; i < self->silos->len && component == NULL; i++) {
+			g_autoptr(GError) error_local = NULL;
+
+			component = xb_silo_query_first (g_ptr_array_index (self->silos, i), xpath->str, &error_local);
+			if (component == NULL &&
+			    !g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+				g_propagate_error (error, g_steal_pointer (&error_local));
+				return FALSE;
+			}
 		}
-		if (!gs_appstream_refine_app (GS_PLUGIN (self), app, self->silo, component, flags, error))
+		if (component == NULL)
+			continue;
+		if (!gs_appstream_refine_app_in_silos (GS_PLUGIN (self), app, self->silos, component, flags, error))
 			return FALSE;
 		gs_plugin_appstream_set_compulsory_quirk (app, component);
 	}
@@ -1291,9 +1765,7 @@ refine_wildcard (GsPluginAppstream    *self,
 {
 	const gchar *id;
 	g_autofree gchar *xpath = NULL;
-	g_autoptr(GError) error_local = NULL;
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
-	g_autoptr(GPtrArray) components = NULL;
 
 	/* not enough info to find */
 	id = gs_app_get_id (app);
@@ -1304,35 +1776,41 @@ refine_wildcard (GsPluginAppstream    *self,
 
 	/* find all app with package names when matching any prefixes */
 	xpath = g_strdup_printf ("components/component/id[text()='%s']/../pkgname/..", id);
-	components = xb_silo_query (self->silo, xpath, 0, &error_local);
-	if (components == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return TRUE;
-		g_propagate_error (error, g_steal_pointer (&error_local));
-		return FALSE;
-	}
-	for (guint i = 0; i < components->len; i++) {
-		XbNode *component = g_ptr_array_index (components, i);
-		g_autoptr(GsApp) new = NULL;
+	for (guint j = 0; j < self->silos->len; j++) {
+		XbSilo *silo = g_ptr_array_index (self->silos, j);
+		g_autoptr(GError) error_local = NULL;
+		g_autoptr(GPtrArray) components = NULL;
 
-		/* new app */
-		new = gs_appstream_create_app (GS_PLUGIN (self), self->silo, component, error);
-		if (new == NULL)
-			return FALSE;
-		gs_app_set_scope (new, AS_COMPONENT_SCOPE_SYSTEM);
-		gs_app_subsume_metadata (new, app);
-		if (!gs_appstream_refine_app (GS_PLUGIN (self), new, self->silo, component,
-					      refine_flags, error))
+		components = xb_silo_query (silo, xpath, 0, &error_local);
+		if (components == NULL) {
+			if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+				continue;
+			g_propagate_error (error, g_steal_pointer (&error_local));
 			return FALSE;
-		gs_plugin_appstream_set_compulsory_quirk (new, component);
+		}
+		for (guint i = 0; i < components->len; i++) {
+			XbNode *component = g_ptr_array_index (components, i);
+			g_autoptr(GsApp) new = NULL;
 
-		/* if an installed desktop or appdata file exists set to installed */
-		if (gs_app_get_state (new) == GS_APP_STATE_UNKNOWN) {
-			if (!gs_plugin_appstream_refine_state (self, new, error))
+			/* new app */
+			new = gs_appstream_create_app (GS_PLUGIN (self), silo, component, error);
+			if (new == NULL)
 				return FALSE;
-		}
+			gs_app_set_scope (new, AS_COMPONENT_SCOPE_SYSTEM);
+			gs_app_subsume_metadata (new, app);
+			if (!gs_appstream_refine_app_in_silos (GS_PLUGIN (self), new, self->silos, component,
+							       refine_flags, error))
+				return FALSE;
+			gs_plugin_appstream_set_compulsory_quirk (new, component);
 
-		gs_app_list_add (list, new);
+			/* if an installed desktop or appdata file exists set to installed */
+			if (gs_app_get_state (new) == GS_APP_STATE_UNKNOWN) {
+				if (!gs_plugin_appstream_refine_state (self, new, error))
+					return FALSE;
+			}
+
+			gs_app_list_add (list, new);
+		}
 	}
 
 	/* success */
@@ -1394,9 +1872,13 @@ refine_categories_thread_cb (GTask        *task,
 
 	locker = g_rw_lock_reader_locker_new (&self->silo_lock);
 
-	if (!gs_appstream_refine_category_sizes (self->silo, data->list, cancellable, &local_error)) {
-		g_task_return_error (task, g_steal_pointer (&local_error));
-		return;
+	/* the sizes are summed across all the layers */
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!gs_appstream_refine_category_sizes (g_ptr_array_index (self->silos, i),
+							 data->list, cancellable, &local_error)) {
+			g_task_return_error (task, g_steal_pointer (&local_error));
+			return;
+		}
 	}
 
 	g_task_return_boolean (task, TRUE);
@@ -1505,60 +1987,64 @@ list_apps_thread_cb (GTask        *task,
 
 	locker = g_rw_lock_reader_locker_new (&self->silo_lock);
 
-	if (released_since != NULL &&
-	    !gs_appstream_add_recent (GS_PLUGIN (self), self->silo, list, age_secs,
-				      cancellable, &local_error)) {
-		g_task_return_error (task, g_steal_pointer (&local_error));
-		return;
-	}
+	for (guint i = 0; i < self->silos->len; i++) {
+		XbSilo *silo = g_ptr_array_index (self->silos, i);
 
-	if (is_curated != GS_APP_QUERY_TRISTATE_UNSET &&
-	    !gs_appstream_add_popular (self->silo, list, cancellable, &local_error)) {
-		g_task_return_error (task, g_steal_pointer (&local_error));
-		return;
-	}
+		if (released_since != NULL &&
+		    !gs_appstream_add_recent (GS_PLUGIN (self), silo, list, age_secs,
+					      cancellable, &local_error)) {
+			g_task_return_error (task, g_steal_pointer (&local_error));
+			return;
+		}
 
-	if (is_featured != GS_APP_QUERY_TRISTATE_UNSET &&
-	    !gs_appstream_add_featured (self->silo, list, cancellable, &local_error)) {
-		g_task_return_error (task, g_steal_pointer (&local_error));
-		return;
-	}
+		if (is_curated != GS_APP_QUERY_TRISTATE_UNSET &&
+		    !gs_appstream_add_popular (silo, list, cancellable, &local_error)) {
+			g_task_return_error (task, g_steal_pointer (&local_error));
+			return;
+		}
 
-	if (category != NULL &&
-	    !gs_appstream_add_category_apps (GS_PLUGIN (self), self->silo, category, list, cancellable, &local_error)) {
-		g_task_return_error (task, g_steal_pointer (&local_error));
-		return;
-	}
+		if (is_featured != GS_APP_QUERY_TRISTATE_UNSET &&
+		    !gs_appstream_add_featured (silo, list, cancellable, &local_error)) {
+			g_task_return_error (task, g_steal_pointer (&local_error));
+			return;
+		}
 
-	if (is_installed == GS_APP_QUERY_TRISTATE_TRUE &&
-	    !gs_appstream_add_installed (GS_PLUGIN (self), self->silo, list, cancellable, &local_error)) {
-		g_task_return_error (task, g_steal_pointer (&local_error));
-		return;
-	}
+		if (category != NULL &&
+		    !gs_appstream_add_category_apps (GS_PLUGIN (self), silo, category, list, cancellable, &local_error)) {
+			g_task_return_error (task, g_steal_pointer (&local_error));
+			return;
+		}
 
-	if (deployment_featured != NULL &&
-	    !gs_appstream_add_deployment_featured (self->silo, deployment_featured, list,
-						   cancellable, &local_error)) {
-		g_task_return_error (task, g_steal_pointer (&local_error));
-		return;
-	}
+		if (is_installed == GS_APP_QUERY_TRISTATE_TRUE &&
+		    !gs_appstream_add_installed (GS_PLUGIN (self), silo, list, cancellable, &local_error)) {
+			g_task_return_error (task, g_steal_pointer (&local_error));
+			return;
+		}
 
-	if (developers != NULL &&
-	    !gs_appstream_search_developer_apps (GS_PLUGIN (self), self->silo, developers, list, cancellable, &local_error)) {
-		g_task_return_error (task, g_steal_pointer (&local_error));
-		return;
-	}
+		if (deployment_featured != NULL &&
+		    !gs_appstream_add_deployment_featured (silo, deployment_featured, list,
+							   cancellable, &local_error)) {
+			g_task_return_error (task, g_steal_pointer (&local_error));
+			return;
+		}
 
-	if (keywords != NULL &&
-	    !gs_appstream_search (GS_PLUGIN (self), self->silo, keywords, list, cancellable, &local_error)) {
-		g_task_return_error (task, g_steal_pointer (&local_error));
-		return;
-	}
+		if (developers != NULL &&
+		    !gs_appstream_search_developer_apps (GS_PLUGIN (self), silo, developers, list, cancellable, &local_error)) {
+			g_task_return_error (task, g_steal_pointer (&local_error));
+			return;
+		}
 
-	if (alternate_of != NULL &&
-	    !gs_appstream_add_alternates (self->silo, alternate_of, list, cancellable, &local_error)) {
-		g_task_return_error (task, g_steal_pointer (&local_error));
-		return;
+		if (keywords != NULL &&
+		    !gs_appstream_search (GS_PLUGIN (self), silo, keywords, list, cancellable, &local_error)) {
+			g_task_return_error (task, g_steal_pointer (&local_error));
+			return;
+		}
+
+		if (alternate_of != NULL &&
+		    !gs_appstream_add_alternates (silo, alternate_of, list, cancellable, &local_error)) {
+			g_task_return_error (task, g_steal_pointer (&local_error));
+			return;
+		}
 	}
 
 	g_task_return_pointer (task, g_steal_pointer (&list), g_object_unref);
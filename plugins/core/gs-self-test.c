@@ -9,12 +9,16 @@
 #include "config.h"
 
 #include <glib/gstdio.h>
+#include <time.h>
 
 #include "gnome-software-private.h"
 
 #include "gs-appstream.h"
 #include "gs-test.h"
 
+/* number of desktop files to create for the perf tests */
+#define N_PERF_DESKTOP_FILES 5000
+
 const gchar * const allowlist[] = {
 	"appstream",
 	"generic-updates",
@@ -65,6 +69,103 @@ gs_plugins_core_search_repo_name_func (GsPluginLoader *plugin_loader)
 	g_assert_cmpint (gs_app_get_kind (app), ==, AS_COMPONENT_KIND_DESKTOP_APP);
 }
 
+static GsAppList *
+gs_plugins_core_appstream_search (GsPlugin    *plugin,
+				  XbSilo      *silo,
+				  const gchar *value1,
+				  const gchar *value2)
+{
+	const gchar *values[] = { value1, value2, NULL };
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GError) error = NULL;
+
+	g_assert_true (gs_appstream_search (plugin, silo, values, list, NULL, &error));
+	g_assert_no_error (error);
+	return g_steal_pointer (&list);
+}
+
+static void
+gs_plugins_core_appstream_search_index_func (GsPluginLoader *plugin_loader)
+{
+	GsPlugin *plugin;
+	gpointer search_index;
+	const gchar *xml =
+		"<components origin=\"search-test\">\n"
+		"  <component type=\"desktop-application\">\n"
+		"    <id>org.example.SearchPainter</id>\n"
+		"    <name>painter</name>\n"
+		"    <summary>draw pictures</summary>\n"
+		"    <keywords><keyword>sketch</keyword></keywords>\n"
+		"  </component>\n"
+		"  <component type=\"desktop-application\">\n"
+		"    <id>org.example.SearchEditor</id>\n"
+		"    <name>editor</name>\n"
+		"    <summary>edit text files</summary>\n"
+		"  </component>\n"
+		"  <component type=\"desktop-application\">\n"
+		"    <id>org.example.SearchCanvas</id>\n"
+		"    <name>canvas</name>\n"
+		"    <summary>a painting tool</summary>\n"
+		"  </component>\n"
+		"</components>\n";
+	g_autoptr(XbBuilder) builder = xb_builder_new ();
+	g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
+	g_autoptr(XbSilo) silo = NULL;
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GError) error = NULL;
+
+	gs_test_reinitialise_plugin_loader (plugin_loader, allowlist, NULL);
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "appstream");
+	g_assert_nonnull (plugin);
+
+	g_assert_true (xb_builder_source_load_xml (source, xml, XB_BUILDER_SOURCE_FLAG_NONE, &error));
+	g_assert_no_error (error);
+	xb_builder_import_source (builder, source);
+	silo = xb_builder_compile (builder, XB_BUILDER_COMPILE_FLAG_NONE, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (silo);
+
+	/* the indexes are built before the silo is searched */
+	g_assert_null (g_object_get_data (G_OBJECT (silo), "GnomeSoftware::search-index"));
+	g_assert_true (gs_appstream_build_search_indexes (silo, &error));
+	g_assert_no_error (error);
+	search_index = g_object_get_data (G_OBJECT (silo), "GnomeSoftware::search-index");
+	g_assert_nonnull (search_index);
+	g_assert_nonnull (g_object_get_data (G_OBJECT (silo), "GnomeSoftware::search-index-developer"));
+
+	/* results come back in silo order */
+	list = gs_plugins_core_appstream_search (plugin, silo, "paint", NULL);
+	g_assert_cmpuint (gs_app_list_length (list), ==, 2);
+	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 0)), ==, "org.example.SearchPainter");
+	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 1)), ==, "org.example.SearchCanvas");
+	g_clear_object (&list);
+
+	/* all the values have to match */
+	list = gs_plugins_core_appstream_search (plugin, silo, "paint", "tool");
+	g_assert_cmpuint (gs_app_list_length (list), ==, 1);
+	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 0)), ==, "org.example.SearchCanvas");
+	g_clear_object (&list);
+
+	/* keywords are indexed too */
+	list = gs_plugins_core_appstream_search (plugin, silo, "sketch", NULL);
+	g_assert_cmpuint (gs_app_list_length (list), ==, 1);
+	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 0)), ==, "org.example.SearchPainter");
+	g_clear_object (&list);
+
+	/* a value too short for the index is searched for without it */
+	list = gs_plugins_core_appstream_search (plugin, silo, "ed", "f");
+	g_assert_cmpuint (gs_app_list_length (list), ==, 1);
+	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 0)), ==, "org.example.SearchEditor");
+	g_clear_object (&list);
+
+	list = gs_plugins_core_appstream_search (plugin, silo, "zebra", NULL);
+	g_assert_cmpuint (gs_app_list_length (list), ==, 0);
+	g_clear_object (&list);
+
+	/* the index is reused */
+	g_assert_true (g_object_get_data (G_OBJECT (silo), "GnomeSoftware::search-index") == search_index);
+}
+
 static void
 gs_plugins_core_os_release_func (GsPluginLoader *plugin_loader)
 {
@@ -193,16 +294,177 @@ gs_plugins_core_generic_updates_func (GsPluginLoader *plugin_loader)
 	}
 }
 
+static void
+gs_plugins_core_inherit_desktop_icon_func (GsPluginLoader *plugin_loader)
+{
+	GPtrArray *icons;
+	gboolean ret;
+	const gchar * const *icon_names;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsApp) app = NULL;
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+
+	/* drop all caches */
+	gs_utils_rmtree (g_getenv ("GS_SELF_TEST_CACHEDIR"), NULL);
+	gs_test_reinitialise_plugin_loader (plugin_loader, allowlist, NULL);
+
+	/* the metainfo file has no icon, so it has to be inherited from the
+	 * desktop file it launches, which is compiled in a different layer */
+	app = gs_app_new ("org.example.Inherit");
+	plugin_job = gs_plugin_job_refine_new_for_app (app, GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	g_assert_cmpstr (gs_app_get_name (app), ==, "Inherit");
+	icons = gs_app_get_icons (app);
+	g_assert_nonnull (icons);
+	g_assert_cmpuint (icons->len, ==, 1);
+	g_assert_true (G_IS_THEMED_ICON (g_ptr_array_index (icons, 0)));
+	icon_names = g_themed_icon_get_names (G_THEMED_ICON (g_ptr_array_index (icons, 0)));
+	g_assert_cmpstr (icon_names[0], ==, "system-file-manager");
+}
+
+static gchar *
+gs_plugins_core_desktop_file_new (guint        idx,
+                                  const gchar *comment)
+{
+	return g_strdup_printf ("[Desktop Entry]\n"
+				"Type=Application\n"
+				"Name=Example %u\n"
+				"Comment=%s\n"
+				"Exec=example-%u\n"
+				"Icon=system-file-manager\n",
+				idx, comment, idx);
+}
+
+static void
+gs_plugins_core_metadata_changed_cb (GsPlugin *plugin,
+                                     gpointer  user_data)
+{
+	gint *n_changed = user_data;
+	g_atomic_int_inc (n_changed);
+}
+
+/* Changes the comment of the first @n_files perf test desktop files, then
+ * waits for the file monitors to invalidate their layers and times the refresh
+ * which rebuilds them. The wall clock time and the CPU time used by all the
+ * threads are returned. Returns %FALSE if the change was never noticed. */
+static gboolean
+gs_plugins_core_appstream_time_rebuild (GsPluginLoader *plugin_loader,
+                                        guint           n_files,
+                                        const gchar    *comment,
+                                        gdouble        *elapsed_out,
+                                        gdouble        *cpu_out)
+{
+	GsPlugin *plugin;
+	clock_t cpu_start = 0;
+	gdouble elapsed = 0.0;
+	gdouble cpu = 0.0;
+	gint n_changed = 0;
+	gulong handler_id;
+	g_autoptr(GError) error = NULL;
+
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "appstream");
+	g_assert_nonnull (plugin);
+	handler_id = g_signal_connect (plugin, "metadata-changed",
+				       G_CALLBACK (gs_plugins_core_metadata_changed_cb),
+				       &n_changed);
+
+	for (guint i = 0; i < n_files; i++) {
+		g_autofree gchar *basename = g_strdup_printf ("org.example.App%u.desktop", i);
+		g_autofree gchar *filename = NULL;
+		g_autofree gchar *contents = NULL;
+
+		filename = g_build_filename (g_getenv ("GS_SELF_TEST_APPSTREAM_DESKTOP_DIR"),
+					     basename, NULL);
+		contents = gs_plugins_core_desktop_file_new (i, comment);
+		g_file_set_contents (filename, contents, -1, &error);
+		g_assert_no_error (error);
+	}
+
+	for (guint i = 0; i < 100 && g_atomic_int_get (&n_changed) == 0; i++) {
+		g_autoptr(GsPluginJob) plugin_job = NULL;
+		gboolean ret;
+
+		g_usleep (G_USEC_PER_SEC / 20);
+		gs_test_flush_main_context ();
+
+		plugin_job = gs_plugin_job_refresh_metadata_new (G_MAXUINT64,
+								 GS_PLUGIN_REFRESH_METADATA_FLAGS_NONE);
+		g_test_timer_start ();
+		cpu_start = clock ();
+		ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+		cpu = (gdouble) (clock () - cpu_start) / CLOCKS_PER_SEC;
+		elapsed = g_test_timer_elapsed ();
+		gs_test_flush_main_context ();
+		g_assert_no_error (error);
+		g_assert_true (ret);
+	}
+
+	g_signal_handler_disconnect (plugin, handler_id);
+
+	*elapsed_out = elapsed;
+	*cpu_out = cpu;
+	return (g_atomic_int_get (&n_changed) > 0);
+}
+
+static void
+gs_plugins_core_appstream_rebuild_perf_func (GsPluginLoader *plugin_loader)
+{
+	gdouble full_elapsed, full_cpu;
+	gdouble incremental_elapsed, incremental_cpu;
+
+	/* changing every desktop file recompiles all their layers */
+	if (!gs_plugins_core_appstream_time_rebuild (plugin_loader, N_PERF_DESKTOP_FILES,
+						     "Changed comment",
+						     &full_elapsed, &full_cpu)) {
+		g_test_skip ("File monitor did not notice the changed files");
+		return;
+	}
+	g_test_message ("Rebuild after changing all %u desktop files: %.3fs (%.3fs CPU)",
+			(guint) N_PERF_DESKTOP_FILES, full_elapsed, full_cpu);
+
+	/* the layers compile concurrently, so more CPU time than wall clock
+	 * time passes if there is more than one CPU to run them on */
+	g_test_maximized_result (full_cpu / full_elapsed,
+				 "Parallel speedup of a full rebuild on %u CPUs: %.2f",
+				 g_get_num_processors (), full_cpu / full_elapsed);
+	if (g_get_num_processors () > 1)
+		g_assert_cmpfloat (full_cpu / full_elapsed, >, 1.0);
+
+	/* changing one only recompiles the layer it is in */
+	if (!gs_plugins_core_appstream_time_rebuild (plugin_loader, 1, "Changed again",
+						     &incremental_elapsed, &incremental_cpu)) {
+		g_test_skip ("File monitor did not notice the changed file");
+		return;
+	}
+	g_test_minimized_result (incremental_elapsed,
+				 "Rebuild after changing 1 of %u desktop files: %.3fs (%.3fs CPU)",
+				 (guint) N_PERF_DESKTOP_FILES, incremental_elapsed, incremental_cpu);
+
+	/* the layers are compiled in parallel, so compare the work done rather
+	 * than the wall clock time, which is about the same on a machine with
+	 * a CPU for every layer */
+	g_assert_cmpfloat (incremental_cpu, <, full_cpu);
+}
+
 int
 main (int argc, char **argv)
 {
 	g_autofree gchar *tmp_root = NULL;
+	g_autofree gchar *data_dir = NULL;
+	g_autofree gchar *inherit_metainfo_filename = NULL;
+	g_autofree gchar *inherit_desktop_filename = NULL;
 	gboolean ret;
 	int retval;
 	g_autofree gchar *os_release_filename = NULL;
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GsPluginLoader) plugin_loader = NULL;
 	const gchar *xml;
+	const gchar *inherit_metainfo;
+	const gchar *inherit_desktop;
 
 	/* While we use %G_TEST_OPTION_ISOLATE_DIRS to create temporary directories
 	 * for each of the tests, we want to use the system MIME registry, assuming
@@ -247,6 +509,44 @@ main (int argc, char **argv)
 		"</components>\n";
 	g_setenv ("GS_SELF_TEST_APPSTREAM_XML", xml, TRUE);
 
+	inherit_metainfo = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<component type=\"desktop-application\">\n"
+		"  <id>org.example.Inherit</id>\n"
+		"  <name>Inherit</name>\n"
+		"  <summary>Inherits its icon</summary>\n"
+		"  <launchable type=\"desktop-id\">org.example.InheritLauncher.desktop</launchable>\n"
+		"</component>\n";
+	inherit_desktop = "[Desktop Entry]\n"
+		"Type=Application\n"
+		"Name=Inherit\n"
+		"Exec=inherit\n"
+		"Icon=system-file-manager\n";
+
+	/* installed metainfo and desktop files; this is outside the cache
+	 * directory, which the tests clear */
+	data_dir = g_dir_make_tmp ("gnome-software-core-data-XXXXXX", NULL);
+	g_assert_nonnull (data_dir);
+	inherit_metainfo_filename = g_build_filename (data_dir, "org.example.Inherit.metainfo.xml", NULL);
+	g_file_set_contents (inherit_metainfo_filename, inherit_metainfo, -1, &error);
+	g_assert_no_error (error);
+	inherit_desktop_filename = g_build_filename (data_dir, "org.example.InheritLauncher.desktop", NULL);
+	g_file_set_contents (inherit_desktop_filename, inherit_desktop, -1, &error);
+	g_assert_no_error (error);
+
+	/* and a large number of desktop files for the perf tests */
+	if (g_test_perf ()) {
+		for (guint i = 0; i < N_PERF_DESKTOP_FILES; i++) {
+			g_autofree gchar *basename = g_strdup_printf ("org.example.App%u.desktop", i);
+			g_autofree gchar *filename = g_build_filename (data_dir, basename, NULL);
+			g_autofree gchar *contents = gs_plugins_core_desktop_file_new (i, "Example app");
+
+			g_file_set_contents (filename, contents, -1, &error);
+			g_assert_no_error (error);
+		}
+	}
+	g_setenv ("GS_SELF_TEST_APPSTREAM_DESKTOP_DIR", data_dir, TRUE);
+	g_setenv ("GS_SELF_TEST_APPSTREAM_METAINFO_DIR", data_dir, TRUE);
+
 	/* we can only load this once per process */
 	plugin_loader = gs_plugin_loader_new (NULL, NULL);
 	gs_plugin_loader_add_location (plugin_loader, LOCALPLUGINDIR);
@@ -262,16 +562,27 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/gnome-software/plugins/core/search-repo-name",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_core_search_repo_name_func);
+	g_test_add_data_func ("/gnome-software/plugins/core/appstream-search-index",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_core_appstream_search_index_func);
 	g_test_add_data_func ("/gnome-software/plugins/core/os-release",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_core_os_release_func);
 	g_test_add_data_func ("/gnome-software/plugins/core/generic-updates",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_core_generic_updates_func);
+	g_test_add_data_func ("/gnome-software/plugins/core/inherit-desktop-icon",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_core_inherit_desktop_icon_func);
+	if (g_test_perf ())
+		g_test_add_data_func ("/gnome-software/plugins/core/appstream-rebuild-perf",
+				      plugin_loader,
+				      (GTestDataFunc) gs_plugins_core_appstream_rebuild_perf_func);
 	retval = g_test_run ();
 
 	/* Clean up. */
 	gs_utils_rmtree (tmp_root, NULL);
+	gs_utils_rmtree (data_dir, NULL);
 
 	return retval;
 }
@@ -297,8 +297,15 @@ gs_plugin_url_to_app (GsPlugin *plugin,
 	if (g_strcmp0 (scheme, "dummy") != 0)
 		return TRUE;
 
-	/* create app */
+	/* used by the self tests */
 	path = gs_utils_get_url_path (url);
+	if (g_strcmp0 (path, "error.desktop") == 0) {
+		g_set_error (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_FAILED,
+			     "failed to convert %s", url);
+		return FALSE;
+	}
+
+	/* create app */
 	app = gs_app_new (path);
 	gs_app_set_management_plugin (app, plugin);
 	gs_app_set_metadata (app, "GnomeSoftware::Creator",
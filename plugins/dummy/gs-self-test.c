@@ -697,6 +697,383 @@ gs_plugins_dummy_limit_parallel_ops_func (GsPluginLoader *plugin_loader)
 	gs_plugin_loader_set_max_parallel_ops (plugin_loader, 0);
 }
 
+static void
+gs_plugins_dummy_scheduler_lanes_func (GsPluginLoader *plugin_loader)
+{
+	const gchar *keywords[2] = { "zeus", NULL };
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GsAppQuery) query = NULL;
+	g_autoptr(GsPluginJob) plugin_job1 = NULL;
+	g_autoptr(GsPluginJob) plugin_job2 = NULL;
+	g_autoptr(GsPluginJob) plugin_job3 = NULL;
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	g_autoptr(GAsyncResult) result1 = NULL;
+	g_autoptr(GAsyncResult) result2 = NULL;
+	g_autoptr(GAsyncResult) result3 = NULL;
+	g_autoptr(GError) local_error = NULL;
+	gint64 start_time;
+
+	/* allow only one operation at a time per lane, and hold back the
+	 * background ops while an interactive one is queued or running */
+	gs_plugin_loader_set_max_parallel_ops (plugin_loader, 1);
+	gs_plugin_loader_set_preempt_background_ops (plugin_loader, TRUE);
+
+	g_main_context_push_thread_default (context);
+
+	/* two background refreshes, each of which takes 3.1s in the dummy
+	 * plugin */
+	start_time = g_get_monotonic_time ();
+	plugin_job1 = gs_plugin_job_refresh_metadata_new (0, GS_PLUGIN_REFRESH_METADATA_FLAGS_NONE);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job1, NULL,
+					    async_result_cb, &result1);
+	plugin_job2 = gs_plugin_job_refresh_metadata_new (0, GS_PLUGIN_REFRESH_METADATA_FLAGS_NONE);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job2, NULL,
+					    async_result_cb, &result2);
+
+	/* a search the user is waiting for overtakes the refreshes */
+	query = gs_app_query_new ("keywords", keywords,
+				  "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+				  "dedupe-flags", GS_PLUGIN_JOB_DEDUPE_FLAGS_DEFAULT,
+				  NULL);
+	plugin_job3 = gs_plugin_job_list_apps_new (query, GS_PLUGIN_LIST_APPS_FLAGS_INTERACTIVE);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job3, NULL,
+					    async_result_cb, &result3);
+
+	while (result3 == NULL)
+		g_main_context_iteration (context, TRUE);
+	g_assert_null (result1);
+	g_assert_null (result2);
+
+	/* the refreshes run asynchronously, so they don’t hold the lane’s
+	 * only thread while they run, and run concurrently rather than in
+	 * turn */
+	while (result1 == NULL || result2 == NULL)
+		g_main_context_iteration (context, TRUE);
+	g_assert_cmpint (g_get_monotonic_time () - start_time, <, 6 * G_USEC_PER_SEC);
+
+	g_main_context_pop_thread_default (context);
+
+	gs_test_flush_main_context ();
+
+	list = gs_plugin_loader_job_process_finish (plugin_loader, result3, &local_error);
+	g_assert_no_error (local_error);
+	g_assert_nonnull (list);
+	g_assert_cmpint (gs_app_list_length (list), >=, 1);
+	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 0)), ==, "zeus.desktop");
+
+	gs_plugin_loader_job_action_finish (plugin_loader, result1, &local_error);
+	g_assert_no_error (local_error);
+
+	gs_plugin_loader_job_action_finish (plugin_loader, result2, &local_error);
+	g_assert_no_error (local_error);
+
+	/* set the default max parallel ops */
+	gs_plugin_loader_set_max_parallel_ops (plugin_loader, 0);
+	gs_plugin_loader_set_preempt_background_ops (plugin_loader, FALSE);
+}
+
+static void
+gs_plugins_dummy_refine_coalesce_func (GsPluginLoader *plugin_loader)
+{
+	GsJobManager *job_manager = gs_plugin_loader_get_job_manager (plugin_loader);
+	guint n_coalesced = gs_job_manager_get_n_refines_coalesced (job_manager);
+	guint n_merged = gs_job_manager_get_n_refines_merged (job_manager);
+	GsPlugin *plugin;
+	g_autoptr(GsApp) app = NULL;
+	g_autoptr(GsPluginJob) plugin_job1 = NULL;
+	g_autoptr(GsPluginJob) plugin_job2 = NULL;
+	g_autoptr(GsPluginJob) plugin_job3 = NULL;
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	GAsyncResult *results[3] = { NULL, };
+
+	app = gs_app_new ("chiron.desktop");
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "dummy");
+	gs_app_set_management_plugin (app, plugin);
+
+	g_main_context_push_thread_default (context);
+
+	/* the second refine asks for less than the first, so is attached to
+	 * it; the third asks for more, so is run as a follow-up */
+	plugin_job1 = gs_plugin_job_refine_new_for_app (app,
+							GS_PLUGIN_REFINE_FLAGS_REQUIRE_DESCRIPTION |
+							GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job1, NULL,
+					    async_result_cb, &results[0]);
+	plugin_job2 = gs_plugin_job_refine_new_for_app (app,
+							GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job2, NULL,
+					    async_result_cb, &results[1]);
+	plugin_job3 = gs_plugin_job_refine_new_for_app (app,
+							GS_PLUGIN_REFINE_FLAGS_REQUIRE_URL);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job3, NULL,
+					    async_result_cb, &results[2]);
+
+	for (guint i = 0; i < G_N_ELEMENTS (results); i++) {
+		while (results[i] == NULL)
+			g_main_context_iteration (context, TRUE);
+	}
+
+	g_main_context_pop_thread_default (context);
+
+	gs_test_flush_main_context ();
+
+	for (guint i = 0; i < G_N_ELEMENTS (results); i++) {
+		g_autoptr(GsAppList) list = NULL;
+		g_autoptr(GError) local_error = NULL;
+
+		list = gs_plugin_loader_job_process_finish (plugin_loader, results[i], &local_error);
+		g_assert_no_error (local_error);
+		g_assert_nonnull (list);
+		g_assert_cmpint (gs_app_list_length (list), ==, 1);
+		g_assert_true (gs_app_list_index (list, 0) == app);
+		g_clear_object (&results[i]);
+	}
+
+	g_assert_cmpint (gs_job_manager_get_n_refines_coalesced (job_manager), ==, n_coalesced + 1);
+	g_assert_cmpint (gs_job_manager_get_n_refines_merged (job_manager), ==, n_merged + 1);
+	g_assert_cmpstr (gs_app_get_license (app), ==, "GPL-2.0-or-later");
+	g_assert_cmpstr (gs_app_get_url (app, AS_URL_KIND_HOMEPAGE), ==, "http://www.test.org/");
+}
+
+static void
+gs_plugins_dummy_refine_coalesce_cancel_func (GsPluginLoader *plugin_loader)
+{
+	GsJobManager *job_manager = gs_plugin_loader_get_job_manager (plugin_loader);
+	guint n_coalesced = gs_job_manager_get_n_refines_coalesced (job_manager);
+	GsPlugin *plugin;
+	g_autoptr(GsApp) app = NULL;
+	g_autoptr(GsPluginJob) plugin_job1 = NULL;
+	g_autoptr(GsPluginJob) plugin_job2 = NULL;
+	g_autoptr(GsPluginJob) plugin_job3 = NULL;
+	g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GError) local_error = NULL;
+	GAsyncResult *results[3] = { NULL, };
+
+	app = gs_app_new ("chiron.desktop");
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "dummy");
+	gs_app_set_management_plugin (app, plugin);
+
+	g_main_context_push_thread_default (context);
+
+	/* the second refine is attached to the first; the third is
+	 * interactive, so isn’t attached to the first, which isn’t */
+	plugin_job1 = gs_plugin_job_refine_new_for_app (app, GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job1, cancellable,
+					    async_result_cb, &results[0]);
+	plugin_job2 = gs_plugin_job_refine_new_for_app (app, GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job2, NULL,
+					    async_result_cb, &results[1]);
+	plugin_job3 = gs_plugin_job_refine_new_for_app (app, GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE);
+	gs_plugin_job_set_interactive (plugin_job3, TRUE);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job3, NULL,
+					    async_result_cb, &results[2]);
+
+	/* cancelling the first caller doesn’t cancel the refine for the
+	 * second */
+	g_cancellable_cancel (cancellable);
+
+	for (guint i = 0; i < G_N_ELEMENTS (results); i++) {
+		while (results[i] == NULL)
+			g_main_context_iteration (context, TRUE);
+	}
+
+	g_main_context_pop_thread_default (context);
+
+	gs_test_flush_main_context ();
+
+	list = gs_plugin_loader_job_process_finish (plugin_loader, results[0], &local_error);
+	g_assert_error (local_error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_CANCELLED);
+	g_assert_null (list);
+	g_clear_error (&local_error);
+
+	for (guint i = 1; i < G_N_ELEMENTS (results); i++) {
+		list = gs_plugin_loader_job_process_finish (plugin_loader, results[i], &local_error);
+		g_assert_no_error (local_error);
+		g_assert_nonnull (list);
+		g_assert_cmpint (gs_app_list_length (list), ==, 1);
+		g_assert_true (gs_app_list_index (list, 0) == app);
+		g_clear_object (&list);
+	}
+
+	for (guint i = 0; i < G_N_ELEMENTS (results); i++)
+		g_clear_object (&results[i]);
+
+	g_assert_cmpint (gs_job_manager_get_n_refines_coalesced (job_manager), ==, n_coalesced + 1);
+	g_assert_cmpstr (gs_app_get_license (app), ==, "GPL-2.0-or-later");
+}
+
+static void
+gs_plugins_dummy_concurrent_jobs_func (GsPluginLoader *plugin_loader)
+{
+	const guint n_jobs = 200;
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	g_autoptr(GPtrArray) jobs = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autofree GAsyncResult **results = g_new0 (GAsyncResult *, n_jobs);
+
+	g_main_context_push_thread_default (context);
+
+	/* start all the jobs at once; each of them has to run the plugins
+	 * and then refine its results twice */
+	for (guint i = 0; i < n_jobs; i++) {
+		GsPluginJob *plugin_job;
+
+		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_URL_TO_APP,
+						 "search", "dummy://chiron.desktop",
+						 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+						 NULL);
+		g_ptr_array_add (jobs, plugin_job);
+		gs_plugin_loader_job_process_async (plugin_loader,
+						    plugin_job,
+						    NULL,
+						    async_result_cb,
+						    &results[i]);
+	}
+
+	/* wait for all of them to finish */
+	for (guint i = 0; i < n_jobs; i++) {
+		while (results[i] == NULL)
+			g_main_context_iteration (context, TRUE);
+	}
+
+	g_main_context_pop_thread_default (context);
+
+	gs_test_flush_main_context ();
+
+	for (guint i = 0; i < n_jobs; i++) {
+		g_autoptr(GsAppList) list = NULL;
+		g_autoptr(GError) local_error = NULL;
+
+		list = gs_plugin_loader_job_process_finish (plugin_loader, results[i], &local_error);
+		g_assert_no_error (local_error);
+		g_assert_nonnull (list);
+		g_assert_cmpint (gs_app_list_length (list), ==, 1);
+		g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 0)), ==, "chiron.desktop");
+		g_clear_object (&results[i]);
+	}
+}
+
+static void
+gs_plugins_dummy_url_to_app_parallel_func (GsPluginLoader *plugin_loader)
+{
+	/* more jobs than the shared pool has threads for running plugins, so
+	 * the plugins of some jobs have to queue behind the others */
+	const guint n_jobs = 4 * MAX (g_get_num_processors (), 2);
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	g_autoptr(GPtrArray) jobs = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autofree GAsyncResult **results = g_new0 (GAsyncResult *, n_jobs);
+
+	g_main_context_push_thread_default (context);
+
+	/* the appstream and dummy plugins both convert URLs, so they are run
+	 * in parallel; every other job fails in the dummy plugin */
+	for (guint i = 0; i < n_jobs; i++) {
+		GsPluginJob *plugin_job;
+
+		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_URL_TO_APP,
+						 "search", (i % 2 == 0) ? "dummy://chiron.desktop" : "dummy://error.desktop",
+						 "propagate-error", TRUE,
+						 NULL);
+		g_ptr_array_add (jobs, plugin_job);
+		gs_plugin_loader_job_process_async (plugin_loader,
+						    plugin_job,
+						    NULL,
+						    async_result_cb,
+						    &results[i]);
+	}
+
+	for (guint i = 0; i < n_jobs; i++) {
+		while (results[i] == NULL)
+			g_main_context_iteration (context, TRUE);
+	}
+
+	g_main_context_pop_thread_default (context);
+
+	gs_test_flush_main_context ();
+
+	/* the results of a failed plugin are not merged with the others */
+	for (guint i = 0; i < n_jobs; i++) {
+		g_autoptr(GsAppList) list = NULL;
+		g_autoptr(GError) local_error = NULL;
+
+		list = gs_plugin_loader_job_process_finish (plugin_loader, results[i], &local_error);
+		if (i % 2 == 0) {
+			g_assert_no_error (local_error);
+			g_assert_nonnull (list);
+			g_assert_cmpint (gs_app_list_length (list), ==, 1);
+			g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 0)), ==, "chiron.desktop");
+		} else {
+			g_assert_error (local_error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_FAILED);
+			g_assert_null (list);
+		}
+		g_clear_object (&results[i]);
+	}
+}
+
+static void
+gs_plugins_dummy_list_apps_cache_func (GsPluginLoader *plugin_loader)
+{
+	GsPlugin *plugin;
+	guint generation = 0;
+	guint generation_old = 0;
+	g_autoptr(GsApp) app = gs_app_new ("chiron.desktop");
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsAppList) cached = NULL;
+
+	gs_app_list_add (list, app);
+	gs_plugin_loader_invalidate_list_apps_cache (plugin_loader);
+
+	/* a miss still returns the generation to add the results with */
+	cached = gs_plugin_loader_lookup_list_apps_cache (plugin_loader, "test-key", &generation);
+	g_assert_null (cached);
+	gs_plugin_loader_add_list_apps_cache (plugin_loader, "test-key", generation, list);
+
+	/* a hit returns a copy of the list */
+	cached = gs_plugin_loader_lookup_list_apps_cache (plugin_loader, "test-key", NULL);
+	g_assert_nonnull (cached);
+	g_assert_true (cached != list);
+	g_assert_cmpuint (gs_app_list_length (cached), ==, 1);
+	g_assert_true (gs_app_list_index (cached, 0) == app);
+	g_clear_object (&cached);
+
+	/* a plugin signalling that its data changed invalidates the cache */
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "dummy");
+	g_assert_nonnull (plugin);
+	gs_plugin_metadata_changed (plugin);
+	cached = gs_plugin_loader_lookup_list_apps_cache (plugin_loader, "test-key", NULL);
+	g_assert_null (cached);
+
+	/* results from a query started before the invalidation are dropped */
+	generation_old = generation;
+	gs_plugin_loader_add_list_apps_cache (plugin_loader, "test-key", generation_old, list);
+	cached = gs_plugin_loader_lookup_list_apps_cache (plugin_loader, "test-key", &generation);
+	g_assert_null (cached);
+	g_assert_cmpuint (generation, !=, generation_old);
+
+	/* the least recently used entries are evicted, so looking one up keeps
+	 * it in the cache */
+	for (guint i = 0; i < GS_PLUGIN_LOADER_LIST_APPS_CACHE_MAX_ENTRIES; i++) {
+		g_autofree gchar *key = g_strdup_printf ("test-key-%u", i);
+		gs_plugin_loader_add_list_apps_cache (plugin_loader, key, generation, list);
+	}
+	cached = gs_plugin_loader_lookup_list_apps_cache (plugin_loader, "test-key-0", NULL);
+	g_assert_nonnull (cached);
+	g_clear_object (&cached);
+	gs_plugin_loader_add_list_apps_cache (plugin_loader, "test-key-new", generation, list);
+
+	cached = gs_plugin_loader_lookup_list_apps_cache (plugin_loader, "test-key-1", NULL);
+	g_assert_null (cached);
+	cached = gs_plugin_loader_lookup_list_apps_cache (plugin_loader, "test-key-0", NULL);
+	g_assert_nonnull (cached);
+	g_clear_object (&cached);
+	cached = gs_plugin_loader_lookup_list_apps_cache (plugin_loader, "test-key-new", NULL);
+	g_assert_nonnull (cached);
+	g_clear_object (&cached);
+
+	gs_plugin_loader_invalidate_list_apps_cache (plugin_loader);
+}
+
 static void
 gs_plugins_dummy_app_size_calc_func (GsPluginLoader *loader)
 {
@@ -937,6 +1314,24 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/gnome-software/plugins/dummy/limit-parallel-ops",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_limit_parallel_ops_func);
+	g_test_add_data_func ("/gnome-software/plugins/dummy/scheduler-lanes",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_scheduler_lanes_func);
+	g_test_add_data_func ("/gnome-software/plugins/dummy/refine-coalesce",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_refine_coalesce_func);
+	g_test_add_data_func ("/gnome-software/plugins/dummy/refine-coalesce-cancel",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_refine_coalesce_cancel_func);
+	g_test_add_data_func ("/gnome-software/plugins/dummy/concurrent-jobs",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_concurrent_jobs_func);
+	g_test_add_data_func ("/gnome-software/plugins/dummy/list-apps-cache",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_list_apps_cache_func);
+	g_test_add_data_func ("/gnome-software/plugins/dummy/url-to-app-parallel",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_url_to_app_parallel_func);
 	g_test_add_data_func ("/gnome-software/plugins/dummy/app-size-calc",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_app_size_calc_func);
@@ -29,7 +29,9 @@
 
 #include <config.h>
 
+#include <errno.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <xmlb.h>
 
 #include "gs-appstream.h"
@@ -50,8 +52,14 @@ struct _GsFlatpak {
 	GFileMonitor		*monitor;
 	AsComponentScope	 scope;
 	GsPlugin		*plugin;
-	XbSilo			*silo;
+	GPtrArray		*silos;  /* (owned) (nullable) (element-type XbSilo) (lock silo_lock); one per remote, then installed apps */
+	GHashTable		*remote_silos;  /* (owned) (element-type utf8 GsFlatpakRemoteSilo) (lock silo_lock); only replaced with silo_rebuild_mutex held */
+	gboolean		 silos_valid;  /* (lock silo_lock) */
 	GRWLock			 silo_lock;
+	guint			 silo_generation;  /* (lock silo_lock) */
+	GMutex			 silo_rebuild_mutex;  /* held while building a new silo */
+	GHashTable		*remote_sizes;  /* (owned) (nullable) (element-type utf8 GsFlatpakRemoteSizes) (lock remote_sizes_mutex); NULL until loaded */
+	GMutex			 remote_sizes_mutex;
 	gchar			*id;
 	guint			 changed_id;
 	GHashTable		*app_silos;
@@ -65,6 +73,71 @@ struct _GsFlatpak {
 
 G_DEFINE_TYPE (GsFlatpak, gs_flatpak, G_TYPE_OBJECT)
 
+/* A compiled silo for the AppStream data of a single remote */
+typedef struct {
+	gchar		*key;  /* (nullable); from gs_flatpak_get_remote_silo_key() */
+	XbSilo		*silo;  /* (owned) */
+} GsFlatpakRemoteSilo;
+
+static GsFlatpakRemoteSilo *
+gs_flatpak_remote_silo_new (const gchar *key,
+			    XbSilo *silo)
+{
+	GsFlatpakRemoteSilo *remote_silo = g_new0 (GsFlatpakRemoteSilo, 1);
+	remote_silo->key = g_strdup (key);
+	remote_silo->silo = g_object_ref (silo);
+	return remote_silo;
+}
+
+static void
+gs_flatpak_remote_silo_free (GsFlatpakRemoteSilo *remote_silo)
+{
+	g_free (remote_silo->key);
+	g_object_unref (remote_silo->silo);
+	g_free (remote_silo);
+}
+
+/* The sizes of a single ref, from the summary of its remote */
+typedef struct {
+	guint64		 download_size;
+	guint64		 installed_size;
+} GsFlatpakRefSize;
+
+/* The sizes of all the refs in a single remote */
+typedef struct {
+	gchar		*key;  /* from gs_flatpak_get_remote_sizes_key(), or empty */
+	GHashTable	*refs;  /* (owned) (element-type utf8 GsFlatpakRefSize) */
+} GsFlatpakRemoteSizes;
+
+static GsFlatpakRemoteSizes *
+gs_flatpak_remote_sizes_new (const gchar *key)
+{
+	GsFlatpakRemoteSizes *remote_sizes = g_new0 (GsFlatpakRemoteSizes, 1);
+	remote_sizes->key = g_strdup (key);
+	remote_sizes->refs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	return remote_sizes;
+}
+
+static void
+gs_flatpak_remote_sizes_free (GsFlatpakRemoteSizes *remote_sizes)
+{
+	g_free (remote_sizes->key);
+	g_hash_table_unref (remote_sizes->refs);
+	g_free (remote_sizes);
+}
+
+static void
+gs_flatpak_remote_sizes_add (GsFlatpakRemoteSizes *remote_sizes,
+			     const gchar *ref,
+			     guint64 download_size,
+			     guint64 installed_size)
+{
+	GsFlatpakRefSize *ref_size = g_new0 (GsFlatpakRefSize, 1);
+	ref_size->download_size = download_size;
+	ref_size->installed_size = installed_size;
+	g_hash_table_replace (remote_sizes->refs, g_strdup (ref), ref_size);
+}
+
 static void
 gs_plugin_refine_item_scope (GsFlatpak *self, GsApp *app)
 {
@@ -615,10 +688,14 @@ gs_flatpak_create_source (GsFlatpak *self, FlatpakRemote *xremote)
 static void
 gs_flatpak_invalidate_silo (GsFlatpak *self)
 {
+	/* the per-remote silos are kept, and reused on the next rebuild if
+	 * their AppStream data hasn’t changed */
 	g_rw_lock_writer_lock (&self->silo_lock);
-	if (self->silo != NULL)
-		xb_silo_invalidate (self->silo);
+	self->silos_valid = FALSE;
+	self->silo_generation++;
 	g_rw_lock_writer_unlock (&self->silo_lock);
+
+	gs_plugin_metadata_changed (self->plugin);
 }
 
 static void
@@ -1147,31 +1224,13 @@ gs_flatpak_rescan_installed (GsFlatpak *self,
 	}
 }
 
-static gboolean
-gs_flatpak_rescan_appstream_store (GsFlatpak *self,
-				   gboolean interactive,
-				   GCancellable *cancellable,
-				   GError **error)
+static XbBuilder *
+gs_flatpak_builder_new (void)
 {
 	const gchar *const *locales = g_get_language_names ();
-	g_autofree gchar *blobfn = NULL;
-	g_autoptr(GFile) file = NULL;
-	g_autoptr(GPtrArray) xremotes = NULL;
-	g_autoptr(GRWLockReaderLocker) reader_locker = NULL;
-	g_autoptr(GRWLockWriterLocker) writer_locker = NULL;
 	g_autoptr(XbBuilder) builder = NULL;
 	g_autoptr(GMainContext) old_thread_default = NULL;
 
-	reader_locker = g_rw_lock_reader_locker_new (&self->silo_lock);
-	/* everything is okay */
-	if (self->silo != NULL && xb_silo_is_valid (self->silo))
-		return TRUE;
-	g_clear_pointer (&reader_locker, g_rw_lock_reader_locker_free);
-
-	/* drat! silo needs regenerating */
-	writer_locker = g_rw_lock_writer_locker_new (&self->silo_lock);
-	g_clear_object (&self->silo);
-
 	/* FIXME: https://gitlab.gnome.org/GNOME/gnome-software/-/issues/1422 */
 	old_thread_default = g_main_context_ref_thread_default ();
 	if (old_thread_default == g_main_context_default ())
@@ -1181,7 +1240,6 @@ gs_flatpak_rescan_appstream_store (GsFlatpak *self,
 	builder = xb_builder_new ();
 	if (old_thread_default != NULL)
 		g_main_context_push_thread_default (old_thread_default);
-	g_clear_pointer (&old_thread_default, g_main_context_unref);
 
 	/* verbose profiling */
 	if (g_getenv ("GS_XMLB_VERBOSE") != NULL) {
@@ -1194,6 +1252,156 @@ gs_flatpak_rescan_appstream_store (GsFlatpak *self,
 	for (guint i = 0; locales[i] != NULL; i++)
 		xb_builder_add_locale (builder, locales[i]);
 
+	return g_steal_pointer (&builder);
+}
+
+static XbSilo *
+gs_flatpak_builder_ensure (GsFlatpak *self,
+			   XbBuilder *builder,
+			   const gchar *basename,
+			   GCancellable *cancellable,
+			   GError **error)
+{
+	g_autofree gchar *blobfn = NULL;
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GMainContext) old_thread_default = NULL;
+	g_autoptr(XbSilo) silo = NULL;
+
+	/* create per-user cache */
+	blobfn = gs_utils_get_cache_filename (gs_flatpak_get_id (self),
+					      basename,
+					      GS_UTILS_CACHE_FLAG_WRITEABLE |
+					      GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+					      error);
+	if (blobfn == NULL)
+		return NULL;
+	file = g_file_new_for_path (blobfn);
+	g_debug ("ensuring %s", blobfn);
+
+	/* FIXME: https://gitlab.gnome.org/GNOME/gnome-software/-/issues/1422 */
+	old_thread_default = g_main_context_ref_thread_default ();
+	if (old_thread_default == g_main_context_default ())
+		g_clear_pointer (&old_thread_default, g_main_context_unref);
+	if (old_thread_default != NULL)
+		g_main_context_pop_thread_default (old_thread_default);
+
+	silo = xb_builder_ensure (builder, file,
+				  XB_BUILDER_COMPILE_FLAG_IGNORE_INVALID |
+				  XB_BUILDER_COMPILE_FLAG_SINGLE_LANG,
+				  cancellable, error);
+
+	if (old_thread_default != NULL)
+		g_main_context_push_thread_default (old_thread_default);
+
+	return g_steal_pointer (&silo);
+}
+
+/* Returns a string which changes whenever the silo for @xremote would need
+ * rebuilding: the checksum of its AppStream data, plus the filters applied to
+ * it. Returns %NULL if there is no AppStream data yet. */
+static gchar *
+gs_flatpak_get_remote_silo_key (FlatpakRemote *xremote)
+{
+	g_autofree gchar *appstream_dir_fn = NULL;
+	g_autofree gchar *checksum = NULL;
+	g_autofree gchar *main_ref = NULL;
+	g_autofree gchar *default_branch = NULL;
+	g_autoptr(GFile) appstream_dir = NULL;
+	g_autoptr(GSettings) settings = NULL;
+
+	appstream_dir = flatpak_remote_get_appstream_dir (xremote, NULL);
+	if (appstream_dir == NULL)
+		return NULL;
+
+	/* the ‘active’ directory is a symlink to the deployed commit */
+	appstream_dir_fn = g_file_get_path (appstream_dir);
+	checksum = g_file_read_link (appstream_dir_fn, NULL);
+	if (checksum == NULL) {
+		g_autofree gchar *appstream_fn = NULL;
+		GStatBuf buf;
+
+		appstream_fn = g_build_filename (appstream_dir_fn, "appstream.xml.gz", NULL);
+		if (g_stat (appstream_fn, &buf) != 0)
+			return NULL;
+		checksum = g_strdup_printf ("%" G_GINT64_FORMAT, (gint64) buf.st_mtime);
+	}
+
+	if (flatpak_remote_get_noenumerate (xremote))
+		main_ref = flatpak_remote_get_main_ref (xremote);
+	settings = g_settings_new ("org.gnome.software");
+	if (g_settings_get_boolean (settings, "filter-default-branch"))
+		default_branch = flatpak_remote_get_default_branch (xremote);
+
+	return g_strdup_printf ("%s:%s:%s", checksum,
+				main_ref != NULL ? main_ref : "",
+				default_branch != NULL ? default_branch : "");
+}
+
+/* Deletes the cached blobs of remotes which no longer exist, as each remote has
+ * a blob of its own. The blobs of disabled remotes are kept, so re-enabling
+ * one doesn’t need its silo to be compiled again. */
+static void
+gs_flatpak_prune_remote_blobs (GsFlatpak *self,
+			       GPtrArray *xremotes)
+{
+	const gchar *fn;
+	g_autofree gchar *blobfn = NULL;
+	g_autofree gchar *cachedir = NULL;
+	g_autoptr(GDir) dir = NULL;
+	g_autoptr(GHashTable) current = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	blobfn = gs_utils_get_cache_filename (gs_flatpak_get_id (self), "components.xmlb",
+					      GS_UTILS_CACHE_FLAG_WRITEABLE, NULL);
+	if (blobfn == NULL)
+		return;
+	cachedir = g_path_get_dirname (blobfn);
+	dir = g_dir_open (cachedir, 0, NULL);
+	if (dir == NULL)
+		return;
+
+	for (guint i = 0; i < xremotes->len; i++) {
+		FlatpakRemote *xremote = g_ptr_array_index (xremotes, i);
+		g_hash_table_add (current, g_strdup_printf ("components-%s.xmlb",
+							    flatpak_remote_get_name (xremote)));
+	}
+
+	while ((fn = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *filename = NULL;
+
+		if (!g_str_has_prefix (fn, "components-") ||
+		    !g_str_has_suffix (fn, ".xmlb") ||
+		    g_hash_table_contains (current, fn))
+			continue;
+
+		filename = g_build_filename (cachedir, fn, NULL);
+		g_debug ("Removing stale blob %s", filename);
+		if (g_unlink (filename) != 0)
+			g_debug ("Failed to remove %s: %s", filename, g_strerror (errno));
+	}
+}
+
+/* Builds new silos for all the remotes and installed refs, reusing the silo of
+ * any remote whose AppStream data hasn’t changed. This doesn’t touch the
+ * published silos, so it’s done without holding @self->silo_lock.
+ *
+ * Must be called with @self->silo_rebuild_mutex held. */
+static gboolean
+gs_flatpak_build_silos (GsFlatpak *self,
+			gboolean interactive,
+			GPtrArray **silos_out,
+			GHashTable **remote_silos_out,
+			GCancellable *cancellable,
+			GError **error)
+{
+	g_autoptr(GPtrArray) xremotes = NULL;
+	g_autoptr(GPtrArray) silos = g_ptr_array_new_with_free_func (g_object_unref);
+	g_autoptr(GHashTable) remote_silos = NULL;
+	g_autoptr(XbBuilder) builder = NULL;
+	g_autoptr(XbSilo) installed_silo = NULL;
+
+	remote_silos = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      g_free, (GDestroyNotify) gs_flatpak_remote_silo_free);
+
 	/* go through each remote adding metadata */
 	xremotes = flatpak_installation_list_remotes (gs_flatpak_get_installation (self, interactive),
 						      cancellable,
@@ -1204,52 +1412,169 @@ gs_flatpak_rescan_appstream_store (GsFlatpak *self,
 	}
 	for (guint i = 0; i < xremotes->len; i++) {
 		g_autoptr(GError) error_local = NULL;
+		g_autoptr(XbBuilder) remote_builder = NULL;
+		g_autoptr(XbSilo) remote_silo = NULL;
+		g_autofree gchar *key = NULL;
+		g_autofree gchar *basename = NULL;
 		FlatpakRemote *xremote = g_ptr_array_index (xremotes, i);
+		const gchar *remote_name = flatpak_remote_get_name (xremote);
+		GsFlatpakRemoteSilo *old;
+
 		if (flatpak_remote_get_disabled (xremote))
 			continue;
-		g_debug ("found remote %s",
-			 flatpak_remote_get_name (xremote));
-		if (!gs_flatpak_add_apps_from_xremote (self, builder, xremote, interactive, cancellable, &error_local)) {
-			g_debug ("Failed to add apps from remote ‘%s’; skipping: %s",
-				 flatpak_remote_get_name (xremote), error_local->message);
-			if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
-				gs_flatpak_error_convert (error);
-				return FALSE;
+		g_debug ("found remote %s", remote_name);
+
+		/* reuse the existing silo if the AppStream data is unchanged;
+		 * holding silo_rebuild_mutex means @self->remote_silos can’t
+		 * be replaced while reading it */
+		key = gs_flatpak_get_remote_silo_key (xremote);
+		old = g_hash_table_lookup (self->remote_silos, remote_name);
+		if (key != NULL && old != NULL &&
+		    g_strcmp0 (key, old->key) == 0 &&
+		    xb_silo_is_valid (old->silo)) {
+			g_debug ("reusing silo for remote %s", remote_name);
+			remote_silo = g_object_ref (old->silo);
+		} else {
+			remote_builder = gs_flatpak_builder_new ();
+			basename = g_strdup_printf ("components-%s.xmlb", remote_name);
+			if (gs_flatpak_add_apps_from_xremote (self, remote_builder, xremote, interactive, cancellable, &error_local))
+				remote_silo = gs_flatpak_builder_ensure (self, remote_builder, basename, cancellable, &error_local);
+			if (remote_silo == NULL) {
+				g_debug ("Failed to add apps from remote ‘%s’; skipping: %s",
+					 remote_name, error_local->message);
+				if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+					gs_flatpak_error_convert (error);
+					return FALSE;
+				}
+				continue;
 			}
+
+			/* the AppStream data may have been refreshed while building */
+			g_free (key);
+			key = gs_flatpak_get_remote_silo_key (xremote);
 		}
+
+		g_ptr_array_add (silos, g_object_ref (remote_silo));
+		g_hash_table_insert (remote_silos, g_strdup (remote_name),
+				     gs_flatpak_remote_silo_new (key, remote_silo));
 	}
 
-	/* add any installed files without AppStream info */
+	/* add any installed files without AppStream info; this is cheap to
+	 * recompose, and xb_builder_ensure() reuses the blob if unchanged */
+	builder = gs_flatpak_builder_new ();
 	gs_flatpak_rescan_installed (self, builder, cancellable, error);
+	installed_silo = gs_flatpak_builder_ensure (self, builder, "components.xmlb", cancellable, error);
+	if (installed_silo == NULL)
+		return FALSE;
+	g_ptr_array_add (silos, g_steal_pointer (&installed_silo));
 
-	/* create per-user cache */
-	blobfn = gs_utils_get_cache_filename (gs_flatpak_get_id (self),
-					      "components.xmlb",
-					      GS_UTILS_CACHE_FLAG_WRITEABLE |
-					      GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
-					      error);
-	if (blobfn == NULL)
+	gs_flatpak_prune_remote_blobs (self, xremotes);
+
+	*silos_out = g_steal_pointer (&silos);
+	*remote_silos_out = g_steal_pointer (&remote_silos);
+
+	return TRUE;
+}
+
+/* Must be called with a lock held on @self->silo_lock */
+static gboolean
+gs_flatpak_silos_are_valid_unlocked (GsFlatpak *self)
+{
+	if (self->silos == NULL || !self->silos_valid)
 		return FALSE;
-	file = g_file_new_for_path (blobfn);
-	g_debug ("ensuring %s", blobfn);
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!xb_silo_is_valid (g_ptr_array_index (self->silos, i)))
+			return FALSE;
+	}
+	return TRUE;
+}
 
-	/* FIXME: https://gitlab.gnome.org/GNOME/gnome-software/-/issues/1422 */
-	old_thread_default = g_main_context_ref_thread_default ();
-	if (old_thread_default == g_main_context_default ())
-		g_clear_pointer (&old_thread_default, g_main_context_unref);
-	if (old_thread_default != NULL)
-		g_main_context_pop_thread_default (old_thread_default);
+/* Returns the silo to look up apps from @origin in. Apps from unknown remotes
+ * use the silo of installed apps, which has no origin set.
+ *
+ * Must be called with a lock held on @self->silo_lock */
+static XbSilo *
+gs_flatpak_get_silo_for_origin_unlocked (GsFlatpak *self,
+					 const gchar *origin)
+{
+	GsFlatpakRemoteSilo *remote_silo = NULL;
 
-	self->silo = xb_builder_ensure (builder, file,
-					XB_BUILDER_COMPILE_FLAG_IGNORE_INVALID |
-					XB_BUILDER_COMPILE_FLAG_SINGLE_LANG,
-					cancellable, error);
+	if (origin != NULL)
+		remote_silo = g_hash_table_lookup (self->remote_silos, origin);
+	if (remote_silo != NULL)
+		return remote_silo->silo;
+	return g_ptr_array_index (self->silos, self->silos->len - 1);
+}
 
-	if (old_thread_default != NULL)
-		g_main_context_push_thread_default (old_thread_default);
+static gboolean
+gs_flatpak_rescan_appstream_store (GsFlatpak *self,
+				   gboolean interactive,
+				   GCancellable *cancellable,
+				   GError **error)
+{
+	g_autoptr(GRWLockReaderLocker) reader_locker = NULL;
+	g_autoptr(GRWLockWriterLocker) writer_locker = NULL;
+	g_autoptr(GPtrArray) silos = NULL;
+	g_autoptr(GHashTable) remote_silos = NULL;
+	gboolean have_old_silos;
+	guint generation;
 
-	if (self->silo == NULL)
+	reader_locker = g_rw_lock_reader_locker_new (&self->silo_lock);
+	/* everything is okay */
+	if (gs_flatpak_silos_are_valid_unlocked (self))
+		return TRUE;
+	have_old_silos = (self->silos != NULL);
+	g_clear_pointer (&reader_locker, g_rw_lock_reader_locker_free);
+
+	/* drat! silos need regenerating; if another thread is already doing
+	 * that, keep using the old silos rather than waiting for it */
+	if (have_old_silos) {
+		if (!g_mutex_trylock (&self->silo_rebuild_mutex))
+			return TRUE;
+	} else {
+		g_mutex_lock (&self->silo_rebuild_mutex);
+	}
+
+	/* they may have been rebuilt while waiting */
+	reader_locker = g_rw_lock_reader_locker_new (&self->silo_lock);
+	if (gs_flatpak_silos_are_valid_unlocked (self)) {
+		g_mutex_unlock (&self->silo_rebuild_mutex);
+		return TRUE;
+	}
+	generation = self->silo_generation;
+	g_clear_pointer (&reader_locker, g_rw_lock_reader_locker_free);
+
+	/* readers keep using the old silos while the new ones are built */
+	if (!gs_flatpak_build_silos (self, interactive, &silos, &remote_silos,
+				     cancellable, error)) {
+		g_mutex_unlock (&self->silo_rebuild_mutex);
 		return FALSE;
+	}
+
+	/* index them now, rather than on the first search; a failure here is
+	 * reported again by that search */
+	for (guint i = 0; i < silos->len; i++) {
+		g_autoptr(GError) error_local = NULL;
+		if (!gs_appstream_build_search_indexes (g_ptr_array_index (silos, i), &error_local))
+			g_debug ("failed to build search index: %s", error_local->message);
+	}
+
+	/* publish them; the writer lock is only held for the swap, and waits
+	 * for any readers still using the old silos */
+	writer_locker = g_rw_lock_writer_locker_new (&self->silo_lock);
+	g_clear_pointer (&self->silos, g_ptr_array_unref);
+	self->silos = g_steal_pointer (&silos);
+	g_clear_pointer (&self->remote_silos, g_hash_table_unref);
+	self->remote_silos = g_steal_pointer (&remote_silos);
+
+	/* invalidated while building, so this may already be out of date;
+	 * use it for now but rebuild on the next query */
+	self->silos_valid = (self->silo_generation == generation);
+	g_clear_pointer (&writer_locker, g_rw_lock_writer_locker_free);
+	g_mutex_unlock (&self->silo_rebuild_mutex);
+
+	/* any results computed from the old silos are now stale */
+	gs_plugin_metadata_changed (self->plugin);
 
 	/* success */
 	return TRUE;
@@ -1296,7 +1621,7 @@ ensure_flatpak_silo_with_locker (GsFlatpak            *self,
 
 	*locker = g_rw_lock_reader_locker_new (&self->silo_lock);
 
-	while (self->silo == NULL) {
+	while (self->silos == NULL) {
 		g_clear_pointer (locker, g_rw_lock_reader_locker_free);
 
 		if (!gs_flatpak_rescan_appstream_store (self, interactive, cancellable, error)) {
@@ -1305,7 +1630,7 @@ ensure_flatpak_silo_with_locker (GsFlatpak            *self,
 		}
 
 		/* At this point either rescan_appstream_store() returned an error or it successfully
-		 * initialised self->silo. There is the possibility that another thread will invalidate
+		 * initialised self->silos. There is the possibility that another thread will invalidate
 		 * the silo before we regain the lock. If so, we’ll have to rescan again. */
 		*locker = g_rw_lock_reader_locker_new (&self->silo_lock);
 	}
@@ -1388,6 +1713,308 @@ gs_flatpak_progress_cb (const gchar *status,
 	gs_plugin_status_update (phelper->plugin, phelper->app, plugin_status);
 }
 
+/* Bump this if the format of the remote sizes cache file changes */
+#define GS_FLATPAK_REMOTE_SIZES_VERSION 3
+#define GS_FLATPAK_REMOTE_SIZES_TYPE "(ua{s(sa(stt))})"
+
+static gchar *
+gs_flatpak_get_remote_sizes_filename (GsFlatpak *self,
+				      GError **error)
+{
+	return gs_utils_get_cache_filename (gs_flatpak_get_id (self),
+					    "remote-sizes.gvariant",
+					    GS_UTILS_CACHE_FLAG_WRITEABLE |
+					    GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+					    error);
+}
+
+/* Must be called with @self->remote_sizes_mutex held */
+static void
+gs_flatpak_load_remote_sizes_unlocked (GsFlatpak *self)
+{
+	const gchar *remote_name;
+	const gchar *key;
+	guint32 version;
+	GVariantIter *refs_iter;
+	g_autofree gchar *filename = NULL;
+	g_autoptr(GMappedFile) mapped = NULL;
+	g_autoptr(GBytes) bytes = NULL;
+	g_autoptr(GVariant) variant = NULL;
+	g_autoptr(GVariantIter) remotes_iter = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	self->remote_sizes = g_hash_table_new_full (g_str_hash, g_str_equal,
+						    g_free, (GDestroyNotify) gs_flatpak_remote_sizes_free);
+	if (self->flags & GS_FLATPAK_FLAG_IS_TEMPORARY)
+		return;
+
+	filename = gs_flatpak_get_remote_sizes_filename (self, &error_local);
+	if (filename != NULL)
+		mapped = g_mapped_file_new (filename, FALSE, &error_local);
+	if (mapped == NULL) {
+		if (!g_error_matches (error_local, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_debug ("failed to load remote sizes: %s", error_local->message);
+		return;
+	}
+
+	bytes = g_mapped_file_get_bytes (mapped);
+	variant = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (GS_FLATPAK_REMOTE_SIZES_TYPE),
+								 bytes, FALSE));
+	g_variant_get (variant, "(ua{s(sa(stt))})", &version, &remotes_iter);
+	if (version != GS_FLATPAK_REMOTE_SIZES_VERSION) {
+		g_debug ("ignoring remote sizes cache version %u", version);
+		return;
+	}
+
+	/* each remote is checked against its current key on first use */
+	while (g_variant_iter_next (remotes_iter, "{&s(&sa(stt))}", &remote_name, &key, &refs_iter)) {
+		GsFlatpakRemoteSizes *remote_sizes = gs_flatpak_remote_sizes_new (key);
+		const gchar *ref;
+		guint64 download_size;
+		guint64 installed_size;
+
+		while (g_variant_iter_next (refs_iter, "(&stt)", &ref, &download_size, &installed_size))
+			gs_flatpak_remote_sizes_add (remote_sizes, ref, download_size, installed_size);
+		g_variant_iter_free (refs_iter);
+
+		g_hash_table_replace (self->remote_sizes, g_strdup (remote_name), remote_sizes);
+	}
+}
+
+/* Must be called with @self->remote_sizes_mutex held */
+static void
+gs_flatpak_save_remote_sizes_unlocked (GsFlatpak *self)
+{
+	GHashTableIter iter;
+	const gchar *remote_name;
+	GsFlatpakRemoteSizes *remote_sizes;
+	GVariantBuilder remotes_builder;
+	g_autofree gchar *filename = NULL;
+	g_autoptr(GVariant) variant = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	if (self->flags & GS_FLATPAK_FLAG_IS_TEMPORARY)
+		return;
+
+	g_variant_builder_init (&remotes_builder, G_VARIANT_TYPE ("a{s(sa(stt))}"));
+	g_hash_table_iter_init (&iter, self->remote_sizes);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &remote_name, (gpointer *) &remote_sizes)) {
+		GHashTableIter refs_iter;
+		const gchar *ref;
+		const GsFlatpakRefSize *ref_size;
+		GVariantBuilder refs_builder;
+
+		g_variant_builder_init (&refs_builder, G_VARIANT_TYPE ("a(stt)"));
+		g_hash_table_iter_init (&refs_iter, remote_sizes->refs);
+		while (g_hash_table_iter_next (&refs_iter, (gpointer *) &ref, (gpointer *) &ref_size))
+			g_variant_builder_add (&refs_builder, "(stt)", ref,
+					       ref_size->download_size, ref_size->installed_size);
+		g_variant_builder_add (&remotes_builder, "{s(sa(stt))}",
+				       remote_name, remote_sizes->key, &refs_builder);
+	}
+	variant = g_variant_ref_sink (g_variant_new (GS_FLATPAK_REMOTE_SIZES_TYPE,
+						     (guint32) GS_FLATPAK_REMOTE_SIZES_VERSION,
+						     &remotes_builder));
+
+	filename = gs_flatpak_get_remote_sizes_filename (self, &error_local);
+	if (filename == NULL ||
+	    !g_file_set_contents (filename, g_variant_get_data (variant),
+				  (gssize) g_variant_get_size (variant), &error_local))
+		g_debug ("failed to save remote sizes: %s", error_local->message);
+}
+
+/* Returns a string which changes whenever the metadata of @remote_name is
+ * refreshed, or %NULL if it never has been. Flatpak updates the summary, which
+ * the sizes are read from, whenever it updates the AppStream data of a remote,
+ * so the modification time of the AppStream timestamp file is used. */
+static gchar *
+gs_flatpak_get_remote_sizes_key (FlatpakInstallation *installation,
+				 const gchar *remote_name,
+				 GCancellable *cancellable)
+{
+	g_autoptr(FlatpakRemote) xremote = NULL;
+	g_autoptr(GFile) timestamp_file = NULL;
+	g_autoptr(GFileInfo) info = NULL;
+
+	xremote = flatpak_installation_get_remote_by_name (installation, remote_name,
+							   cancellable, NULL);
+	if (xremote == NULL)
+		return NULL;
+
+	timestamp_file = flatpak_remote_get_appstream_timestamp (xremote, NULL);
+	info = g_file_query_info (timestamp_file,
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+				  G_FILE_QUERY_INFO_NONE,
+				  cancellable, NULL);
+	if (info == NULL)
+		return NULL;
+
+	return g_strdup_printf ("%" G_GUINT64_FORMAT ".%06u",
+				g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+				g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC));
+}
+
+/* Re-reads the sizes of all the refs in @remote_name in one go, from the
+ * summary which flatpak has cached locally, so looking them up later doesn’t
+ * need a summary lookup per ref. The summary is read without holding
+ * @self->remote_sizes_mutex, and the new sizes are swapped into the cache
+ * afterwards. */
+static void
+gs_flatpak_update_remote_sizes (GsFlatpak *self,
+				FlatpakInstallation *installation,
+				const gchar *remote_name,
+				const gchar *key,
+				GCancellable *cancellable)
+{
+	GsFlatpakRemoteSizes *remote_sizes;
+	g_autoptr(GPtrArray) xrefs = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	xrefs = flatpak_installation_list_remote_refs_sync_full (installation,
+								 remote_name,
+								 FLATPAK_QUERY_FLAGS_ONLY_CACHED,
+								 cancellable,
+								 &error_local);
+	if (xrefs == NULL) {
+		g_debug ("failed to get cached sizes for %s: %s",
+			 remote_name, error_local->message);
+		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			return;
+	}
+
+	/* if the summary couldn’t be read, fall back to looking up each ref
+	 * until the remote is refreshed */
+	remote_sizes = gs_flatpak_remote_sizes_new (key);
+	for (guint i = 0; xrefs != NULL && i < xrefs->len; i++) {
+		FlatpakRemoteRef *xref = g_ptr_array_index (xrefs, i);
+		guint64 download_size = flatpak_remote_ref_get_download_size (xref);
+		guint64 installed_size = flatpak_remote_ref_get_installed_size (xref);
+		g_autofree gchar *ref = NULL;
+
+		/* not in the summary */
+		if (download_size == 0 && installed_size == 0)
+			continue;
+
+		ref = flatpak_ref_format_ref (FLATPAK_REF (xref));
+		gs_flatpak_remote_sizes_add (remote_sizes, ref, download_size, installed_size);
+	}
+
+	locker = g_mutex_locker_new (&self->remote_sizes_mutex);
+	if (self->remote_sizes == NULL)
+		gs_flatpak_load_remote_sizes_unlocked (self);
+	g_hash_table_replace (self->remote_sizes, g_strdup (remote_name), remote_sizes);
+	if (xrefs != NULL) {
+		g_debug ("cached sizes of %u refs in %s",
+			 g_hash_table_size (remote_sizes->refs), remote_name);
+		gs_flatpak_save_remote_sizes_unlocked (self);
+	}
+}
+
+/* Re-reads the sizes of all the refs in @remote_name after its metadata has
+ * been refreshed. */
+static void
+gs_flatpak_refresh_remote_sizes (GsFlatpak *self,
+				 FlatpakInstallation *installation,
+				 const gchar *remote_name,
+				 GCancellable *cancellable)
+{
+	g_autofree gchar *key = gs_flatpak_get_remote_sizes_key (installation, remote_name, cancellable);
+
+	gs_flatpak_update_remote_sizes (self, installation, remote_name,
+					(key != NULL) ? key : "",
+					cancellable);
+}
+
+/* Returns the cached sizes for @remote_name if they were read from the
+ * summary when its key was @key.
+ *
+ * Must be called with @self->remote_sizes_mutex held. */
+static GsFlatpakRemoteSizes *
+gs_flatpak_get_valid_remote_sizes_unlocked (GsFlatpak *self,
+					    const gchar *remote_name,
+					    const gchar *key)
+{
+	GsFlatpakRemoteSizes *remote_sizes;
+
+	if (self->remote_sizes == NULL)
+		gs_flatpak_load_remote_sizes_unlocked (self);
+
+	remote_sizes = g_hash_table_lookup (self->remote_sizes, remote_name);
+	if (remote_sizes == NULL || !g_str_equal (remote_sizes->key, key))
+		return NULL;
+
+	return remote_sizes;
+}
+
+/* Must be called with @self->remote_sizes_mutex held, as @remote_sizes is
+ * owned by the cache. */
+static gboolean
+gs_flatpak_remote_sizes_lookup_unlocked (GsFlatpakRemoteSizes *remote_sizes,
+					 const gchar *ref,
+					 guint64 *download_size_out,
+					 guint64 *installed_size_out)
+{
+	const GsFlatpakRefSize *ref_size;
+
+	if (remote_sizes == NULL)
+		return FALSE;
+	ref_size = g_hash_table_lookup (remote_sizes->refs, ref);
+	if (ref_size == NULL)
+		return FALSE;
+
+	if (download_size_out != NULL)
+		*download_size_out = ref_size->download_size;
+	if (installed_size_out != NULL)
+		*installed_size_out = ref_size->installed_size;
+
+	return TRUE;
+}
+
+/* Looks up the sizes of @xref in @remote_name from the cache. The key of the
+ * remote is checked on every lookup, and the cached sizes for it are re-read
+ * from its summary first if it has been refreshed since they were cached, by
+ * gnome-software or by anything else.
+ *
+ * Returns %FALSE if the sizes aren’t known, in which case the caller should
+ * fall back to flatpak_installation_fetch_remote_size_sync(). */
+static gboolean
+gs_flatpak_lookup_remote_size (GsFlatpak *self,
+			       FlatpakInstallation *installation,
+			       const gchar *remote_name,
+			       FlatpakRef *xref,
+			       guint64 *download_size_out,
+			       guint64 *installed_size_out,
+			       GCancellable *cancellable)
+{
+	GsFlatpakRemoteSizes *remote_sizes;
+	gboolean ret;
+	g_autofree gchar *ref = flatpak_ref_format_ref (xref);
+	g_autofree gchar *key = NULL;
+
+	key = gs_flatpak_get_remote_sizes_key (installation, remote_name, cancellable);
+	if (key == NULL)
+		key = g_strdup ("");
+
+	/* re-read the sizes if the remote has been refreshed */
+	g_mutex_lock (&self->remote_sizes_mutex);
+	remote_sizes = gs_flatpak_get_valid_remote_sizes_unlocked (self, remote_name, key);
+	g_mutex_unlock (&self->remote_sizes_mutex);
+	if (remote_sizes == NULL)
+		gs_flatpak_update_remote_sizes (self, installation, remote_name,
+						key, cancellable);
+
+	g_mutex_lock (&self->remote_sizes_mutex);
+	remote_sizes = gs_flatpak_get_valid_remote_sizes_unlocked (self, remote_name, key);
+	ret = gs_flatpak_remote_sizes_lookup_unlocked (remote_sizes, ref,
+						       download_size_out,
+						       installed_size_out);
+	g_mutex_unlock (&self->remote_sizes_mutex);
+
+	return ret;
+}
+
 static gboolean
 gs_flatpak_refresh_appstream_remote (GsFlatpak *self,
 				     const gchar *remote_name,
@@ -1526,6 +2153,10 @@ gs_flatpak_refresh_appstream (GsFlatpak     *self,
 		file = flatpak_remote_get_appstream_dir (xremote, NULL);
 		appstream_fn = g_file_get_path (file);
 		g_debug ("using AppStream metadata found at: %s", appstream_fn);
+
+		/* the summary has been updated too */
+		gs_flatpak_refresh_remote_sizes (self, gs_flatpak_get_installation (self, interactive),
+						 remote_name, cancellable);
 	}
 
 	/* ensure the AppStream silo is up to date */
@@ -2136,13 +2767,20 @@ gs_flatpak_add_updates (GsFlatpak *self,
 
 			/* get the current download size */
 			if (gs_app_get_size_download (main_app, NULL) != GS_SIZE_TYPE_VALID) {
-				if (!flatpak_installation_fetch_remote_size_sync (installation,
-										  gs_app_get_origin (app),
-										  FLATPAK_REF (xref),
-										  &download_size,
-										  NULL,
-										  cancellable,
-										  &error_local)) {
+				if (gs_flatpak_lookup_remote_size (self, installation,
+								   gs_app_get_origin (app),
+								   FLATPAK_REF (xref),
+								   &download_size,
+								   NULL,
+								   cancellable)) {
+					gs_app_set_size_download (main_app, GS_SIZE_TYPE_VALID, download_size);
+				} else if (!flatpak_installation_fetch_remote_size_sync (installation,
+											 gs_app_get_origin (app),
+											 FLATPAK_REF (xref),
+											 &download_size,
+											 NULL,
+											 cancellable,
+											 &error_local)) {
 					g_warning ("failed to get download size: %s",
 						   error_local->message);
 					g_clear_error (&error_local);
@@ -3020,13 +3658,21 @@ gs_plugin_refine_item_size (GsFlatpak *self,
 		xref = gs_flatpak_create_fake_ref (app, error);
 		if (xref == NULL)
 			return FALSE;
-		ret = flatpak_installation_fetch_remote_size_sync (gs_flatpak_get_installation (self, interactive),
-								   gs_app_get_origin (app),
-								   xref,
-								   &download_size,
-								   &installed_size,
-								   cancellable,
-								   &error_local);
+		ret = gs_flatpak_lookup_remote_size (self,
+						     gs_flatpak_get_installation (self, interactive),
+						     gs_app_get_origin (app),
+						     xref,
+						     &download_size,
+						     &installed_size,
+						     cancellable);
+		if (!ret)
+			ret = flatpak_installation_fetch_remote_size_sync (gs_flatpak_get_installation (self, interactive),
+									   gs_app_get_origin (app),
+									   xref,
+									   &download_size,
+									   &installed_size,
+									   cancellable,
+									   &error_local);
 
 		if (!ret) {
 			/* This can happen when the remote is filtered */
@@ -3435,7 +4081,7 @@ gs_flatpak_refine_app_unlocked (GsFlatpak *self,
 		return FALSE;
 
 	/* always do AppStream properties */
-	if (!gs_flatpak_refine_appstream (self, app, self->silo, flags, interactive, cancellable, error))
+	if (!gs_flatpak_refine_appstream (self, app, gs_flatpak_get_silo_for_origin_unlocked (self, gs_app_get_origin (app)), flags, interactive, cancellable, error))
 		return FALSE;
 
 	/* AppStream sets the source to appname/arch/branch */
@@ -3462,7 +4108,7 @@ gs_flatpak_refine_app_unlocked (GsFlatpak *self,
 
 	/* if the state was changed, perhaps set the version from the release */
 	if (old_state != gs_app_get_state (app)) {
-		if (!gs_flatpak_refine_appstream (self, app, self->silo, flags, interactive, cancellable, error))
+		if (!gs_flatpak_refine_appstream (self, app, gs_flatpak_get_silo_for_origin_unlocked (self, gs_app_get_origin (app)), flags, interactive, cancellable, error))
 			return FALSE;
 	}
 
@@ -3621,8 +4267,7 @@ gs_flatpak_refine_wildcard (GsFlatpak *self, GsApp *app,
 {
 	const gchar *id;
 	g_autofree gchar *xpath = NULL;
-	g_autoptr(GError) error_local = NULL;
-	g_autoptr(GPtrArray) components = NULL;
+	g_autoptr(GPtrArray) silos = NULL;
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
 
 	GS_PROFILER_BEGIN_SCOPED (FlatpakRefineWildcard, "Flatpak (refine wildcard)", NULL);
@@ -3635,47 +4280,58 @@ gs_flatpak_refine_wildcard (GsFlatpak *self, GsApp *app,
 	if (!ensure_flatpak_silo_with_locker (self, &locker, interactive, cancellable, error))
 		return FALSE;
 
-	GS_PROFILER_BEGIN_SCOPED (FlatpakRefineWildcardQuerySilo, "Flatpak (query silo)", NULL);
-
-	/* find all apps when matching any prefixes */
+	/* the lock is dropped while refining each new app, so keep the current
+	 * set of silos alive until done */
+	silos = g_ptr_array_ref (self->silos);
 	xpath = g_strdup_printf ("components/component/id[text()='%s']/..", id);
-	components = xb_silo_query (self->silo, xpath, 0, &error_local);
-	if (components == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return TRUE;
-		g_propagate_error (error, g_steal_pointer (&error_local));
-		return FALSE;
-	}
 
-	GS_PROFILER_END_SCOPED (FlatpakRefineWildcardQuerySilo);
+	for (guint j = 0; j < silos->len; j++) {
+		XbSilo *silo = g_ptr_array_index (silos, j);
+		g_autoptr(GError) error_local = NULL;
+		g_autoptr(GPtrArray) components = NULL;
 
-	gs_flatpak_ensure_remote_title (self, interactive, cancellable);
+		GS_PROFILER_BEGIN_SCOPED (FlatpakRefineWildcardQuerySilo, "Flatpak (query silo)", NULL);
 
-	GS_PROFILER_BEGIN_SCOPED (FlatpakRefineWildcardGenerateApps, "Flatpak (create app)", NULL);
-	for (guint i = 0; i < components->len; i++) {
-		XbNode *component = g_ptr_array_index (components, i);
-		g_autoptr(GsApp) new = NULL;
+		/* find all apps when matching any prefixes */
+		components = xb_silo_query (silo, xpath, 0, &error_local);
 
-		GS_PROFILER_BEGIN_SCOPED (FlatpakRefineWildcardCreateAppstreamApp, "Flatpak (create Appstream app)", NULL);
-		new = gs_appstream_create_app (self->plugin, self->silo, component, error);
-		GS_PROFILER_END_SCOPED (FlatpakRefineWildcardCreateAppstreamApp);
+		GS_PROFILER_END_SCOPED (FlatpakRefineWildcardQuerySilo);
 
-		if (new == NULL)
+		if (components == NULL) {
+			if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+				continue;
+			g_propagate_error (error, g_steal_pointer (&error_local));
 			return FALSE;
-		gs_flatpak_claim_app (self, new);
+		}
 
-		GS_PROFILER_BEGIN_SCOPED (FlatpakRefineWildcardRefineNewApp, "Flatpak (refine new app)", NULL);
-		if (!gs_flatpak_refine_app_unlocked (self, new, refine_flags, interactive, &locker, cancellable, error))
-			return FALSE;
-		GS_PROFILER_END_SCOPED (FlatpakRefineWildcardRefineNewApp);
+		gs_flatpak_ensure_remote_title (self, interactive, cancellable);
 
-		GS_PROFILER_BEGIN_SCOPED (FlatpakRefineWildcardSubsumeMetadata, "Flatpak (subsume metadata)", NULL);
-		gs_app_subsume_metadata (new, app);
-		GS_PROFILER_END_SCOPED (FlatpakRefineWildcardSubsumeMetadata);
+		GS_PROFILER_BEGIN_SCOPED (FlatpakRefineWildcardGenerateApps, "Flatpak (create app)", NULL);
+		for (guint i = 0; i < components->len; i++) {
+			XbNode *component = g_ptr_array_index (components, i);
+			g_autoptr(GsApp) new = NULL;
+
+			GS_PROFILER_BEGIN_SCOPED (FlatpakRefineWildcardCreateAppstreamApp, "Flatpak (create Appstream app)", NULL);
+			new = gs_appstream_create_app (self->plugin, silo, component, error);
+			GS_PROFILER_END_SCOPED (FlatpakRefineWildcardCreateAppstreamApp);
+
+			if (new == NULL)
+				return FALSE;
+			gs_flatpak_claim_app (self, new);
 
-		gs_app_list_add (list, new);
+			GS_PROFILER_BEGIN_SCOPED (FlatpakRefineWildcardRefineNewApp, "Flatpak (refine new app)", NULL);
+			if (!gs_flatpak_refine_app_unlocked (self, new, refine_flags, interactive, &locker, cancellable, error))
+				return FALSE;
+			GS_PROFILER_END_SCOPED (FlatpakRefineWildcardRefineNewApp);
+
+			GS_PROFILER_BEGIN_SCOPED (FlatpakRefineWildcardSubsumeMetadata, "Flatpak (subsume metadata)", NULL);
+			gs_app_subsume_metadata (new, app);
+			GS_PROFILER_END_SCOPED (FlatpakRefineWildcardSubsumeMetadata);
+
+			gs_app_list_add (list, new);
+		}
+		GS_PROFILER_END_SCOPED (FlatpakRefineWildcardGenerateApps);
 	}
-	GS_PROFILER_END_SCOPED (FlatpakRefineWildcardGenerateApps);
 
 	GS_PROFILER_END_SCOPED (FlatpakRefineWildcard);
 
@@ -4213,16 +4869,18 @@ gs_flatpak_search (GsFlatpak *self,
 	if (!ensure_flatpak_silo_with_locker (self, &locker, interactive, cancellable, error))
 		return FALSE;
 
-	if (!gs_appstream_search (self->plugin, self->silo, values, list_tmp,
-				  cancellable, error))
-		return FALSE;
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!gs_appstream_search (self->plugin, g_ptr_array_index (self->silos, i),
+					  values, list_tmp, cancellable, error))
+			return FALSE;
+	}
 
 	gs_flatpak_ensure_remote_title (self, interactive, cancellable);
 
 	gs_flatpak_claim_app_list (self, list_tmp, interactive);
 	gs_app_list_add_list (list, list_tmp);
 
-	/* Also search silos from installed apps which were missing from self->silo */
+	/* Also search silos from installed apps which were missing from self->silos */
 	app_silo_locker = g_mutex_locker_new (&self->app_silos_mutex);
 	g_hash_table_iter_init (&iter, self->app_silos);
 	while (g_hash_table_iter_next (&iter, &key, &value)) {
@@ -4286,16 +4944,18 @@ gs_flatpak_search_developer_apps (GsFlatpak *self,
 	if (!ensure_flatpak_silo_with_locker (self, &locker, interactive, cancellable, error))
 		return FALSE;
 
-	if (!gs_appstream_search_developer_apps (self->plugin, self->silo, values, list_tmp,
-						 cancellable, error))
-		return FALSE;
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!gs_appstream_search_developer_apps (self->plugin, g_ptr_array_index (self->silos, i),
+							 values, list_tmp, cancellable, error))
+			return FALSE;
+	}
 
 	gs_flatpak_ensure_remote_title (self, interactive, cancellable);
 
 	gs_flatpak_claim_app_list (self, list_tmp, interactive);
 	gs_app_list_add_list (list, list_tmp);
 
-	/* Also search silos from installed apps which were missing from self->silo */
+	/* Also search silos from installed apps which were missing from self->silos */
 	app_silo_locker = g_mutex_locker_new (&self->app_silos_mutex);
 	g_hash_table_iter_init (&iter, self->app_silos);
 	while (g_hash_table_iter_next (&iter, &key, &value)) {
@@ -4354,9 +5014,14 @@ gs_flatpak_add_category_apps (GsFlatpak *self,
 	if (!ensure_flatpak_silo_with_locker (self, &locker, interactive, cancellable, error))
 		return FALSE;
 
-	return gs_appstream_add_category_apps (self->plugin, self->silo,
-					       category, list,
-					       cancellable, error);
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!gs_appstream_add_category_apps (self->plugin, g_ptr_array_index (self->silos, i),
+						     category, list,
+						     cancellable, error))
+			return FALSE;
+	}
+
+	return TRUE;
 }
 
 gboolean
@@ -4371,7 +5036,14 @@ gs_flatpak_refine_category_sizes (GsFlatpak     *self,
 	if (!ensure_flatpak_silo_with_locker (self, &locker, interactive, cancellable, error))
 		return FALSE;
 
-	return gs_appstream_refine_category_sizes (self->silo, list, cancellable, error);
+	/* the sizes are summed across all the silos */
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!gs_appstream_refine_category_sizes (g_ptr_array_index (self->silos, i),
+							 list, cancellable, error))
+			return FALSE;
+	}
+
+	return TRUE;
 }
 
 gboolean
@@ -4387,9 +5059,11 @@ gs_flatpak_add_popular (GsFlatpak *self,
 	if (!ensure_flatpak_silo_with_locker (self, &locker, interactive, cancellable, error))
 		return FALSE;
 
-	if (!gs_appstream_add_popular (self->silo, list_tmp,
-				       cancellable, error))
-		return FALSE;
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!gs_appstream_add_popular (g_ptr_array_index (self->silos, i), list_tmp,
+					       cancellable, error))
+			return FALSE;
+	}
 
 	gs_app_list_add_list (list, list_tmp);
 
@@ -4409,9 +5083,11 @@ gs_flatpak_add_featured (GsFlatpak *self,
 	if (!ensure_flatpak_silo_with_locker (self, &locker, interactive, cancellable, error))
 		return FALSE;
 
-	if (!gs_appstream_add_featured (self->silo, list_tmp,
-					cancellable, error))
-		return FALSE;
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!gs_appstream_add_featured (g_ptr_array_index (self->silos, i), list_tmp,
+						cancellable, error))
+			return FALSE;
+	}
 
 	gs_app_list_add_list (list, list_tmp);
 
@@ -4431,7 +5107,13 @@ gs_flatpak_add_deployment_featured (GsFlatpak *self,
 	if (!ensure_flatpak_silo_with_locker (self, &locker, interactive, cancellable, error))
 		return FALSE;
 
-	return gs_appstream_add_deployment_featured (self->silo, deployments, list, cancellable, error);
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!gs_appstream_add_deployment_featured (g_ptr_array_index (self->silos, i),
+							   deployments, list, cancellable, error))
+			return FALSE;
+	}
+
+	return TRUE;
 }
 
 gboolean
@@ -4448,9 +5130,11 @@ gs_flatpak_add_alternates (GsFlatpak *self,
 	if (!ensure_flatpak_silo_with_locker (self, &locker, interactive, cancellable, error))
 		return FALSE;
 
-	if (!gs_appstream_add_alternates (self->silo, app, list_tmp,
-					  cancellable, error))
-		return FALSE;
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!gs_appstream_add_alternates (g_ptr_array_index (self->silos, i), app, list_tmp,
+						  cancellable, error))
+			return FALSE;
+	}
 
 	gs_app_list_add_list (list, list_tmp);
 
@@ -4471,9 +5155,11 @@ gs_flatpak_add_recent (GsFlatpak *self,
 	if (!ensure_flatpak_silo_with_locker (self, &locker, interactive, cancellable, error))
 		return FALSE;
 
-	if (!gs_appstream_add_recent (self->plugin, self->silo, list_tmp, age,
-				      cancellable, error))
-		return FALSE;
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!gs_appstream_add_recent (self->plugin, g_ptr_array_index (self->silos, i),
+					      list_tmp, age, cancellable, error))
+			return FALSE;
+	}
 
 	gs_flatpak_claim_app_list (self, list_tmp, interactive);
 	gs_app_list_add_list (list, list_tmp);
@@ -4495,8 +5181,11 @@ gs_flatpak_url_to_app (GsFlatpak *self,
 	if (!ensure_flatpak_silo_with_locker (self, &locker, interactive, cancellable, error))
 		return FALSE;
 
-	if (!gs_appstream_url_to_app (self->plugin, self->silo, list_tmp, url, cancellable, error))
-		return FALSE;
+	for (guint i = 0; i < self->silos->len; i++) {
+		if (!gs_appstream_url_to_app (self->plugin, g_ptr_array_index (self->silos, i),
+					      list_tmp, url, cancellable, error))
+			return FALSE;
+	}
 
 	gs_flatpak_claim_app_list (self, list_tmp, interactive);
 	gs_app_list_add_list (list, list_tmp);
@@ -4546,8 +5235,8 @@ gs_flatpak_finalize (GObject *object)
 		g_signal_handler_disconnect (self->monitor, self->changed_id);
 		self->changed_id = 0;
 	}
-	if (self->silo != NULL)
-		g_object_unref (self->silo);
+	g_clear_pointer (&self->silos, g_ptr_array_unref);
+	g_clear_pointer (&self->remote_silos, g_hash_table_unref);
 	if (self->monitor != NULL)
 		g_object_unref (self->monitor);
 
@@ -4560,6 +5249,9 @@ gs_flatpak_finalize (GObject *object)
 	g_hash_table_unref (self->broken_remotes);
 	g_mutex_clear (&self->broken_remotes_mutex);
 	g_rw_lock_clear (&self->silo_lock);
+	g_mutex_clear (&self->silo_rebuild_mutex);
+	g_clear_pointer (&self->remote_sizes, g_hash_table_unref);
+	g_mutex_clear (&self->remote_sizes_mutex);
 	g_hash_table_unref (self->app_silos);
 	g_mutex_clear (&self->app_silos_mutex);
 	g_clear_pointer (&self->remote_title, g_hash_table_unref);
@@ -4578,9 +5270,13 @@ gs_flatpak_class_init (GsFlatpakClass *klass)
 static void
 gs_flatpak_init (GsFlatpak *self)
 {
-	/* XbSilo needs external locking as we destroy the silo and build a new
+	/* XbSilo needs external locking as we replace the silo with a new
 	 * one when something changes */
 	g_rw_lock_init (&self->silo_lock);
+	g_mutex_init (&self->silo_rebuild_mutex);
+	self->remote_silos = g_hash_table_new_full (g_str_hash, g_str_equal,
+						    g_free, (GDestroyNotify) gs_flatpak_remote_silo_free);
+	g_mutex_init (&self->remote_sizes_mutex);
 
 	g_mutex_init (&self->installed_refs_mutex);
 	self->installed_refs = NULL;
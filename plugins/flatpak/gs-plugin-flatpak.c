@@ -452,6 +452,111 @@ gs_plugin_flatpak_shutdown_finish (GsPlugin      *plugin,
 	return g_task_propagate_boolean (G_TASK (result), error);
 }
 
+/* Called by gs_plugin_flatpak_foreach_installation() for each installation,
+ * possibly in a thread of its own. Apps should be added to @list, which is
+ * %NULL if the caller isn’t collecting any. */
+typedef gboolean (*GsPluginFlatpakInstallationFunc) (GsFlatpak     *flatpak,
+						     GsAppList     *list,
+						     gpointer       user_data,
+						     GCancellable  *cancellable,
+						     GError       **error);
+
+typedef struct {
+	GsPluginFlatpakInstallationFunc	 func;
+	gpointer			 user_data;
+	GCancellable			*cancellable;
+} GsPluginFlatpakForeachData;
+
+typedef struct {
+	GsFlatpak	*flatpak;  /* (unowned) */
+	GsAppList	*list;  /* (owned) (nullable) */
+	gboolean	 ret;
+	GError		*error;  /* (owned) (nullable) */
+} GsPluginFlatpakForeachCall;
+
+static void
+gs_plugin_flatpak_foreach_call_cb (gpointer data,
+				   gpointer user_data)
+{
+	GsPluginFlatpakForeachCall *call = data;
+	GsPluginFlatpakForeachData *foreach_data = user_data;
+
+	call->ret = foreach_data->func (call->flatpak, call->list, foreach_data->user_data,
+					foreach_data->cancellable, &call->error);
+}
+
+/* Calls @func for each of the installations. If there are several, the calls
+ * run concurrently, so the whole operation only takes as long as the slowest
+ * installation. Each call gets a list of its own. The lists are added to @list
+ * afterwards in the order of the installations, so the results are the same
+ * as running the calls one after another.
+ *
+ * If any of the calls fail, the error from the first installation which
+ * failed is returned and @list is left unchanged. */
+static gboolean
+gs_plugin_flatpak_foreach_installation (GsPluginFlatpak                  *self,
+					GsAppList                        *list,
+					GsPluginFlatpakInstallationFunc   func,
+					gpointer                          user_data,
+					GCancellable                     *cancellable,
+					GError                          **error)
+{
+	GsPluginFlatpakForeachData foreach_data = { func, user_data, cancellable };
+	g_autofree GsPluginFlatpakForeachCall *calls = NULL;
+	guint n_calls = self->installations->len;
+	gboolean ret = TRUE;
+	GThreadPool *pool;
+
+	/* not worth a thread */
+	if (n_calls == 0)
+		return TRUE;
+	if (n_calls == 1)
+		return func (g_ptr_array_index (self->installations, 0), list,
+			     user_data, cancellable, error);
+
+	calls = g_new0 (GsPluginFlatpakForeachCall, n_calls);
+	for (guint i = 0; i < n_calls; i++) {
+		calls[i].flatpak = g_ptr_array_index (self->installations, i);
+		calls[i].list = (list != NULL) ? gs_app_list_new () : NULL;
+	}
+
+	/* the first installation is queried on this thread while the pool,
+	 * which shares its threads with the rest of the process, handles
+	 * the others */
+	pool = g_thread_pool_new (gs_plugin_flatpak_foreach_call_cb, &foreach_data,
+				  (gint) n_calls - 1, FALSE, NULL);
+	for (guint i = 1; i < n_calls; i++)
+		g_thread_pool_push (pool, &calls[i], NULL);
+	gs_plugin_flatpak_foreach_call_cb (&calls[0], &foreach_data);
+	g_thread_pool_free (pool, FALSE, TRUE);
+
+	for (guint i = 0; i < n_calls; i++) {
+		if (ret && !calls[i].ret) {
+			g_propagate_error (error, g_steal_pointer (&calls[i].error));
+			ret = FALSE;
+		}
+	}
+	for (guint i = 0; i < n_calls; i++) {
+		if (ret && list != NULL)
+			gs_app_list_add_list (list, calls[i].list);
+		g_clear_object (&calls[i].list);
+		g_clear_error (&calls[i].error);
+	}
+
+	return ret;
+}
+
+static gboolean
+gs_plugin_flatpak_add_sources_cb (GsFlatpak     *flatpak,
+				  GsAppList     *list,
+				  gpointer       user_data,
+				  GCancellable  *cancellable,
+				  GError       **error)
+{
+	gboolean interactive = GPOINTER_TO_INT (user_data);
+	return gs_flatpak_add_sources (flatpak, list, interactive, cancellable, error);
+}
+
 gboolean
 gs_plugin_add_sources (GsPlugin *plugin,
 		       GsAppList *list,
@@ -461,11 +566,23 @@ gs_plugin_add_sources (GsPlugin *plugin,
 	GsPluginFlatpak *self = GS_PLUGIN_FLATPAK (plugin);
 	gboolean interactive = gs_plugin_has_flags (plugin, GS_PLUGIN_FLAGS_INTERACTIVE);
 
-	for (guint i = 0; i < self->installations->len; i++) {
-		GsFlatpak *flatpak = g_ptr_array_index (self->installations, i);
-		if (!gs_flatpak_add_sources (flatpak, list, interactive, cancellable, error))
-			return FALSE;
-	}
+	return gs_plugin_flatpak_foreach_installation (self, list, gs_plugin_flatpak_add_sources_cb,
+						       GINT_TO_POINTER (interactive),
+						       cancellable, error);
+}
+
+static gboolean
+gs_plugin_flatpak_add_updates_cb (GsFlatpak     *flatpak,
+				  GsAppList     *list,
+				  gpointer       user_data,
+				  GCancellable  *cancellable,
+				  GError       **error)
+{
+	gboolean interactive = GPOINTER_TO_INT (user_data);
+	g_autoptr(GError) local_error = NULL;
+
+	if (!gs_flatpak_add_updates (flatpak, list, interactive, cancellable, &local_error))
+		g_debug ("Failed to get updates for '%s': %s", gs_flatpak_get_id (flatpak), local_error->message);
 	return TRUE;
 }
 
@@ -478,12 +595,9 @@ gs_plugin_add_updates (GsPlugin *plugin,
 	GsPluginFlatpak *self = GS_PLUGIN_FLATPAK (plugin);
 	gboolean interactive = gs_plugin_has_flags (plugin, GS_PLUGIN_FLAGS_INTERACTIVE);
 
-	for (guint i = 0; i < self->installations->len; i++) {
-		GsFlatpak *flatpak = g_ptr_array_index (self->installations, i);
-		g_autoptr(GError) local_error = NULL;
-		if (!gs_flatpak_add_updates (flatpak, list, interactive, cancellable, &local_error))
-			g_debug ("Failed to get updates for '%s': %s", gs_flatpak_get_id (flatpak), local_error->message);
-	}
+	gs_plugin_flatpak_foreach_installation (self, list, gs_plugin_flatpak_add_updates_cb,
+						GINT_TO_POINTER (interactive),
+						cancellable, NULL);
 	gs_plugin_cache_lookup_by_state (plugin, list, GS_APP_STATE_INSTALLING);
 	return TRUE;
 }
@@ -514,6 +628,22 @@ gs_plugin_flatpak_refresh_metadata_async (GsPlugin                     *plugin,
 				refresh_metadata_thread_cb, g_steal_pointer (&task));
 }
 
+static gboolean
+refresh_metadata_installation_cb (GsFlatpak     *flatpak,
+                                  GsAppList     *list,
+                                  gpointer       user_data,
+                                  GCancellable  *cancellable,
+                                  GError       **error)
+{
+	GsPluginRefreshMetadataData *data = user_data;
+	gboolean interactive = (data->flags & GS_PLUGIN_REFRESH_METADATA_FLAGS_INTERACTIVE);
+	g_autoptr(GError) local_error = NULL;
+
+	if (!gs_flatpak_refresh (flatpak, data->cache_age_secs, interactive, cancellable, &local_error))
+		g_debug ("Failed to refresh metadata for '%s': %s", gs_flatpak_get_id (flatpak), local_error->message);
+	return TRUE;
+}
+
 /* Run in @worker. */
 static void
 refresh_metadata_thread_cb (GTask        *task,
@@ -523,17 +653,11 @@ refresh_metadata_thread_cb (GTask        *task,
 {
 	GsPluginFlatpak *self = GS_PLUGIN_FLATPAK (source_object);
 	GsPluginRefreshMetadataData *data = task_data;
-	gboolean interactive = (data->flags & GS_PLUGIN_REFRESH_METADATA_FLAGS_INTERACTIVE);
 
 	assert_in_worker (self);
 
-	for (guint i = 0; i < self->installations->len; i++) {
-		g_autoptr(GError) local_error = NULL;
-		GsFlatpak *flatpak = g_ptr_array_index (self->installations, i);
-
-		if (!gs_flatpak_refresh (flatpak, data->cache_age_secs, interactive, cancellable, &local_error))
-			g_debug ("Failed to refresh metadata for '%s': %s", gs_flatpak_get_id (flatpak), local_error->message);
-	}
+	gs_plugin_flatpak_foreach_installation (self, NULL, refresh_metadata_installation_cb,
+						data, cancellable, NULL);
 
 	g_task_return_boolean (task, TRUE);
 }
@@ -679,6 +803,39 @@ gs_plugin_flatpak_refine_async (GsPlugin            *plugin,
 				refine_thread_cb, g_steal_pointer (&task));
 }
 
+static gboolean
+refine_wildcard_filter_cb (GsApp    *app,
+                           gpointer  user_data)
+{
+	return gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD);
+}
+
+typedef struct {
+	GsAppList		*wildcards;  /* (unowned) */
+	GsPluginRefineFlags	 flags;
+	gboolean		 interactive;
+} RefineWildcardData;
+
+static gboolean
+refine_wildcard_installation_cb (GsFlatpak     *flatpak,
+                                 GsAppList     *list,
+                                 gpointer       user_data,
+                                 GCancellable  *cancellable,
+                                 GError       **error)
+{
+	RefineWildcardData *data = user_data;
+
+	for (guint i = 0; i < gs_app_list_length (data->wildcards); i++) {
+		GsApp *app = gs_app_list_index (data->wildcards, i);
+
+		if (!gs_flatpak_refine_wildcard (flatpak, app, list, data->flags, data->interactive,
+						 cancellable, error))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
 /* Run in @worker. */
 static void
 refine_thread_cb (GTask        *task,
@@ -711,21 +868,15 @@ refine_thread_cb (GTask        *task,
 	 * (e.g. inserting an app in the list on every call results in
 	 * an infinite loop) */
 	app_list = gs_app_list_copy (list);
+	gs_app_list_filter (app_list, refine_wildcard_filter_cb, NULL);
 
-	for (guint j = 0; j < gs_app_list_length (app_list); j++) {
-		GsApp *app = gs_app_list_index (app_list, j);
-
-		if (!gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD))
-			continue;
-
-		for (guint i = 0; i < self->installations->len; i++) {
-			GsFlatpak *flatpak = g_ptr_array_index (self->installations, i);
+	if (gs_app_list_length (app_list) > 0) {
+		RefineWildcardData wildcard_data = { app_list, flags, interactive };
 
-			if (!gs_flatpak_refine_wildcard (flatpak, app, list, flags, interactive,
-							 cancellable, &local_error)) {
-				g_task_return_error (task, g_steal_pointer (&local_error));
-				return;
-			}
+		if (!gs_plugin_flatpak_foreach_installation (self, list, refine_wildcard_installation_cb,
+							     &wildcard_data, cancellable, &local_error)) {
+			g_task_return_error (task, g_steal_pointer (&local_error));
+			return;
 		}
 	}
 
@@ -1922,6 +2073,19 @@ gs_plugin_flatpak_refine_categories_async (GsPlugin                      *plugin
 				refine_categories_thread_cb, g_steal_pointer (&task));
 }
 
+static gboolean
+refine_categories_installation_cb (GsFlatpak     *flatpak,
+                                   GsAppList     *list,
+                                   gpointer       user_data,
+                                   GCancellable  *cancellable,
+                                   GError       **error)
+{
+	GsPluginRefineCategoriesData *data = user_data;
+	gboolean interactive = (data->flags & GS_PLUGIN_REFINE_CATEGORIES_FLAGS_INTERACTIVE);
+
+	return gs_flatpak_refine_category_sizes (flatpak, data->list, interactive, cancellable, error);
+}
+
 /* Run in @worker. */
 static void
 refine_categories_thread_cb (GTask        *task,
@@ -1931,18 +2095,15 @@ refine_categories_thread_cb (GTask        *task,
 {
 	GsPluginFlatpak *self = GS_PLUGIN_FLATPAK (source_object);
 	GsPluginRefineCategoriesData *data = task_data;
-	gboolean interactive = (data->flags & GS_PLUGIN_REFINE_CATEGORIES_FLAGS_INTERACTIVE);
 	g_autoptr(GError) local_error = NULL;
 
 	assert_in_worker (self);
 
-	for (guint i = 0; i < self->installations->len; i++) {
-		GsFlatpak *flatpak = g_ptr_array_index (self->installations, i);
-
-		if (!gs_flatpak_refine_category_sizes (flatpak, data->list, interactive, cancellable, &local_error)) {
-			g_task_return_error (task, g_steal_pointer (&local_error));
-			return;
-		}
+	/* the category sizes are incremented atomically */
+	if (!gs_plugin_flatpak_foreach_installation (self, NULL, refine_categories_installation_cb,
+						     data, cancellable, &local_error)) {
+		g_task_return_error (task, g_steal_pointer (&local_error));
+		return;
 	}
 
 	g_task_return_boolean (task, TRUE);
@@ -1982,6 +2143,81 @@ gs_plugin_flatpak_list_apps_async (GsPlugin              *plugin,
 				list_apps_thread_cb, g_steal_pointer (&task));
 }
 
+/* The parts of a #GsAppQuery which are supported, for
+ * list_apps_installation_cb(). */
+typedef struct {
+	gboolean		 interactive;
+	GDateTime		*released_since;
+	guint64			 age_secs;
+	GsAppQueryTristate	 is_curated;
+	GsAppQueryTristate	 is_featured;
+	GsCategory		*category;
+	GsAppQueryTristate	 is_installed;
+	const gchar * const	*deployment_featured;
+	const gchar * const	*developers;
+	const gchar * const	*keywords;
+	GsApp			*alternate_of;
+	const gchar		*provides_tag;
+	GsAppQueryProvidesType	 provides_type;
+} ListAppsQuery;
+
+static gboolean
+list_apps_installation_cb (GsFlatpak     *flatpak,
+                           GsAppList     *list,
+                           gpointer       user_data,
+                           GCancellable  *cancellable,
+                           GError       **error)
+{
+	ListAppsQuery *q = user_data;
+	const gchar * const provides_tag_strv[2] = { q->provides_tag, NULL };
+
+	if (q->released_since != NULL &&
+	    !gs_flatpak_add_recent (flatpak, list, q->age_secs, q->interactive, cancellable, error))
+		return FALSE;
+
+	if (q->is_curated != GS_APP_QUERY_TRISTATE_UNSET &&
+	    !gs_flatpak_add_popular (flatpak, list, q->interactive, cancellable, error))
+		return FALSE;
+
+	if (q->is_featured != GS_APP_QUERY_TRISTATE_UNSET &&
+	    !gs_flatpak_add_featured (flatpak, list, q->interactive, cancellable, error))
+		return FALSE;
+
+	if (q->category != NULL &&
+	    !gs_flatpak_add_category_apps (flatpak, q->category, list, q->interactive, cancellable, error))
+		return FALSE;
+
+	if (q->is_installed != GS_APP_QUERY_TRISTATE_UNSET &&
+	    !gs_flatpak_add_installed (flatpak, list, q->interactive, cancellable, error))
+		return FALSE;
+
+	if (q->deployment_featured != NULL &&
+	    !gs_flatpak_add_deployment_featured (flatpak, list, q->interactive, q->deployment_featured, cancellable, error))
+		return FALSE;
+
+	if (q->developers != NULL &&
+	    !gs_flatpak_search_developer_apps (flatpak, q->developers, list, q->interactive, cancellable, error))
+		return FALSE;
+
+	if (q->keywords != NULL &&
+	    !gs_flatpak_search (flatpak, q->keywords, list, q->interactive, cancellable, error))
+		return FALSE;
+
+	if (q->alternate_of != NULL &&
+	    !gs_flatpak_add_alternates (flatpak, q->alternate_of, list, q->interactive, cancellable, error))
+		return FALSE;
+
+	/* The @provides_type is deliberately ignored here, as flatpak
+	 * wants to try and match anything. This could be changed in
+	 * future. */
+	if (q->provides_tag != NULL &&
+	    q->provides_type != GS_APP_QUERY_PROVIDES_UNKNOWN &&
+	    !gs_flatpak_search (flatpak, provides_tag_strv, list, q->interactive, cancellable, error))
+		return FALSE;
+
+	return TRUE;
+}
+
 /* Run in @worker. */
 static void
 list_apps_thread_cb (GTask        *task,
@@ -1992,129 +2228,60 @@ list_apps_thread_cb (GTask        *task,
 	GsPluginFlatpak *self = GS_PLUGIN_FLATPAK (source_object);
 	g_autoptr(GsAppList) list = gs_app_list_new ();
 	GsPluginListAppsData *data = task_data;
-	gboolean interactive = (data->flags & GS_PLUGIN_LIST_APPS_FLAGS_INTERACTIVE);
-	GDateTime *released_since = NULL;
-	GsAppQueryTristate is_curated = GS_APP_QUERY_TRISTATE_UNSET;
-	GsAppQueryTristate is_featured = GS_APP_QUERY_TRISTATE_UNSET;
-	GsCategory *category = NULL;
-	GsAppQueryTristate is_installed = GS_APP_QUERY_TRISTATE_UNSET;
-	guint64 age_secs = 0;
-	const gchar * const *deployment_featured = NULL;
-	const gchar *const *developers = NULL;
-	const gchar * const *keywords = NULL;
-	GsApp *alternate_of = NULL;
-	const gchar *provides_tag = NULL;
-	GsAppQueryProvidesType provides_type = GS_APP_QUERY_PROVIDES_UNKNOWN;
+	ListAppsQuery q = { 0, };
 	g_autoptr(GError) local_error = NULL;
 
 	assert_in_worker (self);
 
+	q.interactive = (data->flags & GS_PLUGIN_LIST_APPS_FLAGS_INTERACTIVE);
+	q.is_curated = GS_APP_QUERY_TRISTATE_UNSET;
+	q.is_featured = GS_APP_QUERY_TRISTATE_UNSET;
+	q.is_installed = GS_APP_QUERY_TRISTATE_UNSET;
+	q.provides_type = GS_APP_QUERY_PROVIDES_UNKNOWN;
+
 	if (data->query != NULL) {
-		released_since = gs_app_query_get_released_since (data->query);
-		is_curated = gs_app_query_get_is_curated (data->query);
-		is_featured = gs_app_query_get_is_featured (data->query);
-		category = gs_app_query_get_category (data->query);
-		is_installed = gs_app_query_get_is_installed (data->query);
-		deployment_featured = gs_app_query_get_deployment_featured (data->query);
-		developers = gs_app_query_get_developers (data->query);
-		keywords = gs_app_query_get_keywords (data->query);
-		alternate_of = gs_app_query_get_alternate_of (data->query);
-		provides_type = gs_app_query_get_provides (data->query, &provides_tag);
+		q.released_since = gs_app_query_get_released_since (data->query);
+		q.is_curated = gs_app_query_get_is_curated (data->query);
+		q.is_featured = gs_app_query_get_is_featured (data->query);
+		q.category = gs_app_query_get_category (data->query);
+		q.is_installed = gs_app_query_get_is_installed (data->query);
+		q.deployment_featured = gs_app_query_get_deployment_featured (data->query);
+		q.developers = gs_app_query_get_developers (data->query);
+		q.keywords = gs_app_query_get_keywords (data->query);
+		q.alternate_of = gs_app_query_get_alternate_of (data->query);
+		q.provides_type = gs_app_query_get_provides (data->query, &q.provides_tag);
 	}
 
-	if (released_since != NULL) {
+	if (q.released_since != NULL) {
 		g_autoptr(GDateTime) now = g_date_time_new_now_local ();
-		age_secs = g_date_time_difference (now, released_since) / G_TIME_SPAN_SECOND;
+		q.age_secs = g_date_time_difference (now, q.released_since) / G_TIME_SPAN_SECOND;
 	}
 
 	/* Currently only support a subset of query properties, and only one set at once.
 	 * Also don’t currently support GS_APP_QUERY_TRISTATE_FALSE. */
-	if ((released_since == NULL &&
-	     is_curated == GS_APP_QUERY_TRISTATE_UNSET &&
-	     is_featured == GS_APP_QUERY_TRISTATE_UNSET &&
-	     category == NULL &&
-	     is_installed == GS_APP_QUERY_TRISTATE_UNSET &&
-	     deployment_featured == NULL &&
-	     developers == NULL &&
-	     keywords == NULL &&
-	     alternate_of == NULL &&
-	     provides_tag == NULL) ||
-	    is_curated == GS_APP_QUERY_TRISTATE_FALSE ||
-	    is_featured == GS_APP_QUERY_TRISTATE_FALSE ||
-	    is_installed == GS_APP_QUERY_TRISTATE_FALSE ||
+	if ((q.released_since == NULL &&
+	     q.is_curated == GS_APP_QUERY_TRISTATE_UNSET &&
+	     q.is_featured == GS_APP_QUERY_TRISTATE_UNSET &&
+	     q.category == NULL &&
+	     q.is_installed == GS_APP_QUERY_TRISTATE_UNSET &&
+	     q.deployment_featured == NULL &&
+	     q.developers == NULL &&
+	     q.keywords == NULL &&
+	     q.alternate_of == NULL &&
+	     q.provides_tag == NULL) ||
+	    q.is_curated == GS_APP_QUERY_TRISTATE_FALSE ||
+	    q.is_featured == GS_APP_QUERY_TRISTATE_FALSE ||
+	    q.is_installed == GS_APP_QUERY_TRISTATE_FALSE ||
 	    gs_app_query_get_n_properties_set (data->query) != 1) {
 		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
 					 "Unsupported query");
 		return;
 	}
 
-	for (guint i = 0; i < self->installations->len; i++) {
-		GsFlatpak *flatpak = g_ptr_array_index (self->installations, i);
-		const gchar * const provides_tag_strv[2] = { provides_tag, NULL };
-
-		if (released_since != NULL &&
-		    !gs_flatpak_add_recent (flatpak, list, age_secs, interactive, cancellable, &local_error)) {
-			g_task_return_error (task, g_steal_pointer (&local_error));
-			return;
-		}
-
-		if (is_curated != GS_APP_QUERY_TRISTATE_UNSET &&
-		    !gs_flatpak_add_popular (flatpak, list, interactive, cancellable, &local_error)) {
-			g_task_return_error (task, g_steal_pointer (&local_error));
-			return;
-		}
-
-		if (is_featured != GS_APP_QUERY_TRISTATE_UNSET &&
-		    !gs_flatpak_add_featured (flatpak, list, interactive, cancellable, &local_error)) {
-			g_task_return_error (task, g_steal_pointer (&local_error));
-			return;
-		}
-
-		if (category != NULL &&
-		    !gs_flatpak_add_category_apps (flatpak, category, list, interactive, cancellable, &local_error)) {
-			g_task_return_error (task, g_steal_pointer (&local_error));
-			return;
-		}
-
-		if (is_installed != GS_APP_QUERY_TRISTATE_UNSET &&
-		    !gs_flatpak_add_installed (flatpak, list, interactive, cancellable, &local_error)) {
-			g_task_return_error (task, g_steal_pointer (&local_error));
-			return;
-		}
-
-		if (deployment_featured != NULL &&
-		    !gs_flatpak_add_deployment_featured (flatpak, list, interactive, deployment_featured, cancellable, &local_error)) {
-			g_task_return_error (task, g_steal_pointer (&local_error));
-			return;
-		}
-
-		if (developers != NULL &&
-		    !gs_flatpak_search_developer_apps (flatpak, developers, list, interactive, cancellable, &local_error)) {
-			g_task_return_error (task, g_steal_pointer (&local_error));
-			return;
-		}
-
-		if (keywords != NULL &&
-		    !gs_flatpak_search (flatpak, keywords, list, interactive, cancellable, &local_error)) {
-			g_task_return_error (task, g_steal_pointer (&local_error));
-			return;
-		}
-
-		if (alternate_of != NULL &&
-		    !gs_flatpak_add_alternates (flatpak, alternate_of, list, interactive, cancellable, &local_error)) {
-			g_task_return_error (task, g_steal_pointer (&local_error));
-			return;
-		}
-
-		/* The @provides_type is deliberately ignored here, as flatpak
-		 * wants to try and match anything. This could be changed in
-		 * future. */
-		if (provides_tag != NULL &&
-		    provides_type != GS_APP_QUERY_PROVIDES_UNKNOWN &&
-		    !gs_flatpak_search (flatpak, provides_tag_strv, list, interactive, cancellable, &local_error)) {
-			g_task_return_error (task, g_steal_pointer (&local_error));
-			return;
-		}
+	if (!gs_plugin_flatpak_foreach_installation (self, list, list_apps_installation_cb,
+						     &q, cancellable, &local_error)) {
+		g_task_return_error (task, g_steal_pointer (&local_error));
+		return;
 	}
 
 	g_task_return_pointer (task, g_steal_pointer (&list), g_object_unref);
@@ -2128,6 +2295,22 @@ gs_plugin_flatpak_list_apps_finish (GsPlugin      *plugin,
 	return g_task_propagate_pointer (G_TASK (result), error);
 }
 
+typedef struct {
+	const gchar	*url;
+	gboolean	 interactive;
+} UrlToAppData;
+
+static gboolean
+url_to_app_installation_cb (GsFlatpak     *flatpak,
+                            GsAppList     *list,
+                            gpointer       user_data,
+                            GCancellable  *cancellable,
+                            GError       **error)
+{
+	UrlToAppData *data = user_data;
+	return gs_flatpak_url_to_app (flatpak, list, data->url, data->interactive, cancellable, error);
+}
+
 gboolean
 gs_plugin_url_to_app (GsPlugin *plugin,
 		      GsAppList *list,
@@ -2136,14 +2319,10 @@ gs_plugin_url_to_app (GsPlugin *plugin,
 		      GError **error)
 {
 	GsPluginFlatpak *self = GS_PLUGIN_FLATPAK (plugin);
-	gboolean interactive = gs_plugin_has_flags (plugin, GS_PLUGIN_FLAGS_INTERACTIVE);
+	UrlToAppData data = { url, gs_plugin_has_flags (plugin, GS_PLUGIN_FLAGS_INTERACTIVE) };
 
-	for (guint i = 0; i < self->installations->len; i++) {
-		GsFlatpak *flatpak = g_ptr_array_index (self->installations, i);
-		if (!gs_flatpak_url_to_app (flatpak, list, url, interactive, cancellable, error))
-			return FALSE;
-	}
-	return TRUE;
+	return gs_plugin_flatpak_foreach_installation (self, list, url_to_app_installation_cb,
+						       &data, cancellable, error);
 }
 
 static void install_repository_thread_cb (GTask        *task,
@@ -33,6 +33,7 @@ struct _GsScreenshotImage
 	SoupSession	*session;
 	SoupMessage	*message;
 	GCancellable	*cancellable;
+	GCancellable	*decode_cancellable;	/* (owned) (nullable) */
 	gchar		*filename;
 	const gchar	*current_image;
 	guint		 width;
@@ -97,46 +98,6 @@ gs_screenshot_image_set_error (GsScreenshotImage *ssimg, const gchar *message)
 	gs_screenshot_image_stop_spinner (ssimg);
 }
 
-static void
-as_screenshot_show_image (GsScreenshotImage *ssimg)
-{
-	if (as_screenshot_get_media_kind (ssimg->screenshot) == AS_SCREENSHOT_MEDIA_KIND_VIDEO) {
-		gtk_video_set_filename (GTK_VIDEO (ssimg->video), ssimg->filename);
-		ssimg->current_image = "video";
-	} else {
-		g_autoptr(GdkPixbuf) pixbuf = NULL;
-
-		/* no need to composite */
-		if (ssimg->width == G_MAXUINT || ssimg->height == G_MAXUINT) {
-			pixbuf = gdk_pixbuf_new_from_file (ssimg->filename, NULL);
-		} else {
-			/* this is always going to have alpha */
-			pixbuf = gdk_pixbuf_new_from_file_at_scale (ssimg->filename,
-								    (gint) (ssimg->width * ssimg->scale),
-								    (gint) (ssimg->height * ssimg->scale),
-								    FALSE, NULL);
-		}
-
-		/* show icon */
-		if (g_strcmp0 (ssimg->current_image, "image1") == 0) {
-			if (pixbuf != NULL)
-				gtk_picture_set_pixbuf (GTK_PICTURE (ssimg->image2), pixbuf);
-			ssimg->current_image = "image2";
-		} else {
-			if (pixbuf != NULL)
-				gtk_picture_set_pixbuf (GTK_PICTURE (ssimg->image1), pixbuf);
-			ssimg->current_image = "image1";
-		}
-	}
-
-	gtk_stack_set_visible_child_name (GTK_STACK (ssimg->stack), ssimg->current_image);
-
-	gtk_widget_set_visible (GTK_WIDGET (ssimg), TRUE);
-	ssimg->showing_image = TRUE;
-
-	gs_screenshot_image_stop_spinner (ssimg);
-}
-
 static GdkPixbuf *
 gs_pixbuf_resample (GdkPixbuf *original,
 		    guint width,
@@ -225,41 +186,488 @@ gs_pixbuf_save_filename (GdkPixbuf *pixbuf,
 				NULL);
 }
 
+/* Decoded textures are shared between all the screenshot widgets so that
+ * moving between carousel pages or revisiting an app doesn't decode the
+ * images again. The cache is bounded by the size of the decoded pixels and
+ * is only ever accessed from the main thread. */
+#define TEXTURE_CACHE_MAX_BYTES (64 * 1024 * 1024)
+
+typedef struct {
+	gchar		*key;		/* (owned) */
+	GdkTexture	*texture;	/* (owned) */
+	gsize		 size;
+} GsScreenshotTextureCacheEntry;
+
+static GHashTable *texture_cache = NULL;	/* (owned) (nullable) (element-type utf8 GList) */
+static GQueue texture_cache_lru = G_QUEUE_INIT;	/* most recently used first */
+static gsize texture_cache_size = 0;
+
 static void
-gs_screenshot_image_show_blurred (GsScreenshotImage *ssimg,
-				  const gchar *filename_thumb)
+gs_screenshot_texture_cache_entry_free (GsScreenshotTextureCacheEntry *entry)
 {
-	g_autoptr(GdkPixbuf) pb_src = NULL;
-	g_autoptr(GdkPixbuf) pb = NULL;
+	g_free (entry->key);
+	g_object_unref (entry->texture);
+	g_free (entry);
+}
+
+static gchar *
+gs_screenshot_texture_cache_key (const gchar *filename,
+				 guint width,
+				 guint height,
+				 gboolean blurred)
+{
+	return g_strdup_printf ("%s:%ux%u%s", filename, width, height,
+				blurred ? ":blurred" : "");
+}
+
+static GdkTexture *
+gs_screenshot_texture_cache_lookup (const gchar *filename,
+				    guint width,
+				    guint height,
+				    gboolean blurred)
+{
+	GList *link;
+	GsScreenshotTextureCacheEntry *entry;
+	g_autofree gchar *key = NULL;
 
-	pb_src = gdk_pixbuf_new_from_file (filename_thumb, NULL);
-	if (pb_src == NULL)
+	if (texture_cache == NULL)
+		return NULL;
+
+	key = gs_screenshot_texture_cache_key (filename, width, height, blurred);
+	link = g_hash_table_lookup (texture_cache, key);
+	if (link == NULL)
+		return NULL;
+
+	/* mark as most recently used */
+	g_queue_unlink (&texture_cache_lru, link);
+	g_queue_push_head_link (&texture_cache_lru, link);
+
+	entry = link->data;
+	return g_object_ref (entry->texture);
+}
+
+static void
+gs_screenshot_texture_cache_remove_link (GList *link)
+{
+	GsScreenshotTextureCacheEntry *entry = link->data;
+
+	g_hash_table_remove (texture_cache, entry->key);
+	g_queue_delete_link (&texture_cache_lru, link);
+	texture_cache_size -= entry->size;
+	gs_screenshot_texture_cache_entry_free (entry);
+}
+
+static void
+gs_screenshot_texture_cache_insert (const gchar *filename,
+				    guint width,
+				    guint height,
+				    gboolean blurred,
+				    GdkTexture *texture)
+{
+	GList *link;
+	GsScreenshotTextureCacheEntry *entry;
+	gsize size;
+
+	size = (gsize) gdk_texture_get_width (texture) *
+	       (gsize) gdk_texture_get_height (texture) * 4;
+	if (size > TEXTURE_CACHE_MAX_BYTES)
 		return;
-	pb = gs_pixbuf_resample (pb_src,
-				 ssimg->width * ssimg->scale,
-				 ssimg->height * ssimg->scale,
+
+	if (texture_cache == NULL)
+		texture_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+	entry = g_new0 (GsScreenshotTextureCacheEntry, 1);
+	entry->key = gs_screenshot_texture_cache_key (filename, width, height, blurred);
+	entry->texture = g_object_ref (texture);
+	entry->size = size;
+
+	/* replace any stale copy, e.g. when the file has been downloaded again */
+	link = g_hash_table_lookup (texture_cache, entry->key);
+	if (link != NULL)
+		gs_screenshot_texture_cache_remove_link (link);
+
+	g_queue_push_head (&texture_cache_lru, entry);
+	g_hash_table_insert (texture_cache, entry->key, texture_cache_lru.head);
+	texture_cache_size += size;
+
+	/* evict the least recently used textures */
+	while (texture_cache_size > TEXTURE_CACHE_MAX_BYTES)
+		gs_screenshot_texture_cache_remove_link (texture_cache_lru.tail);
+}
+
+typedef struct {
+	guint		 width;		/* G_MAXUINT for the natural size */
+	guint		 height;	/* G_MAXUINT for the natural size */
+	gboolean	 keep_aspect;
+	gint		 natural_width;	/* (out) */
+	gint		 natural_height;	/* (out) */
+} GsScreenshotSizeHint;
+
+static void
+gs_screenshot_loader_size_prepared_cb (GdkPixbufLoader *loader,
+				       gint width,
+				       gint height,
+				       gpointer user_data)
+{
+	GsScreenshotSizeHint *hint = user_data;
+	gdouble scale;
+
+	hint->natural_width = width;
+	hint->natural_height = height;
+
+	if (hint->width == G_MAXUINT || hint->height == G_MAXUINT ||
+	    width <= 0 || height <= 0)
+		return;
+
+	if (!hint->keep_aspect) {
+		gdk_pixbuf_loader_set_size (loader, (gint) hint->width, (gint) hint->height);
+		return;
+	}
+
+	/* only ever scale down, keeping enough pixels to cover the
+	 * requested size so it can be resampled afterwards */
+	scale = MAX ((gdouble) hint->width / width, (gdouble) hint->height / height);
+	if (scale >= 1.0)
+		return;
+	gdk_pixbuf_loader_set_size (loader,
+				    MAX (1, (gint) (width * scale + 0.5)),
+				    MAX (1, (gint) (height * scale + 0.5)));
+}
+
+/* scales the image while decoding it, which for JPEG means most of the
+ * pixels of a large screenshot are never even decompressed */
+static GdkPixbuf *
+gs_screenshot_decode_pixbuf (GBytes *bytes,
+			     GsScreenshotSizeHint *hint,
+			     GError **error)
+{
+	GdkPixbuf *pixbuf;
+	g_autoptr(GdkPixbufLoader) loader = gdk_pixbuf_loader_new ();
+
+	g_signal_connect (loader, "size-prepared",
+			  G_CALLBACK (gs_screenshot_loader_size_prepared_cb), hint);
+	if (!gdk_pixbuf_loader_write_bytes (loader, bytes, error)) {
+		gdk_pixbuf_loader_close (loader, NULL);
+		return NULL;
+	}
+	if (!gdk_pixbuf_loader_close (loader, error))
+		return NULL;
+
+	pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+	if (pixbuf == NULL) {
+		g_set_error_literal (error,
+				     GDK_PIXBUF_ERROR,
+				     GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+				     "no image data");
+		return NULL;
+	}
+	return g_object_ref (pixbuf);
+}
+
+typedef struct {
+	GBytes		*bytes;			/* (owned) (nullable) */
+	gchar		*filename;		/* (owned) */
+	gchar		*counterpart_filename;	/* (owned) (nullable) */
+	guint		 width;
+	guint		 height;
+	guint		 counterpart_width;
+	guint		 counterpart_height;
+	gboolean	 blurred;
+} GsScreenshotDecodeData;
+
+static void
+gs_screenshot_decode_data_free (GsScreenshotDecodeData *data)
+{
+	g_clear_pointer (&data->bytes, g_bytes_unref);
+	g_free (data->filename);
+	g_free (data->counterpart_filename);
+	g_free (data);
+}
+
+/* decodes the downloaded image, saves it (and possibly its counterpart
+ * size) to the cache and returns the texture to show */
+static GdkTexture *
+gs_screenshot_decode_downloaded (GsScreenshotDecodeData *data,
+				 GError **error)
+{
+	GsScreenshotSizeHint hint = { 0, };
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	g_autoptr(GdkPixbuf) pb = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	hint.width = data->width;
+	hint.height = data->height;
+	hint.keep_aspect = TRUE;
+	if (data->counterpart_filename != NULL) {
+		hint.width = MAX (hint.width, data->counterpart_width);
+		hint.height = MAX (hint.height, data->counterpart_height);
+	}
+
+	pixbuf = gs_screenshot_decode_pixbuf (data->bytes, &hint, &error_local);
+	if (pixbuf == NULL) {
+		g_debug ("failed to decode screenshot: %s", error_local->message);
+		/* TRANSLATORS: possibly image file corrupt or not an image */
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+				     _("Failed to load image"));
+		return NULL;
+	}
+
+	/* is image size destination size unknown or exactly the correct size */
+	if (data->width == G_MAXUINT || data->height == G_MAXUINT ||
+	    (data->width == (guint) hint.natural_width &&
+	     data->height == (guint) hint.natural_height)) {
+		pb = g_object_ref (pixbuf);
+		if (!gdk_pixbuf_save (pb, data->filename, "png", error, NULL))
+			return NULL;
+		gs_cache_manager_add_file (gs_cache_manager_get_default (), data->filename);
+		return gdk_texture_new_for_pixbuf (pb);
+	}
+
+	pb = gs_pixbuf_resample (pixbuf, data->width, data->height, FALSE);
+	if (!gdk_pixbuf_save (pb, data->filename, "png", error, NULL))
+		return NULL;
+	gs_cache_manager_add_file (gs_cache_manager_get_default (), data->filename);
+
+	if (data->counterpart_filename != NULL) {
+		if (gs_pixbuf_save_filename (pixbuf, data->counterpart_filename,
+					     data->counterpart_width,
+					     data->counterpart_height,
+					     &error_local)) {
+			gs_cache_manager_add_file (gs_cache_manager_get_default (),
+						   data->counterpart_filename);
+		} else {
+			/* if we cannot save this screenshot, warn about that but
+			 * do not set a user's visible error because this is a
+			 * complementary operation */
+			g_warning ("Failed to save screenshot '%s': %s",
+				   data->counterpart_filename, error_local->message);
+		}
+	}
+
+	return gdk_texture_new_for_pixbuf (pb);
+}
+
+static GdkTexture *
+gs_screenshot_decode_file (GsScreenshotDecodeData *data,
+			   GCancellable *cancellable,
+			   GError **error)
+{
+	GsScreenshotSizeHint hint = { 0, };
+	g_autoptr(GBytes) bytes = NULL;
+	g_autoptr(GFile) file = g_file_new_for_path (data->filename);
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	g_autoptr(GdkPixbuf) pb = NULL;
+
+	bytes = g_file_load_bytes (file, cancellable, NULL, error);
+	if (bytes == NULL)
+		return NULL;
+
+	/* the blurred thumbnail is tiny, so decode it as-is and then
+	 * stretch it; otherwise this is always going to have alpha */
+	hint.width = data->blurred ? G_MAXUINT : data->width;
+	hint.height = data->blurred ? G_MAXUINT : data->height;
+	hint.keep_aspect = FALSE;
+	pixbuf = gs_screenshot_decode_pixbuf (bytes, &hint, error);
+	if (pixbuf == NULL)
+		return NULL;
+
+	if (!data->blurred)
+		return gdk_texture_new_for_pixbuf (pixbuf);
+
+	pb = gs_pixbuf_resample (pixbuf, data->width, data->height,
 				 TRUE /* blurred */);
-	if (pb == NULL)
+	return gdk_texture_new_for_pixbuf (pb);
+}
+
+static void
+gs_screenshot_image_decode_thread (GTask *task,
+				   gpointer source_object,
+				   gpointer task_data,
+				   GCancellable *cancellable)
+{
+	GsScreenshotDecodeData *data = task_data;
+	GdkTexture *texture;
+	g_autoptr(GError) error = NULL;
+
+	if (data->bytes != NULL)
+		texture = gs_screenshot_decode_downloaded (data, &error);
+	else
+		texture = gs_screenshot_decode_file (data, cancellable, &error);
+	if (texture == NULL) {
+		g_task_return_error (task, g_steal_pointer (&error));
 		return;
+	}
+	g_task_return_pointer (task, texture, g_object_unref);
+}
 
+static void
+gs_screenshot_image_show_texture (GsScreenshotImage *ssimg,
+				  GdkTexture *texture)
+{
+	if (g_strcmp0 (ssimg->current_image, "image1") == 0) {
+		gtk_picture_set_paintable (GTK_PICTURE (ssimg->image2), GDK_PAINTABLE (texture));
+		ssimg->current_image = "image2";
+	} else {
+		gtk_picture_set_paintable (GTK_PICTURE (ssimg->image1), GDK_PAINTABLE (texture));
+		ssimg->current_image = "image1";
+	}
+	gtk_stack_set_visible_child_name (GTK_STACK (ssimg->stack), ssimg->current_image);
+}
+
+static void
+gs_screenshot_image_show_blurred_texture (GsScreenshotImage *ssimg,
+					  GdkTexture *texture)
+{
 	if (g_strcmp0 (ssimg->current_image, "video") == 0) {
 		ssimg->current_image = "image1";
 		gtk_stack_set_visible_child_name (GTK_STACK (ssimg->stack), ssimg->current_image);
 	}
 
 	if (g_strcmp0 (ssimg->current_image, "image1") == 0) {
-		gtk_picture_set_pixbuf (GTK_PICTURE (ssimg->image1), pb);
+		gtk_picture_set_paintable (GTK_PICTURE (ssimg->image1), GDK_PAINTABLE (texture));
 	} else {
-		gtk_picture_set_pixbuf (GTK_PICTURE (ssimg->image2), pb);
+		gtk_picture_set_paintable (GTK_PICTURE (ssimg->image2), GDK_PAINTABLE (texture));
 	}
 }
 
-static gboolean
-gs_screenshot_image_save_downloaded_img (GsScreenshotImage *ssimg,
-					 GdkPixbuf *pixbuf,
-					 GError **error)
+static void
+gs_screenshot_image_set_showing (GsScreenshotImage *ssimg)
+{
+	gtk_widget_set_visible (GTK_WIDGET (ssimg), TRUE);
+	ssimg->showing_image = TRUE;
+
+	gs_screenshot_image_stop_spinner (ssimg);
+}
+
+static void
+gs_screenshot_image_decoded_cb (GObject *source_object,
+				GAsyncResult *result,
+				gpointer user_data)
+{
+	GsScreenshotImage *ssimg = GS_SCREENSHOT_IMAGE (source_object);
+	GsScreenshotDecodeData *data = g_task_get_task_data (G_TASK (result));
+	g_autoptr(GdkTexture) texture = NULL;
+	g_autoptr(GError) error = NULL;
+
+	texture = g_task_propagate_pointer (G_TASK (result), &error);
+	if (texture == NULL) {
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			return;
+		if (data->bytes != NULL)
+			gs_screenshot_image_set_error (ssimg, error->message);
+		else
+			g_debug ("failed to load screenshot %s: %s",
+				 data->filename, error->message);
+		return;
+	}
+
+	gs_screenshot_texture_cache_insert (data->filename,
+					    data->width,
+					    data->height,
+					    data->blurred,
+					    texture);
+
+	if (data->blurred) {
+		gs_screenshot_image_show_blurred_texture (ssimg, texture);
+		return;
+	}
+
+	gs_screenshot_image_show_texture (ssimg, texture);
+
+	/* got image, so show */
+	if (data->bytes != NULL)
+		gs_screenshot_image_set_showing (ssimg);
+}
+
+/* takes ownership of @data; any decode still in flight for this widget is
+ * cancelled, as only the most recent image should end up being shown */
+static void
+gs_screenshot_image_decode_async (GsScreenshotImage *ssimg,
+				  GsScreenshotDecodeData *data)
+{
+	g_autoptr(GTask) task = NULL;
+
+	if (ssimg->decode_cancellable != NULL) {
+		g_cancellable_cancel (ssimg->decode_cancellable);
+		g_clear_object (&ssimg->decode_cancellable);
+	}
+	ssimg->decode_cancellable = g_cancellable_new ();
+
+	task = g_task_new (ssimg, ssimg->decode_cancellable,
+			   gs_screenshot_image_decoded_cb, NULL);
+	g_task_set_source_tag (task, gs_screenshot_image_decode_async);
+	g_task_set_task_data (task, data, (GDestroyNotify) gs_screenshot_decode_data_free);
+	g_task_run_in_thread (task, gs_screenshot_image_decode_thread);
+}
+
+static void
+as_screenshot_show_image (GsScreenshotImage *ssimg)
+{
+	if (as_screenshot_get_media_kind (ssimg->screenshot) == AS_SCREENSHOT_MEDIA_KIND_VIDEO) {
+		gtk_video_set_filename (GTK_VIDEO (ssimg->video), ssimg->filename);
+		ssimg->current_image = "video";
+		gtk_stack_set_visible_child_name (GTK_STACK (ssimg->stack), ssimg->current_image);
+	} else {
+		g_autoptr(GdkTexture) texture = NULL;
+		guint width = G_MAXUINT;
+		guint height = G_MAXUINT;
+
+		/* no need to composite when the size is unknown */
+		if (ssimg->width != G_MAXUINT && ssimg->height != G_MAXUINT) {
+			width = ssimg->width * ssimg->scale;
+			height = ssimg->height * ssimg->scale;
+		}
+
+		/* show icon, decoding it on a worker if not already cached */
+		texture = gs_screenshot_texture_cache_lookup (ssimg->filename,
+							      width, height,
+							      FALSE);
+		if (texture != NULL) {
+			gs_screenshot_image_show_texture (ssimg, texture);
+		} else {
+			GsScreenshotDecodeData *data = g_new0 (GsScreenshotDecodeData, 1);
+			data->filename = g_strdup (ssimg->filename);
+			data->width = width;
+			data->height = height;
+			gs_screenshot_image_decode_async (ssimg, data);
+		}
+	}
+
+	gs_screenshot_image_set_showing (ssimg);
+}
+
+static void
+gs_screenshot_image_show_blurred (GsScreenshotImage *ssimg,
+				  const gchar *filename_thumb)
+{
+	GsScreenshotDecodeData *data;
+	g_autoptr(GdkTexture) texture = NULL;
+	guint width = ssimg->width * ssimg->scale;
+	guint height = ssimg->height * ssimg->scale;
+
+	texture = gs_screenshot_texture_cache_lookup (filename_thumb,
+						      width, height,
+						      TRUE);
+	if (texture != NULL) {
+		gs_screenshot_image_show_blurred_texture (ssimg, texture);
+		return;
+	}
+
+	data = g_new0 (GsScreenshotDecodeData, 1);
+	data->filename = g_strdup (filename_thumb);
+	data->width = width;
+	data->height = height;
+	data->blurred = TRUE;
+	gs_screenshot_image_decode_async (ssimg, data);
+}
+
+/* returns the cache filename of the other screenshot size, so both the
+ * thumbnail and the normal image are available after one download */
+static gchar *
+gs_screenshot_image_get_counterpart_filename (GsScreenshotImage *ssimg,
+					      guint *width_out,
+					      guint *height_out)
 {
-	gboolean ret;
 	const GPtrArray *images;
 	g_autoptr(GError) error_local = NULL;
 	g_autofree char *filename = NULL;
@@ -269,20 +677,12 @@ gs_screenshot_image_save_downloaded_img (GsScreenshotImage *ssimg,
 	guint width = ssimg->width;
 	guint height = ssimg->height;
 
-	ret = gs_pixbuf_save_filename (pixbuf, ssimg->filename,
-				      ssimg->width * ssimg->scale,
-				      ssimg->height * ssimg->scale,
-				      error);
-
-	if (!ret)
-		return FALSE;
-
 	if (ssimg->screenshot == NULL)
-		return TRUE;
+		return NULL;
 
 	images = as_screenshot_get_images (ssimg->screenshot);
 	if (images->len > 1)
-		return TRUE;
+		return NULL;
 
 	if (width == AS_IMAGE_THUMBNAIL_WIDTH &&
 	    height == AS_IMAGE_THUMBNAIL_HEIGHT) {
@@ -298,10 +698,11 @@ gs_screenshot_image_save_downloaded_img (GsScreenshotImage *ssimg,
 	basename = g_path_get_basename (ssimg->filename);
 	size_dir = g_strdup_printf ("%ux%u", width, height);
 	cache_kind = g_build_filename ("screenshots", size_dir, NULL);
-	filename = gs_utils_get_cache_filename (cache_kind, basename,
-						GS_UTILS_CACHE_FLAG_WRITEABLE |
-						GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
-						&error_local);
+	filename = gs_cache_manager_get_filename (gs_cache_manager_get_default (),
+						  cache_kind, basename,
+						  GS_UTILS_CACHE_FLAG_WRITEABLE |
+						  GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+						  &error_local);
 
         if (filename == NULL) {
 		/* if we cannot get a cache filename, warn about that but do not
@@ -310,22 +711,12 @@ gs_screenshot_image_save_downloaded_img (GsScreenshotImage *ssimg,
                 g_warning ("Failed to get cache filename for counterpart "
                            "screenshot '%s' in folder '%s': %s", basename,
                            cache_kind, error_local->message);
-                return TRUE;
-        }
-
-	ret = gs_pixbuf_save_filename (pixbuf, filename,
-					width, height,
-					&error_local);
-
-	if (!ret) {
-		/* if we cannot save this screenshot, warn about that but do not
-		 * set a user's visible error because this is a complementary
-		 * operation */
-                g_warning ("Failed to save screenshot '%s': %s", filename,
-                           error_local->message);
+                return NULL;
         }
 
-	return TRUE;
+	*width_out = width;
+	*height_out = height;
+	return g_steal_pointer (&filename);
 }
 
 static void
@@ -340,17 +731,16 @@ gs_screenshot_image_complete_cb (SoupSession *session,
 #endif
 {
 	g_autoptr(GsScreenshotImage) ssimg = GS_SCREENSHOT_IMAGE (user_data);
-	gboolean ret;
+	GsScreenshotDecodeData *data;
 	g_autoptr(GError) error = NULL;
-	g_autoptr(GdkPixbuf) pixbuf = NULL;
-	g_autoptr(GInputStream) stream = NULL;
+	g_autoptr(GBytes) bytes = NULL;
 	guint status_code;
 
 #if SOUP_CHECK_VERSION(3, 0, 0)
 	SoupMessage *msg;
 
-	stream = soup_session_send_finish (SOUP_SESSION (source_object), result, &error);
-	if (stream == NULL) {
+	bytes = soup_session_send_and_read_finish (SOUP_SESSION (source_object), result, &error);
+	if (bytes == NULL) {
 		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
 			g_warning ("Failed to download screenshot: %s", error->message);
 			/* Reset the width request, thus the image shrinks when the window width is small */
@@ -419,43 +809,25 @@ gs_screenshot_image_complete_cb (SoupSession *session,
 
 #if !SOUP_CHECK_VERSION(3, 0, 0)
 	/* create a buffer with the data */
-	stream = g_memory_input_stream_new_from_data (msg->response_body->data,
-						      msg->response_body->length,
-						      NULL);
-	if (stream == NULL) {
-		gs_screenshot_image_stop_spinner (ssimg);
-		return;
-	}
+	bytes = g_bytes_new (msg->response_body->data,
+			     (gsize) msg->response_body->length);
 #endif
 
-	/* load the image */
-	pixbuf = gdk_pixbuf_new_from_stream (stream, NULL, NULL);
-	if (pixbuf == NULL) {
-		/* TRANSLATORS: possibly image file corrupt or not an image */
-		gs_screenshot_image_set_error (ssimg, _("Failed to load image"));
-		return;
-	}
-
-	/* is image size destination size unknown or exactly the correct size */
-	if (ssimg->width == G_MAXUINT || ssimg->height == G_MAXUINT ||
-	    (ssimg->width * ssimg->scale == (guint) gdk_pixbuf_get_width (pixbuf) &&
-	     ssimg->height * ssimg->scale == (guint) gdk_pixbuf_get_height (pixbuf))) {
-		ret = gs_pixbuf_save_filename (pixbuf, ssimg->filename,
-					       gdk_pixbuf_get_width (pixbuf),
-					       gdk_pixbuf_get_height (pixbuf),
-					       &error);
-		if (!ret) {
-			gs_screenshot_image_set_error (ssimg, error->message);
-			return;
-		}
-	} else if (!gs_screenshot_image_save_downloaded_img (ssimg, pixbuf,
-							     &error)) {
-		gs_screenshot_image_set_error (ssimg, error->message);
-		return;
+	/* decode, scale and save the image on a worker, as doing that for a
+	 * large screenshot would block the UI for a noticeable time */
+	data = g_new0 (GsScreenshotDecodeData, 1);
+	data->bytes = g_steal_pointer (&bytes);
+	data->filename = g_strdup (ssimg->filename);
+	data->width = ssimg->width;
+	data->height = ssimg->height;
+	if (ssimg->width != G_MAXUINT && ssimg->height != G_MAXUINT) {
+		data->width *= ssimg->scale;
+		data->height *= ssimg->scale;
+		data->counterpart_filename = gs_screenshot_image_get_counterpart_filename (ssimg,
+											   &data->counterpart_width,
+											   &data->counterpart_height);
 	}
-
-	/* got image, so show */
-	as_screenshot_show_image (ssimg);
+	gs_screenshot_image_decode_async (ssimg, data);
 }
 
 void
@@ -608,6 +980,8 @@ gs_screenshot_video_downloaded_cb (GObject *source_object,
 
 	if (gs_download_file_finish (ssimg->session, result, &error) ||
 	    g_error_matches (error, GS_DOWNLOAD_ERROR, GS_DOWNLOAD_ERROR_NOT_MODIFIED)) {
+		if (error == NULL)
+			gs_cache_manager_add_file (gs_cache_manager_get_default (), ssimg->filename);
 		gs_screenshot_image_stop_spinner (ssimg);
 		as_screenshot_show_image (ssimg);
 
@@ -667,10 +1041,11 @@ gs_screenshot_image_load_async (GsScreenshotImage *ssimg,
 	}
 	cache_kind = g_build_filename ("screenshots", sizedir, NULL);
 	g_free (ssimg->filename);
-	ssimg->filename = gs_utils_get_cache_filename (cache_kind,
-						       basename,
-						       GS_UTILS_CACHE_FLAG_NONE,
-						       NULL);
+	ssimg->filename = gs_cache_manager_get_filename (gs_cache_manager_get_default (),
+							 cache_kind,
+							 basename,
+							 GS_UTILS_CACHE_FLAG_NONE,
+							 NULL);
 	g_assert (ssimg->filename != NULL);
 
 	/* does local file already exist and has recently been downloaded */
@@ -678,6 +1053,8 @@ gs_screenshot_image_load_async (GsScreenshotImage *ssimg,
 		guint64 age_max;
 		g_autoptr(GFile) file = NULL;
 
+		gs_cache_manager_note_hit (gs_cache_manager_get_default (), ssimg->filename);
+
 		/* show the image we have in cache while we're checking for the
 		 * new screenshot (which probably won't have changed) */
 		as_screenshot_show_image (ssimg);
@@ -689,6 +1066,8 @@ gs_screenshot_image_load_async (GsScreenshotImage *ssimg,
 		/* image new enough, not re-requesting from server */
 		if (age_max > 0 && gs_utils_get_file_age (file) < age_max)
 			return;
+	} else {
+		gs_cache_manager_note_miss (gs_cache_manager_get_default ());
 	}
 
 	/* if we're not showing a full-size image, we try loading a blurred
@@ -707,23 +1086,27 @@ gs_screenshot_image_load_async (GsScreenshotImage *ssimg,
 		url_thumb = as_image_get_url (im);
 		basename_thumb = gs_screenshot_get_cachefn_for_url (url_thumb);
 		cache_kind_thumb = g_build_filename ("screenshots", "112x63", NULL);
-		cachefn_thumb = gs_utils_get_cache_filename (cache_kind_thumb,
-							     basename_thumb,
-							     GS_UTILS_CACHE_FLAG_NONE,
-							     NULL);
+		cachefn_thumb = gs_cache_manager_get_filename (gs_cache_manager_get_default (),
+							       cache_kind_thumb,
+							       basename_thumb,
+							       GS_UTILS_CACHE_FLAG_NONE,
+							       NULL);
 		g_assert (cachefn_thumb != NULL);
-		if (g_file_test (cachefn_thumb, G_FILE_TEST_EXISTS))
+		if (g_file_test (cachefn_thumb, G_FILE_TEST_EXISTS)) {
+			gs_cache_manager_note_hit (gs_cache_manager_get_default (), cachefn_thumb);
 			gs_screenshot_image_show_blurred (ssimg, cachefn_thumb);
+		}
 	}
 
 	/* re-request the cache filename, which might be different as it needs
 	 * to be writable this time */
 	g_free (ssimg->filename);
-	ssimg->filename = gs_utils_get_cache_filename (cache_kind,
-						       basename,
-						       GS_UTILS_CACHE_FLAG_WRITEABLE |
-						       GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
-						       NULL);
+	ssimg->filename = gs_cache_manager_get_filename (gs_cache_manager_get_default (),
+							 cache_kind,
+							 basename,
+							 GS_UTILS_CACHE_FLAG_WRITEABLE |
+							 GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+							 NULL);
 	if (ssimg->filename == NULL) {
 		/* TRANSLATORS: this is when we try create the cache directory
 		 * but we were out of space or permission was denied */
@@ -808,8 +1191,8 @@ gs_screenshot_image_load_async (GsScreenshotImage *ssimg,
 	/* send async */
 #if SOUP_CHECK_VERSION(3, 0, 0)
 	ssimg->cancellable = g_cancellable_new ();
-	soup_session_send_async (ssimg->session, ssimg->message, G_PRIORITY_DEFAULT, ssimg->cancellable,
-				 gs_screenshot_image_complete_cb, g_object_ref (ssimg));
+	soup_session_send_and_read_async (ssimg->session, ssimg->message, G_PRIORITY_DEFAULT, ssimg->cancellable,
+					  gs_screenshot_image_complete_cb, g_object_ref (ssimg));
 #else
 	soup_session_queue_message (ssimg->session,
 				    g_object_ref (ssimg->message) /* transfer full */,
@@ -851,6 +1234,11 @@ gs_screenshot_image_dispose (GObject *object)
 		g_clear_object (&ssimg->cancellable);
 	}
 
+	if (ssimg->decode_cancellable != NULL) {
+		g_cancellable_cancel (ssimg->decode_cancellable);
+		g_clear_object (&ssimg->decode_cancellable);
+	}
+
 	if (ssimg->message != NULL) {
 #if !SOUP_CHECK_VERSION(3, 0, 0)
 		soup_session_cancel_message (ssimg->session,
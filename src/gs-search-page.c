@@ -310,7 +310,7 @@ gs_search_page_load (GsSearchPage *self)
 				  "sort-user-data", self,
 				  "license-type", gs_page_get_query_license_type (GS_PAGE (self)),
 				  NULL);
-	plugin_job = gs_plugin_job_list_apps_new (query, GS_PLUGIN_LIST_APPS_FLAGS_NONE);
+	plugin_job = gs_plugin_job_list_apps_new (query, GS_PLUGIN_LIST_APPS_FLAGS_INTERACTIVE);
 	gs_plugin_loader_job_process_async (self->plugin_loader, plugin_job,
 					    self->search_cancellable,
 					    gs_search_page_get_search_cb,
@@ -11,6 +11,7 @@
 #include "gnome-software-private.h"
 
 #include "gs-css.h"
+#include "gs-shell-search-provider.h"
 #include "gs-test.h"
 
 static void
@@ -40,6 +41,100 @@ gs_css_func (void)
 	g_assert_cmpstr (tmp, ==, "color: white;");
 }
 
+static GsApp *
+gs_shell_search_provider_test_app_new (const gchar *id,
+				       const gchar *name,
+				       const gchar *summary,
+				       guint match_value)
+{
+	GsApp *app = gs_app_new (id);
+
+	gs_app_set_kind (app, AS_COMPONENT_KIND_DESKTOP_APP);
+	gs_app_set_name (app, GS_APP_QUALITY_NORMAL, name);
+	gs_app_set_summary (app, GS_APP_QUALITY_NORMAL, summary);
+	gs_app_set_match_value (app, match_value);
+
+	return app;
+}
+
+static void
+gs_shell_search_provider_subsearch_func (void)
+{
+	const gchar *previous_terms[] = { "we", NULL };
+	const gchar *previous_results[3] = { NULL, };
+	const gchar *narrower_terms[] = { "web", NULL };
+	const gchar *unmatched_terms[] = { "webc", NULL };
+	const gchar *unrelated_terms[] = { "cam", NULL };
+	const gchar *partial_results[2] = { NULL, };
+	g_autoptr(GsShellSearchProvider) provider = gs_shell_search_provider_new ();
+	g_autoptr(GsApp) browser = NULL;
+	g_autoptr(GsApp) camera = NULL;
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsAppList) narrowed = NULL;
+	g_autoptr(GsAppList) truncated = gs_app_list_new ();
+	g_autofree const gchar **truncated_results = NULL;
+
+	/* the browser only matches “web” in its name, and the camera only in
+	 * its summary, but a keyword of the camera matched before */
+	browser = gs_shell_search_provider_test_app_new ("org.example.Browser",
+							 "Web Browser",
+							 "Browse the internet",
+							 AS_SEARCH_TOKEN_MATCH_SUMMARY);
+	camera = gs_shell_search_provider_test_app_new ("org.example.Camera",
+							"Camera",
+							"Take photos with a webcam",
+							AS_SEARCH_TOKEN_MATCH_NAME | AS_SEARCH_TOKEN_MATCH_KEYWORD);
+	gs_app_list_add (list, camera);
+	gs_app_list_add (list, browser);
+	previous_results[0] = gs_app_get_unique_id (camera);
+	previous_results[1] = gs_app_get_unique_id (browser);
+	partial_results[0] = gs_app_get_unique_id (camera);
+
+	/* nothing cached yet */
+	narrowed = gs_shell_search_provider_narrow_cached_results (provider, previous_results, narrower_terms);
+	g_assert_null (narrowed);
+
+	/* both apps still match, so they are re-ranked */
+	gs_shell_search_provider_set_cached_results (provider, list, previous_terms);
+	narrowed = gs_shell_search_provider_narrow_cached_results (provider, previous_results, narrower_terms);
+	g_assert_nonnull (narrowed);
+	g_assert_cmpint (gs_app_list_length (narrowed), ==, 2);
+	g_assert_true (gs_app_list_index (narrowed, 0) == browser);
+	g_assert_true (gs_app_list_index (narrowed, 1) == camera);
+	g_assert_cmpuint (gs_app_get_match_value (browser), ==, AS_SEARCH_TOKEN_MATCH_NAME);
+	g_assert_cmpuint (gs_app_get_match_value (camera), ==, AS_SEARCH_TOKEN_MATCH_SUMMARY | AS_SEARCH_TOKEN_MATCH_KEYWORD);
+	g_clear_object (&narrowed);
+
+	/* the browser no longer matches in any known field, but might still
+	 * match a stemmed term, so a full search is needed */
+	narrowed = gs_shell_search_provider_narrow_cached_results (provider, previous_results, unmatched_terms);
+	g_assert_null (narrowed);
+
+	/* the terms don’t narrow down the previous ones */
+	narrowed = gs_shell_search_provider_narrow_cached_results (provider, previous_results, unrelated_terms);
+	g_assert_null (narrowed);
+
+	/* the shell is narrowing down something other than the cache */
+	narrowed = gs_shell_search_provider_narrow_cached_results (provider, partial_results, narrower_terms);
+	g_assert_null (narrowed);
+
+	/* the cached results were cut off at the maximum number of results, so
+	 * the results for the narrower terms may not all be in them */
+	truncated_results = g_new0 (const gchar *, 21);
+	for (guint i = 0; i < 20; i++) {
+		g_autofree gchar *id = g_strdup_printf ("org.example.Browser%u", i);
+		g_autoptr(GsApp) app = gs_shell_search_provider_test_app_new (id,
+									      "Web Browser",
+									      "Browse the internet",
+									      AS_SEARCH_TOKEN_MATCH_NAME);
+		gs_app_list_add (truncated, app);
+		truncated_results[i] = gs_app_get_unique_id (app);
+	}
+	gs_shell_search_provider_set_cached_results (provider, truncated, previous_terms);
+	narrowed = gs_shell_search_provider_narrow_cached_results (provider, truncated_results, narrower_terms);
+	g_assert_null (narrowed);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -47,6 +142,7 @@ main (int argc, char **argv)
 
 	/* tests go here */
 	g_test_add_func ("/gnome-software/src/css", gs_css_func);
+	g_test_add_func ("/gnome-software/src/shell-search-provider{subsearch}", gs_shell_search_provider_subsearch_func);
 
 	return g_test_run ();
 }
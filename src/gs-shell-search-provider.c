@@ -21,9 +21,17 @@
 
 #define GS_SHELL_SEARCH_PROVIDER_MAX_RESULTS	20
 
+/* the fields of an app which a search term can be checked against here */
+#define GS_SHELL_SEARCH_PROVIDER_KNOWN_MATCHES	(AS_SEARCH_TOKEN_MATCH_NAME | \
+						 AS_SEARCH_TOKEN_MATCH_SUMMARY | \
+						 AS_SEARCH_TOKEN_MATCH_PKGNAME | \
+						 AS_SEARCH_TOKEN_MATCH_ORIGIN)
+
 typedef struct {
 	GsShellSearchProvider *provider;
 	GDBusMethodInvocation *invocation;
+	GCancellable *cancellable;
+	gchar **terms;
 } PendingSearch;
 
 struct _GsShellSearchProvider {
@@ -35,6 +43,7 @@ struct _GsShellSearchProvider {
 
 	GHashTable *metas_cache;
 	GsAppList *search_results;
+	gchar **search_terms;  /* (owned) (nullable); the terms search_results are for */
 };
 
 G_DEFINE_TYPE (GsShellSearchProvider, gs_shell_search_provider, G_TYPE_OBJECT)
@@ -43,6 +52,8 @@ static void
 pending_search_free (PendingSearch *search)
 {
 	g_object_unref (search->invocation);
+	g_object_unref (search->cancellable);
+	g_strfreev (search->terms);
 	g_slice_free (PendingSearch, search);
 }
 
@@ -59,6 +70,55 @@ search_sort_by_kudo_cb (GsApp *app1, GsApp *app2, gpointer user_data)
 	return 0;
 }
 
+/**
+ * gs_shell_search_provider_set_cached_results:
+ * @self: a #GsShellSearchProvider
+ * @list: the results of a search for @terms
+ * @terms: the search terms
+ *
+ * Cache the results of a search, so they can be used in GetResultMetas, and
+ * narrowed down by gs_shell_search_provider_narrow_cached_results() if the
+ * user keeps typing.
+ *
+ * This is used internally, and by the self tests.
+ */
+void
+gs_shell_search_provider_set_cached_results (GsShellSearchProvider *self,
+					     GsAppList             *list,
+					     const gchar * const   *terms)
+{
+	gs_app_list_remove_all (self->search_results);
+	for (guint i = 0; i < gs_app_list_length (list); i++)
+		gs_app_list_add (self->search_results, gs_app_list_index (list, i));
+
+	/* remember what the cache is for, so subsearches can filter it */
+	g_strfreev (self->search_terms);
+	self->search_terms = g_strdupv ((gchar **) terms);
+}
+
+static void
+return_results (GsShellSearchProvider *self,
+		GDBusMethodInvocation *invocation,
+		GsAppList *list,
+		gchar **terms)
+{
+	guint i;
+	GVariantBuilder builder;
+
+	/* sort by kudos, as there is no ratings data by default */
+	gs_app_list_sort (list, search_sort_by_kudo_cb, NULL);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
+	for (i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		g_variant_builder_add (&builder, "s", gs_app_get_unique_id (app));
+	}
+	g_dbus_method_invocation_return_value (invocation, g_variant_new ("(as)", &builder));
+
+	/* cache this in case we need the apps in GetResultMetas */
+	gs_shell_search_provider_set_cached_results (self, list, (const gchar * const *) terms);
+}
+
 static void
 search_done_cb (GObject *source,
 		GAsyncResult *res,
@@ -66,14 +126,22 @@ search_done_cb (GObject *source,
 {
 	PendingSearch *search = user_data;
 	GsShellSearchProvider *self = search->provider;
-	guint i;
-	GVariantBuilder builder;
 	g_autoptr(GsAppList) list = NULL;
 
+	list = gs_plugin_loader_job_process_finish (self->plugin_loader, res, NULL);
+
+	/* superseded by a newer search, which owns the cache now */
+	if (g_cancellable_is_cancelled (search->cancellable)) {
+		g_dbus_method_invocation_return_value (search->invocation, g_variant_new ("(as)", NULL));
+		pending_search_free (search);
+		g_application_release (g_application_get_default ());
+		return;
+	}
+
 	/* cache no longer valid */
 	gs_app_list_remove_all (self->search_results);
+	g_clear_pointer (&self->search_terms, g_strfreev);
 
-	list = gs_plugin_loader_job_process_finish (self->plugin_loader, res, NULL);
 	if (list == NULL) {
 		g_dbus_method_invocation_return_value (search->invocation, g_variant_new ("(as)", NULL));
 		pending_search_free (search);
@@ -81,18 +149,7 @@ search_done_cb (GObject *source,
 		return;	
 	}
 
-	/* sort by kudos, as there is no ratings data by default */
-	gs_app_list_sort (list, search_sort_by_kudo_cb, NULL);
-
-	g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
-	for (i = 0; i < gs_app_list_length (list); i++) {
-		GsApp *app = gs_app_list_index (list, i);
-		g_variant_builder_add (&builder, "s", gs_app_get_unique_id (app));
-
-		/* cache this in case we need the app in GetResultMetas */
-		gs_app_list_add (self->search_results, app);
-	}
-	g_dbus_method_invocation_return_value (search->invocation, g_variant_new ("(as)", &builder));
+	return_results (self, search->invocation, list, search->terms);
 
 	pending_search_free (search);
 	g_application_release (g_application_get_default ());
@@ -162,12 +219,15 @@ execute_search (GsShellSearchProvider  *self,
 		return;
 	}
 
+	self->cancellable = g_cancellable_new ();
+
 	pending_search = g_slice_new (PendingSearch);
 	pending_search->provider = self;
 	pending_search->invocation = g_object_ref (invocation);
+	pending_search->cancellable = g_object_ref (self->cancellable);
+	pending_search->terms = g_strdupv (terms);
 
 	g_application_hold (g_application_get_default ());
-	self->cancellable = g_cancellable_new ();
 
 	settings = g_settings_new ("org.gnome.software");
 
@@ -181,7 +241,7 @@ execute_search (GsShellSearchProvider  *self,
 				  "sort-user-data", self,
 				  "license-type", g_settings_get_boolean (settings, "show-only-free-apps") ? GS_APP_QUERY_LICENSE_FOSS : GS_APP_QUERY_LICENSE_ANY,
 				  NULL);
-	plugin_job = gs_plugin_job_list_apps_new (query, GS_PLUGIN_LIST_APPS_FLAGS_NONE);
+	plugin_job = gs_plugin_job_list_apps_new (query, GS_PLUGIN_LIST_APPS_FLAGS_INTERACTIVE);
 
 	gs_plugin_loader_job_process_async (self->plugin_loader, plugin_job,
 					    self->cancellable,
@@ -189,6 +249,147 @@ execute_search (GsShellSearchProvider  *self,
 					    pending_search);
 }
 
+/* Returns the #AsSearchTokenMatch fields of @app which @term matches, out of
+ * the ones in %GS_SHELL_SEARCH_PROVIDER_KNOWN_MATCHES. */
+static guint
+match_term (GsApp *app,
+	    const gchar *term)
+{
+	const struct {
+		AsSearchTokenMatch match;
+		const gchar *text;
+	} fields[] = {
+		{ AS_SEARCH_TOKEN_MATCH_NAME, gs_app_get_name (app) },
+		{ AS_SEARCH_TOKEN_MATCH_SUMMARY, gs_app_get_summary (app) },
+		{ AS_SEARCH_TOKEN_MATCH_PKGNAME, gs_app_get_source_default (app) },
+		{ AS_SEARCH_TOKEN_MATCH_ORIGIN, gs_app_get_origin (app) },
+	};
+	guint match_value = 0;
+
+	for (gsize i = 0; i < G_N_ELEMENTS (fields); i++) {
+		if (fields[i].text != NULL &&
+		    g_str_match_string (term, fields[i].text, TRUE))
+			match_value |= fields[i].match;
+	}
+
+	return match_value;
+}
+
+static gboolean
+terms_extend (const gchar * const *previous_terms,
+	      const gchar * const *terms)
+{
+	guint n_previous_terms = g_strv_length ((gchar **) previous_terms);
+
+	if (g_strv_length ((gchar **) terms) < n_previous_terms)
+		return FALSE;
+	for (guint i = 0; i < n_previous_terms; i++) {
+		if (!g_str_has_prefix (terms[i], previous_terms[i]))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * gs_shell_search_provider_narrow_cached_results:
+ * @self: a #GsShellSearchProvider
+ * @previous_results: the unique IDs of the results the shell is narrowing down
+ * @terms: the new search terms, which extend the terms of the cached search
+ *
+ * Narrow down the cached results of the previous search for @terms, without
+ * running the plugins again.
+ *
+ * The terms are only compared against the fields of each app which are known
+ * here, without the stemming a full search does, so an app which no longer
+ * matches may still be in the results of a full search. The cached results
+ * are therefore only re-ranked if they all still match; otherwise a full
+ * search is needed. A full search is also needed if the cached results were
+ * truncated, as the results for @terms may not all be in them.
+ *
+ * This is used internally, and by the self tests.
+ *
+ * Returns: (transfer full) (nullable): the narrowed down and ranked results,
+ *   or %NULL if a full search is needed
+ */
+GsAppList *
+gs_shell_search_provider_narrow_cached_results (GsShellSearchProvider *self,
+						const gchar * const   *previous_results,
+						const gchar * const   *terms)
+{
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GArray) match_values = NULL;
+
+	if (self->search_terms == NULL ||
+	    gs_app_list_length (self->search_results) >= GS_SHELL_SEARCH_PROVIDER_MAX_RESULTS ||
+	    !terms_extend ((const gchar * const *) self->search_terms, terms))
+		return NULL;
+
+	/* the cache has to be what the shell is narrowing down */
+	if (g_strv_length ((gchar **) previous_results) != gs_app_list_length (self->search_results))
+		return NULL;
+	for (guint i = 0; previous_results[i] != NULL; i++) {
+		if (gs_app_list_lookup (self->search_results, previous_results[i]) == NULL)
+			return NULL;
+	}
+
+	/* all the terms have to match, as in a full search */
+	list = gs_app_list_new ();
+	match_values = g_array_new (FALSE, FALSE, sizeof (guint));
+	for (guint i = 0; i < gs_app_list_length (self->search_results); i++) {
+		GsApp *app = gs_app_list_index (self->search_results, i);
+		guint previous_match_value = gs_app_get_match_value (app);
+		guint match_value = 0;
+		gboolean matches = TRUE;
+
+		for (guint j = 0; terms[j] != NULL && matches; j++) {
+			guint term_match_value = match_term (app, terms[j]);
+			matches = (term_match_value != 0);
+			match_value |= term_match_value;
+		}
+
+		/* the app may still match in a field which isn’t known here,
+		 * such as its keywords, or match a stemmed term in one of the
+		 * known fields; g_str_match_string() doesn’t stem, so only the
+		 * full search can tell */
+		if (!matches)
+			return NULL;
+
+		/* keep the fields which can’t be checked here */
+		match_value |= previous_match_value & ~GS_SHELL_SEARCH_PROVIDER_KNOWN_MATCHES;
+		gs_app_list_add (list, app);
+		g_array_append_val (match_values, match_value);
+	}
+
+	g_debug ("re-ranked %u cached results", gs_app_list_length (list));
+
+	/* re-rank as the plugin job would have done */
+	for (guint i = 0; i < gs_app_list_length (list); i++)
+		gs_app_set_match_value (gs_app_list_index (list, i), g_array_index (match_values, guint, i));
+	gs_app_list_sort (list, gs_shell_search_provider_sort_cb, self);
+
+	return g_steal_pointer (&list);
+}
+
+static gboolean
+execute_subsearch (GsShellSearchProvider  *self,
+		   GDBusMethodInvocation  *invocation,
+		   gchar		 **previous_results,
+		   gchar		 **terms)
+{
+	g_autoptr(GsAppList) list = NULL;
+
+	list = gs_shell_search_provider_narrow_cached_results (self,
+							       (const gchar * const *) previous_results,
+							       (const gchar * const *) terms);
+	if (list == NULL)
+		return FALSE;
+
+	return_results (self, invocation, list, terms);
+
+	return TRUE;
+}
+
 static gboolean
 handle_get_initial_result_set (GsShellSearchProvider2	*skeleton,
 			       GDBusMethodInvocation	 *invocation,
@@ -212,7 +413,13 @@ handle_get_subsearch_result_set (GsShellSearchProvider2	*skeleton,
 	GsShellSearchProvider *self = user_data;
 
 	g_debug ("****** GetSubSearchResultSet");
-	execute_search (self, invocation, terms);
+
+	/* a newer search supersedes any which is still running */
+	g_cancellable_cancel (self->cancellable);
+	g_clear_object (&self->cancellable);
+
+	if (!execute_subsearch (self, invocation, previous_results, terms))
+		execute_search (self, invocation, terms);
 	return TRUE;
 }
 
@@ -362,6 +569,7 @@ search_provider_dispose (GObject *obj)
 	}
 
 	g_clear_object (&self->search_results);
+	g_clear_pointer (&self->search_terms, g_strfreev);
 	g_clear_object (&self->plugin_loader);
 	g_clear_object (&self->skeleton);
 
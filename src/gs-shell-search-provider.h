@@ -24,3 +24,11 @@ void			 gs_shell_search_provider_unregister	(GsShellSearchProvider	 *self);
 GsShellSearchProvider	*gs_shell_search_provider_new		(void);
 void			 gs_shell_search_provider_setup		(GsShellSearchProvider	 *provider,
 								 GsPluginLoader		 *loader);
+void			 gs_shell_search_provider_set_cached_results
+								(GsShellSearchProvider	 *self,
+								 GsAppList		 *list,
+								 const gchar * const	 *terms);
+GsAppList		*gs_shell_search_provider_narrow_cached_results
+								(GsShellSearchProvider	 *self,
+								 const gchar * const	 *previous_results,
+								 const gchar * const	 *terms);